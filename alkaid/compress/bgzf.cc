@@ -0,0 +1,216 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <alkaid/compress/bgzf.h>
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+#include <alkaid/compress/compression.h>
+#include <turbo/base/endian.h>
+
+#ifdef ENABLE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace alkaid {
+    namespace {
+
+        // ID1 ID2 CM FLG(FEXTRA) MTIME XFL OS XLEN, then the BC subfield whose
+        // BSIZE (total block size - 1) is filled in per block
+        constexpr uint8_t kBgzfHeader[kBgzfBlockHeaderSize] = {
+                0x1f, 0x8b, 8, 4, 0, 0, 0, 0, 0, 0xff, 6, 0, 'B', 'C', 2, 0, 0, 0};
+
+        constexpr uint8_t kBgzfEof[28] = {
+                0x1f, 0x8b, 8, 4, 0, 0, 0, 0, 0, 0xff, 6, 0, 'B', 'C', 2, 0,
+                0x1b, 0, 3, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+
+        constexpr uint8_t kGZipFlagExtra = 4;
+
+        // zlib codecs are stateful, keep one per thread and format so that pool
+        // workers can run blocks concurrently.
+        turbo::Result<Codec *> ThreadLocalCodec(GZipFormat format, int compression_level) {
+            struct CachedCodec {
+                GZipFormat format;
+                int compression_level;
+                std::unique_ptr<Codec> codec;
+            };
+            thread_local std::vector<CachedCodec> codecs;
+            for (auto &cached: codecs) {
+                if (cached.format == format && cached.compression_level == compression_level) {
+                    return cached.codec.get();
+                }
+            }
+            GZipCodecOptions options;
+            options.gzip_format = format;
+            options.compression_level = compression_level;
+            RESULT_ASSIGN_OR_RETURN(auto codec, Codec::Create(CompressionType::GZIP, options));
+            codecs.push_back(CachedCodec{format, compression_level, std::move(codec)});
+            return codecs.back().codec.get();
+        }
+
+        uint32_t BgzfCrc32(const uint8_t *data, int64_t data_len) {
+#ifdef ENABLE_ZLIB
+            return static_cast<uint32_t>(crc32(0L, data, static_cast<uInt>(data_len)));
+#else
+            (void) data;
+            (void) data_len;
+            return 0;
+#endif
+        }
+
+    }  // namespace
+
+    std::string_view BgzfEofBlock() {
+        return {reinterpret_cast<const char *>(kBgzfEof), sizeof(kBgzfEof)};
+    }
+
+    turbo::Result<int64_t> BgzfHeaderSize(const uint8_t *header, int64_t header_len) {
+        if (header_len < kBgzfFixedHeaderSize) {
+            return turbo::Status(turbo::StatusCode::kDataLoss, "truncated bgzf block header");
+        }
+        if (header[0] != 0x1f || header[1] != 0x8b || header[2] != 8 || (header[3] & kGZipFlagExtra) == 0) {
+            return turbo::Status(turbo::StatusCode::kDataLoss, "not a bgzf block");
+        }
+        return kBgzfFixedHeaderSize + turbo::little_endian::load16(header + 10);
+    }
+
+    turbo::Result<int64_t> BgzfBlockSize(const uint8_t *header, int64_t header_len) {
+        RESULT_ASSIGN_OR_RETURN(auto header_size, BgzfHeaderSize(header, header_len));
+        if (header_len < header_size) {
+            return turbo::Status(turbo::StatusCode::kDataLoss, "truncated bgzf block header");
+        }
+        // walk the extra subfields looking for BC
+        int64_t pos = kBgzfFixedHeaderSize;
+        while (pos + 4 <= header_size) {
+            auto subfield_len = turbo::little_endian::load16(header + pos + 2);
+            if (header[pos] == 'B' && header[pos + 1] == 'C' && subfield_len == 2 && pos + 6 <= header_size) {
+                int64_t block_size = turbo::little_endian::load16(header + pos + 4) + 1;
+                if (block_size < header_size + kBgzfBlockFooterSize) {
+                    return turbo::Status(turbo::StatusCode::kDataLoss, "invalid bgzf block size");
+                }
+                return block_size;
+            }
+            pos += 4 + subfield_len;
+        }
+        return turbo::Status(turbo::StatusCode::kDataLoss, "bgzf block without BC extra field");
+    }
+
+    turbo::Result<std::vector<uint8_t>> CompressBgzfBlock(const uint8_t *data, int64_t data_len,
+                                                          int compression_level) {
+        if (data_len > kBgzfMaxBlockDataSize) {
+            return turbo::invalid_argument_error(
+                    turbo::str_cat("bgzf block data is limited to ", kBgzfMaxBlockDataSize, " bytes"));
+        }
+        RESULT_ASSIGN_OR_RETURN(auto codec, ThreadLocalCodec(GZipFormat::DEFLATE, compression_level));
+        std::vector<uint8_t> block(kBgzfBlockHeaderSize + codec->MaxCompressedLen(data_len, data) +
+                                   kBgzfBlockFooterSize);
+        RESULT_ASSIGN_OR_RETURN(auto compressed_len,
+                                codec->Compress(data_len, data, block.size() - kBgzfBlockHeaderSize,
+                                                block.data() + kBgzfBlockHeaderSize));
+        if (kBgzfBlockHeaderSize + compressed_len + kBgzfBlockFooterSize > kBgzfMaxBlockSize) {
+            // incompressible data, a stored deflate block always fits
+            uint8_t *stored = block.data() + kBgzfBlockHeaderSize;
+            stored[0] = 1;  // BFINAL, BTYPE = 00
+            turbo::little_endian::store16(stored + 1, static_cast<uint16_t>(data_len));
+            turbo::little_endian::store16(stored + 3, static_cast<uint16_t>(~data_len));
+            memcpy(stored + 5, data, data_len);
+            compressed_len = data_len + 5;
+        }
+        int64_t block_size = kBgzfBlockHeaderSize + compressed_len + kBgzfBlockFooterSize;
+        memcpy(block.data(), kBgzfHeader, kBgzfBlockHeaderSize);
+        turbo::little_endian::store16(block.data() + 16, static_cast<uint16_t>(block_size - 1));
+        uint8_t *footer = block.data() + kBgzfBlockHeaderSize + compressed_len;
+        turbo::little_endian::store32(footer, BgzfCrc32(data, data_len));
+        turbo::little_endian::store32(footer + 4, static_cast<uint32_t>(data_len));
+        block.resize(block_size);
+        return block;
+    }
+
+    turbo::Result<std::vector<uint8_t>> DecompressBgzfBlock(const uint8_t *block, int64_t block_len) {
+        RESULT_ASSIGN_OR_RETURN(auto block_size, BgzfBlockSize(block, block_len));
+        if (block_len < block_size) {
+            return turbo::Status(turbo::StatusCode::kDataLoss, "truncated bgzf block");
+        }
+        auto data_len = static_cast<int64_t>(turbo::little_endian::load32(block + block_size - 4));
+        if (data_len > kBgzfMaxBlockSize) {
+            return turbo::Status(turbo::StatusCode::kDataLoss, "invalid bgzf block length");
+        }
+        // the block is a complete gzip member, the codec checks its CRC32
+        RESULT_ASSIGN_OR_RETURN(auto codec, ThreadLocalCodec(GZipFormat::GZIP, kUseDefaultCompressionLevel));
+        std::vector<uint8_t> data(data_len);
+        RESULT_ASSIGN_OR_RETURN(auto decompressed_len, codec->Decompress(block_size, block, data_len, data.data()));
+        if (decompressed_len != data_len) {
+            return turbo::Status(turbo::StatusCode::kDataLoss, "bgzf block length mismatch");
+        }
+        return data;
+    }
+
+    // ----------------------------------------------------------------------
+    // BgzfIndex implementation
+
+    turbo::Result<uint64_t> BgzfIndex::VirtualOffset(uint64_t uncompressed_offset) const {
+        auto it = std::upper_bound(entries_.begin(), entries_.end(), uncompressed_offset,
+                                   [](uint64_t offset, const Entry &entry) {
+                                       return offset < entry.uncompressed_offset;
+                                   });
+        Entry start;
+        if (it != entries_.begin()) {
+            start = *(it - 1);
+        }
+        uint64_t offset_in_block = uncompressed_offset - start.uncompressed_offset;
+        if (offset_in_block > 0xffff) {
+            return turbo::out_of_range_error(
+                    turbo::str_cat("offset ", uncompressed_offset, " is beyond the indexed data"));
+        }
+        return MakeBgzfVirtualOffset(start.compressed_offset, static_cast<uint32_t>(offset_in_block));
+    }
+
+    std::string BgzfIndex::Serialize() const {
+        std::string data(8 + 16 * entries_.size(), '\0');
+        auto *p = reinterpret_cast<uint8_t *>(data.data());
+        turbo::little_endian::store64(p, entries_.size());
+        p += 8;
+        for (auto &entry: entries_) {
+            turbo::little_endian::store64(p, entry.compressed_offset);
+            turbo::little_endian::store64(p + 8, entry.uncompressed_offset);
+            p += 16;
+        }
+        return data;
+    }
+
+    turbo::Result<BgzfIndex> BgzfIndex::Parse(std::string_view data) {
+        if (data.size() < 8) {
+            return turbo::Status(turbo::StatusCode::kDataLoss, "truncated bgzf index");
+        }
+        auto p = reinterpret_cast<const uint8_t *>(data.data());
+        uint64_t count = turbo::little_endian::load64(p);
+        if ((data.size() - 8) / 16 != count || (data.size() - 8) % 16 != 0) {
+            return turbo::Status(turbo::StatusCode::kDataLoss, "bgzf index size mismatch");
+        }
+        BgzfIndex index;
+        index.entries_.reserve(count);
+        p += 8;
+        for (uint64_t i = 0; i < count; ++i, p += 16) {
+            index.Add(turbo::little_endian::load64(p), turbo::little_endian::load64(p + 8));
+        }
+        return index;
+    }
+
+}  // namespace alkaid
@@ -0,0 +1,112 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <turbo/base/macros.h>
+#include <turbo/utility/status.h>
+
+// BGZF (blocked gzip, as used by samtools / htslib) is a series of gzip
+// members of at most 64KB each.  Every member carries a "BC" extra field
+// holding its compressed size, so the member boundaries can be found without
+// inflating anything.  Any gzip reader sees a BGZF file as ordinary gzip.
+//
+// A position in the uncompressed data is addressed by a virtual offset: the
+// file offset of the block containing it shifted left by 16 bits, or'ed with
+// the offset inside the uncompressed block.
+
+namespace alkaid {
+
+    /// Largest uncompressed payload of a block, as written by htslib
+    constexpr int64_t kBgzfMaxBlockDataSize = 0xff00;
+    /// Largest compressed block, BSIZE is a 16 bit field
+    constexpr int64_t kBgzfMaxBlockSize = 0x10000;
+    /// Header size of a block carrying only the BC extra field
+    constexpr int64_t kBgzfBlockHeaderSize = 18;
+    /// Fixed gzip header part, up to and including XLEN
+    constexpr int64_t kBgzfFixedHeaderSize = 12;
+    /// CRC32 and ISIZE
+    constexpr int64_t kBgzfBlockFooterSize = 8;
+
+    inline uint64_t MakeBgzfVirtualOffset(uint64_t block_offset, uint32_t offset_in_block) {
+        return (block_offset << 16) | (offset_in_block & 0xffff);
+    }
+
+    inline uint64_t BgzfBlockOffset(uint64_t virtual_offset) { return virtual_offset >> 16; }
+
+    inline uint32_t BgzfOffsetInBlock(uint64_t virtual_offset) {
+        return static_cast<uint32_t>(virtual_offset & 0xffff);
+    }
+
+    /// \brief The empty block every BGZF file ends with
+    TURBO_EXPORT std::string_view BgzfEofBlock();
+
+    /// \brief Size of the gzip header of a block, given its first kBgzfFixedHeaderSize bytes
+    TURBO_EXPORT turbo::Result<int64_t> BgzfHeaderSize(const uint8_t *header, int64_t header_len);
+
+    /// \brief Total compressed size of a block, given its complete header
+    TURBO_EXPORT turbo::Result<int64_t> BgzfBlockSize(const uint8_t *header, int64_t header_len);
+
+    /// \brief Compress at most kBgzfMaxBlockDataSize bytes into one complete block
+    TURBO_EXPORT turbo::Result<std::vector<uint8_t>> CompressBgzfBlock(const uint8_t *data, int64_t data_len,
+                                                                       int compression_level);
+
+    /// \brief Decompress one complete block, checking its CRC32 and length
+    TURBO_EXPORT turbo::Result<std::vector<uint8_t>> DecompressBgzfBlock(const uint8_t *block, int64_t block_len);
+
+    /// \brief The ".gzi" index of a BGZF file, in the format used by htslib.
+    ///
+    /// Each entry maps the file offset where a block starts to the
+    /// uncompressed offset of its first byte.  The first block, at (0, 0), is
+    /// implicit.  BgzfFileWriter adds an entry after every block, so the last
+    /// one marks the end of the data.
+    class TURBO_EXPORT BgzfIndex {
+    public:
+        struct Entry {
+            uint64_t compressed_offset{0};
+            uint64_t uncompressed_offset{0};
+        };
+
+        void Add(uint64_t compressed_offset, uint64_t uncompressed_offset) {
+            entries_.push_back(Entry{compressed_offset, uncompressed_offset});
+        }
+
+        const std::vector<Entry> &entries() const { return entries_; }
+
+        /// \brief Uncompressed size of the data covered by the index
+        uint64_t uncompressed_size() const {
+            return entries_.empty() ? 0 : entries_.back().uncompressed_offset;
+        }
+
+        /// \brief Virtual offset of an uncompressed position
+        turbo::Result<uint64_t> VirtualOffset(uint64_t uncompressed_offset) const;
+
+        std::string Serialize() const;
+
+        static turbo::Result<BgzfIndex> Parse(std::string_view data);
+
+    private:
+        std::vector<Entry> entries_;
+    };
+
+}  // namespace alkaid
@@ -0,0 +1,320 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <alkaid/compress/codec_metrics.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <utility>
+
+namespace alkaid {
+
+    namespace {
+
+        class OperationCounters {
+        public:
+            void record(int64_t bytes_in, int64_t bytes_out, uint64_t nanos) {
+                calls_.fetch_add(1, std::memory_order_relaxed);
+                bytes_in_.fetch_add(static_cast<uint64_t>(bytes_in), std::memory_order_relaxed);
+                bytes_out_.fetch_add(static_cast<uint64_t>(bytes_out), std::memory_order_relaxed);
+                nanos_.fetch_add(nanos, std::memory_order_relaxed);
+                const uint64_t micros = nanos / 1000;
+                const int bucket = micros == 0 ? 0 : 64 - __builtin_clzll(micros);
+                latency_[std::min(bucket, kCodecLatencyBuckets - 1)].fetch_add(1, std::memory_order_relaxed);
+            }
+
+            void record_error(uint64_t nanos) {
+                errors_.fetch_add(1, std::memory_order_relaxed);
+                record(0, 0, nanos);
+            }
+
+            CodecOperationMetrics load() const {
+                CodecOperationMetrics metrics;
+                metrics.calls = calls_.load(std::memory_order_relaxed);
+                metrics.errors = errors_.load(std::memory_order_relaxed);
+                metrics.bytes_in = bytes_in_.load(std::memory_order_relaxed);
+                metrics.bytes_out = bytes_out_.load(std::memory_order_relaxed);
+                metrics.nanos = nanos_.load(std::memory_order_relaxed);
+                for (int i = 0; i < kCodecLatencyBuckets; ++i) {
+                    metrics.latency_histogram[i] = latency_[i].load(std::memory_order_relaxed);
+                }
+                return metrics;
+            }
+
+            void reset() {
+                calls_ = 0;
+                errors_ = 0;
+                bytes_in_ = 0;
+                bytes_out_ = 0;
+                nanos_ = 0;
+                for (auto &bucket: latency_) {
+                    bucket = 0;
+                }
+            }
+
+        private:
+            std::atomic<uint64_t> calls_{0};
+            std::atomic<uint64_t> errors_{0};
+            std::atomic<uint64_t> bytes_in_{0};
+            std::atomic<uint64_t> bytes_out_{0};
+            std::atomic<uint64_t> nanos_{0};
+            std::array<std::atomic<uint64_t>, kCodecLatencyBuckets> latency_{};
+        };
+
+        struct CodecCounters {
+            OperationCounters compress;
+            OperationCounters decompress;
+        };
+
+        // counters are never removed, so codecs can keep plain pointers to them
+        class MetricsRegistry {
+        public:
+            static MetricsRegistry &instance() {
+                static MetricsRegistry registry;
+                return registry;
+            }
+
+            CodecCounters *counters(CompressionType compression, int compression_level) {
+                std::lock_guard<std::mutex> lock(mutex_);
+                auto &counters = counters_[{compression, compression_level}];
+                if (counters == nullptr) {
+                    counters = std::make_unique<CodecCounters>();
+                }
+                return counters.get();
+            }
+
+            std::vector<CodecMetricsSnapshot> snapshot() {
+                std::lock_guard<std::mutex> lock(mutex_);
+                std::vector<CodecMetricsSnapshot> snapshots;
+                snapshots.reserve(counters_.size());
+                for (auto &[key, counters]: counters_) {
+                    CodecMetricsSnapshot snapshot;
+                    snapshot.compression = key.first;
+                    snapshot.compression_level = key.second;
+                    snapshot.compress = counters->compress.load();
+                    snapshot.decompress = counters->decompress.load();
+                    snapshots.push_back(snapshot);
+                }
+                return snapshots;
+            }
+
+            void reset() {
+                std::lock_guard<std::mutex> lock(mutex_);
+                for (auto &[key, counters]: counters_) {
+                    counters->compress.reset();
+                    counters->decompress.reset();
+                }
+            }
+
+            std::atomic<bool> enabled{false};
+
+        private:
+            std::mutex mutex_;
+            std::map<std::pair<CompressionType, int>, std::unique_ptr<CodecCounters>> counters_;
+        };
+
+        // times a codec call and records it, bytes_in and bytes_out are only
+        // known once the call returns
+        class ScopedTimer {
+        public:
+            explicit ScopedTimer(OperationCounters *counters)
+                    : counters_(counters), start_(std::chrono::steady_clock::now()) {}
+
+            uint64_t elapsed() const {
+                return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - start_).count());
+            }
+
+            template<typename T>
+            void record(const turbo::Result<T> &result, int64_t bytes_in, int64_t bytes_out) {
+                if (result.ok()) {
+                    counters_->record(bytes_in, bytes_out, elapsed());
+                } else {
+                    counters_->record_error(elapsed());
+                }
+            }
+
+        private:
+            OperationCounters *counters_;
+            std::chrono::steady_clock::time_point start_;
+        };
+
+        class InstrumentedCompressor : public Compressor {
+        public:
+            InstrumentedCompressor(std::shared_ptr<Compressor> compressor, CodecCounters *counters)
+                    : compressor_(std::move(compressor)), counters_(counters) {}
+
+            turbo::Result<CompressResult> Compress(int64_t input_len, const uint8_t *input,
+                                                   int64_t output_len, uint8_t *output) override {
+                ScopedTimer timer(&counters_->compress);
+                auto result = compressor_->Compress(input_len, input, output_len, output);
+                timer.record(result, result.ok() ? result->bytes_read : 0, result.ok() ? result->bytes_written : 0);
+                return result;
+            }
+
+            turbo::Result<FlushResult> Flush(int64_t output_len, uint8_t *output) override {
+                ScopedTimer timer(&counters_->compress);
+                auto result = compressor_->Flush(output_len, output);
+                timer.record(result, 0, result.ok() ? result->bytes_written : 0);
+                return result;
+            }
+
+            turbo::Result<EndResult> End(int64_t output_len, uint8_t *output) override {
+                ScopedTimer timer(&counters_->compress);
+                auto result = compressor_->End(output_len, output);
+                timer.record(result, 0, result.ok() ? result->bytes_written : 0);
+                return result;
+            }
+
+        private:
+            std::shared_ptr<Compressor> compressor_;
+            CodecCounters *counters_;
+        };
+
+        class InstrumentedDecompressor : public Decompressor {
+        public:
+            InstrumentedDecompressor(std::shared_ptr<Decompressor> decompressor, CodecCounters *counters)
+                    : decompressor_(std::move(decompressor)), counters_(counters) {}
+
+            turbo::Result<DecompressResult> Decompress(int64_t input_len, const uint8_t *input,
+                                                       int64_t output_len, uint8_t *output) override {
+                ScopedTimer timer(&counters_->decompress);
+                auto result = decompressor_->Decompress(input_len, input, output_len, output);
+                timer.record(result, result.ok() ? result->bytes_read : 0, result.ok() ? result->bytes_written : 0);
+                return result;
+            }
+
+            bool IsFinished() override { return decompressor_->IsFinished(); }
+
+            turbo::Status Reset() override { return decompressor_->Reset(); }
+
+        private:
+            std::shared_ptr<Decompressor> decompressor_;
+            CodecCounters *counters_;
+        };
+
+        class InstrumentedCodec : public Codec {
+        public:
+            explicit InstrumentedCodec(std::unique_ptr<Codec> codec)
+                    : codec_(std::move(codec)),
+                      counters_(MetricsRegistry::instance().counters(codec_->compression_type(),
+                                                                     codec_->compression_level())) {}
+
+            turbo::Result<int64_t> Decompress(int64_t input_len, const uint8_t *input,
+                                              int64_t output_buffer_len, uint8_t *output_buffer) override {
+                ScopedTimer timer(&counters_->decompress);
+                auto result = codec_->Decompress(input_len, input, output_buffer_len, output_buffer);
+                timer.record(result, input_len, result.ok() ? *result : 0);
+                return result;
+            }
+
+            turbo::Result<std::vector<uint8_t>> Decompress(int64_t input_len, const uint8_t *input) override {
+                ScopedTimer timer(&counters_->decompress);
+                auto result = codec_->Decompress(input_len, input);
+                timer.record(result, input_len, result.ok() ? static_cast<int64_t>(result->size()) : 0);
+                return result;
+            }
+
+            turbo::Result<int64_t> Compress(int64_t input_len, const uint8_t *input,
+                                            int64_t output_buffer_len, uint8_t *output_buffer) override {
+                ScopedTimer timer(&counters_->compress);
+                auto result = codec_->Compress(input_len, input, output_buffer_len, output_buffer);
+                timer.record(result, input_len, result.ok() ? *result : 0);
+                return result;
+            }
+
+            int64_t MaxCompressedLen(int64_t input_len, const uint8_t *input) override {
+                return codec_->MaxCompressedLen(input_len, input);
+            }
+
+            std::optional<int64_t> DecompressedLength(int64_t input_len, const uint8_t *input) override {
+                return codec_->DecompressedLength(input_len, input);
+            }
+
+            turbo::Result<std::shared_ptr<Compressor>> MakeCompressor() override {
+                RESULT_ASSIGN_OR_RETURN(auto compressor, codec_->MakeCompressor());
+                return std::make_shared<InstrumentedCompressor>(std::move(compressor), counters_);
+            }
+
+            turbo::Result<std::shared_ptr<Decompressor>> MakeDecompressor() override {
+                RESULT_ASSIGN_OR_RETURN(auto decompressor, codec_->MakeDecompressor());
+                return std::make_shared<InstrumentedDecompressor>(std::move(decompressor), counters_);
+            }
+
+            CompressionType compression_type() const override { return codec_->compression_type(); }
+
+            int compression_level() const override { return codec_->compression_level(); }
+
+            int minimum_compression_level() const override { return codec_->minimum_compression_level(); }
+
+            int maximum_compression_level() const override { return codec_->maximum_compression_level(); }
+
+            int default_compression_level() const override { return codec_->default_compression_level(); }
+
+        private:
+            std::unique_ptr<Codec> codec_;
+            CodecCounters *counters_;
+        };
+
+    }  // namespace
+
+    // ----------------------------------------------------------------------
+    // CodecMetrics implementation
+
+    double CodecOperationMetrics::throughput(bool compress) const {
+        if (nanos == 0) {
+            return 0;
+        }
+        auto uncompressed = static_cast<double>(compress ? bytes_in : bytes_out);
+        return uncompressed / 1e6 / (static_cast<double>(nanos) / 1e9);
+    }
+
+    double CodecMetricsSnapshot::compression_ratio() const {
+        if (compress.bytes_out == 0) {
+            return 0;
+        }
+        return static_cast<double>(compress.bytes_in) / static_cast<double>(compress.bytes_out);
+    }
+
+    void CodecMetrics::set_enabled(bool enabled) {
+        MetricsRegistry::instance().enabled.store(enabled, std::memory_order_relaxed);
+    }
+
+    bool CodecMetrics::enabled() {
+        return MetricsRegistry::instance().enabled.load(std::memory_order_relaxed);
+    }
+
+    std::vector<CodecMetricsSnapshot> CodecMetrics::snapshot() {
+        return MetricsRegistry::instance().snapshot();
+    }
+
+    void CodecMetrics::reset() {
+        MetricsRegistry::instance().reset();
+    }
+
+    std::unique_ptr<Codec> MakeInstrumentedCodec(std::unique_ptr<Codec> codec) {
+        if (codec == nullptr) {
+            return codec;
+        }
+        return std::make_unique<InstrumentedCodec>(std::move(codec));
+    }
+
+}  // namespace alkaid
@@ -0,0 +1,84 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <turbo/base/macros.h>
+#include <alkaid/compress/compression.h>
+
+namespace alkaid {
+
+    /// Latency buckets: bucket 0 counts calls under 1us, bucket i calls of
+    /// [2^(i-1), 2^i) us and the last bucket everything slower
+    constexpr int kCodecLatencyBuckets = 32;
+
+    /// \brief Counters of one direction of a codec, one-shot and streaming calls together
+    struct TURBO_EXPORT CodecOperationMetrics {
+        uint64_t calls{0};
+        uint64_t errors{0};
+        uint64_t bytes_in{0};
+        uint64_t bytes_out{0};
+        uint64_t nanos{0};
+        std::array<uint64_t, kCodecLatencyBuckets> latency_histogram{};
+
+        /// uncompressed MB per second of the time spent in the codec
+        double throughput(bool compress) const;
+    };
+
+    /// \brief Counters of the codecs of one compression type and level
+    struct TURBO_EXPORT CodecMetricsSnapshot {
+        CompressionType compression{CompressionType::UNCOMPRESSED};
+        int compression_level{kUseDefaultCompressionLevel};
+        CodecOperationMetrics compress;
+        CodecOperationMetrics decompress;
+
+        /// uncompressed bytes per compressed byte, over everything compressed
+        double compression_ratio() const;
+    };
+
+    /// \brief Process wide codec instrumentation.
+    ///
+    /// While enabled, Codec::Create wraps the codecs it returns, and the
+    /// compressors and decompressors they make, to count calls, bytes in and
+    /// out, time spent and a latency histogram per compression type and
+    /// level.  Codecs created while disabled are not counted.  The counters
+    /// are atomics, so a snapshot taken while codecs run may be a few calls
+    /// apart between fields.
+    class TURBO_EXPORT CodecMetrics {
+    public:
+        static void set_enabled(bool enabled);
+
+        static bool enabled();
+
+        /// counters of every type and level seen, sorted by type and level
+        static std::vector<CodecMetricsSnapshot> snapshot();
+
+        /// zero every counter, codecs in use keep counting
+        static void reset();
+    };
+
+    /// \brief Wrap a codec so it counts into CodecMetrics, whether or not
+    /// instrumentation is enabled
+    TURBO_EXPORT std::unique_ptr<Codec> MakeInstrumentedCodec(std::unique_ptr<Codec> codec);
+
+}  // namespace alkaid
@@ -18,11 +18,14 @@
 
 #include <alkaid/compress/compression.h>
 
+#include <algorithm>
 #include <memory>
 #include <string>
 #include <utility>
 
+#include <alkaid/compress/codec_metrics.h>
 #include <alkaid/compress/compression_internal.h>
+#include <turbo/base/endian.h>
 #include <turbo/log/logging.h>
 
 namespace alkaid {
@@ -36,8 +39,278 @@ namespace alkaid {
             return turbo::OkStatus();
         }
 
+        // Largest CordBuffer that can be allocated, as CordBuffer::kCustomLimit
+        constexpr size_t kCordBufferMaxSize = 64 << 10;
+        // Output space first offered to a codec, grown while it asks for more
+        constexpr size_t kCordMinOutputSize = 64;
+        constexpr size_t kCordMaxOutputSize = size_t{1} << 30;
+
+        // Non-null input for calls that only drain output
+        constexpr uint8_t kNoInput[1] = {0};
+
+        // Hand produce() at least min_capacity bytes of contiguous space at the
+        // end of output: the free tail of the Cord or a new CordBuffer when
+        // that is enough, otherwise a heap string which the Cord adopts.
+        template<typename F>
+        turbo::Status AppendToCord(turbo::Cord *output, size_t min_capacity, F &&produce) {
+            if (min_capacity <= kCordBufferMaxSize) {
+                turbo::CordBuffer buffer =
+                        min_capacity <= turbo::CordBuffer::kDefaultLimit
+                        ? output->get_append_buffer(turbo::CordBuffer::kDefaultLimit, min_capacity)
+                        : turbo::CordBuffer::create_with_custom_limit(kCordBufferMaxSize, min_capacity);
+                turbo::span<char> space = buffer.available();
+                auto written = produce(static_cast<int64_t>(space.size()), reinterpret_cast<uint8_t *>(space.data()));
+                if (written.ok()) {
+                    buffer.increase_length_by(static_cast<size_t>(written.value()));
+                }
+                // the buffer may hold the former tail of output, always give it back
+                output->append(std::move(buffer));
+                return written.status();
+            }
+            std::string block(min_capacity, '\0');
+            RESULT_ASSIGN_OR_RETURN(auto written,
+                                    produce(static_cast<int64_t>(block.size()), reinterpret_cast<uint8_t *>(block.data())));
+            block.resize(static_cast<size_t>(written));
+            output->append(std::move(block));
+            return turbo::OkStatus();
+        }
+
+        // Initial output of the growable one-shot decompression
+        constexpr int64_t kGrowingMinOutputSize = 64 << 10;
+        // Formats without a recorded length expand at most this much, LZ4
+        // and LZO are bounded by 255
+        constexpr int64_t kMaxExpansion = 256;
+
+        turbo::Status GrowOutputSize(size_t *min_capacity) {
+            if (*min_capacity >= kCordMaxOutputSize) {
+                return turbo::resource_exhausted_error("codec keeps asking for a larger output buffer");
+            }
+            *min_capacity *= 2;
+            return turbo::OkStatus();
+        }
+
     }  // namespace
 
+    // ----------------------------------------------------------------------
+    // Cord streaming implementation
+
+    turbo::Status Compressor::Compress(const turbo::Cord &input, turbo::Cord *output) {
+        size_t min_capacity = kCordMinOutputSize;
+        for (std::string_view chunk: input.chunks()) {
+            auto data = reinterpret_cast<const uint8_t *>(chunk.data());
+            auto remaining = static_cast<int64_t>(chunk.size());
+            while (remaining > 0) {
+                int64_t bytes_read = 0;
+                STATUS_RETURN_IF_ERROR(AppendToCord(output, min_capacity, [&](int64_t output_len, uint8_t *out)
+                        -> turbo::Result<int64_t> {
+                    RESULT_ASSIGN_OR_RETURN(auto result, Compress(remaining, data, output_len, out));
+                    bytes_read = result.bytes_read;
+                    return result.bytes_written;
+                }));
+                if (bytes_read == 0) {
+                    STATUS_RETURN_IF_ERROR(GrowOutputSize(&min_capacity));
+                }
+                data += bytes_read;
+                remaining -= bytes_read;
+            }
+        }
+        return turbo::OkStatus();
+    }
+
+    turbo::Status Compressor::Flush(turbo::Cord *output) {
+        size_t min_capacity = kCordMinOutputSize;
+        bool should_retry = true;
+        while (should_retry) {
+            int64_t bytes_written = 0;
+            STATUS_RETURN_IF_ERROR(AppendToCord(output, min_capacity, [&](int64_t output_len, uint8_t *out)
+                    -> turbo::Result<int64_t> {
+                RESULT_ASSIGN_OR_RETURN(auto result, Flush(output_len, out));
+                should_retry = result.should_retry;
+                bytes_written = result.bytes_written;
+                return result.bytes_written;
+            }));
+            if (should_retry && bytes_written == 0) {
+                STATUS_RETURN_IF_ERROR(GrowOutputSize(&min_capacity));
+            }
+        }
+        return turbo::OkStatus();
+    }
+
+    turbo::Status Compressor::End(turbo::Cord *output) {
+        size_t min_capacity = kCordMinOutputSize;
+        bool should_retry = true;
+        while (should_retry) {
+            int64_t bytes_written = 0;
+            STATUS_RETURN_IF_ERROR(AppendToCord(output, min_capacity, [&](int64_t output_len, uint8_t *out)
+                    -> turbo::Result<int64_t> {
+                RESULT_ASSIGN_OR_RETURN(auto result, End(output_len, out));
+                should_retry = result.should_retry;
+                bytes_written = result.bytes_written;
+                return result.bytes_written;
+            }));
+            if (should_retry && bytes_written == 0) {
+                STATUS_RETURN_IF_ERROR(GrowOutputSize(&min_capacity));
+            }
+        }
+        return turbo::OkStatus();
+    }
+
+    turbo::Status Decompressor::Decompress(const turbo::Cord &input, turbo::Cord *output) {
+        size_t min_capacity = kCordMinOutputSize;
+        auto step = [&](const uint8_t *data, int64_t data_len) -> turbo::Result<DecompressResult> {
+            DecompressResult result{0, 0, false};
+            STATUS_RETURN_IF_ERROR(AppendToCord(output, min_capacity, [&](int64_t output_len, uint8_t *out)
+                    -> turbo::Result<int64_t> {
+                RESULT_ASSIGN_OR_RETURN(result, Decompress(data_len, data, output_len, out));
+                return result.bytes_written;
+            }));
+            return result;
+        };
+
+        for (std::string_view chunk: input.chunks()) {
+            auto data = reinterpret_cast<const uint8_t *>(chunk.data());
+            auto remaining = static_cast<int64_t>(chunk.size());
+            while (remaining > 0) {
+                RESULT_ASSIGN_OR_RETURN(auto result, step(data, remaining));
+                data += result.bytes_read;
+                remaining -= result.bytes_read;
+                if (result.bytes_read > 0 || result.bytes_written > 0) {
+                    continue;
+                }
+                // No progress with input left: either the stream ended and
+                // another one follows, or the output space was too small.
+                if (IsFinished()) {
+                    STATUS_RETURN_IF_ERROR(Reset());
+                } else {
+                    STATUS_RETURN_IF_ERROR(GrowOutputSize(&min_capacity));
+                }
+            }
+        }
+        // Drain output still buffered in the decompressor.  Without input, a
+        // call that writes nothing means the stream needs more input.
+        while (!IsFinished()) {
+            RESULT_ASSIGN_OR_RETURN(auto result, step(kNoInput, 0));
+            if (result.bytes_written == 0) {
+                break;
+            }
+        }
+        return turbo::OkStatus();
+    }
+
+    turbo::Status Codec::Compress(const turbo::Cord &input, turbo::Cord *output) {
+        auto original_size = output->size();
+        auto status = [&]() -> turbo::Status {
+            RESULT_ASSIGN_OR_RETURN(auto compressor, MakeCompressor());
+            STATUS_RETURN_IF_ERROR(compressor->Compress(input, output));
+            return compressor->End(output);
+        }();
+        if (!status.ok()) {
+            output->remove_suffix(output->size() - original_size);
+        }
+        return status;
+    }
+
+    turbo::Status Codec::Decompress(const turbo::Cord &input, turbo::Cord *output) {
+        auto original_size = output->size();
+        auto status = [&]() -> turbo::Status {
+            RESULT_ASSIGN_OR_RETURN(auto decompressor, MakeDecompressor());
+            STATUS_RETURN_IF_ERROR(decompressor->Decompress(input, output));
+            if (!decompressor->IsFinished()) {
+                return turbo::Status(turbo::StatusCode::kDataLoss, "truncated compressed stream");
+            }
+            return turbo::OkStatus();
+        }();
+        if (!status.ok()) {
+            output->remove_suffix(output->size() - original_size);
+        }
+        return status;
+    }
+
+    // ----------------------------------------------------------------------
+    // Growable output implementation
+
+    std::optional<int64_t> Codec::DecompressedLength(int64_t input_len, const uint8_t *input) {
+        (void) input_len;
+        (void) input;
+        return std::nullopt;
+    }
+
+    turbo::Result<std::vector<uint8_t>> Codec::Decompress(int64_t input_len, const uint8_t *input) {
+        std::vector<uint8_t> output;
+        const int64_t max_capacity = input_len * kMaxExpansion + kGrowingMinOutputSize;
+        auto length = DecompressedLength(input_len, input);
+        if (length && *length > max_capacity) {
+            // the recorded length comes from the input, a corrupt one must not size
+            // the allocation: grow with what the data really decompresses to
+            return DecompressGrowing(input_len, input, max_capacity);
+        }
+        if (length && *length >= 0) {
+            output.resize(static_cast<size_t>(*length));
+            auto decompressed_len = Decompress(input_len, input, *length, output.data());
+            if (decompressed_len.ok()) {
+                output.resize(static_cast<size_t>(*decompressed_len));
+                return output;
+            }
+            // the length came from a misdetected framing, e.g. raw LZ4 data
+            // looking like Hadoop frames, fall back on growing
+        }
+        // Without a recorded length, retry with a larger buffer until the data fits
+        auto capacity = std::max(input_len * 2, kGrowingMinOutputSize);
+        while (true) {
+            output.resize(static_cast<size_t>(capacity));
+            auto decompressed_len = Decompress(input_len, input, capacity, output.data());
+            if (decompressed_len.ok()) {
+                output.resize(static_cast<size_t>(*decompressed_len));
+                return output;
+            }
+            if (capacity >= max_capacity) {
+                // more than kMaxExpansion, where the streaming format is the one-shot
+                // one, e.g. brotli, the output can grow as far as the data goes
+                auto grown = DecompressGrowing(input_len, input, max_capacity);
+                if (grown.ok()) {
+                    return grown;
+                }
+                return decompressed_len.status();
+            }
+            capacity = std::min(capacity * 2, max_capacity);
+        }
+    }
+
+    turbo::Result<std::vector<uint8_t>> Codec::DecompressGrowing(int64_t input_len, const uint8_t *input,
+                                                                 int64_t initial_capacity) {
+        RESULT_ASSIGN_OR_RETURN(auto decompressor, MakeDecompressor());
+        // the hint may come from corrupt data, never trust it beyond kMaxExpansion
+        initial_capacity = std::min(initial_capacity, input_len * kMaxExpansion);
+        std::vector<uint8_t> output(static_cast<size_t>(std::max(initial_capacity, kGrowingMinOutputSize)));
+        int64_t output_len = 0;
+        while (input_len > 0 || !decompressor->IsFinished()) {
+            if (output_len == static_cast<int64_t>(output.size())) {
+                output.resize(output.size() * 2);
+            }
+            RESULT_ASSIGN_OR_RETURN(auto result,
+                                    decompressor->Decompress(input_len, input,
+                                                             static_cast<int64_t>(output.size()) - output_len,
+                                                             output.data() + output_len));
+            input += result.bytes_read;
+            input_len -= result.bytes_read;
+            output_len += result.bytes_written;
+            if (result.bytes_read > 0 || result.bytes_written > 0) {
+                continue;
+            }
+            // No progress with output space left
+            if (input_len == 0) {
+                return turbo::Status(turbo::StatusCode::kDataLoss, "truncated compressed stream");
+            }
+            if (!decompressor->IsFinished()) {
+                return turbo::Status(turbo::StatusCode::kDataLoss, "decompressor made no progress");
+            }
+            // another stream follows
+            STATUS_RETURN_IF_ERROR(decompressor->Reset());
+        }
+        output.resize(static_cast<size_t>(output_len));
+        return output;
+    }
+
     int Codec::UseDefaultCompressionLevel() { return kUseDefaultCompressionLevel; }
 
     turbo::Status Codec::Init() { return turbo::OkStatus(); }
@@ -46,7 +319,8 @@ namespace alkaid {
         static const std::string uncompressed = "uncompressed", snappy = "snappy",
                 gzip = "gzip", lzo = "lzo", brotli = "brotli",
                 lz4_raw = "lz4_raw", lz4 = "lz4", lz4_hadoop = "lz4_hadoop",
-                zstd = "zstd", bz2 = "bz2", unknown = "unknown";
+                zstd = "zstd", bz2 = "bz2", frame_of_reference = "frame_of_reference",
+                delta_zigzag = "delta_zigzag", stream_vbyte = "stream_vbyte", unknown = "unknown";
 
         switch (t) {
             case CompressionType::UNCOMPRESSED:
@@ -69,6 +343,12 @@ namespace alkaid {
                 return zstd;
             case CompressionType::BZ2:
                 return bz2;
+            case CompressionType::FRAME_OF_REFERENCE:
+                return frame_of_reference;
+            case CompressionType::DELTA_ZIGZAG:
+                return delta_zigzag;
+            case CompressionType::STREAM_VBYTE:
+                return stream_vbyte;
             default:
                 return unknown;
         }
@@ -95,6 +375,12 @@ namespace alkaid {
             return CompressionType::ZSTD;
         } else if (name == "bz2") {
             return CompressionType::BZ2;
+        } else if (name == "frame_of_reference") {
+            return CompressionType::FRAME_OF_REFERENCE;
+        } else if (name == "delta_zigzag") {
+            return CompressionType::DELTA_ZIGZAG;
+        } else if (name == "stream_vbyte") {
+            return CompressionType::STREAM_VBYTE;
         } else {
             return turbo::invalid_argument_error("Unrecognized compression type: %s", name);
         }
@@ -108,6 +394,8 @@ namespace alkaid {
             case CompressionType::BZ2:
             case CompressionType::LZ4_FRAME:
             case CompressionType::LZ4:
+            case CompressionType::LZ4_HADOOP:
+            case CompressionType::LZO:
                 return true;
             default:
                 return false;
@@ -135,10 +423,6 @@ namespace alkaid {
     turbo::Result<std::unique_ptr<Codec>> Codec::Create(CompressionType codec_type,
                                                         const CodecOptions &codec_options) {
         if (!IsAvailable(codec_type)) {
-            if (codec_type == CompressionType::LZO) {
-                return turbo::unimplemented_error("LZO codec not implemented");
-            }
-
             auto name = GetCodecAsString(codec_type);
             if (name == "unknown") {
                 return turbo::invalid_argument_error("Unrecognized codec");
@@ -169,7 +453,9 @@ namespace alkaid {
                 auto opt = dynamic_cast<const GZipCodecOptions*>(&codec_options);
                 codec = internal::MakeGZipCodec(compression_level,
                                                 opt ? opt->gzip_format : GZipFormat::GZIP,
-                                                opt ? opt->window_bits : std::nullopt);
+                                                opt ? opt->window_bits : std::nullopt,
+                                                opt ? opt->compression_threads : 1,
+                                                opt ? opt->block_size : 128 * 1024);
 #endif
                 break;
             }
@@ -186,32 +472,53 @@ namespace alkaid {
                 codec = internal::MakeLz4RawCodec(compression_level);
 #endif
                 break;
-            case CompressionType::LZ4_FRAME:
+            case CompressionType::LZ4_FRAME: {
 #ifdef ENABLE_LZ4
-                codec = internal::MakeLz4FrameCodec(compression_level);
+                auto opt = dynamic_cast<const Lz4CodecOptions*>(&codec_options);
+                codec = internal::MakeLz4FrameCodec(compression_level, opt ? *opt : Lz4CodecOptions{});
 #endif
                 break;
+            }
             case CompressionType::LZ4_HADOOP:
 #ifdef ENABLE_LZ4
-                codec = internal::MakeLz4HadoopRawCodec();
+                codec = internal::MakeLz4HadoopRawCodec(compression_level);
 #endif
                 break;
-            case CompressionType::ZSTD:
+            case CompressionType::LZO:
+#ifdef ENABLE_LZO
+                codec = internal::MakeLzoCodec(compression_level);
+#endif
+                break;
+            case CompressionType::ZSTD: {
 #ifdef ENABLE_ZSTD
-                codec = internal::MakeZSTDCodec(compression_level);
+                auto opt = dynamic_cast<const ZstdCodecOptions*>(&codec_options);
+                codec = internal::MakeZSTDCodec(compression_level, opt ? *opt : ZstdCodecOptions{});
 #endif
                 break;
-            case CompressionType::BZ2:
+            }
+            case CompressionType::BZ2: {
 #ifdef ENABLE_BZIP2
-                codec = internal::MakeBZ2Codec(compression_level);
+                auto opt = dynamic_cast<const BZ2CodecOptions*>(&codec_options);
+                codec = internal::MakeBZ2Codec(compression_level, opt ? opt->decompression_threads : 1);
 #endif
                 break;
+            }
+            case CompressionType::FRAME_OF_REFERENCE:
+            case CompressionType::DELTA_ZIGZAG:
+            case CompressionType::STREAM_VBYTE: {
+                auto opt = dynamic_cast<const IntegerCodecOptions*>(&codec_options);
+                codec = internal::MakeIntegerCodec(codec_type, opt ? opt->value_size : 4);
+                break;
+            }
             default:
                 break;
         }
 
         DCHECK_NE(codec.get(), nullptr);
         STATUS_RETURN_IF_ERROR(codec->Init());
+        if (CodecMetrics::enabled()) {
+            codec = MakeInstrumentedCodec(std::move(codec));
+        }
         return codec;
     }
 
@@ -224,6 +531,9 @@ namespace alkaid {
     bool Codec::IsAvailable(CompressionType codec_type) {
         switch (codec_type) {
             case CompressionType::UNCOMPRESSED:
+            case CompressionType::FRAME_OF_REFERENCE:
+            case CompressionType::DELTA_ZIGZAG:
+            case CompressionType::STREAM_VBYTE:
                 return true;
             case CompressionType::SNAPPY:
 #ifdef ENABLE_SNAPPY
@@ -238,7 +548,11 @@ namespace alkaid {
                 return false;
 #endif
             case CompressionType::LZO:
+#ifdef ENABLE_LZO
+                return true;
+#else
                 return false;
+#endif
             case CompressionType::BROTLI:
 #ifdef ENABLE_BROTLI
                 return true;
@@ -270,4 +584,29 @@ namespace alkaid {
         }
     }
 
+    namespace internal {
+
+        std::optional<int64_t> HadoopFramedLength(int64_t input_len, const uint8_t *input) {
+            constexpr int64_t kPrefixLength = sizeof(uint32_t) * 2;
+            int64_t total = 0;
+            while (input_len >= kPrefixLength) {
+                const uint32_t decompressed_size = turbo::big_endian::load32(input);
+                const uint32_t compressed_size = turbo::big_endian::load32(input + sizeof(uint32_t));
+                input += kPrefixLength;
+                input_len -= kPrefixLength;
+                if (input_len < compressed_size) {
+                    return std::nullopt;
+                }
+                input += compressed_size;
+                input_len -= compressed_size;
+                total += decompressed_size;
+            }
+            if (input_len != 0) {
+                return std::nullopt;
+            }
+            return total;
+        }
+
+    }  // namespace internal
+
 }  // namespace alkaid
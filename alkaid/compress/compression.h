@@ -21,8 +21,12 @@
 
 #pragma once
 
+#include <optional>
+#include <vector>
+
 #include <turbo/base/macros.h>
 #include <turbo/utility/status.h>
+#include <turbo/strings/cord.h>
 #include <alkaid/version.h>
 
 namespace alkaid {
@@ -39,7 +43,11 @@ namespace alkaid {
         LZ4_FRAME,
         LZO,
         BZ2,
-        LZ4_HADOOP
+        LZ4_HADOOP,
+        /// Integer codecs, for arrays of little endian 32 or 64 bit values
+        FRAME_OF_REFERENCE,
+        DELTA_ZIGZAG,
+        STREAM_VBYTE
     };
 
     class TURBO_EXPORT Compressor {
@@ -79,6 +87,18 @@ namespace alkaid {
         /// End() implies Flush().
         virtual turbo::Result<EndResult> End(int64_t output_len, uint8_t *output) = 0;
 
+        /// \brief Compress all of input chunk by chunk, appending to output.
+        ///
+        /// The Cord is never flattened, the compressed data goes into
+        /// CordBuffers appended to output.
+        turbo::Status Compress(const turbo::Cord &input, turbo::Cord *output);
+
+        /// \brief Flush the compressed output, appending it to output.
+        turbo::Status Flush(turbo::Cord *output);
+
+        /// \brief End the stream, appending the remaining output to output.
+        turbo::Status End(turbo::Cord *output);
+
         // XXX add methods for buffer size heuristics?
     };
 
@@ -112,6 +132,13 @@ namespace alkaid {
         /// \brief Reinitialize decompressor, making it ready for a new compressed stream.
         virtual turbo::Status Reset() = 0;
 
+        /// \brief Decompress all of input chunk by chunk, appending to output.
+        ///
+        /// The Cord is never flattened, the decompressed data goes into
+        /// CordBuffers appended to output.  Input following the end of a
+        /// compressed stream starts a new one, as with concatenated gzip members.
+        turbo::Status Decompress(const turbo::Cord &input, turbo::Cord *output);
+
         // XXX add methods for buffer size heuristics?
     };
 
@@ -139,6 +166,12 @@ namespace alkaid {
     public:
         GZipFormat gzip_format = GZipFormat::GZIP;
         std::optional<int> window_bits;
+        /// Threads deflating blocks in parallel (pigz style), 1 compresses
+        /// serially and 0 uses the hardware concurrency.  The output is still
+        /// a single standard stream.
+        int compression_threads = 1;
+        /// Uncompressed size of a parallel block, clamped to [128KB, 1MB]
+        int64_t block_size = 128 * 1024;
     };
 
     // ----------------------------------------------------------------------
@@ -149,6 +182,76 @@ namespace alkaid {
         std::optional<int> window_bits;
     };
 
+    // ----------------------------------------------------------------------
+    // bz2 codec options implementation
+
+    class TURBO_EXPORT BZ2CodecOptions : public CodecOptions {
+    public:
+        /// Threads decoding bz2 blocks in parallel, 1 decodes serially and
+        /// 0 uses the hardware concurrency.
+        int decompression_threads = 1;
+    };
+
+    // ----------------------------------------------------------------------
+    // lz4 codec options implementation
+
+    /// LZ4 frame options.  Levels from 3 up compress with LZ4HC, for the raw
+    /// and Hadoop formats as well.
+    class TURBO_EXPORT Lz4CodecOptions : public CodecOptions {
+    public:
+        /// Uncompressed size of a frame block: 64KB, 256KB, 1MB or 4MB, 0 keeps 64KB
+        int64_t block_size = 0;
+        /// Blocks may reference the data of the previous blocks, which compresses
+        /// small blocks better but only decodes from the start of the frame
+        bool linked_blocks = false;
+        /// Append a checksum of the content to each frame
+        bool content_checksum = false;
+        /// Append a checksum to each block
+        bool block_checksum = false;
+        /// At levels 10 and up, trade a little ratio for faster decompression
+        bool favor_decompression_speed = false;
+    };
+
+    // ----------------------------------------------------------------------
+    // zstd codec options implementation
+
+    /// Advanced zstd parameters, applied with ZSTD_CCtx_setParameter.  Zero
+    /// keeps the value zstd derives from the compression level.
+    class TURBO_EXPORT ZstdCodecOptions : public CodecOptions {
+    public:
+        /// Long distance matching, finds repeats up to 2^window_log bytes back
+        bool enable_long_distance_matching = false;
+        /// log2 of the match window.  Above 27 the decompressing codec needs
+        /// the same window_log to accept the frames.
+        int window_log = 0;
+        /// ZSTD_strategy, from 1 (ZSTD_fast) to 9 (ZSTD_btultra2)
+        int strategy = 0;
+        /// Compressed size the blocks aim for, smaller blocks cut the latency
+        /// of streaming output
+        int64_t target_block_size = 0;
+        /// Threads compressing jobs in parallel, 1 compresses in the calling
+        /// thread and 0 uses the hardware concurrency.  Needs a multithreaded libzstd.
+        int compression_threads = 1;
+        /// Uncompressed size of a job when compressing with threads
+        int64_t job_size = 0;
+        /// Append a checksum of the content to each frame
+        bool checksum = false;
+    };
+
+    // ----------------------------------------------------------------------
+    // integer codec options implementation
+
+    /// FRAME_OF_REFERENCE bit packs blocks of 128 values as offsets from the
+    /// block minimum, DELTA_ZIGZAG does the same with the zigzag encoded
+    /// differences of successive values, and STREAM_VBYTE stores each value
+    /// in 1 to value_size bytes.  Trailing bytes which don't form a whole
+    /// value are stored as is.
+    class TURBO_EXPORT IntegerCodecOptions : public CodecOptions {
+    public:
+        /// Width of the values in bytes, 4 or 8
+        int value_size = 4;
+    };
+
     /// \brief Compression codec
     class TURBO_EXPORT Codec {
     public:
@@ -224,6 +327,30 @@ namespace alkaid {
 
         virtual int64_t MaxCompressedLen(int64_t input_len, const uint8_t *input) = 0;
 
+        /// \brief Decompressed length recorded in one-shot compressed data
+        ///
+        /// std::nullopt when the format does not record it.  The length is
+        /// exact for zstd, LZ4 frames, snappy and the Hadoop framings.  The
+        /// gzip ISIZE only covers the last member modulo 2^32, so it is a hint.
+        virtual std::optional<int64_t> DecompressedLength(int64_t input_len, const uint8_t *input);
+
+        /// \brief One-shot decompression into a buffer sized by the codec
+        ///
+        /// The output is sized from DecompressedLength() when the format
+        /// records it, otherwise it grows geometrically while decompressing.
+        virtual turbo::Result<std::vector<uint8_t>> Decompress(int64_t input_len, const uint8_t *input);
+
+        /// \brief Compress a Cord with the streaming compressor, appending to output
+        ///
+        /// The output is in the streaming format, see MakeCompressor().  Codecs
+        /// without a streaming compressor return an error.
+        turbo::Status Compress(const turbo::Cord &input, turbo::Cord *output);
+
+        /// \brief Decompress a Cord with the streaming decompressor, appending to output
+        ///
+        /// The input must be complete.  output is left unchanged on error.
+        turbo::Status Decompress(const turbo::Cord &input, turbo::Cord *output);
+
         /// \brief Create a streaming compressor instance
         virtual turbo::Result<std::shared_ptr<Compressor>> MakeCompressor() = 0;
 
@@ -239,6 +366,12 @@ namespace alkaid {
         /// \brief This Codec's compression level, if applicable
         virtual int compression_level() const { return UseDefaultCompressionLevel(); }
 
+    protected:
+        /// \brief Decompress with the streaming decompressor, growing the output
+        /// geometrically from initial_capacity.  Concatenated streams are decoded.
+        turbo::Result<std::vector<uint8_t>> DecompressGrowing(int64_t input_len, const uint8_t *input,
+                                                              int64_t initial_capacity);
+
     private:
         /// \brief Initializes the codec's resources.
         virtual turbo::Status Init();
@@ -21,15 +21,21 @@
 #if defined(ENABLE_BZIP2)
 
 #include <alkaid/compress/compression_internal.h>
+#include <alkaid/utility/thread_pool.h>
 #include <turbo/utility/status.h>
 #include <turbo/log/logging.h>
 
 #include <algorithm>
+#include <chrono>
 #include <cstdint>
 #include <cstring>
+#include <deque>
+#include <future>
 #include <limits>
 #include <memory>
+#include <optional>
 #include <sstream>
+#include <vector>
 #include <bzlib.h>
 
 
@@ -119,6 +125,10 @@ namespace alkaid::internal {
 
             turbo::Result<DecompressResult> Decompress(int64_t input_len, const uint8_t *input,
                                                        int64_t output_len, uint8_t *output) override {
+                if (finished_) {
+                    // libbz2 rejects calls past the end of the stream, Reset() starts the next one
+                    return DecompressResult{0, 0, false};
+                }
                 stream_.next_in = const_cast<char *>(reinterpret_cast<const char *>(input));
                 stream_.avail_in = static_cast<unsigned int>(std::min(input_len, kSizeLimit));
                 stream_.next_out = reinterpret_cast<char *>(output);
@@ -223,33 +233,534 @@ namespace alkaid::internal {
             int compression_level_;
         };
 
+// ----------------------------------------------------------------------
+// parallel bz2 decompressor implementation
+//
+// A bz2 stream is "BZh" plus a level digit, then a sequence of blocks, each
+// starting with the 48 bit magic 0x314159265359 at an arbitrary bit offset,
+// then the 48 bit end of stream magic 0x177245385090, a 32 bit combined CRC
+// and padding to a byte boundary.  Blocks do not depend on each other: the
+// bits of one block wrapped in a stream header and an end of stream marker
+// (whose combined CRC is then the block CRC) form a valid stream of their own.
+// Scanning the input for the magics therefore lets the blocks be decoded on a
+// thread pool while the output is still delivered in order, as lbzip2 does.
+//
+// The block magic may also occur by chance inside compressed data.  A block
+// cut at such a false magic fails to decode, it is then merged with the block
+// that follows it and decoded again.  An end of stream magic is only taken
+// when the end of the input or the header of another stream follows it.
+
+        constexpr uint64_t kBZ2BlockMagic = 0x314159265359ULL;
+        constexpr uint64_t kBZ2EndOfStreamMagic = 0x177245385090ULL;
+        constexpr uint64_t kBZ2MagicMask = (uint64_t{1} << 48) - 1;
+        constexpr uint64_t kBZ2MagicBits = 48;
+        constexpr uint64_t kBZ2CrcBits = 32;
+        constexpr int64_t kBZ2StreamHeaderSize = 4;
+        // Compressed input accepted per Decompress() call, about one 900k block
+        constexpr int64_t kBZ2MaxInputChunk = 1 << 20;
+        // A legitimate block never compresses to more than ~1MB, a merge chain
+        // longer than this means the data is corrupt rather than unlucky.
+        constexpr uint64_t kBZ2MaxMergedBlockBits = uint64_t{8} << 23;
+
+        // Decode one complete bz2 stream whose decompressed size is unknown.
+        turbo::Result<std::vector<uint8_t>> DecompressBZ2Stream(const std::vector<uint8_t> &input) {
+            bz_stream stream;
+            memset(&stream, 0, sizeof(stream));
+            int ret = BZ2_bzDecompressInit(&stream, 0, 0);
+            if (ret != BZ_OK) {
+                return BZ2Error("bz2 decompressor init failed: ", ret);
+            }
+            std::vector<uint8_t> output(std::max<size_t>(input.size() * 4, 4096));
+            size_t output_size = 0;
+            stream.next_in = const_cast<char *>(reinterpret_cast<const char *>(input.data()));
+            stream.avail_in = static_cast<unsigned int>(input.size());
+            while (true) {
+                auto avail_out = static_cast<unsigned int>(
+                        std::min(static_cast<int64_t>(output.size() - output_size), kSizeLimit));
+                stream.next_out = reinterpret_cast<char *>(output.data() + output_size);
+                stream.avail_out = avail_out;
+                ret = BZ2_bzDecompress(&stream);
+                output_size += avail_out - stream.avail_out;
+                if (ret == BZ_STREAM_END) {
+                    break;
+                }
+                if (ret != BZ_OK) {
+                    (void) (BZ2_bzDecompressEnd(&stream));
+                    return BZ2Error("bz2 decompress failed: ", ret);
+                }
+                if (stream.avail_out > 0) {
+                    // all input consumed without reaching the end of stream
+                    (void) (BZ2_bzDecompressEnd(&stream));
+                    return turbo::Status(turbo::StatusCode::kDataLoss, "truncated bz2 block");
+                }
+                output.resize(output.size() * 2);
+            }
+            (void) (BZ2_bzDecompressEnd(&stream));
+            output.resize(output_size);
+            return output;
+        }
+
+        class ParallelBZ2Decompressor : public Decompressor {
+        public:
+            explicit ParallelBZ2Decompressor(std::shared_ptr<ThreadPool> pool)
+                    : pool_(std::move(pool)), max_in_flight_(2 * pool_->size()) {}
+
+            turbo::Status Reset() override {
+                blocks_.clear();
+                buffer_.clear();
+                base_byte_ = 0;
+                cursor_bit_ = 0;
+                state_ = State::kStreamHeader;
+                level_ = '9';
+                block_begin_.reset();
+                reg_ = 0;
+                reg_bits_ = 0;
+                resume_bit_.reset();
+                input_ended_ = false;
+                streams_ = 0;
+                output_.clear();
+                output_pos_ = 0;
+                return turbo::OkStatus();
+            }
+
+            turbo::Result<DecompressResult> Decompress(int64_t input_len, const uint8_t *input,
+                                                       int64_t output_len, uint8_t *output) override {
+                RESULT_ASSIGN_OR_RETURN(int64_t bytes_read, AcceptInput(input_len, input));
+
+                int64_t bytes_written = 0;
+                while (bytes_written < output_len) {
+                    if (output_pos_ < output_.size()) {
+                        auto n = std::min(static_cast<size_t>(output_len - bytes_written),
+                                          output_.size() - output_pos_);
+                        memcpy(output + bytes_written, output_.data() + output_pos_, n);
+                        output_pos_ += n;
+                        bytes_written += n;
+                        continue;
+                    }
+                    if (blocks_.empty()) {
+                        break;
+                    }
+                    auto &front = blocks_.front();
+                    if (!front.result.has_value()) {
+                        // Only block when this call would otherwise make no progress
+                        bool ready = front.future.wait_for(std::chrono::seconds(0)) ==
+                                     std::future_status::ready;
+                        if (!ready && (bytes_read > 0 || bytes_written > 0)) {
+                            break;
+                        }
+                        front.result.emplace(front.future.get());
+                    }
+                    if (!front.result->ok()) {
+                        RESULT_ASSIGN_OR_RETURN(bool merged, MergeFailedBlock());
+                        if (!merged) {
+                            // The failed block is now part of the block being scanned,
+                            // which needs more input before it is dispatched again.
+                            if (bytes_read == 0 && input_len > 0) {
+                                RESULT_ASSIGN_OR_RETURN(bytes_read, AcceptInput(input_len, input));
+                                continue;
+                            }
+                            break;
+                        }
+                        continue;
+                    }
+                    output_ = std::move(front.result->value());
+                    output_pos_ = 0;
+                    blocks_.pop_front();
+                }
+                ReleaseInput();
+                return DecompressResult{bytes_read, bytes_written, output_pos_ < output_.size()};
+            }
+
+            bool IsFinished() override {
+                return state_ == State::kStreamHeader && streams_ > 0 && cursor_bit_ / 8 == EndByte() &&
+                       blocks_.empty() && output_pos_ == output_.size();
+            }
+
+        private:
+            enum class State {
+                kStreamHeader,
+                kBlocks,
+                kStreamCrc,
+            };
+
+            struct Block {
+                uint64_t begin_bit;
+                uint64_t end_bit;
+                char level;
+                std::future<turbo::Result<std::vector<uint8_t>>> future;
+                std::optional<turbo::Result<std::vector<uint8_t>>> result;
+            };
+
+            uint64_t EndByte() const { return base_byte_ + buffer_.size(); }
+
+            // Buffer and scan up to one chunk of input unless enough blocks are in flight.
+            turbo::Result<int64_t> AcceptInput(int64_t input_len, const uint8_t *input) {
+                if (input_len == 0) {
+                    // the end of the input decides an end of stream magic waiting for what follows it
+                    if (resume_bit_.has_value() && !input_ended_) {
+                        input_ended_ = true;
+                        STATUS_RETURN_IF_ERROR(Scan());
+                    }
+                    return 0;
+                }
+                if (blocks_.size() >= max_in_flight_) {
+                    return 0;
+                }
+                input_ended_ = false;
+                int64_t bytes_read = std::min(input_len, kBZ2MaxInputChunk);
+                buffer_.insert(buffer_.end(), input, input + bytes_read);
+                STATUS_RETURN_IF_ERROR(Scan());
+                return bytes_read;
+            }
+
+            uint32_t ReadBits(uint64_t bit, int count) const {
+                uint32_t value = 0;
+                for (int i = 0; i < count; ++i, ++bit) {
+                    uint64_t offset = bit - base_byte_ * 8;
+                    value = (value << 1) | ((buffer_[offset >> 3] >> (7 - (offset & 7))) & 1);
+                }
+                return value;
+            }
+
+            // Locate stream headers, block boundaries and stream trailers in the
+            // buffered input, dispatching every block whose end is known.
+            turbo::Status Scan() {
+                while (true) {
+                    switch (state_) {
+                        case State::kStreamHeader: {
+                            uint64_t offset = cursor_bit_ / 8 - base_byte_;
+                            if (buffer_.size() - offset < kBZ2StreamHeaderSize) {
+                                return turbo::OkStatus();
+                            }
+                            const uint8_t *header = buffer_.data() + offset;
+                            if (header[0] != 'B' || header[1] != 'Z' || header[2] != 'h' ||
+                                header[3] < '1' || header[3] > '9') {
+                                return BZ2Error("bz2 decompress failed: ", BZ_DATA_ERROR_MAGIC);
+                            }
+                            level_ = static_cast<char>(header[3]);
+                            cursor_bit_ += kBZ2StreamHeaderSize * 8;
+                            reg_ = 0;
+                            reg_bits_ = 0;
+                            state_ = State::kBlocks;
+                            break;
+                        }
+                        case State::kBlocks: {
+                            if (!ScanBlocks()) {
+                                return turbo::OkStatus();
+                            }
+                            break;
+                        }
+                        case State::kStreamCrc: {
+                            if (cursor_bit_ + kBZ2CrcBits > EndByte() * 8) {
+                                return turbo::OkStatus();
+                            }
+                            // Streams start on a byte boundary
+                            cursor_bit_ = (cursor_bit_ + kBZ2CrcBits + 7) / 8 * 8;
+                            ++streams_;
+                            state_ = State::kStreamHeader;
+                            break;
+                        }
+                    }
+                }
+            }
+
+            enum class Trailer {
+                kValid,
+                kFalseMagic,
+                kNeedInput,
+            };
+
+            // An end of stream magic is real when its CRC and padding are followed
+            // by the end of the input or by the header of the next stream.  The
+            // magic may also occur by chance inside the Huffman coded data.
+            Trailer CheckTrailer(uint64_t magic_begin) const {
+                uint64_t next_byte = (magic_begin + kBZ2MagicBits + kBZ2CrcBits + 7) / 8;
+                uint64_t available = EndByte() > next_byte ? EndByte() - next_byte : 0;
+                uint64_t checked = std::min<uint64_t>(available, kBZ2StreamHeaderSize);
+                for (uint64_t i = 0; i < checked; ++i) {
+                    uint8_t c = buffer_[next_byte - base_byte_ + i];
+                    bool ok = i < 3 ? c == static_cast<uint8_t>("BZh"[i]) : c >= '1' && c <= '9';
+                    if (!ok) {
+                        return Trailer::kFalseMagic;
+                    }
+                }
+                if (checked == kBZ2StreamHeaderSize || (input_ended_ && EndByte() >= next_byte)) {
+                    return Trailer::kValid;
+                }
+                if (input_ended_) {
+                    // the input ends inside the CRC, a truncated stream
+                    return Trailer::kFalseMagic;
+                }
+                return Trailer::kNeedInput;
+            }
+
+            // Returns true when the end of stream magic was found.
+            bool ScanBlocks() {
+                while (cursor_bit_ / 8 < EndByte()) {
+                    uint64_t first_bit = 0;
+                    if (resume_bit_.has_value()) {
+                        // the byte is in reg_ already, an end of stream magic waited for more input
+                        first_bit = *resume_bit_;
+                        resume_bit_.reset();
+                    } else {
+                        reg_ = (reg_ << 8) | buffer_[cursor_bit_ / 8 - base_byte_];
+                        reg_bits_ = std::min<uint64_t>(reg_bits_ + 8, 64);
+                    }
+                    for (uint64_t j = first_bit; j < 8; ++j) {
+                        if (reg_bits_ - (7 - j) < kBZ2MagicBits) {
+                            continue;
+                        }
+                        uint64_t candidate = (reg_ >> (7 - j)) & kBZ2MagicMask;
+                        uint64_t magic_begin = cursor_bit_ + j + 1 - kBZ2MagicBits;
+                        if (candidate == kBZ2BlockMagic) {
+                            if (block_begin_.has_value()) {
+                                DispatchBlock(*block_begin_, magic_begin);
+                            }
+                            block_begin_ = magic_begin;
+                        } else if (candidate == kBZ2EndOfStreamMagic) {
+                            auto trailer = CheckTrailer(magic_begin);
+                            if (trailer == Trailer::kFalseMagic) {
+                                continue;
+                            }
+                            if (trailer == Trailer::kNeedInput) {
+                                resume_bit_ = j;
+                                return false;
+                            }
+                            if (block_begin_.has_value()) {
+                                DispatchBlock(*block_begin_, magic_begin);
+                                block_begin_.reset();
+                            }
+                            cursor_bit_ = magic_begin + kBZ2MagicBits;
+                            state_ = State::kStreamCrc;
+                            return true;
+                        }
+                    }
+                    cursor_bit_ += 8;
+                }
+                return false;
+            }
+
+            // Wrap the bits [begin_bit, end_bit) of one block into a stand-alone stream.
+            std::vector<uint8_t> MakeBlockStream(uint64_t begin_bit, uint64_t end_bit, char level) const {
+                uint64_t block_bits = end_bit - begin_bit;
+                uint64_t total_bits = kBZ2StreamHeaderSize * 8 + block_bits + kBZ2MagicBits + kBZ2CrcBits;
+                std::vector<uint8_t> stream((total_bits + 7) / 8, 0);
+                stream[0] = 'B';
+                stream[1] = 'Z';
+                stream[2] = 'h';
+                stream[3] = static_cast<uint8_t>(level);
+
+                // Whole bytes of the block, realigned to the byte boundary
+                const uint8_t *src = buffer_.data() + (begin_bit / 8 - base_byte_);
+                unsigned shift = begin_bit % 8;
+                uint64_t whole_bytes = block_bits / 8;
+                uint8_t *dst = stream.data() + kBZ2StreamHeaderSize;
+                for (uint64_t i = 0; i < whole_bytes; ++i) {
+                    dst[i] = shift == 0 ? src[i]
+                                        : static_cast<uint8_t>((src[i] << shift) | (src[i + 1] >> (8 - shift)));
+                }
+
+                uint64_t out_bit = (kBZ2StreamHeaderSize + whole_bytes) * 8;
+                auto put_bits = [&](uint64_t value, uint64_t count) {
+                    for (uint64_t i = count; i-- > 0; ++out_bit) {
+                        stream[out_bit >> 3] |= static_cast<uint8_t>(((value >> i) & 1) << (7 - (out_bit & 7)));
+                    }
+                };
+                uint64_t tail_bits = block_bits % 8;
+                put_bits(ReadBits(begin_bit + whole_bytes * 8, static_cast<int>(tail_bits)), tail_bits);
+                put_bits(kBZ2EndOfStreamMagic, kBZ2MagicBits);
+                // The combined CRC of a single block stream is the block CRC
+                uint32_t block_crc = block_bits >= kBZ2MagicBits + kBZ2CrcBits
+                                     ? ReadBits(begin_bit + kBZ2MagicBits, kBZ2CrcBits) : 0;
+                put_bits(block_crc, kBZ2CrcBits);
+                return stream;
+            }
+
+            void DispatchBlock(uint64_t begin_bit, uint64_t end_bit) {
+                auto stream = MakeBlockStream(begin_bit, end_bit, level_);
+                Block block{begin_bit, end_bit, level_, {}, std::nullopt};
+                block.future = pool_->submit([stream = std::move(stream)]() {
+                    return DecompressBZ2Stream(stream);
+                });
+                blocks_.push_back(std::move(block));
+            }
+
+            // The front block failed to decode, most likely because it was cut at
+            // a false block magic.  Merge it with its successor: returns true if
+            // the merged block was decoded in place, false if it was folded into
+            // the block still being scanned.
+            turbo::Result<bool> MergeFailedBlock() {
+                auto &front = blocks_.front();
+                bool has_next = blocks_.size() > 1 && blocks_[1].begin_bit == front.end_bit;
+                bool next_open = blocks_.size() == 1 && state_ == State::kBlocks &&
+                                 block_begin_.has_value() && *block_begin_ == front.end_bit;
+                if (!has_next && !next_open) {
+                    return front.result->status();
+                }
+                uint64_t merged_end = has_next ? blocks_[1].end_bit : *block_begin_;
+                if (merged_end - front.begin_bit > kBZ2MaxMergedBlockBits) {
+                    return front.result->status();
+                }
+                if (next_open) {
+                    block_begin_ = front.begin_bit;
+                    blocks_.pop_front();
+                    return false;
+                }
+                // erasing from a deque invalidates the reference to the front
+                blocks_.erase(blocks_.begin() + 1);
+                auto &merged = blocks_.front();
+                merged.end_bit = merged_end;
+                merged.result.emplace(DecompressBZ2Stream(MakeBlockStream(merged.begin_bit, merged.end_bit,
+                                                                          merged.level)));
+                return true;
+            }
+
+            // Drop buffered input no block can refer to anymore.
+            void ReleaseInput() {
+                uint64_t keep_bit = cursor_bit_;
+                if (block_begin_.has_value()) {
+                    keep_bit = std::min(keep_bit, *block_begin_);
+                }
+                if (!blocks_.empty()) {
+                    keep_bit = std::min(keep_bit, blocks_.front().begin_bit);
+                }
+                uint64_t release = keep_bit / 8 - base_byte_;
+                if (release > 0 && release >= buffer_.size() / 2) {
+                    buffer_.erase(buffer_.begin(), buffer_.begin() + release);
+                    base_byte_ += release;
+                }
+            }
+
+        private:
+            std::shared_ptr<ThreadPool> pool_;
+            size_t max_in_flight_;
+            std::deque<Block> blocks_;
+
+            // input not yet released, buffer_[0] is byte base_byte_ of the input
+            std::vector<uint8_t> buffer_;
+            uint64_t base_byte_{0};
+            // next input bit to parse
+            uint64_t cursor_bit_{0};
+            State state_{State::kStreamHeader};
+            char level_{'9'};
+            std::optional<uint64_t> block_begin_;
+            uint64_t reg_{0};
+            uint64_t reg_bits_{0};
+            // bit of the byte at cursor_bit_ to go on scanning from, the byte being
+            // in reg_ already, when an end of stream magic waits for what follows it
+            std::optional<uint64_t> resume_bit_;
+            // Decompress() was called without input, nothing follows the buffered input for now
+            bool input_ended_{false};
+            uint64_t streams_{0};
+
+            std::vector<uint8_t> output_;
+            size_t output_pos_{0};
+        };
+
 // ----------------------------------------------------------------------
 // bz2 codec implementation
 
         class BZ2Codec : public Codec {
         public:
-            explicit BZ2Codec(int compression_level) : compression_level_(compression_level) {
+            BZ2Codec(int compression_level, int decompression_threads) : compression_level_(compression_level) {
                 compression_level_ = compression_level == kUseDefaultCompressionLevel
                                      ? kBZ2DefaultCompressionLevel
                                      : compression_level;
+                if (decompression_threads != 1) {
+                    pool_ = std::make_shared<ThreadPool>(static_cast<size_t>(std::max(decompression_threads, 0)));
+                }
             }
 
             turbo::Result<int64_t> Decompress(int64_t input_len, const uint8_t *input,
                                               int64_t output_buffer_len, uint8_t *output_buffer) override {
-                return turbo::unimplemented_error("One-shot bz2 decompression not supported");
+                if (pool_ != nullptr) {
+                    return ParallelDecompress(input_len, input, output_buffer_len, output_buffer);
+                }
+                // Handle concatenated streams, as written by pbzip2 or by appending files
+                int64_t read_input_bytes = 0;
+                int64_t decompressed_bytes = 0;
+                while (read_input_bytes < input_len) {
+                    bz_stream stream;
+                    memset(&stream, 0, sizeof(stream));
+                    int ret = BZ2_bzDecompressInit(&stream, 0, 0);
+                    if (ret != BZ_OK) {
+                        return BZ2Error("bz2 decompressor init failed: ", ret);
+                    }
+                    do {
+                        auto avail_in = static_cast<unsigned int>(std::min(input_len - read_input_bytes, kSizeLimit));
+                        auto avail_out = static_cast<unsigned int>(
+                                std::min(output_buffer_len - decompressed_bytes, kSizeLimit));
+                        stream.next_in = const_cast<char *>(reinterpret_cast<const char *>(input + read_input_bytes));
+                        stream.avail_in = avail_in;
+                        stream.next_out = reinterpret_cast<char *>(output_buffer + decompressed_bytes);
+                        stream.avail_out = avail_out;
+                        ret = BZ2_bzDecompress(&stream);
+                        read_input_bytes += avail_in - stream.avail_in;
+                        decompressed_bytes += avail_out - stream.avail_out;
+                        if (ret == BZ_OK && avail_in == stream.avail_in && avail_out == stream.avail_out) {
+                            (void) (BZ2_bzDecompressEnd(&stream));
+                            if (decompressed_bytes == output_buffer_len) {
+                                return turbo::unavailable_error(
+                                        turbo::str_cat("Too small a buffer passed to BZ2Codec. InputLength=",
+                                                       input_len, " OutputLength=", output_buffer_len));
+                            }
+                            return turbo::Status(turbo::StatusCode::kDataLoss, "truncated bz2 stream");
+                        }
+                    } while (ret == BZ_OK);
+                    (void) (BZ2_bzDecompressEnd(&stream));
+                    if (ret != BZ_STREAM_END) {
+                        return BZ2Error("bz2 decompress failed: ", ret);
+                    }
+                }
+                return decompressed_bytes;
             }
 
             turbo::Result<int64_t> Compress(int64_t input_len, const uint8_t *input,
                                             int64_t output_buffer_len, uint8_t *output_buffer) override {
-                return turbo::unimplemented_error("One-shot bz2 compression not supported");
+                bz_stream stream;
+                memset(&stream, 0, sizeof(stream));
+                int ret = BZ2_bzCompressInit(&stream, compression_level_, 0, 0);
+                if (ret != BZ_OK) {
+                    return BZ2Error("bz2 compressor init failed: ", ret);
+                }
+                int64_t read_input_bytes = 0;
+                int64_t compressed_bytes = 0;
+                // BZ_RUN until the input is consumed, then BZ_FINISH until the end of stream
+                do {
+                    auto avail_in = static_cast<unsigned int>(std::min(input_len - read_input_bytes, kSizeLimit));
+                    auto avail_out = static_cast<unsigned int>(
+                            std::min(output_buffer_len - compressed_bytes, kSizeLimit));
+                    stream.next_in = const_cast<char *>(reinterpret_cast<const char *>(input + read_input_bytes));
+                    stream.avail_in = avail_in;
+                    stream.next_out = reinterpret_cast<char *>(output_buffer + compressed_bytes);
+                    stream.avail_out = avail_out;
+                    bool finish = read_input_bytes + avail_in == input_len;
+                    ret = BZ2_bzCompress(&stream, finish ? BZ_FINISH : BZ_RUN);
+                    read_input_bytes += avail_in - stream.avail_in;
+                    compressed_bytes += avail_out - stream.avail_out;
+                    if ((ret == BZ_RUN_OK || ret == BZ_FINISH_OK) && stream.avail_out == 0 &&
+                        compressed_bytes == output_buffer_len) {
+                        (void) (BZ2_bzCompressEnd(&stream));
+                        return turbo::unavailable_error("bz2 compress failed, output buffer too small");
+                    }
+                } while (ret == BZ_RUN_OK || ret == BZ_FINISH_OK);
+                (void) (BZ2_bzCompressEnd(&stream));
+                if (ret != BZ_STREAM_END) {
+                    return BZ2Error("bz2 compress failed: ", ret);
+                }
+                return compressed_bytes;
+            }
+
+            turbo::Result<std::vector<uint8_t>> Decompress(int64_t input_len, const uint8_t *input) override {
+                // bzip2 records no length, grow from a typical ratio
+                return DecompressGrowing(input_len, input, input_len * 4);
             }
 
             int64_t MaxCompressedLen(int64_t input_len,
                                      const uint8_t *input) override {
-                // Cannot determine upper bound for bz2-compressed data
                 (void) input;
-                (void) input_len;
-                return 0;
+                // bzip2 documents the output as at most 1% larger than the input plus 600 bytes
+                return input_len + input_len / 100 + 600;
             }
 
             turbo::Result<std::shared_ptr<Compressor>> MakeCompressor() override {
@@ -259,6 +770,9 @@ namespace alkaid::internal {
             }
 
             turbo::Result<std::shared_ptr<Decompressor>> MakeDecompressor() override {
+                if (pool_ != nullptr) {
+                    return std::make_shared<ParallelBZ2Decompressor>(pool_);
+                }
                 auto ptr = std::make_shared<BZ2Decompressor>();
                 STATUS_RETURN_IF_ERROR(ptr->Init());
                 return ptr;
@@ -275,13 +789,40 @@ namespace alkaid::internal {
             int default_compression_level() const override { return kBZ2DefaultCompressionLevel; }
 
         private:
+            turbo::Result<int64_t> ParallelDecompress(int64_t input_len, const uint8_t *input,
+                                                      int64_t output_buffer_len, uint8_t *output_buffer) {
+                ParallelBZ2Decompressor decompressor(pool_);
+                int64_t read_input_bytes = 0;
+                int64_t decompressed_bytes = 0;
+                while (read_input_bytes < input_len || !decompressor.IsFinished()) {
+                    RESULT_ASSIGN_OR_RETURN(auto result,
+                                            decompressor.Decompress(input_len - read_input_bytes,
+                                                                    input + read_input_bytes,
+                                                                    output_buffer_len - decompressed_bytes,
+                                                                    output_buffer + decompressed_bytes));
+                    read_input_bytes += result.bytes_read;
+                    decompressed_bytes += result.bytes_written;
+                    if (result.need_more_output && decompressed_bytes == output_buffer_len) {
+                        return turbo::unavailable_error(
+                                turbo::str_cat("Too small a buffer passed to BZ2Codec. InputLength=",
+                                               input_len, " OutputLength=", output_buffer_len));
+                    }
+                    if (result.bytes_read == 0 && result.bytes_written == 0 && !result.need_more_output) {
+                        return turbo::Status(turbo::StatusCode::kDataLoss, "truncated bz2 stream");
+                    }
+                }
+                return decompressed_bytes;
+            }
+
             int compression_level_;
+            // set when block-parallel decompression is enabled
+            std::shared_ptr<ThreadPool> pool_;
         };
 
     }  // namespace
 
-    std::unique_ptr<Codec> MakeBZ2Codec(int compression_level) {
-        return std::make_unique<BZ2Codec>(compression_level);
+    std::unique_ptr<Codec> MakeBZ2Codec(int compression_level, int decompression_threads) {
+        return std::make_unique<BZ2Codec>(compression_level, decompression_threads);
     }
 
 }  // namespace alkaid::internal
@@ -0,0 +1,560 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <alkaid/compress/compression_internal.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <vector>
+
+#include <turbo/base/endian.h>
+#include <turbo/strings/str_cat.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+
+namespace alkaid::internal {
+
+    namespace {
+
+        // Values are bit packed in blocks of 128, each with its own reference
+        // value and bit width
+        constexpr int64_t kIntegerBlockSize = 128;
+        // compression type, value size and the uncompressed length in bytes
+        constexpr int64_t kIntegerHeaderSize = 10;
+
+        turbo::Status CorruptIntegerData() {
+            return turbo::unavailable_error("Corrupt integer compressed data.");
+        }
+
+        template<typename U>
+        inline int BitWidth(U v) {
+            int width = 0;
+            if constexpr (sizeof(U) == 4) {
+                width = v == 0 ? 0 : 32 - __builtin_clz(v);
+            } else {
+                width = v == 0 ? 0 : 64 - __builtin_clzll(v);
+            }
+            return width;
+        }
+
+        template<typename U>
+        inline U LoadValue(const uint8_t *p) {
+            if constexpr (sizeof(U) == 4) {
+                return turbo::little_endian::load32(p);
+            } else {
+                return turbo::little_endian::load64(p);
+            }
+        }
+
+        template<typename U>
+        inline void StoreValue(uint8_t *p, U v) {
+            if constexpr (sizeof(U) == 4) {
+                turbo::little_endian::store32(p, v);
+            } else {
+                turbo::little_endian::store64(p, v);
+            }
+        }
+
+        template<typename U>
+        inline U ZigZagEncode(U d) {
+            using S = std::make_signed_t<U>;
+            return static_cast<U>(d << 1) ^ static_cast<U>(static_cast<S>(d) >> (sizeof(U) * 8 - 1));
+        }
+
+        template<typename U>
+        inline U ZigZagDecode(U z) {
+            return static_cast<U>(z >> 1) ^ static_cast<U>(U(0) - (z & 1));
+        }
+
+        // ----------------------------------------------------------------------
+        // Bit packing kernels
+        //
+        // A block of 128 values of bw bits packs into exactly 16 * bw bytes.
+        // 32 bit values use the SIMD-BP128 layout: value i goes to lane i % 4,
+        // each lane packs its 32 values into bw words, and word m of lane j is
+        // word 4 * m + j of the block.  SSE2 then packs and unpacks 4 values
+        // per instruction, the scalar code writes the same bytes.  64 bit
+        // values are packed as one little endian bit stream.
+
+        void Pack32(const uint32_t *values, int bw, uint8_t *out) {
+#if defined(__SSE2__)
+            __m128i acc = _mm_setzero_si128();
+            int bits = 0;
+            for (int k = 0; k < 32; ++k) {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(values + 4 * k));
+                acc = _mm_or_si128(acc, _mm_sll_epi32(v, _mm_cvtsi32_si128(bits)));
+                bits += bw;
+                if (bits >= 32) {
+                    _mm_storeu_si128(reinterpret_cast<__m128i *>(out), acc);
+                    out += 16;
+                    bits -= 32;
+                    acc = bits > 0 ? _mm_srl_epi32(v, _mm_cvtsi32_si128(bw - bits)) : _mm_setzero_si128();
+                }
+            }
+#else
+            for (int j = 0; j < 4; ++j) {
+                uint64_t acc = 0;
+                int bits = 0;
+                int m = 0;
+                for (int k = 0; k < 32; ++k) {
+                    acc |= static_cast<uint64_t>(values[4 * k + j]) << bits;
+                    bits += bw;
+                    if (bits >= 32) {
+                        turbo::little_endian::store32(out + 4 * (4 * m + j), static_cast<uint32_t>(acc));
+                        acc >>= 32;
+                        bits -= 32;
+                        ++m;
+                    }
+                }
+            }
+#endif
+        }
+
+        void Unpack32(const uint8_t *in, int bw, uint32_t *values) {
+            if (bw == 0) {
+                std::fill(values, values + kIntegerBlockSize, 0);
+                return;
+            }
+            const uint32_t mask = bw == 32 ? 0xffffffffu : (1u << bw) - 1;
+#if defined(__SSE2__)
+            const __m128i vmask = _mm_set1_epi32(static_cast<int>(mask));
+            __m128i cur = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in));
+            int shift = 0;
+            for (int k = 0; k < 32; ++k) {
+                __m128i v = _mm_srl_epi32(cur, _mm_cvtsi32_si128(shift));
+                shift += bw;
+                if (shift > 32 || (shift == 32 && k < 31)) {
+                    in += 16;
+                    cur = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in));
+                    shift -= 32;
+                    if (shift > 0) {
+                        v = _mm_or_si128(v, _mm_sll_epi32(cur, _mm_cvtsi32_si128(bw - shift)));
+                    }
+                }
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(values + 4 * k), _mm_and_si128(v, vmask));
+            }
+#else
+            for (int j = 0; j < 4; ++j) {
+                uint64_t acc = 0;
+                int bits = 0;
+                int m = 0;
+                for (int k = 0; k < 32; ++k) {
+                    if (bits < bw) {
+                        acc |= static_cast<uint64_t>(turbo::little_endian::load32(in + 4 * (4 * m + j))) << bits;
+                        bits += 32;
+                        ++m;
+                    }
+                    values[4 * k + j] = static_cast<uint32_t>(acc) & mask;
+                    acc >>= bw;
+                    bits -= bw;
+                }
+            }
+#endif
+        }
+
+        void Pack64(const uint64_t *values, int bw, uint8_t *out) {
+            uint64_t acc = 0;
+            int bits = 0;
+            for (int64_t i = 0; i < kIntegerBlockSize && bw > 0; ++i) {
+                acc |= values[i] << bits;
+                if (bits + bw >= 64) {
+                    turbo::little_endian::store64(out, acc);
+                    out += 8;
+                    acc = bits == 0 ? 0 : values[i] >> (64 - bits);
+                    bits = bits + bw - 64;
+                } else {
+                    bits += bw;
+                }
+            }
+        }
+
+        void Unpack64(const uint8_t *in, int bw, uint64_t *values) {
+            if (bw == 0) {
+                std::fill(values, values + kIntegerBlockSize, 0);
+                return;
+            }
+            const uint64_t mask = bw == 64 ? ~uint64_t{0} : (uint64_t{1} << bw) - 1;
+            uint64_t cur = turbo::little_endian::load64(in);
+            int shift = 0;
+            for (int64_t i = 0; i < kIntegerBlockSize; ++i) {
+                uint64_t v = shift < 64 ? cur >> shift : 0;
+                shift += bw;
+                if (shift > 64 || (shift == 64 && i < kIntegerBlockSize - 1)) {
+                    in += 8;
+                    cur = turbo::little_endian::load64(in);
+                    shift -= 64;
+                    if (shift > 0) {
+                        v |= cur << (bw - shift);
+                    }
+                }
+                values[i] = v & mask;
+            }
+        }
+
+        template<typename U>
+        inline void PackBlock(const U *values, int bw, uint8_t *out) {
+            if constexpr (sizeof(U) == 4) {
+                Pack32(values, bw, out);
+            } else {
+                Pack64(values, bw, out);
+            }
+        }
+
+        template<typename U>
+        inline void UnpackBlock(const uint8_t *in, int bw, U *values) {
+            if constexpr (sizeof(U) == 4) {
+                Unpack32(in, bw, values);
+            } else {
+                Unpack64(in, bw, values);
+            }
+        }
+
+        // Frame of reference: each block stores its smallest value as ordered by
+        // K, its bit width and the packed differences to it
+        template<typename U, typename K>
+        uint8_t *EncodeBlocks(const U *values, int64_t count, uint8_t *out) {
+            U buffer[kIntegerBlockSize];
+            for (int64_t start = 0; start < count; start += kIntegerBlockSize) {
+                const int64_t n = std::min(kIntegerBlockSize, count - start);
+                const U *block = values + start;
+                K lo = static_cast<K>(block[0]), hi = static_cast<K>(block[0]);
+                for (int64_t i = 1; i < n; ++i) {
+                    lo = std::min(lo, static_cast<K>(block[i]));
+                    hi = std::max(hi, static_cast<K>(block[i]));
+                }
+                const auto reference = static_cast<U>(lo);
+                const int bw = BitWidth(static_cast<U>(static_cast<U>(hi) - reference));
+                for (int64_t i = 0; i < n; ++i) {
+                    buffer[i] = block[i] - reference;
+                }
+                std::fill(buffer + n, buffer + kIntegerBlockSize, 0);
+                StoreValue<U>(out, reference);
+                out[sizeof(U)] = static_cast<uint8_t>(bw);
+                out += sizeof(U) + 1;
+                PackBlock<U>(buffer, bw, out);
+                out += 16 * bw;
+            }
+            return out;
+        }
+
+        template<typename U>
+        turbo::Result<const uint8_t *> DecodeBlocks(const uint8_t *in, const uint8_t *end, int64_t count,
+                                                    U *values) {
+            U buffer[kIntegerBlockSize];
+            for (int64_t start = 0; start < count; start += kIntegerBlockSize) {
+                if (end - in < static_cast<int64_t>(sizeof(U)) + 1) {
+                    return CorruptIntegerData();
+                }
+                const U reference = LoadValue<U>(in);
+                const int bw = in[sizeof(U)];
+                in += sizeof(U) + 1;
+                if (bw > static_cast<int>(sizeof(U) * 8) || end - in < 16 * bw) {
+                    return CorruptIntegerData();
+                }
+                UnpackBlock<U>(in, bw, buffer);
+                in += 16 * bw;
+                const int64_t n = std::min(kIntegerBlockSize, count - start);
+                for (int64_t i = 0; i < n; ++i) {
+                    values[start + i] = buffer[i] + reference;
+                }
+            }
+            return in;
+        }
+
+        // ----------------------------------------------------------------------
+        // Stream VByte kernels
+        //
+        // Control bytes come first, holding the byte length - 1 of each value:
+        // 2 bits per 32 bit value, 4 bits per 64 bit value.  The little endian
+        // value bytes follow, without their leading zero bytes.
+
+        template<typename U>
+        constexpr int kVByteCodeBits = sizeof(U) == 4 ? 2 : 4;
+
+        template<typename U>
+        constexpr int64_t VByteControlSize(int64_t count) {
+            constexpr int64_t per_byte = 8 / kVByteCodeBits<U>;
+            return (count + per_byte - 1) / per_byte;
+        }
+
+        template<typename U>
+        uint8_t *VByteEncode(const U *values, int64_t count, uint8_t *out) {
+            constexpr int code_bits = kVByteCodeBits<U>;
+            uint8_t *control = out;
+            uint8_t *data = out + VByteControlSize<U>(count);
+            memset(control, 0, static_cast<size_t>(VByteControlSize<U>(count)));
+            for (int64_t i = 0; i < count; ++i) {
+                const int length = std::max(1, (BitWidth(values[i]) + 7) / 8);
+                const int64_t bit = i * code_bits;
+                control[bit / 8] |= static_cast<uint8_t>((length - 1) << (bit % 8));
+                U v = values[i];
+                for (int b = 0; b < length; ++b) {
+                    *data++ = static_cast<uint8_t>(v);
+                    v = static_cast<U>(v >> 8);
+                }
+            }
+            return data;
+        }
+
+#if defined(__SSSE3__)
+        // pshufb masks spreading the data bytes of 4 values to 4 words, for
+        // each control byte, and the number of data bytes they take
+        struct VByteShuffleTable {
+            std::array<std::array<uint8_t, 16>, 256> masks;
+            std::array<uint8_t, 256> lengths;
+
+            VByteShuffleTable() {
+                for (int c = 0; c < 256; ++c) {
+                    int offset = 0;
+                    for (int k = 0; k < 4; ++k) {
+                        const int length = ((c >> (2 * k)) & 3) + 1;
+                        for (int b = 0; b < 4; ++b) {
+                            masks[c][4 * k + b] = b < length ? static_cast<uint8_t>(offset + b) : 0x80;
+                        }
+                        offset += length;
+                    }
+                    lengths[c] = static_cast<uint8_t>(offset);
+                }
+            }
+        };
+
+        const VByteShuffleTable &GetVByteShuffleTable() {
+            static const VByteShuffleTable table;
+            return table;
+        }
+#endif
+
+        template<typename U>
+        turbo::Result<const uint8_t *> VByteDecode(const uint8_t *in, const uint8_t *end, int64_t count,
+                                                   U *values) {
+            constexpr int code_bits = kVByteCodeBits<U>;
+            const int64_t control_size = VByteControlSize<U>(count);
+            if (end - in < control_size) {
+                return CorruptIntegerData();
+            }
+            const uint8_t *control = in;
+            const uint8_t *data = in + control_size;
+            int64_t i = 0;
+#if defined(__SSSE3__)
+            if constexpr (sizeof(U) == 4) {
+                const auto &table = GetVByteShuffleTable();
+                // 4 values per control byte, as long as 16 bytes can be loaded
+                for (; i + 4 <= count && end - data >= 16; i += 4) {
+                    const uint8_t c = control[i / 4];
+                    __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data));
+                    __m128i mask = _mm_loadu_si128(reinterpret_cast<const __m128i *>(table.masks[c].data()));
+                    _mm_storeu_si128(reinterpret_cast<__m128i *>(values + i), _mm_shuffle_epi8(bytes, mask));
+                    data += table.lengths[c];
+                }
+            }
+#endif
+            for (; i < count; ++i) {
+                const int64_t bit = i * code_bits;
+                const int length = ((control[bit / 8] >> (bit % 8)) & ((1 << code_bits) - 1)) + 1;
+                if (length > static_cast<int>(sizeof(U)) || end - data < length) {
+                    return CorruptIntegerData();
+                }
+                U v = 0;
+                for (int b = 0; b < length; ++b) {
+                    v |= static_cast<U>(data[b]) << (8 * b);
+                }
+                values[i] = v;
+                data += length;
+            }
+            return data;
+        }
+
+        // ----------------------------------------------------------------------
+        // Integer codec implementation
+
+        class IntegerCodec : public Codec {
+        public:
+            IntegerCodec(CompressionType type, int value_size) : type_(type), value_size_(value_size) {}
+
+            turbo::Status Init() override {
+                if (value_size_ != 4 && value_size_ != 8) {
+                    return turbo::invalid_argument_error(
+                            turbo::str_cat("integer codecs take 4 or 8 byte values, got ", value_size_));
+                }
+                return turbo::OkStatus();
+            }
+
+            turbo::Result<int64_t> Decompress(int64_t input_len, const uint8_t *input,
+                                              int64_t output_buffer_len, uint8_t *output_buffer) override {
+                auto length = DecompressedLength(input_len, input);
+                if (!length.has_value()) {
+                    return CorruptIntegerData();
+                }
+                if (output_buffer_len < *length) {
+                    return turbo::invalid_argument_error(
+                            turbo::str_cat("Output buffer size (", output_buffer_len, ") must be ",
+                                           *length, " or larger."));
+                }
+                if (value_size_ == 4) {
+                    return DecodeValues<uint32_t>(input, input + input_len, *length, output_buffer);
+                }
+                return DecodeValues<uint64_t>(input, input + input_len, *length, output_buffer);
+            }
+
+            std::optional<int64_t> DecompressedLength(int64_t input_len, const uint8_t *input) override {
+                if (input_len < kIntegerHeaderSize || input[0] != static_cast<uint8_t>(type_) ||
+                    input[1] != value_size_) {
+                    return std::nullopt;
+                }
+                auto length = turbo::little_endian::load64(input + 2);
+                if (length > static_cast<uint64_t>(std::numeric_limits<int64_t>::max())) {
+                    return std::nullopt;
+                }
+                return static_cast<int64_t>(length);
+            }
+
+            int64_t MaxCompressedLen(int64_t input_len, const uint8_t *input) override {
+                (void) input;
+                const int64_t count = input_len / value_size_;
+                int64_t body;
+                if (type_ == CompressionType::STREAM_VBYTE) {
+                    body = (value_size_ == 4 ? VByteControlSize<uint32_t>(count) : VByteControlSize<uint64_t>(count)) +
+                           count * value_size_;
+                } else {
+                    const int64_t blocks = (count + kIntegerBlockSize - 1) / kIntegerBlockSize;
+                    body = blocks * (value_size_ + 1 + 16 * 8 * value_size_);
+                }
+                return kIntegerHeaderSize + body + input_len % value_size_;
+            }
+
+            turbo::Result<int64_t> Compress(int64_t input_len, const uint8_t *input,
+                                            int64_t output_buffer_len, uint8_t *output_buffer) override {
+                if (output_buffer_len < MaxCompressedLen(input_len, input)) {
+                    return turbo::invalid_argument_error("Output buffer too small for integer compression");
+                }
+                output_buffer[0] = static_cast<uint8_t>(type_);
+                output_buffer[1] = static_cast<uint8_t>(value_size_);
+                turbo::little_endian::store64(output_buffer + 2, static_cast<uint64_t>(input_len));
+                uint8_t *end = value_size_ == 4
+                               ? EncodeValues<uint32_t>(input, input_len, output_buffer + kIntegerHeaderSize)
+                               : EncodeValues<uint64_t>(input, input_len, output_buffer + kIntegerHeaderSize);
+                return end - output_buffer;
+            }
+
+            turbo::Result<std::shared_ptr<Compressor>> MakeCompressor() override {
+                return turbo::unimplemented_error("Streaming compression unsupported with integer codecs");
+            }
+
+            turbo::Result<std::shared_ptr<Decompressor>> MakeDecompressor() override {
+                return turbo::unimplemented_error("Streaming decompression unsupported with integer codecs");
+            }
+
+            CompressionType compression_type() const override { return type_; }
+
+            int minimum_compression_level() const override { return kUseDefaultCompressionLevel; }
+
+            int maximum_compression_level() const override { return kUseDefaultCompressionLevel; }
+
+            int default_compression_level() const override { return kUseDefaultCompressionLevel; }
+
+        private:
+            template<typename U>
+            uint8_t *EncodeValues(const uint8_t *input, int64_t input_len, uint8_t *out) {
+                using S = std::make_signed_t<U>;
+                const int64_t count = input_len / value_size_;
+                std::vector<U> values(static_cast<size_t>(count));
+                for (int64_t i = 0; i < count; ++i) {
+                    values[i] = LoadValue<U>(input + i * value_size_);
+                }
+                switch (type_) {
+                    case CompressionType::FRAME_OF_REFERENCE:
+                        out = EncodeBlocks<U, S>(values.data(), count, out);
+                        break;
+                    case CompressionType::DELTA_ZIGZAG: {
+                        U prev = 0;
+                        for (auto &v: values) {
+                            U delta = v - prev;
+                            prev = v;
+                            v = ZigZagEncode(delta);
+                        }
+                        out = EncodeBlocks<U, U>(values.data(), count, out);
+                        break;
+                    }
+                    default:
+                        out = VByteEncode<U>(values.data(), count, out);
+                        break;
+                }
+                const int64_t tail = input_len - count * value_size_;
+                if (tail > 0) {
+                    memcpy(out, input + count * value_size_, static_cast<size_t>(tail));
+                }
+                return out + tail;
+            }
+
+            template<typename U>
+            turbo::Result<int64_t> DecodeValues(const uint8_t *in, const uint8_t *end, int64_t length,
+                                                uint8_t *output) {
+                const int64_t count = length / value_size_;
+                // reject lengths the input can't hold before allocating for them
+                if (count / kIntegerBlockSize > end - in) {
+                    return CorruptIntegerData();
+                }
+                in += kIntegerHeaderSize;
+                std::vector<U> values(static_cast<size_t>(count));
+                if (type_ == CompressionType::STREAM_VBYTE) {
+                    RESULT_ASSIGN_OR_RETURN(in, VByteDecode<U>(in, end, count, values.data()));
+                } else {
+                    RESULT_ASSIGN_OR_RETURN(in, DecodeBlocks<U>(in, end, count, values.data()));
+                }
+                if (type_ == CompressionType::DELTA_ZIGZAG) {
+                    U prev = 0;
+                    for (auto &v: values) {
+                        prev = static_cast<U>(prev + ZigZagDecode(v));
+                        v = prev;
+                    }
+                }
+                for (int64_t i = 0; i < count; ++i) {
+                    StoreValue<U>(output + i * value_size_, values[i]);
+                }
+                const int64_t tail = length - count * value_size_;
+                if (end - in != tail) {
+                    return CorruptIntegerData();
+                }
+                if (tail > 0) {
+                    memcpy(output + count * value_size_, in, static_cast<size_t>(tail));
+                }
+                return length;
+            }
+
+            const CompressionType type_;
+            const int value_size_;
+        };
+
+    }  // namespace
+
+    std::unique_ptr<Codec> MakeIntegerCodec(CompressionType type, int value_size) {
+        return std::make_unique<IntegerCodec>(type, value_size);
+    }
+
+}  // namespace alkaid::internal
@@ -35,14 +35,17 @@ namespace alkaid::internal {
     // BZ2 codec.
     constexpr int kBZ2DefaultCompressionLevel = 9;
 
-    std::unique_ptr<Codec> MakeBZ2Codec(int compression_level = kBZ2DefaultCompressionLevel);
+    std::unique_ptr<Codec> MakeBZ2Codec(int compression_level = kBZ2DefaultCompressionLevel,
+                                        int decompression_threads = 1);
 
     // GZip
     constexpr int kGZipDefaultCompressionLevel = 9;
 
     std::unique_ptr<Codec> MakeGZipCodec(int compression_level = kGZipDefaultCompressionLevel,
                                          GZipFormat format = GZipFormat::GZIP,
-                                         std::optional<int> window_bits = std::nullopt);
+                                         std::optional<int> window_bits = std::nullopt,
+                                         int compression_threads = 1,
+                                         int64_t block_size = 128 * 1024);
 
     // Snappy
     std::unique_ptr<Codec> MakeSnappyCodec();
@@ -53,14 +56,26 @@ namespace alkaid::internal {
     // Lz4 frame format codec.
 
     std::unique_ptr<Codec> MakeLz4FrameCodec(
-            int compression_level = kLz4DefaultCompressionLevel);
+            int compression_level = kLz4DefaultCompressionLevel,
+            const Lz4CodecOptions &options = Lz4CodecOptions{});
 
     // Lz4 "raw" format codec.
     std::unique_ptr<Codec> MakeLz4RawCodec(
             int compression_level = kLz4DefaultCompressionLevel);
 
     // Lz4 "Hadoop" format codec (== Lz4 raw codec prefixed with lengths header)
-    std::unique_ptr<Codec> MakeLz4HadoopRawCodec();
+    std::unique_ptr<Codec> MakeLz4HadoopRawCodec(
+            int compression_level = kLz4DefaultCompressionLevel);
+
+    // LZO codec (Hadoop LzoCodec framing one-shot, lzop container streaming)
+    constexpr int kLzoDefaultCompressionLevel = 3;
+
+    std::unique_ptr<Codec> MakeLzoCodec(int compression_level = kLzoDefaultCompressionLevel);
+
+    // Total decompressed size of Hadoop framed data (a sequence of big-endian
+    // decompressed size, compressed size and payload), std::nullopt when the
+    // input doesn't split into such frames.
+    std::optional<int64_t> HadoopFramedLength(int64_t input_len, const uint8_t *input);
 
     // ZSTD codec.
 
@@ -68,6 +83,10 @@ namespace alkaid::internal {
     constexpr int kZSTDDefaultCompressionLevel = 1;
 
     std::unique_ptr<Codec> MakeZSTDCodec(
-            int compression_level = kZSTDDefaultCompressionLevel);
+            int compression_level = kZSTDDefaultCompressionLevel,
+            const ZstdCodecOptions &options = ZstdCodecOptions{});
+
+    // Frame of reference, delta zigzag and Stream VByte integer codecs.
+    std::unique_ptr<Codec> MakeIntegerCodec(CompressionType type, int value_size = 4);
 
 }  // namespace alkaid::internal
@@ -26,7 +26,10 @@
 #include <turbo/base/endian.h>
 #include <cstdint>
 #include <cstring>
+#include <limits>
 #include <memory>
+#include <optional>
+#include <vector>
 
 #include <lz4.h>
 #include <lz4frame.h>
@@ -42,6 +45,7 @@ namespace alkaid::internal {
     namespace {
 
         constexpr int kLz4MinCompressionLevel = 1;
+        constexpr uint32_t kLz4FrameMagic = 0x184D2204;
 
         static turbo::Status LZ4Error(LZ4F_errorCode_t ret, const char *prefix_msg) {
             return turbo::unavailable_error(turbo::str_cat(prefix_msg, LZ4F_getErrorName(ret)));
@@ -59,6 +63,43 @@ namespace alkaid::internal {
             return prefs;
         }
 
+        static turbo::Result<LZ4F_blockSizeID_t> Lz4BlockSizeId(int64_t block_size) {
+            switch (block_size) {
+                case 0:
+                    return LZ4F_default;
+                case 64 << 10:
+                    return LZ4F_max64KB;
+                case 256 << 10:
+                    return LZ4F_max256KB;
+                case 1 << 20:
+                    return LZ4F_max1MB;
+                case 4 << 20:
+                    return LZ4F_max4MB;
+                default:
+                    return turbo::invalid_argument_error(
+                            turbo::str_cat("Lz4 frame block size must be 64KB, 256KB, 1MB or 4MB, got ",
+                                           block_size));
+            }
+        }
+
+        static turbo::Result<LZ4F_preferences_t> PreferencesWithOptions(int compression_level,
+                                                                        const Lz4CodecOptions &options) {
+            LZ4F_preferences_t prefs = PreferencesWithCompressionLevel(compression_level);
+            RESULT_ASSIGN_OR_RETURN(prefs.frameInfo.blockSizeID, Lz4BlockSizeId(options.block_size));
+            prefs.frameInfo.blockMode = options.linked_blocks ? LZ4F_blockLinked : LZ4F_blockIndependent;
+            prefs.frameInfo.contentChecksumFlag =
+                    options.content_checksum ? LZ4F_contentChecksumEnabled : LZ4F_noContentChecksum;
+#if (defined(LZ4_VERSION_NUMBER) && LZ4_VERSION_NUMBER < 10802)
+            if (options.block_checksum || options.favor_decompression_speed) {
+                return turbo::unimplemented_error("Lz4 block checksums and favor_decompression_speed need lz4 1.8.2");
+            }
+#else
+            prefs.frameInfo.blockChecksumFlag = options.block_checksum ? LZ4F_blockChecksumEnabled : LZ4F_noBlockChecksum;
+            prefs.favorDecSpeed = options.favor_decompression_speed ? 1 : 0;
+#endif
+            return prefs;
+        }
+
 // ----------------------------------------------------------------------
 // Lz4 frame decompressor implementation
 
@@ -131,7 +172,7 @@ namespace alkaid::internal {
 
         class LZ4Compressor : public Compressor {
         public:
-            explicit LZ4Compressor(int compression_level) : compression_level_(compression_level) {}
+            explicit LZ4Compressor(const LZ4F_preferences_t &prefs) : prefs_(prefs) {}
 
             ~LZ4Compressor() override {
                 if (ctx_ != nullptr) {
@@ -141,7 +182,6 @@ namespace alkaid::internal {
 
             turbo::Status Init() {
                 LZ4F_errorCode_t ret;
-                prefs_ = PreferencesWithCompressionLevel(compression_level_);
                 first_time_ = true;
 
                 ret = LZ4F_createCompressionContext(&ctx_, LZ4F_VERSION);
@@ -240,9 +280,8 @@ namespace alkaid::internal {
 #undef BEGIN_COMPRESS
 
         protected:
-            int compression_level_;
             LZ4F_compressionContext_t ctx_ = nullptr;
-            LZ4F_preferences_t prefs_;
+            const LZ4F_preferences_t prefs_;
             bool first_time_;
         };
 
@@ -251,12 +290,18 @@ namespace alkaid::internal {
 
         class Lz4FrameCodec : public Codec {
         public:
-            explicit Lz4FrameCodec(int compression_level)
+            Lz4FrameCodec(int compression_level, const Lz4CodecOptions &options)
                     : compression_level_(compression_level == kUseDefaultCompressionLevel
                                          ? kLz4DefaultCompressionLevel
                                          : compression_level),
+                      options_(options),
                       prefs_(PreferencesWithCompressionLevel(compression_level_)) {}
 
+            turbo::Status Init() override {
+                RESULT_ASSIGN_OR_RETURN(prefs_, PreferencesWithOptions(compression_level_, options_));
+                return turbo::OkStatus();
+            }
+
             int64_t MaxCompressedLen(int64_t input_len,
                                      const uint8_t *input) override {
                 (void) input;
@@ -266,9 +311,12 @@ namespace alkaid::internal {
 
             turbo::Result<int64_t> Compress(int64_t input_len, const uint8_t *input,
                                             int64_t output_buffer_len, uint8_t *output_buffer) override {
+                // Record the content size, so DecompressedLength() can size the output
+                LZ4F_preferences_t prefs = prefs_;
+                prefs.frameInfo.contentSize = static_cast<unsigned long long>(input_len);
                 auto output_len =
                         LZ4F_compressFrame(output_buffer, static_cast<size_t>(output_buffer_len), input,
-                                           static_cast<size_t>(input_len), &prefs_);
+                                           static_cast<size_t>(input_len), &prefs);
                 if (LZ4F_isError(output_len)) {
                     return LZ4Error(output_len, "Lz4 compression failure: ");
                 }
@@ -302,8 +350,31 @@ namespace alkaid::internal {
                 return total_bytes_written;
             }
 
+            std::optional<int64_t> DecompressedLength(int64_t input_len, const uint8_t *input) override {
+                // Frame descriptor: magic, FLG, BD, then the optional 8 byte content size
+                constexpr int64_t kContentSizeOffset = 6;
+                constexpr uint8_t kContentSizeFlag = 0x08;
+                if (input_len < kContentSizeOffset + 8 ||
+                    turbo::little_endian::load32(input) != kLz4FrameMagic ||
+                    (input[4] & kContentSizeFlag) == 0) {
+                    return std::nullopt;
+                }
+                uint64_t content_size = turbo::little_endian::load64(input + kContentSizeOffset);
+                if (content_size > static_cast<uint64_t>(std::numeric_limits<int64_t>::max())) {
+                    return std::nullopt;
+                }
+                return static_cast<int64_t>(content_size);
+            }
+
+            turbo::Result<std::vector<uint8_t>> Decompress(int64_t input_len, const uint8_t *input) override {
+                if (DecompressedLength(input_len, input).has_value()) {
+                    return Codec::Decompress(input_len, input);
+                }
+                return DecompressGrowing(input_len, input, input_len * 4);
+            }
+
             turbo::Result<std::shared_ptr<Compressor>> MakeCompressor() override {
-                auto ptr = std::make_shared<LZ4Compressor>(compression_level_);
+                auto ptr = std::make_shared<LZ4Compressor>(prefs_);
                 STATUS_RETURN_IF_ERROR(ptr->Init());
                 return ptr;
             }
@@ -332,7 +403,8 @@ namespace alkaid::internal {
 
         protected:
             const int compression_level_;
-            const LZ4F_preferences_t prefs_;
+            const Lz4CodecOptions options_;
+            LZ4F_preferences_t prefs_;
         };
 
 // ----------------------------------------------------------------------
@@ -412,6 +484,8 @@ namespace alkaid::internal {
 
             int default_compression_level() const override { return kLz4DefaultCompressionLevel; }
 
+            int compression_level() const override { return compression_level_; }
+
         protected:
             int compression_level_;
         };
@@ -421,7 +495,7 @@ namespace alkaid::internal {
 
         class Lz4HadoopCodec : public Lz4Codec {
         public:
-            Lz4HadoopCodec() : Lz4Codec(kUseDefaultCompressionLevel) {}
+            explicit Lz4HadoopCodec(int compression_level) : Lz4Codec(compression_level) {}
 
             turbo::Result<int64_t> Decompress(int64_t input_len, const uint8_t *input,
                                               int64_t output_buffer_len, uint8_t *output_buffer) override {
@@ -434,6 +508,10 @@ namespace alkaid::internal {
                 return Lz4Codec::Decompress(input_len, input, output_buffer_len, output_buffer);
             }
 
+            std::optional<int64_t> DecompressedLength(int64_t input_len, const uint8_t *input) override {
+                return HadoopFramedLength(input_len, input);
+            }
+
             int64_t MaxCompressedLen(int64_t input_len,
                                      const uint8_t *input) override {
                 (void) input;
@@ -528,22 +606,16 @@ namespace alkaid::internal {
                     return kNotHadoop;
                 }
             }
-
-            int minimum_compression_level() const override { return kUseDefaultCompressionLevel; }
-
-            int maximum_compression_level() const override { return kUseDefaultCompressionLevel; }
-
-            int default_compression_level() const override { return kUseDefaultCompressionLevel; }
         };
 
     }  // namespace
 
-    std::unique_ptr<Codec> MakeLz4FrameCodec(int compression_level) {
-        return std::make_unique<Lz4FrameCodec>(compression_level);
+    std::unique_ptr<Codec> MakeLz4FrameCodec(int compression_level, const Lz4CodecOptions &options) {
+        return std::make_unique<Lz4FrameCodec>(compression_level, options);
     }
 
-    std::unique_ptr<Codec> MakeLz4HadoopRawCodec() {
-        return std::make_unique<Lz4HadoopCodec>();
+    std::unique_ptr<Codec> MakeLz4HadoopRawCodec(int compression_level) {
+        return std::make_unique<Lz4HadoopCodec>(compression_level);
     }
 
     std::unique_ptr<Codec> MakeLz4RawCodec(int compression_level) {
@@ -0,0 +1,712 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <alkaid/version.h>
+
+#if defined(ENABLE_LZO)
+
+#include <alkaid/compress/compression_internal.h>
+#include <turbo/utility/status.h>
+#include <turbo/log/logging.h>
+#include <turbo/base/endian.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <vector>
+#include <lzo/lzo1x.h>
+
+namespace alkaid::internal {
+
+    namespace {
+
+        constexpr int kLzoMinCompressionLevel = 1;
+        constexpr int kLzoMaxCompressionLevel = 9;
+        // Like lzop, levels 1-6 use LZO1X-1 and levels 7-9 use LZO1X-999
+        constexpr int kLzo999MinCompressionLevel = 7;
+
+        // Both Hadoop LzoCodec and lzop cut their input into 256KB blocks
+        constexpr size_t kLzoBlockSize = 256 * 1024;
+        // lzop refuses to read blocks larger than this
+        constexpr size_t kLzoMaxBlockSize = 64 * 1024 * 1024;
+
+        // Worst case LZO1X expansion of n bytes
+        inline size_t LzoCompressBound(size_t n) { return n + n / 16 + 64 + 3; }
+
+        inline lzo_bytep LzoBytes(const uint8_t *p) { return const_cast<lzo_bytep>(p); }
+
+        turbo::Status LzoError(const char *prefix_msg, int lzo_result) {
+            return turbo::unavailable_error(turbo::str_cat(prefix_msg, "lzo error ", lzo_result));
+        }
+
+        // LZO1X block compressor owning the work memory the compress functions need.
+        class LzoBlockCompressor {
+        public:
+            explicit LzoBlockCompressor(int compression_level)
+                    : compression_level_(compression_level) {
+                size_t wrkmem_size = compression_level_ >= kLzo999MinCompressionLevel
+                                     ? LZO1X_999_MEM_COMPRESS : LZO1X_1_MEM_COMPRESS;
+                wrkmem_.resize((wrkmem_size + sizeof(lzo_align_t) - 1) / sizeof(lzo_align_t));
+            }
+
+            // output must hold LzoCompressBound(input_len) bytes
+            turbo::Result<size_t> Compress(const uint8_t *input, size_t input_len, uint8_t *output) {
+                lzo_uint output_len = 0;
+                int ret;
+                if (compression_level_ >= kLzo999MinCompressionLevel) {
+                    ret = lzo1x_999_compress_level(LzoBytes(input), input_len, output, &output_len,
+                                                   wrkmem_.data(), nullptr, 0, nullptr, compression_level_);
+                } else {
+                    ret = lzo1x_1_compress(LzoBytes(input), input_len, output, &output_len, wrkmem_.data());
+                }
+                if (ret != LZO_E_OK) {
+                    return LzoError("LZO compression failed: ", ret);
+                }
+                return static_cast<size_t>(output_len);
+            }
+
+        private:
+            int compression_level_;
+            std::vector<lzo_align_t> wrkmem_;
+        };
+
+        // Decompress one LZO1X block into at most output_len bytes, returns the decompressed size.
+        turbo::Result<size_t> LzoDecompressBlock(const uint8_t *input, size_t input_len,
+                                                 uint8_t *output, size_t output_len) {
+            lzo_uint decompressed_len = output_len;
+            int ret = lzo1x_decompress_safe(LzoBytes(input), input_len, output, &decompressed_len, nullptr);
+            if (ret != LZO_E_OK) {
+                return LzoError("Corrupt LZO compressed data: ", ret);
+            }
+            return static_cast<size_t>(decompressed_len);
+        }
+
+        // ----------------------------------------------------------------------
+        // lzop container format constants
+        //
+        // An lzop file is a magic, a header describing the method and checksums,
+        // then blocks of big-endian (uncompressed size, compressed size,
+        // checksums, data) terminated by an uncompressed size of zero.  A block
+        // whose compressed size equals its uncompressed size is stored as is.
+        // Hadoop's LzopCodec reads and writes the same format.
+
+        constexpr uint8_t kLzopMagic[] = {0x89, 'L', 'Z', 'O', 0x00, 0x0d, 0x0a, 0x1a, 0x0a};
+        constexpr size_t kLzopMagicSize = sizeof(kLzopMagic);
+
+        constexpr uint16_t kLzopVersion = 0x1030;
+        constexpr uint16_t kLzopMinVersion = 0x0900;
+        // Versions from this one on carry the version-needed, level and mtime-high fields
+        constexpr uint16_t kLzopVersionNeededToExtract = 0x0940;
+
+        constexpr uint8_t kLzopMethodLzo1x1 = 1;
+        constexpr uint8_t kLzopMethodLzo1x1_15 = 2;
+        constexpr uint8_t kLzopMethodLzo1x999 = 3;
+
+        constexpr uint32_t kLzopFlagAdler32D = 0x0001;
+        constexpr uint32_t kLzopFlagAdler32C = 0x0002;
+        constexpr uint32_t kLzopFlagExtraField = 0x0040;
+        constexpr uint32_t kLzopFlagCrc32D = 0x0100;
+        constexpr uint32_t kLzopFlagCrc32C = 0x0200;
+        constexpr uint32_t kLzopFlagFilter = 0x0800;
+        constexpr uint32_t kLzopFlagHeaderCrc32 = 0x1000;
+
+        constexpr size_t kLzopHeaderSize = 25;
+        constexpr size_t kLzopBlockHeaderMaxSize = 4 * 6;
+
+        inline uint32_t LzopAdler32(const uint8_t *data, size_t n) {
+            return lzo_adler32(1, LzoBytes(data), n);
+        }
+
+        inline uint32_t LzopCrc32(const uint8_t *data, size_t n) {
+            return lzo_crc32(0, LzoBytes(data), n);
+        }
+
+        inline size_t LzopChecksumCount(uint32_t flags, uint32_t adler_flag, uint32_t crc_flag) {
+            return ((flags & adler_flag) ? 1 : 0) + ((flags & crc_flag) ? 1 : 0);
+        }
+
+// ----------------------------------------------------------------------
+// lzop decompressor implementation
+
+        class LzopDecompressor : public Decompressor {
+        public:
+            LzopDecompressor() = default;
+
+            turbo::Status Init() { return Reset(); }
+
+            turbo::Status Reset() override {
+                state_ = State::kMagic;
+                partial_.clear();
+                needed_ = kLzopMagicSize;
+                flags_ = 0;
+                pending_pos_ = 0;
+                pending_size_ = 0;
+                finished_ = false;
+                return turbo::OkStatus();
+            }
+
+            turbo::Result<DecompressResult> Decompress(int64_t input_len, const uint8_t *input,
+                                                       int64_t output_len, uint8_t *output) override {
+                int64_t bytes_read = 0;
+                int64_t bytes_written = 0;
+                while (true) {
+                    bytes_written += DrainPending(output + bytes_written, output_len - bytes_written);
+                    if (pending_pos_ < pending_size_ || bytes_read == input_len) {
+                        break;
+                    }
+                    const uint8_t *src = input + bytes_read;
+                    auto avail = static_cast<size_t>(input_len - bytes_read);
+
+                    if (state_ == State::kBlockData && partial_.empty() && avail >= needed_) {
+                        // Fast path: the whole block is available, decode in place
+                        STATUS_RETURN_IF_ERROR(ProcessBlock(src));
+                        bytes_read += static_cast<int64_t>(block_compressed_);
+                        continue;
+                    }
+                    if (state_ == State::kMagic) {
+                        // a further stream follows, as in concatenated .lzo files
+                        finished_ = false;
+                    }
+                    auto n = std::min(avail, needed_ - partial_.size());
+                    partial_.insert(partial_.end(), src, src + n);
+                    bytes_read += static_cast<int64_t>(n);
+                    if (partial_.size() == needed_) {
+                        STATUS_RETURN_IF_ERROR(ParseStage());
+                    }
+                }
+                return DecompressResult{bytes_read, bytes_written, pending_pos_ < pending_size_};
+            }
+
+            bool IsFinished() override {
+                return finished_ && partial_.empty() && pending_pos_ == pending_size_;
+            }
+
+        private:
+            enum class State {
+                kMagic,
+                kHeader,
+                kBlockHeader,
+                kBlockData,
+            };
+
+            int64_t DrainPending(uint8_t *output, int64_t output_len) {
+                auto n = std::min(static_cast<size_t>(output_len), pending_size_ - pending_pos_);
+                if (n > 0) {
+                    std::memcpy(output, block_.data() + pending_pos_, n);
+                    pending_pos_ += n;
+                }
+                return static_cast<int64_t>(n);
+            }
+
+            void NextStage(State state, size_t needed) {
+                state_ = state;
+                needed_ = needed;
+                partial_.clear();
+            }
+
+            // Called once partial_ holds needed_ bytes: either completes the
+            // current stage or raises needed_.
+            turbo::Status ParseStage() {
+                switch (state_) {
+                    case State::kMagic:
+                        if (std::memcmp(partial_.data(), kLzopMagic, kLzopMagicSize) != 0) {
+                            return turbo::unavailable_error("Corrupt lzop data: bad magic");
+                        }
+                        NextStage(State::kHeader, 4);
+                        return turbo::OkStatus();
+                    case State::kHeader: {
+                        RESULT_ASSIGN_OR_RETURN(auto needed, ParseHeader());
+                        if (needed > partial_.size()) {
+                            needed_ = needed;
+                        } else {
+                            NextStage(State::kBlockHeader, 4);
+                        }
+                        return turbo::OkStatus();
+                    }
+                    case State::kBlockHeader:
+                        return ParseBlockHeader();
+                    case State::kBlockData:
+                        return ProcessBlock(partial_.data());
+                }
+                return turbo::OkStatus();
+            }
+
+            // Returns the full header size, which is larger than partial_ while
+            // the header is incomplete.
+            turbo::Result<size_t> ParseHeader() {
+                const uint8_t *p = partial_.data();
+                const size_t size = partial_.size();
+                size_t pos = 0;
+
+                const uint16_t version = turbo::big_endian::load16(p);
+                pos += 4;  // version, library version
+                if (version < kLzopMinVersion) {
+                    return turbo::unavailable_error("Corrupt lzop data: unsupported version");
+                }
+                const bool has_extended_fields = version >= kLzopVersionNeededToExtract;
+                // version needed (2), method (1), level (1), flags (4)
+                const size_t flags_pos = pos + (has_extended_fields ? 4 : 1);
+                if (size < flags_pos + 4) {
+                    return flags_pos + 4;
+                }
+                if (has_extended_fields && turbo::big_endian::load16(p + pos) > kLzopVersion) {
+                    return turbo::unavailable_error("Corrupt lzop data: needs a newer lzop to extract");
+                }
+                const uint8_t method = p[has_extended_fields ? pos + 2 : pos];
+                if (method != kLzopMethodLzo1x1 && method != kLzopMethodLzo1x1_15 &&
+                    method != kLzopMethodLzo1x999) {
+                    return turbo::unimplemented_error(
+                            turbo::str_cat("lzop compression method ", static_cast<int>(method), " not supported"));
+                }
+                flags_ = turbo::big_endian::load32(p + flags_pos);
+                if (flags_ & kLzopFlagFilter) {
+                    return turbo::unimplemented_error("lzop filters not supported");
+                }
+                // mode (4), mtime low (4), mtime high (4), name length (1)
+                const size_t name_len_pos = flags_pos + 4 + (has_extended_fields ? 12 : 8);
+                if (size < name_len_pos + 1) {
+                    return name_len_pos + 1;
+                }
+                const size_t checksum_pos = name_len_pos + 1 + p[name_len_pos];
+                if (size < checksum_pos + 4) {
+                    return checksum_pos + 4;
+                }
+                const bool header_crc32 = flags_ & kLzopFlagHeaderCrc32;
+                auto checksum = [&](const uint8_t *data, size_t n) {
+                    return header_crc32 ? LzopCrc32(data, n) : LzopAdler32(data, n);
+                };
+                if (checksum(p, checksum_pos) != turbo::big_endian::load32(p + checksum_pos)) {
+                    return turbo::unavailable_error("Corrupt lzop data: header checksum mismatch");
+                }
+                pos = checksum_pos + 4;
+                if (flags_ & kLzopFlagExtraField) {
+                    if (size < pos + 4) {
+                        return pos + 4;
+                    }
+                    const size_t extra_len = turbo::big_endian::load32(p + pos);
+                    if (size < pos + 4 + extra_len + 4) {
+                        return pos + 4 + extra_len + 4;
+                    }
+                    if (checksum(p + pos, 4 + extra_len) != turbo::big_endian::load32(p + pos + 4 + extra_len)) {
+                        return turbo::unavailable_error("Corrupt lzop data: extra field checksum mismatch");
+                    }
+                    pos += 4 + extra_len + 4;
+                }
+                return pos;
+            }
+
+            turbo::Status ParseBlockHeader() {
+                const uint8_t *p = partial_.data();
+                block_uncompressed_ = turbo::big_endian::load32(p);
+                if (block_uncompressed_ == 0) {
+                    // end of stream marker
+                    finished_ = true;
+                    NextStage(State::kMagic, kLzopMagicSize);
+                    return turbo::OkStatus();
+                }
+                if (block_uncompressed_ > kLzoMaxBlockSize) {
+                    return turbo::unavailable_error("Corrupt lzop data: block too large");
+                }
+                if (partial_.size() < 8) {
+                    needed_ = 8;
+                    return turbo::OkStatus();
+                }
+                block_compressed_ = turbo::big_endian::load32(p + 4);
+                if (block_compressed_ == 0 || block_compressed_ > block_uncompressed_) {
+                    return turbo::unavailable_error("Corrupt lzop data: bad block length");
+                }
+                const bool compressed = block_compressed_ < block_uncompressed_;
+                const size_t header_size =
+                        8 + 4 * LzopChecksumCount(flags_, kLzopFlagAdler32D, kLzopFlagCrc32D) +
+                        (compressed ? 4 * LzopChecksumCount(flags_, kLzopFlagAdler32C, kLzopFlagCrc32C) : 0);
+                if (partial_.size() < header_size) {
+                    needed_ = header_size;
+                    return turbo::OkStatus();
+                }
+                // Checksums come in the order adler32 (D), crc32 (D), adler32 (C), crc32 (C)
+                size_t pos = 8;
+                auto read_checksum = [&](uint32_t flag) -> uint32_t {
+                    if (!(flags_ & flag)) {
+                        return 0;
+                    }
+                    uint32_t value = turbo::big_endian::load32(p + pos);
+                    pos += 4;
+                    return value;
+                };
+                adler32_d_ = read_checksum(kLzopFlagAdler32D);
+                crc32_d_ = read_checksum(kLzopFlagCrc32D);
+                adler32_c_ = compressed ? read_checksum(kLzopFlagAdler32C) : 0;
+                crc32_c_ = compressed ? read_checksum(kLzopFlagCrc32C) : 0;
+                NextStage(State::kBlockData, block_compressed_);
+                return turbo::OkStatus();
+            }
+
+            turbo::Status ProcessBlock(const uint8_t *data) {
+                const bool compressed = block_compressed_ < block_uncompressed_;
+                if (compressed) {
+                    if (((flags_ & kLzopFlagAdler32C) && LzopAdler32(data, block_compressed_) != adler32_c_) ||
+                        ((flags_ & kLzopFlagCrc32C) && LzopCrc32(data, block_compressed_) != crc32_c_)) {
+                        return turbo::unavailable_error("Corrupt lzop data: compressed checksum mismatch");
+                    }
+                }
+                if (block_.size() < block_uncompressed_) {
+                    block_.resize(block_uncompressed_);
+                }
+                if (compressed) {
+                    RESULT_ASSIGN_OR_RETURN(auto decompressed_size,
+                                            LzoDecompressBlock(data, block_compressed_, block_.data(),
+                                                               block_uncompressed_));
+                    if (decompressed_size != block_uncompressed_) {
+                        return turbo::unavailable_error("Corrupt lzop data: bad block length");
+                    }
+                } else {
+                    std::memcpy(block_.data(), data, block_uncompressed_);
+                }
+                if (((flags_ & kLzopFlagAdler32D) && LzopAdler32(block_.data(), block_uncompressed_) != adler32_d_) ||
+                    ((flags_ & kLzopFlagCrc32D) && LzopCrc32(block_.data(), block_uncompressed_) != crc32_d_)) {
+                    return turbo::unavailable_error("Corrupt lzop data: checksum mismatch");
+                }
+                pending_pos_ = 0;
+                pending_size_ = block_uncompressed_;
+                NextStage(State::kBlockHeader, 4);
+                return turbo::OkStatus();
+            }
+
+            State state_ = State::kMagic;
+            // Bytes of the current stage, only used when it straddles input buffers
+            std::vector<uint8_t> partial_;
+            // Bytes the current stage needs in partial_ before it can be parsed
+            size_t needed_ = kLzopMagicSize;
+            uint32_t flags_ = 0;
+            size_t block_uncompressed_ = 0;
+            size_t block_compressed_ = 0;
+            uint32_t adler32_d_ = 0;
+            uint32_t crc32_d_ = 0;
+            uint32_t adler32_c_ = 0;
+            uint32_t crc32_c_ = 0;
+            // Decoded block waiting to be copied out
+            std::vector<uint8_t> block_;
+            size_t pending_pos_ = 0;
+            size_t pending_size_ = 0;
+            bool finished_ = false;
+        };
+
+// ----------------------------------------------------------------------
+// lzop compressor implementation
+
+        class LzopCompressor : public Compressor {
+        public:
+            explicit LzopCompressor(int compression_level)
+                    : compression_level_(compression_level), block_compressor_(compression_level) {}
+
+            turbo::Status Init() {
+                block_.reserve(kLzoBlockSize);
+                pending_.resize(kLzopMagicSize + kLzopHeaderSize + 4 + kLzopBlockHeaderMaxSize +
+                                LzoCompressBound(kLzoBlockSize) + 4);
+                pending_pos_ = 0;
+                pending_size_ = 0;
+                stream_started_ = false;
+                ending_ = false;
+                return turbo::OkStatus();
+            }
+
+            turbo::Result<CompressResult> Compress(int64_t input_len, const uint8_t *input,
+                                                   int64_t output_len, uint8_t *output) override {
+                int64_t bytes_read = 0;
+                int64_t bytes_written = 0;
+                while (true) {
+                    bytes_written += DrainPending(output + bytes_written, output_len - bytes_written);
+                    if (pending_pos_ < pending_size_ || bytes_read == input_len) {
+                        break;
+                    }
+                    auto n = std::min(static_cast<size_t>(input_len - bytes_read), kLzoBlockSize - block_.size());
+                    block_.insert(block_.end(), input + bytes_read, input + bytes_read + n);
+                    bytes_read += static_cast<int64_t>(n);
+                    if (block_.size() == kLzoBlockSize) {
+                        STATUS_RETURN_IF_ERROR(EmitBlock(false));
+                    }
+                }
+                return CompressResult{bytes_read, bytes_written};
+            }
+
+            turbo::Result<FlushResult> Flush(int64_t output_len, uint8_t *output) override {
+                int64_t bytes_written = DrainPending(output, output_len);
+                if (pending_pos_ == pending_size_ && (!block_.empty() || !stream_started_)) {
+                    STATUS_RETURN_IF_ERROR(EmitBlock(false));
+                    bytes_written += DrainPending(output + bytes_written, output_len - bytes_written);
+                }
+                return FlushResult{bytes_written, pending_pos_ < pending_size_};
+            }
+
+            turbo::Result<EndResult> End(int64_t output_len, uint8_t *output) override {
+                int64_t bytes_written = DrainPending(output, output_len);
+                if (!ending_ && pending_pos_ == pending_size_) {
+                    STATUS_RETURN_IF_ERROR(EmitBlock(true));
+                    ending_ = true;
+                    bytes_written += DrainPending(output + bytes_written, output_len - bytes_written);
+                }
+                const bool should_retry = pending_pos_ < pending_size_;
+                if (!should_retry) {
+                    // further input starts a new lzop stream
+                    ending_ = false;
+                }
+                return EndResult{bytes_written, should_retry};
+            }
+
+        private:
+            int64_t DrainPending(uint8_t *output, int64_t output_len) {
+                auto n = std::min(static_cast<size_t>(output_len), pending_size_ - pending_pos_);
+                if (n > 0) {
+                    std::memcpy(output, pending_.data() + pending_pos_, n);
+                    pending_pos_ += n;
+                }
+                return static_cast<int64_t>(n);
+            }
+
+            uint8_t *StoreHeader(uint8_t *out) {
+                std::memcpy(out, kLzopMagic, kLzopMagicSize);
+                uint8_t *header = out + kLzopMagicSize;
+                turbo::big_endian::store16(header, kLzopVersion);
+                turbo::big_endian::store16(header + 2, static_cast<uint16_t>(lzo_version() & 0xffff));
+                turbo::big_endian::store16(header + 4, kLzopVersionNeededToExtract);
+                header[6] = compression_level_ >= kLzo999MinCompressionLevel ? kLzopMethodLzo1x999
+                                                                             : kLzopMethodLzo1x1;
+                header[7] = static_cast<uint8_t>(compression_level_);
+                turbo::big_endian::store32(header + 8, kLzopFlagAdler32D | kLzopFlagAdler32C);
+                turbo::big_endian::store32(header + 12, 0);  // mode
+                turbo::big_endian::store32(header + 16, 0);  // mtime low
+                turbo::big_endian::store32(header + 20, 0);  // mtime high
+                header[24] = 0;                              // no file name
+                turbo::big_endian::store32(header + kLzopHeaderSize, LzopAdler32(header, kLzopHeaderSize));
+                return header + kLzopHeaderSize + 4;
+            }
+
+            // Frame the buffered block (and the header on first use, the end of
+            // stream marker if asked) into pending_.  Must only be called once
+            // pending_ has been drained.
+            turbo::Status EmitBlock(bool end_of_stream) {
+                uint8_t *out = pending_.data();
+                if (!stream_started_) {
+                    out = StoreHeader(out);
+                    stream_started_ = true;
+                }
+                if (!block_.empty()) {
+                    const size_t block_size = block_.size();
+                    turbo::big_endian::store32(out, static_cast<uint32_t>(block_size));
+                    turbo::big_endian::store32(out + 8, LzopAdler32(block_.data(), block_size));
+                    uint8_t *body = out + 16;
+                    RESULT_ASSIGN_OR_RETURN(auto compressed_size,
+                                            block_compressor_.Compress(block_.data(), block_size, body));
+                    if (compressed_size < block_size) {
+                        turbo::big_endian::store32(out + 4, static_cast<uint32_t>(compressed_size));
+                        turbo::big_endian::store32(out + 12, LzopAdler32(body, compressed_size));
+                        out = body + compressed_size;
+                    } else {
+                        // Incompressible: store the block, without the compressed checksum
+                        turbo::big_endian::store32(out + 4, static_cast<uint32_t>(block_size));
+                        std::memcpy(out + 12, block_.data(), block_size);
+                        out += 12 + block_size;
+                    }
+                    block_.clear();
+                }
+                if (end_of_stream) {
+                    turbo::big_endian::store32(out, 0);
+                    out += 4;
+                    stream_started_ = false;
+                }
+                pending_pos_ = 0;
+                pending_size_ = static_cast<size_t>(out - pending_.data());
+                return turbo::OkStatus();
+            }
+
+            int compression_level_;
+            LzoBlockCompressor block_compressor_;
+            // Uncompressed bytes waiting to fill a block
+            std::vector<uint8_t> block_;
+            // Framed bytes waiting to be copied out
+            std::vector<uint8_t> pending_;
+            size_t pending_pos_ = 0;
+            size_t pending_size_ = 0;
+            bool stream_started_ = false;
+            bool ending_ = false;
+        };
+
+// ----------------------------------------------------------------------
+// Lzo Hadoop codec implementation
+
+        class LzoCodec : public Codec {
+        public:
+            explicit LzoCodec(int compression_level)
+                    : compression_level_(compression_level == kUseDefaultCompressionLevel
+                                         ? kLzoDefaultCompressionLevel
+                                         : compression_level) {}
+
+            turbo::Status Init() override {
+                if (compression_level_ < kLzoMinCompressionLevel || compression_level_ > kLzoMaxCompressionLevel) {
+                    return turbo::invalid_argument_error(
+                            turbo::str_cat("LZO compression level should be between ", kLzoMinCompressionLevel,
+                                           " and ", kLzoMaxCompressionLevel));
+                }
+                if (lzo_init() != LZO_E_OK) {
+                    return turbo::unavailable_error("lzo_init failed");
+                }
+                return turbo::OkStatus();
+            }
+
+            turbo::Result<int64_t> Decompress(int64_t input_len, const uint8_t *input,
+                                              int64_t output_buffer_len, uint8_t *output_buffer) override {
+                const int64_t decompressed_size =
+                        TryDecompressHadoop(input_len, input, output_buffer_len, output_buffer);
+                if (decompressed_size != kNotHadoop) {
+                    return decompressed_size;
+                }
+                // Fall back on a raw LZO1X block, as written without Hadoop framing
+                RESULT_ASSIGN_OR_RETURN(auto raw_size,
+                                        LzoDecompressBlock(input, static_cast<size_t>(input_len), output_buffer,
+                                                           static_cast<size_t>(output_buffer_len)));
+                return static_cast<int64_t>(raw_size);
+            }
+
+            std::optional<int64_t> DecompressedLength(int64_t input_len, const uint8_t *input) override {
+                return HadoopFramedLength(input_len, input);
+            }
+
+            int64_t MaxCompressedLen(int64_t input_len,
+                                     const uint8_t *input) override {
+                (void) input;
+                const int64_t num_blocks = input_len / static_cast<int64_t>(kLzoBlockSize) + 1;
+                return num_blocks * kPrefixLength + input_len + input_len / 16 + num_blocks * (64 + 3);
+            }
+
+            turbo::Result<int64_t> Compress(int64_t input_len, const uint8_t *input,
+                                            int64_t output_buffer_len, uint8_t *output_buffer) override {
+                // Hadoop LzoCodec framing: each block of at most kLzoBlockSize bytes is
+                // prefixed with its big-endian decompressed and compressed sizes.
+                LzoBlockCompressor compressor(compression_level_);
+                int64_t output_len = 0;
+                for (int64_t pos = 0; pos < input_len;) {
+                    const auto block_size = static_cast<size_t>(
+                            std::min(input_len - pos, static_cast<int64_t>(kLzoBlockSize)));
+                    if (output_buffer_len - output_len <
+                        kPrefixLength + static_cast<int64_t>(LzoCompressBound(block_size))) {
+                        return turbo::invalid_argument_error("Output buffer too small for LzoCodec compression");
+                    }
+                    uint8_t *out = output_buffer + output_len;
+                    RESULT_ASSIGN_OR_RETURN(auto compressed_size,
+                                            compressor.Compress(input + pos, block_size, out + kPrefixLength));
+                    turbo::big_endian::store32(out, static_cast<uint32_t>(block_size));
+                    turbo::big_endian::store32(out + sizeof(uint32_t), static_cast<uint32_t>(compressed_size));
+                    output_len += kPrefixLength + static_cast<int64_t>(compressed_size);
+                    pos += static_cast<int64_t>(block_size);
+                }
+                return output_len;
+            }
+
+            // Streaming uses the lzop container format, while the one-shot functions
+            // above use Hadoop block framing; the two are not interchangeable.
+            turbo::Result<std::shared_ptr<Compressor>> MakeCompressor() override {
+                auto ptr = std::make_shared<LzopCompressor>(compression_level_);
+                STATUS_RETURN_IF_ERROR(ptr->Init());
+                return ptr;
+            }
+
+            turbo::Result<std::shared_ptr<Decompressor>> MakeDecompressor() override {
+                auto ptr = std::make_shared<LzopDecompressor>();
+                STATUS_RETURN_IF_ERROR(ptr->Init());
+                return ptr;
+            }
+
+            CompressionType compression_type() const override { return CompressionType::LZO; }
+
+            int compression_level() const override { return compression_level_; }
+
+            int minimum_compression_level() const override { return kLzoMinCompressionLevel; }
+
+            int maximum_compression_level() const override { return kLzoMaxCompressionLevel; }
+
+            int default_compression_level() const override { return kLzoDefaultCompressionLevel; }
+
+        private:
+            // Offset starting at which block data can be read/written
+            static const int64_t kPrefixLength = sizeof(uint32_t) * 2;
+
+            static const int64_t kNotHadoop = -1;
+
+            int64_t TryDecompressHadoop(int64_t input_len, const uint8_t *input,
+                                        int64_t output_buffer_len, uint8_t *output_buffer) {
+                // Hadoop's BlockCompressorStream, used by LzoCodec, writes a sequence
+                // of blocks, each with the following structure:
+                // - bytes 0..3: big-endian uint32_t representing the block decompressed size
+                // - then one or more chunks, each a big-endian uint32_t compressed size
+                //   followed by that many bytes of LZO1X data, until the chunks add
+                //   up to the block decompressed size
+                int64_t total_decompressed_size = 0;
+
+                while (input_len > 0) {
+                    if (input_len < static_cast<int64_t>(sizeof(uint32_t))) {
+                        return kNotHadoop;
+                    }
+                    const uint32_t block_size = turbo::big_endian::load32(input);
+                    input += sizeof(uint32_t);
+                    input_len -= sizeof(uint32_t);
+                    if (output_buffer_len < block_size) {
+                        // Not enough bytes to hold advertised output => probably not Hadoop
+                        return kNotHadoop;
+                    }
+                    uint32_t block_decompressed = 0;
+                    while (block_decompressed < block_size) {
+                        if (input_len < static_cast<int64_t>(sizeof(uint32_t))) {
+                            return kNotHadoop;
+                        }
+                        const uint32_t chunk_size = turbo::big_endian::load32(input);
+                        input += sizeof(uint32_t);
+                        input_len -= sizeof(uint32_t);
+                        if (input_len < chunk_size) {
+                            return kNotHadoop;
+                        }
+                        auto maybe_decompressed_size =
+                                LzoDecompressBlock(input, chunk_size, output_buffer + block_decompressed,
+                                                   block_size - block_decompressed);
+                        if (!maybe_decompressed_size.ok() || *maybe_decompressed_size == 0) {
+                            return kNotHadoop;
+                        }
+                        block_decompressed += static_cast<uint32_t>(*maybe_decompressed_size);
+                        input += chunk_size;
+                        input_len -= chunk_size;
+                    }
+                    output_buffer += block_size;
+                    output_buffer_len -= block_size;
+                    total_decompressed_size += block_size;
+                }
+                return total_decompressed_size;
+            }
+
+            int compression_level_;
+        };
+
+    }  // namespace
+
+    std::unique_ptr<Codec> MakeLzoCodec(int compression_level) {
+        return std::make_unique<LzoCodec>(compression_level);
+    }
+
+}  // namespace alkaid::internal
+
+#endif  // defined(ENABLE_LZO)
@@ -18,14 +18,20 @@
 #include <alkaid/version.h>
 #ifdef ENABLE_SNAPPY
 #include <alkaid/compress/compression_internal.h>
+#include <alkaid/compress/crc32c.h>
+#include <algorithm>
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <memory>
+#include <optional>
+#include <vector>
 
 #include <snappy.h>
 
 #include <turbo/utility/status.h>
 #include <turbo/log/logging.h>
+#include <turbo/base/endian.h>
 
 using std::size_t;
 
@@ -33,6 +39,322 @@ namespace alkaid::internal {
 
     namespace {
 
+        // ----------------------------------------------------------------------
+        // Snappy framing format constants
+        //
+        // See https://github.com/google/snappy/blob/main/framing_format.txt
+        //
+        // A framed stream is a sequence of chunks, each one starting with a
+        // 1-byte chunk type and a 3-byte little-endian chunk length.  Data
+        // chunks carry a masked CRC32C of the uncompressed data followed by
+        // either snappy-compressed or raw bytes, never more than 64KB once
+        // uncompressed.
+
+        constexpr uint8_t kChunkCompressedData = 0x00;
+        constexpr uint8_t kChunkUncompressedData = 0x01;
+        constexpr uint8_t kChunkPadding = 0xfe;
+        constexpr uint8_t kChunkStreamIdentifier = 0xff;
+        constexpr uint8_t kChunkReservedSkippableMin = 0x80;
+
+        constexpr size_t kChunkHeaderSize = 4;
+        constexpr size_t kChunkChecksumSize = 4;
+        constexpr size_t kMaxBlockSize = 65536;
+
+        constexpr char kStreamIdentifierBody[] = "sNaPpY";
+        constexpr size_t kStreamIdentifierBodySize = sizeof(kStreamIdentifierBody) - 1;
+
+        // Only emit a compressed chunk if it saves at least 1/8 of the input,
+        // as recommended by the framing format description.
+        inline bool WorthCompressing(size_t raw_size, size_t compressed_size) {
+            return compressed_size < raw_size - raw_size / 8;
+        }
+
+        inline void StoreChunkHeader(uint8_t *out, uint8_t type, size_t length) {
+            out[0] = type;
+            out[1] = static_cast<uint8_t>(length & 0xff);
+            out[2] = static_cast<uint8_t>((length >> 8) & 0xff);
+            out[3] = static_cast<uint8_t>((length >> 16) & 0xff);
+        }
+
+// ----------------------------------------------------------------------
+// Snappy framed decompressor implementation
+
+        class SnappyFramedDecompressor : public Decompressor {
+        public:
+            SnappyFramedDecompressor() = default;
+
+            turbo::Status Init() {
+                uncompressed_.resize(kMaxBlockSize);
+                return Reset();
+            }
+
+            turbo::Status Reset() override {
+                header_size_ = 0;
+                chunk_.clear();
+                chunk_type_ = 0;
+                chunk_length_ = 0;
+                in_chunk_ = false;
+                skip_remaining_ = 0;
+                pending_pos_ = 0;
+                pending_size_ = 0;
+                seen_stream_identifier_ = false;
+                return turbo::OkStatus();
+            }
+
+            turbo::Result<DecompressResult> Decompress(int64_t input_len, const uint8_t *input,
+                                                       int64_t output_len, uint8_t *output) override {
+                int64_t bytes_read = 0;
+                int64_t bytes_written = 0;
+                while (true) {
+                    bytes_written += DrainPending(output + bytes_written, output_len - bytes_written);
+                    if (pending_pos_ < pending_size_) {
+                        // Output buffer is full
+                        break;
+                    }
+                    if (bytes_read == input_len) {
+                        break;
+                    }
+                    const uint8_t *src = input + bytes_read;
+                    auto avail = static_cast<size_t>(input_len - bytes_read);
+
+                    if (skip_remaining_ > 0) {
+                        auto n = std::min(avail, skip_remaining_);
+                        skip_remaining_ -= n;
+                        bytes_read += static_cast<int64_t>(n);
+                        continue;
+                    }
+
+                    if (!in_chunk_) {
+                        auto n = std::min(avail, kChunkHeaderSize - header_size_);
+                        std::memcpy(header_ + header_size_, src, n);
+                        header_size_ += n;
+                        bytes_read += static_cast<int64_t>(n);
+                        if (header_size_ == kChunkHeaderSize) {
+                            STATUS_RETURN_IF_ERROR(BeginChunk());
+                        }
+                        continue;
+                    }
+
+                    if (chunk_.empty() && avail >= chunk_length_) {
+                        // Fast path: the whole chunk body is available, decode in place
+                        STATUS_RETURN_IF_ERROR(ProcessChunk(src, chunk_length_));
+                        bytes_read += static_cast<int64_t>(chunk_length_);
+                        continue;
+                    }
+                    auto n = std::min(avail, chunk_length_ - chunk_.size());
+                    chunk_.insert(chunk_.end(), src, src + n);
+                    bytes_read += static_cast<int64_t>(n);
+                    if (chunk_.size() == chunk_length_) {
+                        STATUS_RETURN_IF_ERROR(ProcessChunk(chunk_.data(), chunk_.size()));
+                        chunk_.clear();
+                    }
+                }
+                return DecompressResult{bytes_read, bytes_written, pending_pos_ < pending_size_};
+            }
+
+            /// The framing format has no end-of-stream marker, so a stream is
+            /// considered finished whenever the decoder sits on a chunk boundary
+            /// with nothing left to hand out.
+            bool IsFinished() override {
+                return seen_stream_identifier_ && !in_chunk_ && header_size_ == 0 &&
+                       skip_remaining_ == 0 && pending_pos_ == pending_size_;
+            }
+
+        private:
+            int64_t DrainPending(uint8_t *output, int64_t output_len) {
+                auto n = std::min(static_cast<size_t>(output_len), pending_size_ - pending_pos_);
+                if (n > 0) {
+                    std::memcpy(output, uncompressed_.data() + pending_pos_, n);
+                    pending_pos_ += n;
+                }
+                return static_cast<int64_t>(n);
+            }
+
+            turbo::Status BeginChunk() {
+                chunk_type_ = header_[0];
+                chunk_length_ = static_cast<size_t>(header_[1]) | (static_cast<size_t>(header_[2]) << 8) |
+                                (static_cast<size_t>(header_[3]) << 16);
+                header_size_ = 0;
+                if (chunk_type_ == kChunkStreamIdentifier) {
+                    if (chunk_length_ != kStreamIdentifierBodySize) {
+                        return turbo::unavailable_error("Corrupt snappy framed data: bad stream identifier");
+                    }
+                } else if (!seen_stream_identifier_) {
+                    return turbo::unavailable_error("Corrupt snappy framed data: missing stream identifier");
+                } else if (chunk_type_ == kChunkCompressedData || chunk_type_ == kChunkUncompressedData) {
+                    if (chunk_length_ < kChunkChecksumSize) {
+                        return turbo::unavailable_error("Corrupt snappy framed data: chunk too short");
+                    }
+                    if (chunk_length_ > kChunkChecksumSize + snappy::MaxCompressedLength(kMaxBlockSize)) {
+                        return turbo::unavailable_error("Corrupt snappy framed data: chunk too large");
+                    }
+                } else if (chunk_type_ >= kChunkReservedSkippableMin) {
+                    // Padding and reserved skippable chunks are dropped without buffering
+                    skip_remaining_ = chunk_length_;
+                    return turbo::OkStatus();
+                } else {
+                    return turbo::unavailable_error(
+                            turbo::str_cat("Corrupt snappy framed data: reserved unskippable chunk type ",
+                                           static_cast<int>(chunk_type_)));
+                }
+                in_chunk_ = true;
+                return turbo::OkStatus();
+            }
+
+            turbo::Status ProcessChunk(const uint8_t *data, size_t length) {
+                in_chunk_ = false;
+                if (chunk_type_ == kChunkStreamIdentifier) {
+                    if (std::memcmp(data, kStreamIdentifierBody, kStreamIdentifierBodySize) != 0) {
+                        return turbo::unavailable_error("Corrupt snappy framed data: bad stream identifier");
+                    }
+                    seen_stream_identifier_ = true;
+                    return turbo::OkStatus();
+                }
+
+                const uint32_t expected_crc = crc32c::unmask(turbo::little_endian::load32(data));
+                data += kChunkChecksumSize;
+                length -= kChunkChecksumSize;
+
+                size_t uncompressed_size;
+                if (chunk_type_ == kChunkCompressedData) {
+                    auto src = reinterpret_cast<const char *>(data);
+                    if (!snappy::GetUncompressedLength(src, length, &uncompressed_size) ||
+                        uncompressed_size > kMaxBlockSize) {
+                        return turbo::unavailable_error("Corrupt snappy framed data: bad block length");
+                    }
+                    if (!snappy::RawUncompress(src, length, reinterpret_cast<char *>(uncompressed_.data()))) {
+                        return turbo::unavailable_error("Corrupt snappy compressed data.");
+                    }
+                } else {
+                    uncompressed_size = length;
+                    if (uncompressed_size > kMaxBlockSize) {
+                        return turbo::unavailable_error("Corrupt snappy framed data: bad block length");
+                    }
+                    std::memcpy(uncompressed_.data(), data, uncompressed_size);
+                }
+                if (crc32c::value(uncompressed_.data(), uncompressed_size) != expected_crc) {
+                    return turbo::unavailable_error("Corrupt snappy framed data: checksum mismatch");
+                }
+                pending_pos_ = 0;
+                pending_size_ = uncompressed_size;
+                return turbo::OkStatus();
+            }
+
+            uint8_t header_[kChunkHeaderSize];
+            size_t header_size_ = 0;
+            uint8_t chunk_type_ = 0;
+            size_t chunk_length_ = 0;
+            bool in_chunk_ = false;
+            // Partial chunk body, only used when a chunk straddles input buffers
+            std::vector<uint8_t> chunk_;
+            size_t skip_remaining_ = 0;
+            // Decoded block waiting to be copied out
+            std::vector<uint8_t> uncompressed_;
+            size_t pending_pos_ = 0;
+            size_t pending_size_ = 0;
+            bool seen_stream_identifier_ = false;
+        };
+
+// ----------------------------------------------------------------------
+// Snappy framed compressor implementation
+
+        class SnappyFramedCompressor : public Compressor {
+        public:
+            SnappyFramedCompressor() = default;
+
+            turbo::Status Init() {
+                block_.reserve(kMaxBlockSize);
+                pending_.resize(kChunkHeaderSize + kStreamIdentifierBodySize + kChunkHeaderSize +
+                                kChunkChecksumSize + snappy::MaxCompressedLength(kMaxBlockSize));
+                pending_pos_ = 0;
+                pending_size_ = 0;
+                stream_started_ = false;
+                return turbo::OkStatus();
+            }
+
+            turbo::Result<CompressResult> Compress(int64_t input_len, const uint8_t *input,
+                                                   int64_t output_len, uint8_t *output) override {
+                int64_t bytes_read = 0;
+                int64_t bytes_written = 0;
+                while (true) {
+                    bytes_written += DrainPending(output + bytes_written, output_len - bytes_written);
+                    if (pending_pos_ < pending_size_ || bytes_read == input_len) {
+                        break;
+                    }
+                    auto n = std::min(static_cast<size_t>(input_len - bytes_read), kMaxBlockSize - block_.size());
+                    block_.insert(block_.end(), input + bytes_read, input + bytes_read + n);
+                    bytes_read += static_cast<int64_t>(n);
+                    if (block_.size() == kMaxBlockSize) {
+                        EmitBlock();
+                    }
+                }
+                return CompressResult{bytes_read, bytes_written};
+            }
+
+            turbo::Result<FlushResult> Flush(int64_t output_len, uint8_t *output) override {
+                int64_t bytes_written = DrainPending(output, output_len);
+                if (pending_pos_ == pending_size_ && (!block_.empty() || !stream_started_)) {
+                    EmitBlock();
+                    bytes_written += DrainPending(output + bytes_written, output_len - bytes_written);
+                }
+                return FlushResult{bytes_written, pending_pos_ < pending_size_};
+            }
+
+            turbo::Result<EndResult> End(int64_t output_len, uint8_t *output) override {
+                RESULT_ASSIGN_OR_RETURN(auto flush_result, Flush(output_len, output));
+                return EndResult{flush_result.bytes_written, flush_result.should_retry};
+            }
+
+        private:
+            int64_t DrainPending(uint8_t *output, int64_t output_len) {
+                auto n = std::min(static_cast<size_t>(output_len), pending_size_ - pending_pos_);
+                if (n > 0) {
+                    std::memcpy(output, pending_.data() + pending_pos_, n);
+                    pending_pos_ += n;
+                }
+                return static_cast<int64_t>(n);
+            }
+
+            // Frame the buffered block (and the stream identifier on first use)
+            // into pending_.  Must only be called once pending_ has been drained.
+            void EmitBlock() {
+                uint8_t *out = pending_.data();
+                if (!stream_started_) {
+                    StoreChunkHeader(out, kChunkStreamIdentifier, kStreamIdentifierBodySize);
+                    std::memcpy(out + kChunkHeaderSize, kStreamIdentifierBody, kStreamIdentifierBodySize);
+                    out += kChunkHeaderSize + kStreamIdentifierBodySize;
+                    stream_started_ = true;
+                }
+                if (!block_.empty()) {
+                    const uint32_t masked_crc = crc32c::mask(crc32c::value(block_.data(), block_.size()));
+                    uint8_t *body = out + kChunkHeaderSize + kChunkChecksumSize;
+                    size_t compressed_size;
+                    snappy::RawCompress(reinterpret_cast<const char *>(block_.data()), block_.size(),
+                                        reinterpret_cast<char *>(body), &compressed_size);
+                    uint8_t chunk_type = kChunkCompressedData;
+                    if (!WorthCompressing(block_.size(), compressed_size)) {
+                        chunk_type = kChunkUncompressedData;
+                        compressed_size = block_.size();
+                        std::memcpy(body, block_.data(), compressed_size);
+                    }
+                    StoreChunkHeader(out, chunk_type, kChunkChecksumSize + compressed_size);
+                    turbo::little_endian::store32(out + kChunkHeaderSize, masked_crc);
+                    out = body + compressed_size;
+                    block_.clear();
+                }
+                pending_pos_ = 0;
+                pending_size_ = static_cast<size_t>(out - pending_.data());
+            }
+
+            // Uncompressed bytes waiting to fill a block
+            std::vector<uint8_t> block_;
+            // Framed bytes waiting to be copied out
+            std::vector<uint8_t> pending_;
+            size_t pending_pos_ = 0;
+            size_t pending_size_ = 0;
+            bool stream_started_ = false;
+        };
+
 // ----------------------------------------------------------------------
 // Snappy implementation
 
@@ -59,6 +381,16 @@ namespace alkaid::internal {
                 return static_cast<int64_t>(decompressed_size);
             }
 
+            std::optional<int64_t> DecompressedLength(int64_t input_len, const uint8_t *input) override {
+                size_t decompressed_size;
+                if (!snappy::GetUncompressedLength(reinterpret_cast<const char *>(input),
+                                                   static_cast<size_t>(input_len),
+                                                   &decompressed_size)) {
+                    return std::nullopt;
+                }
+                return static_cast<int64_t>(decompressed_size);
+            }
+
             int64_t MaxCompressedLen(int64_t input_len,
                                      const uint8_t *input) override {
                 (void) input;
@@ -77,12 +409,18 @@ namespace alkaid::internal {
                 return static_cast<int64_t>(output_size);
             }
 
+            // Streaming uses the snappy framing format, while the one-shot functions
+            // above use raw snappy blocks; the two are not interchangeable.
             turbo::Result<std::shared_ptr<Compressor>> MakeCompressor() override {
-                return turbo::unimplemented_error("Streaming compression unsupported with Snappy");
+                auto ptr = std::make_shared<SnappyFramedCompressor>();
+                STATUS_RETURN_IF_ERROR(ptr->Init());
+                return ptr;
             }
 
             turbo::Result<std::shared_ptr<Decompressor>> MakeDecompressor() override {
-                return turbo::unimplemented_error("Streaming decompression unsupported with Snappy");
+                auto ptr = std::make_shared<SnappyFramedDecompressor>();
+                STATUS_RETURN_IF_ERROR(ptr->Init());
+                return ptr;
             }
 
             CompressionType compression_type() const override { return CompressionType::SNAPPY; }
@@ -18,13 +18,21 @@
 #include <alkaid/version.h>
 #if defined(ENABLE_ZLIB)
 #include <alkaid/compress/compression_internal.h>
+#include <alkaid/utility/thread_pool.h>
 #include <turbo/utility/status.h>
 #include <turbo/log/logging.h>
+#include <turbo/base/endian.h>
 #include <algorithm>
+#include <chrono>
 #include <cstdint>
 #include <cstring>
+#include <deque>
+#include <future>
 #include <limits>
 #include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
 
 #include <zconf.h>
 #include <zlib.h>
@@ -57,6 +65,13 @@ namespace alkaid::internal {
         constexpr int kGZipMinCompressionLevel = 1;
         constexpr int kGZipMaxCompressionLevel = 9;
 
+        // Block size bounds of the parallel compressor, as in pigz
+        constexpr int64_t kGZipMinParallelBlockSize = 128 * 1024;
+        constexpr int64_t kGZipMaxParallelBlockSize = 1024 * 1024;
+        // Worst case bytes added per parallel block: the sync flush marker
+        // plus a possible stored block header
+        constexpr int64_t kGZipParallelBlockOverhead = 16;
+
         int CompressionWindowBitsForFormat(GZipFormat format, int window_bits) {
             switch (format) {
                 case GZipFormat::DEFLATE:
@@ -297,9 +312,318 @@ namespace alkaid::internal {
             int compression_level_;
         };
 
+        // ----------------------------------------------------------------------
+        // parallel gzip compressor implementation
+        //
+        // The same scheme as pigz: the input is cut into fixed size blocks which are
+        // deflated independently on a thread pool.  Each block is primed with the last
+        // window of the data before it as a preset dictionary, so matches still reach
+        // back across block boundaries, and every block but the last ends with a sync
+        // flush, which leaves the output byte aligned without marking the final deflate
+        // block.  Concatenated in order the pieces form one deflate stream; the CRC32
+        // (or Adler-32) of each block is merged with crc32_combine() for the trailer.
+        // The result is an ordinary single member gzip (or zlib / raw deflate) stream.
+
+        // gzip header: magic, CM = deflate, no flags, no mtime, no XFL, OS = unix
+        constexpr uint8_t kGZipHeader[] = {0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 3};
+
+        struct DeflatedBlock {
+            std::vector<uint8_t> data;
+            // CRC32 (gzip) or Adler-32 (zlib) of the uncompressed block
+            uint32_t check{0};
+            size_t length{0};
+        };
+
+        turbo::Result<DeflatedBlock> DeflateBlock(int compression_level, GZipFormat format, int window_bits,
+                                                  const std::vector<uint8_t> &dictionary,
+                                                  const std::vector<uint8_t> &input, bool last) {
+            z_stream stream;
+            memset(&stream, 0, sizeof(stream));
+            if (deflateInit2(&stream, compression_level, Z_DEFLATED, -window_bits, 8,
+                             Z_DEFAULT_STRATEGY) != Z_OK) {
+                return ZlibErrorPrefix("zlib deflateInit failed: ", stream.msg);
+            }
+            if (!dictionary.empty() &&
+                deflateSetDictionary(&stream, dictionary.data(), static_cast<uInt>(dictionary.size())) != Z_OK) {
+                (void) deflateEnd(&stream);
+                return ZlibErrorPrefix("zlib deflateSetDictionary failed: ", stream.msg);
+            }
+
+            DeflatedBlock block;
+            // deflateBound() does not count the empty stored block of a sync flush
+            block.data.resize(deflateBound(&stream, static_cast<uLong>(input.size())) + 16);
+            stream.next_in = const_cast<Bytef *>(input.data());
+            stream.avail_in = static_cast<uInt>(input.size());
+            const int flush = last ? Z_FINISH : Z_SYNC_FLUSH;
+            size_t written = 0;
+            while (true) {
+                stream.next_out = block.data.data() + written;
+                stream.avail_out = static_cast<uInt>(block.data.size() - written);
+                int ret = deflate(&stream, flush);
+                written = block.data.size() - stream.avail_out;
+                if (ret == Z_STREAM_ERROR) {
+                    (void) deflateEnd(&stream);
+                    return ZlibErrorPrefix("zlib deflate failed: ", stream.msg);
+                }
+                if (last ? ret == Z_STREAM_END : (stream.avail_in == 0 && stream.avail_out != 0)) {
+                    break;
+                }
+                block.data.resize(block.data.size() * 2);
+            }
+            (void) deflateEnd(&stream);
+            block.data.resize(written);
+            block.length = input.size();
+
+            if (format == GZipFormat::GZIP) {
+                block.check = static_cast<uint32_t>(crc32(0L, input.data(), static_cast<uInt>(input.size())));
+            } else {
+                block.check = static_cast<uint32_t>(adler32(1L, input.data(), static_cast<uInt>(input.size())));
+            }
+            return block;
+        }
+
+        class ParallelGZipCompressor : public Compressor {
+        public:
+            ParallelGZipCompressor(std::shared_ptr<ThreadPool> pool, int compression_level, GZipFormat format,
+                                   int window_bits, int64_t block_size)
+                    : pool_(std::move(pool)),
+                      compression_level_(compression_level),
+                      format_(format),
+                      window_bits_(window_bits),
+                      block_size_(static_cast<size_t>(block_size)),
+                      max_in_flight_(2 * pool_->size()) {
+                Reset();
+            }
+
+            turbo::Result<CompressResult> Compress(int64_t input_len, const uint8_t *input,
+                                                   int64_t output_len, uint8_t *output) override {
+                DCHECK(!ending_) << "Compress called after End";
+                int64_t bytes_read = 0;
+                int64_t bytes_written = 0;
+                StartStream();
+                while (true) {
+                    bytes_written += DrainPending(output_len - bytes_written, output + bytes_written);
+                    if (pending_pos_ < pending_.size()) {
+                        break;
+                    }
+                    RESULT_ASSIGN_OR_RETURN(bool collected, CollectBlock(false));
+                    if (collected) {
+                        continue;
+                    }
+                    if (bytes_read == input_len) {
+                        break;
+                    }
+                    if (block_.size() == block_size_) {
+                        if (jobs_.size() >= max_in_flight_) {
+                            // wait for the oldest block, this bounds the memory held in flight
+                            RESULT_ASSIGN_OR_RETURN(collected, CollectBlock(true));
+                        } else {
+                            DispatchBlock(false);
+                        }
+                        continue;
+                    }
+                    auto n = std::min(static_cast<size_t>(input_len - bytes_read), block_size_ - block_.size());
+                    block_.insert(block_.end(), input + bytes_read, input + bytes_read + n);
+                    bytes_read += static_cast<int64_t>(n);
+                }
+                return CompressResult{bytes_read, bytes_written};
+            }
+
+            turbo::Result<FlushResult> Flush(int64_t output_len, uint8_t *output) override {
+                StartStream();
+                if (!block_.empty()) {
+                    DispatchBlock(false);
+                }
+                RESULT_ASSIGN_OR_RETURN(auto result, DrainAll(output_len, output));
+                return FlushResult{result.first, result.second};
+            }
+
+            turbo::Result<EndResult> End(int64_t output_len, uint8_t *output) override {
+                StartStream();
+                if (!ending_) {
+                    // the last block may be empty, it still carries the final block bit
+                    DispatchBlock(true);
+                    ending_ = true;
+                }
+                int64_t bytes_written = 0;
+                while (true) {
+                    RESULT_ASSIGN_OR_RETURN(auto result,
+                                            DrainAll(output_len - bytes_written, output + bytes_written));
+                    bytes_written += result.first;
+                    if (result.second) {
+                        return EndResult{bytes_written, true};
+                    }
+                    if (trailer_written_) {
+                        break;
+                    }
+                    AppendTrailer();
+                    trailer_written_ = true;
+                }
+                // ready for another stream
+                Reset();
+                return EndResult{bytes_written, false};
+            }
+
+        private:
+            void Reset() {
+                jobs_.clear();
+                block_.clear();
+                dictionary_.clear();
+                pending_.clear();
+                pending_pos_ = 0;
+                check_ = format_ == GZipFormat::GZIP ? 0 : 1;
+                total_in_ = 0;
+                started_ = false;
+                ending_ = false;
+                trailer_written_ = false;
+            }
+
+            void StartStream() {
+                if (started_) {
+                    return;
+                }
+                started_ = true;
+                if (format_ == GZipFormat::GZIP) {
+                    AppendPending(kGZipHeader, sizeof(kGZipHeader));
+                } else if (format_ == GZipFormat::ZLIB) {
+                    // CMF: deflate with the window size, FLG: level hint and check bits
+                    uint8_t header[2];
+                    header[0] = static_cast<uint8_t>(((window_bits_ - 8) << 4) | Z_DEFLATED);
+                    int level_flags = 3;
+                    if (compression_level_ < 2) {
+                        level_flags = 0;
+                    } else if (compression_level_ < 6) {
+                        level_flags = 1;
+                    } else if (compression_level_ == 6) {
+                        level_flags = 2;
+                    }
+                    int flags = level_flags << 6;
+                    flags += 31 - ((header[0] << 8) + flags) % 31;
+                    header[1] = static_cast<uint8_t>(flags);
+                    AppendPending(header, sizeof(header));
+                }
+            }
+
+            void AppendTrailer() {
+                uint8_t trailer[8];
+                if (format_ == GZipFormat::GZIP) {
+                    turbo::little_endian::store32(trailer, check_);
+                    turbo::little_endian::store32(trailer + 4, static_cast<uint32_t>(total_in_));
+                    AppendPending(trailer, 8);
+                } else if (format_ == GZipFormat::ZLIB) {
+                    turbo::big_endian::store32(trailer, check_);
+                    AppendPending(trailer, 4);
+                }
+            }
+
+            void DispatchBlock(bool last) {
+                std::vector<uint8_t> block = std::move(block_);
+                block_.clear();
+                block_.reserve(block_size_);
+                total_in_ += block.size();
+
+                // the window ending at this block primes the next one
+                std::vector<uint8_t> dictionary = dictionary_;
+                const size_t window = size_t{1} << window_bits_;
+                if (block.size() >= window) {
+                    dictionary_.assign(block.end() - static_cast<std::ptrdiff_t>(window), block.end());
+                } else {
+                    dictionary_.insert(dictionary_.end(), block.begin(), block.end());
+                    if (dictionary_.size() > window) {
+                        dictionary_.erase(dictionary_.begin(),
+                                          dictionary_.end() - static_cast<std::ptrdiff_t>(window));
+                    }
+                }
+
+                jobs_.push_back(pool_->submit(
+                        [level = compression_level_, format = format_, window_bits = window_bits_,
+                                dictionary = std::move(dictionary), block = std::move(block), last]() {
+                            return DeflateBlock(level, format, window_bits, dictionary, block, last);
+                        }));
+            }
+
+            // Move the oldest block to the pending output, if it is done or wait is set.
+            turbo::Result<bool> CollectBlock(bool wait) {
+                if (jobs_.empty()) {
+                    return false;
+                }
+                if (!wait && jobs_.front().wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+                    return false;
+                }
+                auto result = jobs_.front().get();
+                jobs_.pop_front();
+                RESULT_ASSIGN_OR_RETURN(auto block, std::move(result));
+                auto length = static_cast<z_off_t>(block.length);
+                if (format_ == GZipFormat::GZIP) {
+                    check_ = static_cast<uint32_t>(crc32_combine(check_, block.check, length));
+                } else if (format_ == GZipFormat::ZLIB) {
+                    check_ = static_cast<uint32_t>(adler32_combine(check_, block.check, length));
+                }
+                AppendPending(block.data.data(), block.data.size());
+                return true;
+            }
+
+            // Wait for every dispatched block and write out as much as fits.
+            // Returns the bytes written and whether output is still pending.
+            turbo::Result<std::pair<int64_t, bool>> DrainAll(int64_t output_len, uint8_t *output) {
+                int64_t bytes_written = 0;
+                while (true) {
+                    bytes_written += DrainPending(output_len - bytes_written, output + bytes_written);
+                    if (pending_pos_ < pending_.size()) {
+                        return std::make_pair(bytes_written, true);
+                    }
+                    if (jobs_.empty()) {
+                        return std::make_pair(bytes_written, false);
+                    }
+                    RESULT_ASSIGN_OR_RETURN(bool collected, CollectBlock(true));
+                    (void) collected;
+                }
+            }
+
+            void AppendPending(const uint8_t *data, size_t size) {
+                if (pending_pos_ == pending_.size()) {
+                    pending_.clear();
+                    pending_pos_ = 0;
+                }
+                pending_.insert(pending_.end(), data, data + size);
+            }
+
+            int64_t DrainPending(int64_t output_len, uint8_t *output) {
+                auto n = std::min(static_cast<size_t>(output_len), pending_.size() - pending_pos_);
+                if (n > 0) {
+                    memcpy(output, pending_.data() + pending_pos_, n);
+                    pending_pos_ += n;
+                }
+                return static_cast<int64_t>(n);
+            }
+
+            std::shared_ptr<ThreadPool> pool_;
+            int compression_level_;
+            GZipFormat format_;
+            int window_bits_;
+            size_t block_size_;
+            size_t max_in_flight_;
+
+            // blocks being deflated, in stream order
+            std::deque<std::future<turbo::Result<DeflatedBlock>>> jobs_;
+            // input of the block being filled
+            std::vector<uint8_t> block_;
+            // last window of input already dispatched
+            std::vector<uint8_t> dictionary_;
+            // header, deflated blocks and trailer not yet returned to the caller
+            std::vector<uint8_t> pending_;
+            size_t pending_pos_{0};
+            uint32_t check_{0};
+            uint64_t total_in_{0};
+            bool started_{false};
+            bool ending_{false};
+            bool trailer_written_{false};
+        };
+
         class GZipCodec : public Codec {
         public:
-            explicit GZipCodec(int compression_level, GZipFormat format, int window_bits)
+            explicit GZipCodec(int compression_level, GZipFormat format, int window_bits,
+                               int compression_threads = 1, int64_t block_size = kGZipMinParallelBlockSize)
                     : format_(format),
                       window_bits_(window_bits),
                       compressor_initialized_(false),
@@ -307,6 +631,10 @@ namespace alkaid::internal {
                 compression_level_ = compression_level == kUseDefaultCompressionLevel
                                      ? kGZipDefaultCompressionLevel
                                      : compression_level;
+                block_size_ = std::clamp(block_size, kGZipMinParallelBlockSize, kGZipMaxParallelBlockSize);
+                if (compression_threads != 1) {
+                    pool_ = std::make_shared<ThreadPool>(static_cast<size_t>(std::max(compression_threads, 0)));
+                }
             }
 
             ~GZipCodec() override {
@@ -315,6 +643,10 @@ namespace alkaid::internal {
             }
 
             turbo::Result<std::shared_ptr<Compressor>> MakeCompressor() override {
+                if (pool_ != nullptr) {
+                    return std::make_shared<ParallelGZipCompressor>(pool_, compression_level_, format_,
+                                                                    window_bits_, block_size_);
+                }
                 auto ptr = std::make_shared<GZipCompressor>(compression_level_);
                 STATUS_RETURN_IF_ERROR(ptr->Init(format_, window_bits_));
                 return ptr;
@@ -428,6 +760,21 @@ namespace alkaid::internal {
                 return decompressed_bytes;
             }
 
+            std::optional<int64_t> DecompressedLength(int64_t input_len, const uint8_t *input) override {
+                // ISIZE, the last 4 bytes of a gzip member: a hint, it only covers
+                // the last member and is stored modulo 2^32
+                constexpr int64_t kMinGZipMemberSize = 18;
+                if (format_ != GZipFormat::GZIP || input_len < kMinGZipMemberSize) {
+                    return std::nullopt;
+                }
+                return static_cast<int64_t>(turbo::little_endian::load32(input + input_len - 4));
+            }
+
+            turbo::Result<std::vector<uint8_t>> Decompress(int64_t input_len, const uint8_t *input) override {
+                auto hint = DecompressedLength(input_len, input);
+                return DecompressGrowing(input_len, input, hint.value_or(input_len * 4));
+            }
+
             int64_t MaxCompressedLen(int64_t input_length,
                                      const uint8_t *input) override {
                 (void) input;
@@ -437,11 +784,17 @@ namespace alkaid::internal {
                     CHECK_OK(s);
                 }
                 int64_t max_len = deflateBound(&stream_, static_cast<uLong>(input_length));
+                if (pool_ != nullptr) {
+                    max_len += (input_length / block_size_ + 1) * kGZipParallelBlockOverhead;
+                }
                 return max_len + 12;
             }
 
             turbo::Result<int64_t> Compress(int64_t input_length, const uint8_t *input,
                                             int64_t output_buffer_len, uint8_t *output) override {
+                if (pool_ != nullptr) {
+                    return ParallelCompress(input_length, input, output_buffer_len, output);
+                }
                 if (!compressor_initialized_) {
                     STATUS_RETURN_IF_ERROR(InitCompressor());
                 }
@@ -493,6 +846,30 @@ namespace alkaid::internal {
             int default_compression_level() const override { return kGZipDefaultCompressionLevel; }
 
         private:
+            turbo::Result<int64_t> ParallelCompress(int64_t input_len, const uint8_t *input,
+                                                    int64_t output_buffer_len, uint8_t *output) {
+                ParallelGZipCompressor compressor(pool_, compression_level_, format_, window_bits_, block_size_);
+                int64_t read_input_bytes = 0;
+                int64_t compressed_bytes = 0;
+                while (read_input_bytes < input_len) {
+                    RESULT_ASSIGN_OR_RETURN(auto result,
+                                            compressor.Compress(input_len - read_input_bytes, input + read_input_bytes,
+                                                                output_buffer_len - compressed_bytes,
+                                                                output + compressed_bytes));
+                    read_input_bytes += result.bytes_read;
+                    compressed_bytes += result.bytes_written;
+                    if (compressed_bytes == output_buffer_len && read_input_bytes < input_len) {
+                        return turbo::unavailable_error("zlib deflate failed, output buffer too small");
+                    }
+                }
+                RESULT_ASSIGN_OR_RETURN(auto result, compressor.End(output_buffer_len - compressed_bytes,
+                                                                    output + compressed_bytes));
+                if (result.should_retry) {
+                    return turbo::unavailable_error("zlib deflate failed, output buffer too small");
+                }
+                return compressed_bytes + result.bytes_written;
+            }
+
             // zlib is stateful and the z_stream state variable must be initialized
             // before
             z_stream stream_;
@@ -512,14 +889,19 @@ namespace alkaid::internal {
             bool compressor_initialized_;
             bool decompressor_initialized_;
             int compression_level_;
+            // set when parallel compression is enabled
+            std::shared_ptr<ThreadPool> pool_;
+            int64_t block_size_;
         };
 
     }  // namespace
 
     std::unique_ptr<Codec> MakeGZipCodec(int compression_level, GZipFormat format,
-                                         std::optional<int> window_bits) {
+                                         std::optional<int> window_bits, int compression_threads,
+                                         int64_t block_size) {
         return std::make_unique<GZipCodec>(compression_level, format,
-                                           window_bits.value_or(kGZipDefaultWindowBits));
+                                           window_bits.value_or(kGZipDefaultWindowBits),
+                                           compression_threads, block_size);
     }
 
 }  // namespace alkaid::internal
@@ -25,7 +25,11 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <limits>
 #include <memory>
+#include <optional>
+#include <thread>
+#include <vector>
 
 #include <zstd.h>
 
@@ -40,12 +44,82 @@ namespace alkaid::internal {
             return turbo::unavailable_error(turbo::str_cat(prefix_msg, ZSTD_getErrorName(ret)));
         }
 
+        // Largest window zstd decompresses without being told otherwise
+        constexpr int kZSTDDefaultWindowLogMax = 27;
+
+        struct ZSTDCCtxDeleter {
+            void operator()(ZSTD_CCtx *ctx) const { ZSTD_freeCCtx(ctx); }
+        };
+
+        struct ZSTDDCtxDeleter {
+            void operator()(ZSTD_DCtx *ctx) const { ZSTD_freeDCtx(ctx); }
+        };
+
+        turbo::Status SetParameter(ZSTD_CCtx *ctx, ZSTD_cParameter param, int64_t value, const char *name) {
+            if (value < std::numeric_limits<int>::min() || value > std::numeric_limits<int>::max()) {
+                return turbo::invalid_argument_error(turbo::str_cat("ZSTD ", name, " out of range: ", value));
+            }
+            size_t ret = ZSTD_CCtx_setParameter(ctx, param, static_cast<int>(value));
+            if (ZSTD_isError(ret)) {
+                return ZSTDError(ret, turbo::str_cat("ZSTD ", name, " rejected: ").c_str());
+            }
+            return turbo::OkStatus();
+        }
+
+        // Apply the level and the advanced options, ctx must be reset to its
+        // default parameters
+        turbo::Status ApplyParameters(ZSTD_CCtx *ctx, int compression_level, const ZstdCodecOptions &options) {
+            STATUS_RETURN_IF_ERROR(SetParameter(ctx, ZSTD_c_compressionLevel, compression_level,
+                                                "compression level"));
+            if (options.enable_long_distance_matching) {
+                STATUS_RETURN_IF_ERROR(SetParameter(ctx, ZSTD_c_enableLongDistanceMatching, 1,
+                                                    "long distance matching"));
+            }
+            if (options.window_log != 0) {
+                STATUS_RETURN_IF_ERROR(SetParameter(ctx, ZSTD_c_windowLog, options.window_log, "window log"));
+            }
+            if (options.strategy != 0) {
+                STATUS_RETURN_IF_ERROR(SetParameter(ctx, ZSTD_c_strategy, options.strategy, "strategy"));
+            }
+            if (options.target_block_size != 0) {
+#if ZSTD_VERSION_NUMBER >= 10506
+                STATUS_RETURN_IF_ERROR(SetParameter(ctx, ZSTD_c_targetCBlockSize, options.target_block_size,
+                                                    "target block size"));
+#else
+                return turbo::unimplemented_error("ZSTD target block size needs zstd 1.5.6");
+#endif
+            }
+            if (options.compression_threads != 1) {
+                int64_t workers = options.compression_threads > 0 ? options.compression_threads
+                                                                  : std::thread::hardware_concurrency();
+                STATUS_RETURN_IF_ERROR(SetParameter(ctx, ZSTD_c_nbWorkers, workers, "compression threads"));
+            }
+            if (options.job_size != 0) {
+                STATUS_RETURN_IF_ERROR(SetParameter(ctx, ZSTD_c_jobSize, options.job_size, "job size"));
+            }
+            if (options.checksum) {
+                STATUS_RETURN_IF_ERROR(SetParameter(ctx, ZSTD_c_checksumFlag, 1, "checksum flag"));
+            }
+            return turbo::OkStatus();
+        }
+
+        turbo::Status ApplyParameters(ZSTD_DCtx *ctx, const ZstdCodecOptions &options) {
+            if (options.window_log > kZSTDDefaultWindowLogMax) {
+                size_t ret = ZSTD_DCtx_setParameter(ctx, ZSTD_d_windowLogMax, options.window_log);
+                if (ZSTD_isError(ret)) {
+                    return ZSTDError(ret, "ZSTD window log rejected: ");
+                }
+            }
+            return turbo::OkStatus();
+        }
+
 // ----------------------------------------------------------------------
 // ZSTD decompressor implementation
 
         class ZSTDDecompressor : public Decompressor {
         public:
-            ZSTDDecompressor() : stream_(ZSTD_createDStream()) {}
+            explicit ZSTDDecompressor(const ZstdCodecOptions &options)
+                    : stream_(ZSTD_createDStream()), options_(options) {}
 
             ~ZSTDDecompressor() override { ZSTD_freeDStream(stream_); }
 
@@ -54,9 +128,8 @@ namespace alkaid::internal {
                 size_t ret = ZSTD_initDStream(stream_);
                 if (ZSTD_isError(ret)) {
                     return ZSTDError(ret, "ZSTD init failed: ");
-                } else {
-                    return turbo::OkStatus();
                 }
+                return ApplyParameters(stream_, options_);
             }
 
             turbo::Result<DecompressResult> Decompress(int64_t input_len, const uint8_t *input,
@@ -88,6 +161,7 @@ namespace alkaid::internal {
 
         protected:
             ZSTD_DStream *stream_;
+            const ZstdCodecOptions options_;
             bool finished_;
         };
 
@@ -96,18 +170,17 @@ namespace alkaid::internal {
 
         class ZSTDCompressor : public Compressor {
         public:
-            explicit ZSTDCompressor(int compression_level)
-                    : stream_(ZSTD_createCStream()), compression_level_(compression_level) {}
+            ZSTDCompressor(int compression_level, const ZstdCodecOptions &options)
+                    : stream_(ZSTD_createCStream()), compression_level_(compression_level), options_(options) {}
 
             ~ZSTDCompressor() override { ZSTD_freeCStream(stream_); }
 
             turbo::Status Init() {
-                size_t ret = ZSTD_initCStream(stream_, compression_level_);
+                size_t ret = ZSTD_CCtx_reset(stream_, ZSTD_reset_session_and_parameters);
                 if (ZSTD_isError(ret)) {
                     return ZSTDError(ret, "ZSTD init failed: ");
-                } else {
-                    return turbo::OkStatus();
                 }
+                return ApplyParameters(stream_, compression_level_, options_);
             }
 
             turbo::Result<CompressResult> Compress(int64_t input_len, const uint8_t *input,
@@ -166,6 +239,7 @@ namespace alkaid::internal {
 
         private:
             int compression_level_;
+            const ZstdCodecOptions options_;
         };
 
         // ----------------------------------------------------------------------
@@ -173,10 +247,22 @@ namespace alkaid::internal {
 
         class ZSTDCodec : public Codec {
         public:
-            explicit ZSTDCodec(int compression_level)
+            ZSTDCodec(int compression_level, const ZstdCodecOptions &options)
                     : compression_level_(compression_level == kUseDefaultCompressionLevel
                                          ? kZSTDDefaultCompressionLevel
-                                         : compression_level) {}
+                                         : compression_level),
+                      options_(options) {}
+
+            turbo::Status Init() override {
+                // Reject bad options when the codec is created rather than on first use
+                std::unique_ptr<ZSTD_CCtx, ZSTDCCtxDeleter> cctx(ZSTD_createCCtx());
+                std::unique_ptr<ZSTD_DCtx, ZSTDDCtxDeleter> dctx(ZSTD_createDCtx());
+                if (cctx == nullptr || dctx == nullptr) {
+                    return turbo::resource_exhausted_error("ZSTD context allocation failed");
+                }
+                STATUS_RETURN_IF_ERROR(ApplyParameters(cctx.get(), compression_level_, options_));
+                return ApplyParameters(dctx.get(), options_);
+            }
 
             turbo::Result<int64_t> Decompress(int64_t input_len, const uint8_t *input,
                                               int64_t output_buffer_len, uint8_t *output_buffer) override {
@@ -188,8 +274,13 @@ namespace alkaid::internal {
                     output_buffer = &empty_buffer;
                 }
 
-                size_t ret = ZSTD_decompress(output_buffer, static_cast<size_t>(output_buffer_len),
-                                             input, static_cast<size_t>(input_len));
+                std::unique_ptr<ZSTD_DCtx, ZSTDDCtxDeleter> dctx(ZSTD_createDCtx());
+                if (dctx == nullptr) {
+                    return turbo::resource_exhausted_error("ZSTD context allocation failed");
+                }
+                STATUS_RETURN_IF_ERROR(ApplyParameters(dctx.get(), options_));
+                size_t ret = ZSTD_decompressDCtx(dctx.get(), output_buffer, static_cast<size_t>(output_buffer_len),
+                                                 input, static_cast<size_t>(input_len));
                 if (ZSTD_isError(ret)) {
                     return ZSTDError(ret, "ZSTD decompression failed: ");
                 }
@@ -199,17 +290,58 @@ namespace alkaid::internal {
                 return static_cast<int64_t>(ret);
             }
 
+            std::optional<int64_t> DecompressedLength(int64_t input_len, const uint8_t *input) override {
+                // Sum the content sizes of all frames, one-shot compression records it
+                // in the frame header while streaming compression does not
+                int64_t total = 0;
+                auto remaining = static_cast<size_t>(input_len);
+                while (remaining > 0) {
+                    unsigned long long content_size = ZSTD_getFrameContentSize(input, remaining);
+                    size_t frame_size = ZSTD_findFrameCompressedSize(input, remaining);
+                    if (content_size == ZSTD_CONTENTSIZE_UNKNOWN || content_size == ZSTD_CONTENTSIZE_ERROR ||
+                        ZSTD_isError(frame_size) ||
+                        content_size > static_cast<unsigned long long>(std::numeric_limits<int64_t>::max() - total)) {
+                        return std::nullopt;
+                    }
+                    total += static_cast<int64_t>(content_size);
+                    input += frame_size;
+                    remaining -= frame_size;
+                }
+                return total;
+            }
+
+            turbo::Result<std::vector<uint8_t>> Decompress(int64_t input_len, const uint8_t *input) override {
+                if (DecompressedLength(input_len, input).has_value()) {
+                    return Codec::Decompress(input_len, input);
+                }
+                return DecompressGrowing(input_len, input, input_len * 4);
+            }
+
             int64_t MaxCompressedLen(int64_t input_len,
                                      const uint8_t *input) override {
                 (void) input;
                 DCHECK_GE(input_len, 0);
-                return ZSTD_compressBound(static_cast<size_t>(input_len));
+                int64_t max_len = ZSTD_compressBound(static_cast<size_t>(input_len));
+                if (options_.checksum) {
+                    max_len += 4;
+                }
+                if (options_.target_block_size > 0) {
+                    // a 3 byte header for each of the smaller blocks
+                    max_len += 3 * (input_len / options_.target_block_size + 1);
+                }
+                return max_len;
             }
 
             turbo::Result<int64_t> Compress(int64_t input_len, const uint8_t *input,
                                             int64_t output_buffer_len, uint8_t *output_buffer) override {
-                size_t ret = ZSTD_compress(output_buffer, static_cast<size_t>(output_buffer_len),
-                                           input, static_cast<size_t>(input_len), compression_level_);
+                // A context per call, like ZSTD_compress(), keeps the codec usable from several threads
+                std::unique_ptr<ZSTD_CCtx, ZSTDCCtxDeleter> cctx(ZSTD_createCCtx());
+                if (cctx == nullptr) {
+                    return turbo::resource_exhausted_error("ZSTD context allocation failed");
+                }
+                STATUS_RETURN_IF_ERROR(ApplyParameters(cctx.get(), compression_level_, options_));
+                size_t ret = ZSTD_compress2(cctx.get(), output_buffer, static_cast<size_t>(output_buffer_len),
+                                            input, static_cast<size_t>(input_len));
                 if (ZSTD_isError(ret)) {
                     return ZSTDError(ret, "ZSTD compression failed: ");
                 }
@@ -217,13 +349,13 @@ namespace alkaid::internal {
             }
 
             turbo::Result<std::shared_ptr<Compressor>> MakeCompressor() override {
-                auto ptr = std::make_shared<ZSTDCompressor>(compression_level_);
+                auto ptr = std::make_shared<ZSTDCompressor>(compression_level_, options_);
                 STATUS_RETURN_IF_ERROR(ptr->Init());
                 return ptr;
             }
 
             turbo::Result<std::shared_ptr<Decompressor>> MakeDecompressor() override {
-                auto ptr = std::make_shared<ZSTDDecompressor>();
+                auto ptr = std::make_shared<ZSTDDecompressor>(options_);
                 STATUS_RETURN_IF_ERROR(ptr->Init());
                 return ptr;
             }
@@ -240,12 +372,13 @@ namespace alkaid::internal {
 
         private:
             const int compression_level_;
+            const ZstdCodecOptions options_;
         };
 
     }  // namespace
 
-    std::unique_ptr<Codec> MakeZSTDCodec(int compression_level) {
-        return std::make_unique<ZSTDCodec>(compression_level);
+    std::unique_ptr<Codec> MakeZSTDCodec(int compression_level, const ZstdCodecOptions &options) {
+        return std::make_unique<ZSTDCodec>(compression_level, options);
     }
 
 }  // namespace alkaid::internal
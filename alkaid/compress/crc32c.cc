@@ -0,0 +1,256 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <alkaid/compress/crc32c.h>
+
+#include <array>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <nmmintrin.h>
+#define ALKAID_CRC32C_X86 1
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define ALKAID_CRC32C_ARM 1
+#endif
+
+namespace alkaid::crc32c {
+
+    namespace {
+
+        // Castagnoli polynomial, reflected.
+        constexpr uint32_t kCastagnoliPoly = 0x82f63b78u;
+
+        // Slicing-by-4 tables, table[0] is the classic byte-at-a-time table.
+        using SliceTable = std::array<std::array<uint32_t, 256>, 4>;
+
+        constexpr SliceTable MakeSliceTable() {
+            SliceTable table{};
+            for (uint32_t i = 0; i < 256; ++i) {
+                uint32_t crc = i;
+                for (int k = 0; k < 8; ++k) {
+                    crc = (crc >> 1) ^ ((crc & 1) ? kCastagnoliPoly : 0);
+                }
+                table[0][i] = crc;
+            }
+            for (uint32_t i = 0; i < 256; ++i) {
+                for (size_t t = 1; t < 4; ++t) {
+                    table[t][i] = (table[t - 1][i] >> 8) ^ table[0][table[t - 1][i] & 0xff];
+                }
+            }
+            return table;
+        }
+
+        constexpr SliceTable kSliceTable = MakeSliceTable();
+
+        inline uint32_t LoadLE32(const uint8_t *p) {
+            return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+                   (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+        }
+
+        uint32_t ExtendPortable(uint32_t crc, const uint8_t *p, size_t n) {
+            while (n >= 4) {
+                crc ^= LoadLE32(p);
+                crc = kSliceTable[3][crc & 0xff] ^ kSliceTable[2][(crc >> 8) & 0xff] ^
+                      kSliceTable[1][(crc >> 16) & 0xff] ^ kSliceTable[0][crc >> 24];
+                p += 4;
+                n -= 4;
+            }
+            while (n > 0) {
+                crc = kSliceTable[0][(crc ^ *p) & 0xff] ^ (crc >> 8);
+                ++p;
+                --n;
+            }
+            return crc;
+        }
+
+#if defined(ALKAID_CRC32C_X86) || defined(ALKAID_CRC32C_ARM)
+        // The crc32 instruction has a latency of 3 cycles but issues every
+        // cycle, so the hardware path runs three independent crcs over
+        // adjacent chunks and combines them.  Appending len zero bytes to a
+        // crc is linear over GF(2), and ShiftTable applies it with 4 lookups.
+        constexpr size_t kLongChunk = 8192;
+        constexpr size_t kShortChunk = 256;
+
+        using ShiftTable = std::array<std::array<uint32_t, 256>, 4>;
+
+        uint32_t Gf2MatrixTimes(const uint32_t *mat, uint32_t vec) {
+            uint32_t sum = 0;
+            while (vec) {
+                if (vec & 1) {
+                    sum ^= *mat;
+                }
+                vec >>= 1;
+                ++mat;
+            }
+            return sum;
+        }
+
+        void Gf2MatrixSquare(uint32_t *square, const uint32_t *mat) {
+            for (int n = 0; n < 32; ++n) {
+                square[n] = Gf2MatrixTimes(mat, mat[n]);
+            }
+        }
+
+        ShiftTable MakeShiftTable(size_t len) {
+            // operator for one zero bit, then squared up to len zero bytes
+            uint32_t odd[32], even[32];
+            odd[0] = kCastagnoliPoly;
+            uint32_t row = 1;
+            for (int n = 1; n < 32; ++n) {
+                odd[n] = row;
+                row <<= 1;
+            }
+            Gf2MatrixSquare(even, odd);
+            Gf2MatrixSquare(odd, even);
+            const uint32_t *op = odd;
+            do {
+                Gf2MatrixSquare(even, odd);
+                len >>= 1;
+                op = even;
+                if (len == 0) {
+                    break;
+                }
+                Gf2MatrixSquare(odd, even);
+                len >>= 1;
+                op = odd;
+            } while (len);
+            ShiftTable table{};
+            for (uint32_t n = 0; n < 256; ++n) {
+                table[0][n] = Gf2MatrixTimes(op, n);
+                table[1][n] = Gf2MatrixTimes(op, n << 8);
+                table[2][n] = Gf2MatrixTimes(op, n << 16);
+                table[3][n] = Gf2MatrixTimes(op, n << 24);
+            }
+            return table;
+        }
+
+        inline uint32_t Shift(const ShiftTable &table, uint32_t crc) {
+            return table[0][crc & 0xff] ^ table[1][(crc >> 8) & 0xff] ^ table[2][(crc >> 16) & 0xff] ^
+                   table[3][crc >> 24];
+        }
+
+        const ShiftTable &LongShiftTable() {
+            static const ShiftTable table = MakeShiftTable(kLongChunk);
+            return table;
+        }
+
+        const ShiftTable &ShortShiftTable() {
+            static const ShiftTable table = MakeShiftTable(kShortChunk);
+            return table;
+        }
+
+#if defined(ALKAID_CRC32C_X86)
+#define ALKAID_CRC32C_TARGET __attribute__((target("sse4.2")))
+        ALKAID_CRC32C_TARGET inline uint32_t Crc32cU8(uint32_t crc, uint8_t v) { return _mm_crc32_u8(crc, v); }
+#if defined(__x86_64__)
+        ALKAID_CRC32C_TARGET inline uint64_t Crc32cU64(uint64_t crc, uint64_t v) { return _mm_crc32_u64(crc, v); }
+#else
+        ALKAID_CRC32C_TARGET inline uint64_t Crc32cU64(uint64_t crc, uint64_t v) {
+            crc = _mm_crc32_u32(static_cast<uint32_t>(crc), static_cast<uint32_t>(v));
+            return _mm_crc32_u32(static_cast<uint32_t>(crc), static_cast<uint32_t>(v >> 32));
+        }
+#endif
+#else
+#define ALKAID_CRC32C_TARGET
+        inline uint32_t Crc32cU8(uint32_t crc, uint8_t v) { return __crc32cb(crc, v); }
+
+        inline uint64_t Crc32cU64(uint64_t crc, uint64_t v) { return __crc32cd(static_cast<uint32_t>(crc), v); }
+#endif
+
+        inline uint64_t Load64(const uint8_t *p) {
+            uint64_t v;
+            memcpy(&v, p, sizeof(v));
+            return v;
+        }
+
+        // Runs three crcs over chunk_len bytes each while at least 3 chunks remain
+        ALKAID_CRC32C_TARGET inline uint64_t ExtendChunks(uint64_t crc0, const uint8_t *&p, size_t &n,
+                                                          size_t chunk_len, const ShiftTable &table) {
+            while (n >= 3 * chunk_len) {
+                uint64_t crc1 = 0;
+                uint64_t crc2 = 0;
+                const uint8_t *end = p + chunk_len;
+                do {
+                    crc0 = Crc32cU64(crc0, Load64(p));
+                    crc1 = Crc32cU64(crc1, Load64(p + chunk_len));
+                    crc2 = Crc32cU64(crc2, Load64(p + 2 * chunk_len));
+                    p += 8;
+                } while (p < end);
+                crc0 = Shift(table, static_cast<uint32_t>(crc0)) ^ crc1;
+                crc0 = Shift(table, static_cast<uint32_t>(crc0)) ^ crc2;
+                p += 2 * chunk_len;
+                n -= 3 * chunk_len;
+            }
+            return crc0;
+        }
+
+        ALKAID_CRC32C_TARGET uint32_t ExtendHardware(uint32_t crc, const uint8_t *p, size_t n) {
+            const auto &long_table = LongShiftTable();
+            const auto &short_table = ShortShiftTable();
+            uint64_t crc0 = crc;
+            while (n > 0 && (reinterpret_cast<uintptr_t>(p) & 7) != 0) {
+                crc0 = Crc32cU8(static_cast<uint32_t>(crc0), *p++);
+                --n;
+            }
+            crc0 = ExtendChunks(crc0, p, n, kLongChunk, long_table);
+            crc0 = ExtendChunks(crc0, p, n, kShortChunk, short_table);
+            while (n >= 8) {
+                crc0 = Crc32cU64(crc0, Load64(p));
+                p += 8;
+                n -= 8;
+            }
+            while (n > 0) {
+                crc0 = Crc32cU8(static_cast<uint32_t>(crc0), *p++);
+                --n;
+            }
+            return static_cast<uint32_t>(crc0);
+        }
+
+        bool HasHardwareCrc32c() {
+#if defined(ALKAID_CRC32C_X86)
+            static const bool has_sse42 = __builtin_cpu_supports("sse4.2");
+            return has_sse42;
+#else
+            return true;
+#endif
+        }
+#endif
+
+    }  // namespace
+
+    bool is_hardware_accelerated() {
+#if defined(ALKAID_CRC32C_X86) || defined(ALKAID_CRC32C_ARM)
+        return HasHardwareCrc32c();
+#else
+        return false;
+#endif
+    }
+
+    uint32_t extend(uint32_t init_crc, const void *data, size_t n) {
+        auto p = static_cast<const uint8_t *>(data);
+        uint32_t crc = init_crc ^ 0xffffffffu;
+#if defined(ALKAID_CRC32C_X86) || defined(ALKAID_CRC32C_ARM)
+        if (HasHardwareCrc32c()) {
+            return ExtendHardware(crc, p, n) ^ 0xffffffffu;
+        }
+#endif
+        return ExtendPortable(crc, p, n) ^ 0xffffffffu;
+    }
+
+}  // namespace alkaid::crc32c
@@ -0,0 +1,58 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace alkaid::crc32c {
+
+    /// \brief Return the crc32c of concat(A, data[0,n-1]) where init_crc is the
+    /// crc32c of some string A.  extend() is often used to maintain the
+    /// crc32c of a stream of data.
+    ///
+    /// Uses the SSE4.2 or ARMv8 crc32c instructions when the cpu has them,
+    /// and slicing-by-4 tables otherwise.
+    uint32_t extend(uint32_t init_crc, const void *data, size_t n);
+
+    /// \brief Return true if extend() runs on crc32c instructions
+    bool is_hardware_accelerated();
+
+    /// \brief Return the crc32c of data[0,n-1]
+    inline uint32_t value(const void *data, size_t n) { return extend(0, data, n); }
+
+    static constexpr uint32_t kMaskDelta = 0xa282ead8ul;
+
+    /// \brief Return a masked representation of crc.
+    ///
+    /// Computing the CRC of a string that contains embedded CRCs is
+    /// problematic, so the snappy framing format (and the alkaid record
+    /// formats) store masked CRCs instead.
+    inline uint32_t mask(uint32_t crc) {
+        // Rotate right by 15 bits and add a constant.
+        return ((crc >> 15) | (crc << 17)) + kMaskDelta;
+    }
+
+    /// \brief Return the crc whose masked representation is masked_crc.
+    inline uint32_t unmask(uint32_t masked_crc) {
+        uint32_t rot = masked_crc - kMaskDelta;
+        return ((rot >> 17) | (rot << 15));
+    }
+
+}  // namespace alkaid::crc32c
@@ -0,0 +1,488 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <alkaid/compress/filter.h>
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+#include <turbo/base/endian.h>
+#include <turbo/strings/str_cat.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace alkaid {
+
+    namespace {
+
+        // ----------------------------------------------------------------------
+        // Byte shuffle kernels
+
+        void ByteShuffleScalar(const uint8_t *input, int64_t count, int32_t type_size, int64_t start,
+                               uint8_t *output) {
+            for (int64_t i = start; i < count; ++i) {
+                for (int32_t j = 0; j < type_size; ++j) {
+                    output[j * count + i] = input[i * type_size + j];
+                }
+            }
+        }
+
+        void ByteUnshuffleScalar(const uint8_t *input, int64_t count, int32_t type_size, int64_t start,
+                                 uint8_t *output) {
+            for (int64_t i = start; i < count; ++i) {
+                for (int32_t j = 0; j < type_size; ++j) {
+                    output[i * type_size + j] = input[j * count + i];
+                }
+            }
+        }
+
+#if defined(__SSE2__)
+        inline __m128i Load128(const uint8_t *p) { return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p)); }
+
+        inline void Store128(uint8_t *p, __m128i v) { _mm_storeu_si128(reinterpret_cast<__m128i *>(p), v); }
+
+        // The SSE2 kernels transpose 16 elements per step with rounds of
+        // unpacks, each round interleaving pairs of vectors.  They return the
+        // number of elements done, the scalar code finishes the rest.
+
+        int64_t ByteShuffle4Sse2(const uint8_t *input, int64_t count, uint8_t *output) {
+            int64_t i = 0;
+            for (; i + 16 <= count; i += 16) {
+                const uint8_t *src = input + i * 4;
+                __m128i a = Load128(src), b = Load128(src + 16), c = Load128(src + 32), d = Load128(src + 48);
+                __m128i u0 = _mm_unpacklo_epi8(a, b), u1 = _mm_unpackhi_epi8(a, b);
+                __m128i u2 = _mm_unpacklo_epi8(c, d), u3 = _mm_unpackhi_epi8(c, d);
+                __m128i w0 = _mm_unpacklo_epi8(u0, u1), w1 = _mm_unpackhi_epi8(u0, u1);
+                __m128i w2 = _mm_unpacklo_epi8(u2, u3), w3 = _mm_unpackhi_epi8(u2, u3);
+                // bytes 0 and 1, then bytes 2 and 3, of 8 elements each
+                __m128i x0 = _mm_unpacklo_epi8(w0, w1), x1 = _mm_unpackhi_epi8(w0, w1);
+                __m128i x2 = _mm_unpacklo_epi8(w2, w3), x3 = _mm_unpackhi_epi8(w2, w3);
+                Store128(output + i, _mm_unpacklo_epi64(x0, x2));
+                Store128(output + count + i, _mm_unpackhi_epi64(x0, x2));
+                Store128(output + 2 * count + i, _mm_unpacklo_epi64(x1, x3));
+                Store128(output + 3 * count + i, _mm_unpackhi_epi64(x1, x3));
+            }
+            return i;
+        }
+
+        int64_t ByteUnshuffle4Sse2(const uint8_t *input, int64_t count, uint8_t *output) {
+            int64_t i = 0;
+            for (; i + 16 <= count; i += 16) {
+                __m128i p0 = Load128(input + i), p1 = Load128(input + count + i);
+                __m128i p2 = Load128(input + 2 * count + i), p3 = Load128(input + 3 * count + i);
+                __m128i q0 = _mm_unpacklo_epi8(p0, p1), q1 = _mm_unpackhi_epi8(p0, p1);
+                __m128i q2 = _mm_unpacklo_epi8(p2, p3), q3 = _mm_unpackhi_epi8(p2, p3);
+                uint8_t *dst = output + i * 4;
+                Store128(dst, _mm_unpacklo_epi16(q0, q2));
+                Store128(dst + 16, _mm_unpackhi_epi16(q0, q2));
+                Store128(dst + 32, _mm_unpacklo_epi16(q1, q3));
+                Store128(dst + 48, _mm_unpackhi_epi16(q1, q3));
+            }
+            return i;
+        }
+
+        int64_t ByteShuffle8Sse2(const uint8_t *input, int64_t count, uint8_t *output) {
+            int64_t i = 0;
+            for (; i + 16 <= count; i += 16) {
+                const uint8_t *src = input + i * 8;
+                __m128i v[8], a[8], b[8], c[8];
+                for (int k = 0; k < 8; ++k) {
+                    v[k] = Load128(src + 16 * k);
+                }
+                for (int k = 0; k < 8; k += 2) {
+                    a[k] = _mm_unpacklo_epi8(v[k], v[k + 1]);
+                    a[k + 1] = _mm_unpackhi_epi8(v[k], v[k + 1]);
+                }
+                // bytes 0-3, then bytes 4-7, of 4 elements each
+                for (int k = 0; k < 8; k += 2) {
+                    b[k] = _mm_unpacklo_epi8(a[k], a[k + 1]);
+                    b[k + 1] = _mm_unpackhi_epi8(a[k], a[k + 1]);
+                }
+                // pairs of bytes of 8 elements each
+                for (int k = 0; k < 8; k += 4) {
+                    c[k] = _mm_unpacklo_epi32(b[k], b[k + 2]);
+                    c[k + 1] = _mm_unpackhi_epi32(b[k], b[k + 2]);
+                    c[k + 2] = _mm_unpacklo_epi32(b[k + 1], b[k + 3]);
+                    c[k + 3] = _mm_unpackhi_epi32(b[k + 1], b[k + 3]);
+                }
+                for (int k = 0; k < 4; ++k) {
+                    Store128(output + 2 * k * count + i, _mm_unpacklo_epi64(c[k], c[k + 4]));
+                    Store128(output + (2 * k + 1) * count + i, _mm_unpackhi_epi64(c[k], c[k + 4]));
+                }
+            }
+            return i;
+        }
+
+        int64_t ByteUnshuffle8Sse2(const uint8_t *input, int64_t count, uint8_t *output) {
+            int64_t i = 0;
+            for (; i + 16 <= count; i += 16) {
+                __m128i p[8], q[8], r[8];
+                for (int k = 0; k < 8; ++k) {
+                    p[k] = Load128(input + k * count + i);
+                }
+                for (int k = 0; k < 8; k += 2) {
+                    q[k] = _mm_unpacklo_epi8(p[k], p[k + 1]);
+                    q[k + 1] = _mm_unpackhi_epi8(p[k], p[k + 1]);
+                }
+                // bytes 0-3 of elements 0-3, 4-7, 8-11 and 12-15, then bytes 4-7
+                for (int k = 0; k < 8; k += 4) {
+                    r[k] = _mm_unpacklo_epi16(q[k], q[k + 2]);
+                    r[k + 1] = _mm_unpackhi_epi16(q[k], q[k + 2]);
+                    r[k + 2] = _mm_unpacklo_epi16(q[k + 1], q[k + 3]);
+                    r[k + 3] = _mm_unpackhi_epi16(q[k + 1], q[k + 3]);
+                }
+                uint8_t *dst = output + i * 8;
+                for (int k = 0; k < 4; ++k) {
+                    Store128(dst + 32 * k, _mm_unpacklo_epi32(r[k], r[k + 4]));
+                    Store128(dst + 32 * k + 16, _mm_unpackhi_epi32(r[k], r[k + 4]));
+                }
+            }
+            return i;
+        }
+#endif
+
+        void ByteShuffle(const uint8_t *input, int64_t count, int32_t type_size, uint8_t *output) {
+            int64_t done = 0;
+#if defined(__SSE2__)
+            if (type_size == 4) {
+                done = ByteShuffle4Sse2(input, count, output);
+            } else if (type_size == 8) {
+                done = ByteShuffle8Sse2(input, count, output);
+            }
+#endif
+            ByteShuffleScalar(input, count, type_size, done, output);
+        }
+
+        void ByteUnshuffle(const uint8_t *input, int64_t count, int32_t type_size, uint8_t *output) {
+            int64_t done = 0;
+#if defined(__SSE2__)
+            if (type_size == 4) {
+                done = ByteUnshuffle4Sse2(input, count, output);
+            } else if (type_size == 8) {
+                done = ByteUnshuffle8Sse2(input, count, output);
+            }
+#endif
+            ByteUnshuffleScalar(input, count, type_size, done, output);
+        }
+
+        // ----------------------------------------------------------------------
+        // Bit shuffle kernels
+
+        // Transpose the 8x8 bit matrix whose rows are the bytes of x
+        inline uint64_t Transpose8x8(uint64_t x) {
+            uint64_t t;
+            t = (x ^ (x >> 7)) & 0x00aa00aa00aa00aaULL;
+            x = x ^ t ^ (t << 7);
+            t = (x ^ (x >> 14)) & 0x0000cccc0000ccccULL;
+            x = x ^ t ^ (t << 14);
+            t = (x ^ (x >> 28)) & 0x00000000f0f0f0f0ULL;
+            x = x ^ t ^ (t << 28);
+            return x;
+        }
+
+        // Split a plane of count bytes, count a multiple of 8, into 8 planes of
+        // count / 8 bytes, plane k holding bit k of every byte
+        void BitTranspose(const uint8_t *input, int64_t count, uint8_t *output) {
+            const int64_t plane_size = count / 8;
+            int64_t i = 0;
+#if defined(__SSE2__)
+            for (; i + 16 <= count; i += 16) {
+                __m128i x = Load128(input + i);
+                // movemask gathers the top bit of 16 bytes, shifting brings the
+                // next bit up; the bits crossing into the upper byte never
+                // reach its top bit within 7 shifts
+                for (int k = 7; k >= 0; --k) {
+                    turbo::little_endian::store16(output + k * plane_size + i / 8,
+                                                  static_cast<uint16_t>(_mm_movemask_epi8(x)));
+                    x = _mm_slli_epi16(x, 1);
+                }
+            }
+#endif
+            for (; i < count; i += 8) {
+                uint64_t x = Transpose8x8(turbo::little_endian::load64(input + i));
+                for (int k = 0; k < 8; ++k) {
+                    output[k * plane_size + i / 8] = static_cast<uint8_t>(x >> (8 * k));
+                }
+            }
+        }
+
+        void BitUntranspose(const uint8_t *input, int64_t count, uint8_t *output) {
+            const int64_t plane_size = count / 8;
+            for (int64_t i = 0; i < count; i += 8) {
+                uint64_t x = 0;
+                for (int k = 0; k < 8; ++k) {
+                    x |= static_cast<uint64_t>(input[k * plane_size + i / 8]) << (8 * k);
+                }
+                turbo::little_endian::store64(output + i, Transpose8x8(x));
+            }
+        }
+
+        void BitShuffle(const uint8_t *input, int64_t count, int32_t type_size, uint8_t *output) {
+            std::vector<uint8_t> shuffled(static_cast<size_t>(count * type_size));
+            ByteShuffle(input, count, type_size, shuffled.data());
+            for (int32_t j = 0; j < type_size; ++j) {
+                BitTranspose(shuffled.data() + j * count, count, output + j * count);
+            }
+        }
+
+        void BitUnshuffle(const uint8_t *input, int64_t count, int32_t type_size, uint8_t *output) {
+            std::vector<uint8_t> shuffled(static_cast<size_t>(count * type_size));
+            for (int32_t j = 0; j < type_size; ++j) {
+                BitUntranspose(input + j * count, count, shuffled.data() + j * count);
+            }
+            ByteUnshuffle(shuffled.data(), count, type_size, output);
+        }
+
+        // ----------------------------------------------------------------------
+        // Delta and xor kernels
+        //
+        // Elements are unsigned integers in native byte order, so deltas wrap.
+        // The encoding loops have no dependency between iterations and are
+        // vectorized by the compiler, decoding is a prefix sum.
+
+        template<typename T>
+        inline T LoadElement(const uint8_t *p) {
+            T v;
+            memcpy(&v, p, sizeof(T));
+            return v;
+        }
+
+        template<typename T>
+        inline void StoreElement(uint8_t *p, T v) { memcpy(p, &v, sizeof(T)); }
+
+        template<typename T>
+        void DeltaEncode(const uint8_t *input, int64_t count, uint8_t *output, bool use_xor) {
+            if (count == 0) {
+                return;
+            }
+            StoreElement<T>(output, LoadElement<T>(input));
+            for (int64_t i = 1; i < count; ++i) {
+                T v = LoadElement<T>(input + i * sizeof(T));
+                T prev = LoadElement<T>(input + (i - 1) * sizeof(T));
+                StoreElement<T>(output + i * sizeof(T), use_xor ? T(v ^ prev) : T(v - prev));
+            }
+        }
+
+        template<typename T>
+        void DeltaDecode(const uint8_t *input, int64_t count, uint8_t *output, bool use_xor) {
+            T prev = 0;
+            for (int64_t i = 0; i < count; ++i) {
+                T v = LoadElement<T>(input + i * sizeof(T));
+                prev = use_xor ? T(v ^ prev) : T(v + prev);
+                StoreElement<T>(output + i * sizeof(T), prev);
+            }
+        }
+
+        turbo::Status CheckFilter(FilterType filter, int32_t type_size) {
+            if (type_size < 1) {
+                return turbo::invalid_argument_error(turbo::str_cat("filter type size must be positive, got ",
+                                                                    type_size));
+            }
+            if ((filter == FilterType::DELTA || filter == FilterType::XOR) &&
+                type_size != 1 && type_size != 2 && type_size != 4 && type_size != 8) {
+                return turbo::invalid_argument_error(
+                        turbo::str_cat("delta and xor filters take a type size of 1, 2, 4 or 8, got ", type_size));
+            }
+            return turbo::OkStatus();
+        }
+
+        // Run the kernel matching type_size over count elements
+        template<template<typename> class Kernel, typename... Args>
+        void DispatchDelta(int32_t type_size, Args... args) {
+            switch (type_size) {
+                case 1:
+                    Kernel<uint8_t>::Run(args...);
+                    break;
+                case 2:
+                    Kernel<uint16_t>::Run(args...);
+                    break;
+                case 4:
+                    Kernel<uint32_t>::Run(args...);
+                    break;
+                default:
+                    Kernel<uint64_t>::Run(args...);
+                    break;
+            }
+        }
+
+        template<typename T>
+        struct DeltaEncodeKernel {
+            static void Run(const uint8_t *input, int64_t count, uint8_t *output, bool use_xor) {
+                DeltaEncode<T>(input, count, output, use_xor);
+            }
+        };
+
+        template<typename T>
+        struct DeltaDecodeKernel {
+            static void Run(const uint8_t *input, int64_t count, uint8_t *output, bool use_xor) {
+                DeltaDecode<T>(input, count, output, use_xor);
+            }
+        };
+
+        turbo::Status RunFilter(FilterType filter, int32_t type_size, const uint8_t *input, int64_t length,
+                                uint8_t *output, bool revert) {
+            STATUS_RETURN_IF_ERROR(CheckFilter(filter, type_size));
+            int64_t count = length / type_size;
+            if (filter == FilterType::BIT_SHUFFLE) {
+                count &= ~int64_t{7};
+            }
+            switch (filter) {
+                case FilterType::BYTE_SHUFFLE:
+                    (revert ? ByteUnshuffle : ByteShuffle)(input, count, type_size, output);
+                    break;
+                case FilterType::BIT_SHUFFLE:
+                    (revert ? BitUnshuffle : BitShuffle)(input, count, type_size, output);
+                    break;
+                case FilterType::DELTA:
+                case FilterType::XOR:
+                    if (revert) {
+                        DispatchDelta<DeltaDecodeKernel>(type_size, input, count, output,
+                                                         filter == FilterType::XOR);
+                    } else {
+                        DispatchDelta<DeltaEncodeKernel>(type_size, input, count, output,
+                                                         filter == FilterType::XOR);
+                    }
+                    break;
+                default:
+                    return turbo::invalid_argument_error("unknown filter type");
+            }
+            const int64_t filtered = count * type_size;
+            if (length > filtered) {
+                memcpy(output + filtered, input + filtered, static_cast<size_t>(length - filtered));
+            }
+            return turbo::OkStatus();
+        }
+
+        // ----------------------------------------------------------------------
+        // Filtered codec implementation
+
+        class FilteredCodec : public Codec {
+        public:
+            FilteredCodec(std::unique_ptr<Codec> codec, std::vector<FilterType> filters, int32_t type_size)
+                    : codec_(std::move(codec)), filters_(std::move(filters)), type_size_(type_size) {}
+
+            turbo::Result<int64_t> Decompress(int64_t input_len, const uint8_t *input,
+                                              int64_t output_buffer_len, uint8_t *output_buffer) override {
+                std::vector<uint8_t> filtered(static_cast<size_t>(output_buffer_len));
+                RESULT_ASSIGN_OR_RETURN(auto decompressed_len,
+                                        codec_->Decompress(input_len, input, output_buffer_len, filtered.data()));
+                STATUS_RETURN_IF_ERROR(Revert(std::move(filtered), decompressed_len, output_buffer));
+                return decompressed_len;
+            }
+
+            turbo::Result<std::vector<uint8_t>> Decompress(int64_t input_len, const uint8_t *input) override {
+                RESULT_ASSIGN_OR_RETURN(auto filtered, codec_->Decompress(input_len, input));
+                std::vector<uint8_t> output(filtered.size());
+                auto length = static_cast<int64_t>(filtered.size());
+                STATUS_RETURN_IF_ERROR(Revert(std::move(filtered), length, output.data()));
+                return output;
+            }
+
+            std::optional<int64_t> DecompressedLength(int64_t input_len, const uint8_t *input) override {
+                return codec_->DecompressedLength(input_len, input);
+            }
+
+            turbo::Result<int64_t> Compress(int64_t input_len, const uint8_t *input,
+                                            int64_t output_buffer_len, uint8_t *output_buffer) override {
+                std::vector<uint8_t> filtered(static_cast<size_t>(input_len));
+                std::vector<uint8_t> scratch(filters_.size() > 1 ? filtered.size() : 0);
+                const uint8_t *src = input;
+                for (size_t i = 0; i < filters_.size(); ++i) {
+                    // ping-pong so that the last filter writes to filtered
+                    uint8_t *dst = (filters_.size() - i) % 2 == 1 ? filtered.data() : scratch.data();
+                    STATUS_RETURN_IF_ERROR(ApplyFilter(filters_[i], type_size_, src, input_len, dst));
+                    src = dst;
+                }
+                return codec_->Compress(input_len, src, output_buffer_len, output_buffer);
+            }
+
+            int64_t MaxCompressedLen(int64_t input_len, const uint8_t *input) override {
+                return codec_->MaxCompressedLen(input_len, input);
+            }
+
+            turbo::Result<std::shared_ptr<Compressor>> MakeCompressor() override {
+                return turbo::unimplemented_error("Streaming compression unsupported with filters");
+            }
+
+            turbo::Result<std::shared_ptr<Decompressor>> MakeDecompressor() override {
+                return turbo::unimplemented_error("Streaming decompression unsupported with filters");
+            }
+
+            // the wrapped codec's type, which alone does not read the filtered format
+            CompressionType compression_type() const override { return codec_->compression_type(); }
+
+            int minimum_compression_level() const override { return codec_->minimum_compression_level(); }
+
+            int maximum_compression_level() const override { return codec_->maximum_compression_level(); }
+
+            int default_compression_level() const override { return codec_->default_compression_level(); }
+
+            int compression_level() const override { return codec_->compression_level(); }
+
+        private:
+            // Revert the filters of length bytes in filtered, ending in output
+            turbo::Status Revert(std::vector<uint8_t> filtered, int64_t length, uint8_t *output) {
+                if (filters_.empty()) {
+                    if (length > 0) {
+                        memcpy(output, filtered.data(), static_cast<size_t>(length));
+                    }
+                    return turbo::OkStatus();
+                }
+                std::vector<uint8_t> scratch(filters_.size() > 1 ? static_cast<size_t>(length) : 0);
+                const uint8_t *src = filtered.data();
+                for (size_t i = filters_.size(); i-- > 0;) {
+                    uint8_t *dst = i == 0 ? output : (src == scratch.data() ? filtered.data() : scratch.data());
+                    STATUS_RETURN_IF_ERROR(RevertFilter(filters_[i], type_size_, src, length, dst));
+                    src = dst;
+                }
+                return turbo::OkStatus();
+            }
+
+            std::unique_ptr<Codec> codec_;
+            const std::vector<FilterType> filters_;
+            const int32_t type_size_;
+        };
+
+    }  // namespace
+
+    turbo::Status ApplyFilter(FilterType filter, int32_t type_size, const uint8_t *input, int64_t length,
+                              uint8_t *output) {
+        return RunFilter(filter, type_size, input, length, output, false);
+    }
+
+    turbo::Status RevertFilter(FilterType filter, int32_t type_size, const uint8_t *input, int64_t length,
+                               uint8_t *output) {
+        return RunFilter(filter, type_size, input, length, output, true);
+    }
+
+    turbo::Result<std::unique_ptr<Codec>> MakeFilteredCodec(std::unique_ptr<Codec> codec,
+                                                           std::vector<FilterType> filters,
+                                                           int32_t type_size) {
+        if (codec == nullptr) {
+            return turbo::invalid_argument_error("filtered codec needs a codec");
+        }
+        for (auto filter: filters) {
+            STATUS_RETURN_IF_ERROR(CheckFilter(filter, type_size));
+        }
+        return std::make_unique<FilteredCodec>(std::move(codec), std::move(filters), type_size);
+    }
+
+}  // namespace alkaid
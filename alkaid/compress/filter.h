@@ -0,0 +1,76 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <turbo/base/macros.h>
+#include <turbo/utility/status.h>
+#include <alkaid/compress/compression.h>
+
+// Blosc style pre-filters for arrays of fixed width values.  They reorder or
+// transform the bytes so that a general purpose codec finds more redundancy:
+// the high bytes of timestamps or of similar floats are mostly equal, but
+// they are 4 or 8 bytes apart in the raw array.
+//
+// The filters see the input as elements of type_size bytes.  Trailing bytes
+// which don't form a whole element are passed through unchanged.
+
+namespace alkaid {
+
+    enum class FilterType : uint8_t {
+        /// Group byte i of every element together
+        BYTE_SHUFFLE,
+        /// Group bit i of every element together, element counts are rounded
+        /// down to a multiple of 8 and the rest is left as is
+        BIT_SHUFFLE,
+        /// Replace each element by its difference to the previous one, for integers
+        DELTA,
+        /// Replace each element by its xor with the previous one, for floats
+        XOR,
+    };
+
+    /// \brief Apply a filter, output must hold length bytes and not overlap input
+    TURBO_EXPORT turbo::Status ApplyFilter(FilterType filter, int32_t type_size, const uint8_t *input,
+                                           int64_t length, uint8_t *output);
+
+    /// \brief Undo a filter, output must hold length bytes and not overlap input
+    TURBO_EXPORT turbo::Status RevertFilter(FilterType filter, int32_t type_size, const uint8_t *input,
+                                            int64_t length, uint8_t *output);
+
+    /// \brief Wrap a codec, running filters over the data before compressing it
+    /// and reverting them after decompressing.
+    ///
+    /// Filters run in the given order and are reverted in reverse order.
+    /// DELTA and XOR take a type_size of 1, 2, 4 or 8.  The wrapper only does
+    /// one-shot compression, since the filters work on whole arrays.  Its
+    /// output is not readable by the bare codec.
+    ///
+    /// compression_type() and the compression levels are those of the wrapped
+    /// codec, so the type does not identify the format: Codec::Create() with
+    /// it gives a codec that decodes filtered data to garbage.  Record the
+    /// filters and their type_size next to the type, and rebuild the reader
+    /// with MakeFilteredCodec().
+    TURBO_EXPORT turbo::Result<std::unique_ptr<Codec>> MakeFilteredCodec(std::unique_ptr<Codec> codec,
+                                                                         std::vector<FilterType> filters,
+                                                                         int32_t type_size);
+
+}  // namespace alkaid
@@ -0,0 +1,267 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <alkaid/compress/xxhash.h>
+
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace alkaid::xxh3 {
+
+    namespace {
+
+        constexpr uint32_t kPrime32_1 = 0x9E3779B1u;
+        constexpr uint32_t kPrime32_2 = 0x85EBCA77u;
+        constexpr uint32_t kPrime32_3 = 0xC2B2AE3Du;
+        constexpr uint64_t kPrime64_1 = 0x9E3779B185EBCA87ull;
+        constexpr uint64_t kPrime64_2 = 0xC2B2AE3D27D4EB4Full;
+        constexpr uint64_t kPrime64_3 = 0x165667B19E3779F9ull;
+        constexpr uint64_t kPrime64_4 = 0x85EBCA77C2B2AE63ull;
+        constexpr uint64_t kPrime64_5 = 0x27D4EB2F165667C5ull;
+        constexpr uint64_t kPrimeMx1 = 0x165667919E3779F9ull;
+        constexpr uint64_t kPrimeMx2 = 0x9FB21C651E98DF25ull;
+
+        constexpr size_t kSecretSize = 192;
+        constexpr size_t kStripeLen = 64;
+        constexpr size_t kSecretConsumeRate = 8;
+        constexpr size_t kStripesPerBlock = (kSecretSize - kStripeLen) / kSecretConsumeRate;
+        constexpr size_t kBlockLen = kStripeLen * kStripesPerBlock;
+        constexpr size_t kMidSizeMax = 240;
+
+        // The default secret of the reference implementation, taken from FARSH
+        alignas(64) constexpr uint8_t kSecret[kSecretSize] = {
+                0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c, 0xf7, 0x21, 0xad, 0x1c,
+                0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb, 0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f,
+                0xcb, 0x79, 0xe6, 0x4e, 0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+                0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6, 0x81, 0x3a, 0x26, 0x4c,
+                0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb, 0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3,
+                0x71, 0x64, 0x48, 0x97, 0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+                0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7, 0xc7, 0x0b, 0x4f, 0x1d,
+                0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31, 0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64,
+                0xea, 0xc5, 0xac, 0x83, 0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+                0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16, 0x55, 0x26, 0x29, 0xd4, 0x68, 0x9e,
+                0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc, 0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce,
+                0x45, 0xcb, 0x3a, 0x8f, 0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e,
+        };
+
+        // values are read in host order, which is little endian on every
+        // platform alkaid builds for
+        inline uint32_t Read32(const uint8_t *p) {
+            uint32_t v;
+            memcpy(&v, p, sizeof(v));
+            return v;
+        }
+
+        inline uint64_t Read64(const uint8_t *p) {
+            uint64_t v;
+            memcpy(&v, p, sizeof(v));
+            return v;
+        }
+
+        inline uint64_t Rotl64(uint64_t v, int r) { return (v << r) | (v >> (64 - r)); }
+
+        inline uint64_t Mul128Fold64(uint64_t lhs, uint64_t rhs) {
+            auto product = static_cast<unsigned __int128>(lhs) * rhs;
+            return static_cast<uint64_t>(product) ^ static_cast<uint64_t>(product >> 64);
+        }
+
+        inline uint64_t Xxh64Avalanche(uint64_t h) {
+            h ^= h >> 33;
+            h *= kPrime64_2;
+            h ^= h >> 29;
+            h *= kPrime64_3;
+            h ^= h >> 32;
+            return h;
+        }
+
+        inline uint64_t Avalanche(uint64_t h) {
+            h ^= h >> 37;
+            h *= kPrimeMx1;
+            h ^= h >> 32;
+            return h;
+        }
+
+        inline uint64_t Rrmxmx(uint64_t h, uint64_t len) {
+            h ^= Rotl64(h, 49) ^ Rotl64(h, 24);
+            h *= kPrimeMx2;
+            h ^= (h >> 35) + len;
+            h *= kPrimeMx2;
+            return h ^ (h >> 28);
+        }
+
+        inline uint64_t Mix16B(const uint8_t *input, const uint8_t *secret) {
+            return Mul128Fold64(Read64(input) ^ Read64(secret), Read64(input + 8) ^ Read64(secret + 8));
+        }
+
+        uint64_t Hash0To16(const uint8_t *input, size_t len) {
+            if (len > 8) {
+                const uint64_t lo = Read64(input) ^ (Read64(kSecret + 24) ^ Read64(kSecret + 32));
+                const uint64_t hi = Read64(input + len - 8) ^ (Read64(kSecret + 40) ^ Read64(kSecret + 48));
+                return Avalanche(len + __builtin_bswap64(lo) + hi + Mul128Fold64(lo, hi));
+            }
+            if (len >= 4) {
+                const uint64_t input64 = Read32(input + len - 4) + (static_cast<uint64_t>(Read32(input)) << 32);
+                return Rrmxmx(input64 ^ (Read64(kSecret + 8) ^ Read64(kSecret + 16)), len);
+            }
+            if (len > 0) {
+                const uint32_t combined = (static_cast<uint32_t>(input[0]) << 16) |
+                                          (static_cast<uint32_t>(input[len >> 1]) << 24) |
+                                          static_cast<uint32_t>(input[len - 1]) |
+                                          (static_cast<uint32_t>(len) << 8);
+                return Xxh64Avalanche(combined ^ static_cast<uint64_t>(Read32(kSecret) ^ Read32(kSecret + 4)));
+            }
+            return Xxh64Avalanche(Read64(kSecret + 56) ^ Read64(kSecret + 64));
+        }
+
+        uint64_t Hash17To128(const uint8_t *input, size_t len) {
+            uint64_t acc = len * kPrime64_1;
+            if (len > 32) {
+                if (len > 64) {
+                    if (len > 96) {
+                        acc += Mix16B(input + 48, kSecret + 96);
+                        acc += Mix16B(input + len - 64, kSecret + 112);
+                    }
+                    acc += Mix16B(input + 32, kSecret + 64);
+                    acc += Mix16B(input + len - 48, kSecret + 80);
+                }
+                acc += Mix16B(input + 16, kSecret + 32);
+                acc += Mix16B(input + len - 32, kSecret + 48);
+            }
+            acc += Mix16B(input, kSecret);
+            acc += Mix16B(input + len - 16, kSecret + 16);
+            return Avalanche(acc);
+        }
+
+        uint64_t Hash129To240(const uint8_t *input, size_t len) {
+            constexpr size_t kSecretSizeMin = 136;
+            constexpr size_t kStartOffset = 3;
+            constexpr size_t kLastOffset = 17;
+            uint64_t acc = len * kPrime64_1;
+            for (size_t i = 0; i < 8; ++i) {
+                acc += Mix16B(input + 16 * i, kSecret + 16 * i);
+            }
+            acc = Avalanche(acc);
+            uint64_t acc_end = Mix16B(input + len - 16, kSecret + kSecretSizeMin - kLastOffset);
+            for (size_t i = 8; i < len / 16; ++i) {
+                acc_end += Mix16B(input + 16 * i, kSecret + 16 * (i - 8) + kStartOffset);
+            }
+            return Avalanche(acc + acc_end);
+        }
+
+        // ----------------------------------------------------------------------
+        // Long inputs: 8 lanes accumulate 64 byte stripes, and are scrambled
+        // after each block of 16 stripes
+
+#if defined(__SSE2__)
+        inline void Accumulate512(uint64_t *acc, const uint8_t *input, const uint8_t *secret) {
+            auto *xacc = reinterpret_cast<__m128i *>(acc);
+            for (int i = 0; i < 4; ++i) {
+                __m128i data_vec = _mm_loadu_si128(reinterpret_cast<const __m128i *>(input) + i);
+                __m128i key_vec = _mm_loadu_si128(reinterpret_cast<const __m128i *>(secret) + i);
+                __m128i data_key = _mm_xor_si128(data_vec, key_vec);
+                __m128i data_key_lo = _mm_shuffle_epi32(data_key, _MM_SHUFFLE(0, 3, 0, 1));
+                __m128i product = _mm_mul_epu32(data_key, data_key_lo);
+                __m128i data_swap = _mm_shuffle_epi32(data_vec, _MM_SHUFFLE(1, 0, 3, 2));
+                __m128i sum = _mm_add_epi64(_mm_load_si128(xacc + i), data_swap);
+                _mm_store_si128(xacc + i, _mm_add_epi64(product, sum));
+            }
+        }
+
+        inline void ScrambleAcc(uint64_t *acc, const uint8_t *secret) {
+            auto *xacc = reinterpret_cast<__m128i *>(acc);
+            const __m128i prime32 = _mm_set1_epi32(static_cast<int>(kPrime32_1));
+            for (int i = 0; i < 4; ++i) {
+                __m128i acc_vec = _mm_load_si128(xacc + i);
+                __m128i data_vec = _mm_xor_si128(acc_vec, _mm_srli_epi64(acc_vec, 47));
+                __m128i key_vec = _mm_loadu_si128(reinterpret_cast<const __m128i *>(secret) + i);
+                __m128i data_key = _mm_xor_si128(data_vec, key_vec);
+                __m128i data_key_hi = _mm_shuffle_epi32(data_key, _MM_SHUFFLE(0, 3, 0, 1));
+                __m128i prod_lo = _mm_mul_epu32(data_key, prime32);
+                __m128i prod_hi = _mm_mul_epu32(data_key_hi, prime32);
+                _mm_store_si128(xacc + i, _mm_add_epi64(prod_lo, _mm_slli_epi64(prod_hi, 32)));
+            }
+        }
+#else
+        inline void Accumulate512(uint64_t *acc, const uint8_t *input, const uint8_t *secret) {
+            for (size_t i = 0; i < 8; ++i) {
+                const uint64_t data_val = Read64(input + 8 * i);
+                const uint64_t data_key = data_val ^ Read64(secret + 8 * i);
+                acc[i ^ 1] += data_val;
+                acc[i] += (data_key & 0xffffffffu) * (data_key >> 32);
+            }
+        }
+
+        inline void ScrambleAcc(uint64_t *acc, const uint8_t *secret) {
+            for (size_t i = 0; i < 8; ++i) {
+                uint64_t acc64 = acc[i];
+                acc64 ^= acc64 >> 47;
+                acc64 ^= Read64(secret + 8 * i);
+                acc[i] = acc64 * kPrime32_1;
+            }
+        }
+#endif
+
+        uint64_t HashLong(const uint8_t *input, size_t len) {
+            alignas(16) uint64_t acc[8] = {kPrime32_3, kPrime64_1, kPrime64_2, kPrime64_3,
+                                           kPrime64_4, kPrime32_2, kPrime64_5, kPrime32_1};
+            const size_t blocks = (len - 1) / kBlockLen;
+            for (size_t n = 0; n < blocks; ++n) {
+                const uint8_t *block = input + n * kBlockLen;
+                for (size_t s = 0; s < kStripesPerBlock; ++s) {
+                    Accumulate512(acc, block + s * kStripeLen, kSecret + s * kSecretConsumeRate);
+                }
+                ScrambleAcc(acc, kSecret + kSecretSize - kStripeLen);
+            }
+            // the last partial block, then the last stripe which may overlap it
+            const size_t stripes = ((len - 1) - kBlockLen * blocks) / kStripeLen;
+            const uint8_t *block = input + blocks * kBlockLen;
+            for (size_t s = 0; s < stripes; ++s) {
+                Accumulate512(acc, block + s * kStripeLen, kSecret + s * kSecretConsumeRate);
+            }
+            constexpr size_t kLastAccStart = 7;
+            Accumulate512(acc, input + len - kStripeLen, kSecret + kSecretSize - kStripeLen - kLastAccStart);
+
+            constexpr size_t kMergeAccsStart = 11;
+            uint64_t result = len * kPrime64_1;
+            for (size_t i = 0; i < 4; ++i) {
+                const uint8_t *secret = kSecret + kMergeAccsStart + 16 * i;
+                result += Mul128Fold64(acc[2 * i] ^ Read64(secret), acc[2 * i + 1] ^ Read64(secret + 8));
+            }
+            return Avalanche(result);
+        }
+
+    }  // namespace
+
+    uint64_t hash64(const void *data, size_t n) {
+        auto p = static_cast<const uint8_t *>(data);
+        if (n <= 16) {
+            return Hash0To16(p, n);
+        }
+        if (n <= 128) {
+            return Hash17To128(p, n);
+        }
+        if (n <= kMidSizeMax) {
+            return Hash129To240(p, n);
+        }
+        return HashLong(p, n);
+    }
+
+}  // namespace alkaid::xxh3
@@ -0,0 +1,33 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace alkaid::xxh3 {
+
+    /// \brief Return the 64 bit XXH3 hash of data[0,n-1], with seed 0 and
+    /// the default secret.
+    ///
+    /// The result matches XXH3_64bits() of the reference xxHash library.
+    /// Inputs over 240 bytes are accumulated with SSE2 when available.
+    uint64_t hash64(const void *data, size_t n);
+
+}  // namespace alkaid::xxh3
@@ -0,0 +1,496 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <alkaid/files/bgzf_file.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+namespace alkaid {
+
+    namespace {
+
+        constexpr const char *kBgzfIndexSuffix = ".gzi";
+
+        std::shared_ptr<ThreadPool> make_pool(int threads) {
+            if (threads == 1) {
+                return nullptr;
+            }
+            return std::make_shared<ThreadPool>(static_cast<size_t>(std::max(threads, 0)));
+        }
+
+        bool is_ready(const std::future<turbo::Result<std::vector<uint8_t>>> &future) {
+            return future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+        }
+
+    }  // namespace
+
+    // ----------------------------------------------------------------------
+    // BgzfFileWriter implementation
+
+    BgzfFileWriter::BgzfFileWriter(std::shared_ptr<SequentialFileWriter> file,
+                                   std::shared_ptr<SequentialFileWriter> index_file)
+            : file_(std::move(file)), index_file_(std::move(index_file)) {
+    }
+
+    BgzfFileWriter::~BgzfFileWriter() {
+        auto r = close_impl();
+        (void) r;
+    }
+
+    turbo::Status BgzfFileWriter::open(const std::string &path, std::any options, FileEventListener listener) noexcept {
+        auto r = close_impl();
+        (void) r;
+        options_ = BgzfWriteOptions();
+        if (options.has_value()) {
+            try {
+                options_ = std::any_cast<BgzfWriteOptions>(options);
+            } catch (const std::bad_any_cast &e) {
+                return turbo::invalid_argument_error("invalid options");
+            }
+        }
+        path_ = path;
+        pool_ = make_pool(options_.threads);
+        max_in_flight_ = pool_ ? 2 * pool_->size() : 0;
+        block_.clear();
+        block_.reserve(kBgzfMaxBlockDataSize);
+        uncompressed_size_ = 0;
+        compressed_written_ = 0;
+        uncompressed_written_ = 0;
+        index_ = BgzfIndex();
+        STATUS_RETURN_IF_ERROR(file_->open(path, options_.file_options, listener));
+        opened_ = true;
+        return turbo::OkStatus();
+    }
+
+    turbo::Result<int64_t> BgzfFileWriter::tell() const noexcept {
+        if (!opened_) {
+            return turbo::invalid_argument_error("file not open");
+        }
+        return static_cast<int64_t>(uncompressed_size_);
+    }
+
+    turbo::Result<size_t> BgzfFileWriter::size() const noexcept {
+        if (!opened_) {
+            return turbo::unavailable_error("file not opened");
+        }
+        return uncompressed_size_;
+    }
+
+    turbo::Status BgzfFileWriter::flush() {
+        if (!opened_) {
+            return turbo::invalid_argument_error("file not open");
+        }
+        STATUS_RETURN_IF_ERROR(dispatch_block());
+        STATUS_RETURN_IF_ERROR(write_blocks(true));
+        return file_->flush();
+    }
+
+    turbo::Status BgzfFileWriter::truncate(size_t size) noexcept {
+        (void) size;
+        return turbo::unimplemented_error("bgzf files can not be truncated");
+    }
+
+    turbo::Result<uint64_t> BgzfFileWriter::virtual_tell() {
+        if (!opened_) {
+            return turbo::invalid_argument_error("file not open");
+        }
+        STATUS_RETURN_IF_ERROR(write_blocks(true));
+        return MakeBgzfVirtualOffset(compressed_written_, static_cast<uint32_t>(block_.size()));
+    }
+
+    turbo::Status BgzfFileWriter::append_impl(const void *buff, size_t len) noexcept {
+        if (!opened_) {
+            return turbo::invalid_argument_error("file not open");
+        }
+        auto data = static_cast<const uint8_t *>(buff);
+        while (len > 0) {
+            auto n = std::min(len, static_cast<size_t>(kBgzfMaxBlockDataSize) - block_.size());
+            block_.insert(block_.end(), data, data + n);
+            data += n;
+            len -= n;
+            uncompressed_size_ += n;
+            // a full block goes out at once, so block_ always has room for the next byte
+            if (block_.size() == static_cast<size_t>(kBgzfMaxBlockDataSize)) {
+                STATUS_RETURN_IF_ERROR(dispatch_block());
+            }
+        }
+        return turbo::OkStatus();
+    }
+
+    turbo::Status BgzfFileWriter::dispatch_block() {
+        if (block_.empty()) {
+            return turbo::OkStatus();
+        }
+        std::vector<uint8_t> data = std::move(block_);
+        block_.clear();
+        block_.reserve(kBgzfMaxBlockDataSize);
+        auto level = options_.compression_level;
+        if (pool_ == nullptr) {
+            RESULT_ASSIGN_OR_RETURN(auto block, CompressBgzfBlock(data.data(), data.size(), level));
+            return write_block(block, data.size());
+        }
+        auto data_len = data.size();
+        pending_.push_back(PendingBlock{pool_->submit([data = std::move(data), level]() {
+            return CompressBgzfBlock(data.data(), data.size(), level);
+        }), data_len});
+        return write_blocks(false);
+    }
+
+    turbo::Status BgzfFileWriter::write_blocks(bool wait_all) {
+        while (!pending_.empty()) {
+            auto &front = pending_.front();
+            if (!wait_all && pending_.size() <= max_in_flight_ && !is_ready(front.block)) {
+                break;
+            }
+            auto result = front.block.get();
+            auto data_len = front.data_len;
+            pending_.pop_front();
+            RESULT_ASSIGN_OR_RETURN(auto block, std::move(result));
+            STATUS_RETURN_IF_ERROR(write_block(block, data_len));
+        }
+        return turbo::OkStatus();
+    }
+
+    turbo::Status BgzfFileWriter::write_block(const std::vector<uint8_t> &block, size_t data_len) {
+        STATUS_RETURN_IF_ERROR(file_->append(block.data(), block.size()));
+        compressed_written_ += block.size();
+        uncompressed_written_ += data_len;
+        index_.Add(compressed_written_, uncompressed_written_);
+        return turbo::OkStatus();
+    }
+
+    turbo::Status BgzfFileWriter::close_impl() noexcept {
+        if (!opened_) {
+            return turbo::OkStatus();
+        }
+        opened_ = false;
+        auto status = dispatch_block();
+        auto write_status = write_blocks(true);
+        if (status.ok()) {
+            status = write_status;
+        }
+        if (status.ok()) {
+            status = file_->append(BgzfEofBlock());
+        }
+        auto close_status = file_->close();
+        if (status.ok()) {
+            status = close_status;
+        }
+        pending_.clear();
+        if (status.ok() && index_file_ != nullptr) {
+            status = index_file_->open(path_ + kBgzfIndexSuffix, options_.file_options);
+            if (status.ok()) {
+                status = index_file_->append(index_.Serialize());
+                close_status = index_file_->close();
+                if (status.ok()) {
+                    status = close_status;
+                }
+            }
+        }
+        return status;
+    }
+
+    // ----------------------------------------------------------------------
+    // BgzfFileReader implementation
+
+    BgzfFileReader::BgzfFileReader(std::shared_ptr<SequentialFileReader> file) : file_(std::move(file)) {
+    }
+
+    BgzfFileReader::~BgzfFileReader() {
+        auto r = close();
+        (void) r;
+    }
+
+    turbo::Status BgzfFileReader::open(const std::string &path, std::any options, FileEventListener listener) noexcept {
+        auto r = close();
+        (void) r;
+        BgzfReadOptions read_options;
+        if (options.has_value()) {
+            try {
+                read_options = std::any_cast<BgzfReadOptions>(options);
+            } catch (const std::bad_any_cast &e) {
+                return turbo::invalid_argument_error("invalid options");
+            }
+        }
+        path_ = path;
+        pool_ = make_pool(read_options.threads);
+        max_in_flight_ = pool_ ? 2 * pool_->size() : 1;
+        next_offset_ = 0;
+        file_eof_ = false;
+        block_.clear();
+        block_pos_ = 0;
+        block_offset_ = 0;
+        block_size_ = 0;
+        position_ = 0;
+        return file_->open(path, read_options.file_options, listener);
+    }
+
+    turbo::Status BgzfFileReader::close() noexcept {
+        // let the blocks in flight finish before their input goes away
+        for (auto &pending: pending_) {
+            pending.data.wait();
+        }
+        pending_.clear();
+        return file_->close();
+    }
+
+    turbo::Result<int64_t> BgzfFileReader::tell() const noexcept {
+        return static_cast<int64_t>(position_);
+    }
+
+    turbo::Result<size_t> BgzfFileReader::size() const noexcept {
+        return turbo::unavailable_error("the uncompressed size of a bgzf file is only known from its index");
+    }
+
+    turbo::Status BgzfFileReader::advance(off_t n) noexcept {
+        uint8_t buff[4096];
+        while (n > 0) {
+            RESULT_ASSIGN_OR_RETURN(auto read_size, read_impl(buff, std::min(static_cast<size_t>(n), sizeof(buff))));
+            if (read_size == 0) {
+                return turbo::out_of_range_error("advance past the end of the file");
+            }
+            n -= static_cast<off_t>(read_size);
+        }
+        return turbo::OkStatus();
+    }
+
+    uint64_t BgzfFileReader::virtual_tell() const {
+        if (block_pos_ < block_.size()) {
+            return MakeBgzfVirtualOffset(block_offset_, static_cast<uint32_t>(block_pos_));
+        }
+        return MakeBgzfVirtualOffset(block_offset_ + block_size_, 0);
+    }
+
+    turbo::Result<size_t> BgzfFileReader::read_impl(void *buff, size_t len) noexcept {
+        auto out = static_cast<uint8_t *>(buff);
+        size_t total = 0;
+        while (total < len) {
+            STATUS_RETURN_IF_ERROR(fill_block());
+            if (block_pos_ == block_.size()) {
+                break;
+            }
+            auto n = std::min(len - total, block_.size() - block_pos_);
+            memcpy(out + total, block_.data() + block_pos_, n);
+            block_pos_ += n;
+            total += n;
+        }
+        position_ += total;
+        return total;
+    }
+
+    turbo::Status BgzfFileReader::fill_block() {
+        while (block_pos_ == block_.size()) {
+            // keep the pool busy with the blocks that follow
+            while (!file_eof_ && pending_.size() < max_in_flight_) {
+                std::vector<uint8_t> raw;
+                RESULT_ASSIGN_OR_RETURN(bool has_block, read_raw_block(&raw));
+                if (!has_block) {
+                    file_eof_ = true;
+                    break;
+                }
+                PendingBlock pending;
+                pending.offset = next_offset_;
+                pending.size = raw.size();
+                next_offset_ += raw.size();
+                if (pool_ != nullptr) {
+                    pending.data = pool_->submit([raw = std::move(raw)]() {
+                        return DecompressBgzfBlock(raw.data(), raw.size());
+                    });
+                } else {
+                    std::promise<turbo::Result<std::vector<uint8_t>>> promise;
+                    promise.set_value(DecompressBgzfBlock(raw.data(), raw.size()));
+                    pending.data = promise.get_future();
+                }
+                pending_.push_back(std::move(pending));
+            }
+            if (pending_.empty()) {
+                return turbo::OkStatus();
+            }
+            auto result = pending_.front().data.get();
+            block_offset_ = pending_.front().offset;
+            block_size_ = pending_.front().size;
+            pending_.pop_front();
+            RESULT_ASSIGN_OR_RETURN(block_, std::move(result));
+            block_pos_ = 0;
+        }
+        return turbo::OkStatus();
+    }
+
+    turbo::Result<bool> BgzfFileReader::read_raw_block(std::vector<uint8_t> *block) {
+        block->resize(kBgzfFixedHeaderSize);
+        RESULT_ASSIGN_OR_RETURN(auto n, read_fully(block->data(), kBgzfFixedHeaderSize));
+        if (n == 0) {
+            return false;
+        }
+        RESULT_ASSIGN_OR_RETURN(auto header_size, BgzfHeaderSize(block->data(), n));
+        block->resize(header_size);
+        RESULT_ASSIGN_OR_RETURN(n, read_fully(block->data() + kBgzfFixedHeaderSize,
+                                              header_size - kBgzfFixedHeaderSize));
+        RESULT_ASSIGN_OR_RETURN(auto block_size, BgzfBlockSize(block->data(), kBgzfFixedHeaderSize + n));
+        block->resize(block_size);
+        RESULT_ASSIGN_OR_RETURN(n, read_fully(block->data() + header_size, block_size - header_size));
+        if (static_cast<int64_t>(n) != block_size - header_size) {
+            return turbo::Status(turbo::StatusCode::kDataLoss, "truncated bgzf block");
+        }
+        return true;
+    }
+
+    turbo::Result<size_t> BgzfFileReader::read_fully(uint8_t *buff, size_t len) {
+        size_t total = 0;
+        while (total < len) {
+            RESULT_ASSIGN_OR_RETURN(auto n, file_->read(buff + total, len - total));
+            if (n == 0) {
+                break;
+            }
+            total += n;
+        }
+        return total;
+    }
+
+    // ----------------------------------------------------------------------
+    // BgzfRandomReadFile implementation
+
+    BgzfRandomReadFile::BgzfRandomReadFile(std::shared_ptr<RandomAccessFileReader> file,
+                                           std::shared_ptr<RandomAccessFileReader> index_file)
+            : file_(std::move(file)), index_file_(std::move(index_file)) {
+    }
+
+    BgzfRandomReadFile::~BgzfRandomReadFile() {
+        auto r = close();
+        (void) r;
+    }
+
+    turbo::Status BgzfRandomReadFile::open(const std::string &path, std::any options,
+                                           FileEventListener listener) noexcept {
+        auto r = close();
+        (void) r;
+        path_ = path;
+        block_.clear();
+        block_offset_ = std::numeric_limits<uint64_t>::max();
+        block_size_ = 0;
+        index_ = BgzfIndex();
+        has_index_ = false;
+        STATUS_RETURN_IF_ERROR(file_->open(path, options, listener));
+        RESULT_ASSIGN_OR_RETURN(file_size_, file_->size());
+        if (index_file_ != nullptr) {
+            STATUS_RETURN_IF_ERROR(index_file_->open(path + kBgzfIndexSuffix, options));
+            std::string content;
+            auto rs = index_file_->read_at(0, &content);
+            auto close_status = index_file_->close();
+            if (!rs.ok()) {
+                return rs.status();
+            }
+            STATUS_RETURN_IF_ERROR(close_status);
+            RESULT_ASSIGN_OR_RETURN(index_, BgzfIndex::Parse(content));
+            has_index_ = true;
+        }
+        return turbo::OkStatus();
+    }
+
+    turbo::Status BgzfRandomReadFile::close() noexcept {
+        block_.clear();
+        block_offset_ = std::numeric_limits<uint64_t>::max();
+        return file_->close();
+    }
+
+    turbo::Result<int64_t> BgzfRandomReadFile::tell() const noexcept {
+        return file_->tell();
+    }
+
+    turbo::Result<size_t> BgzfRandomReadFile::size() const noexcept {
+        if (!has_index_) {
+            return turbo::unavailable_error("the uncompressed size of a bgzf file is only known from its index");
+        }
+        return index_.uncompressed_size();
+    }
+
+    turbo::Result<size_t> BgzfRandomReadFile::read_uncompressed_at(uint64_t offset, void *buff, size_t len) {
+        if (!has_index_) {
+            return turbo::unavailable_error("reading at an uncompressed offset needs the bgzf index");
+        }
+        RESULT_ASSIGN_OR_RETURN(auto virtual_offset, index_.VirtualOffset(offset));
+        return read_at_impl(static_cast<off_t>(virtual_offset), buff, len);
+    }
+
+    turbo::Result<size_t> BgzfRandomReadFile::read_at_impl(off_t offset, void *buff, size_t len) {
+        auto out = static_cast<uint8_t *>(buff);
+        uint64_t block_offset = BgzfBlockOffset(static_cast<uint64_t>(offset));
+        size_t pos = BgzfOffsetInBlock(static_cast<uint64_t>(offset));
+        size_t total = 0;
+        while (total < len) {
+            STATUS_RETURN_IF_ERROR(load_block(block_offset));
+            if (block_size_ == 0) {
+                break;
+            }
+            if (pos > block_.size()) {
+                return turbo::out_of_range_error("virtual offset beyond the end of its block");
+            }
+            auto n = std::min(len - total, block_.size() - pos);
+            if (n > 0) {
+                memcpy(out + total, block_.data() + pos, n);
+            }
+            total += n;
+            block_offset += block_size_;
+            pos = 0;
+        }
+        return total;
+    }
+
+    turbo::Status BgzfRandomReadFile::load_block(uint64_t block_offset) {
+        if (block_offset == block_offset_) {
+            return turbo::OkStatus();
+        }
+        // only a block loaded in full is cached
+        block_offset_ = std::numeric_limits<uint64_t>::max();
+        block_.clear();
+        block_size_ = 0;
+        if (block_offset >= file_size_) {
+            block_offset_ = block_offset;
+            return turbo::OkStatus();
+        }
+        auto available = file_size_ - block_offset;
+        std::vector<uint8_t> raw(std::min<uint64_t>(available, kBgzfBlockHeaderSize));
+        RESULT_ASSIGN_OR_RETURN(auto n, file_->read_at(static_cast<off_t>(block_offset), raw.data(), raw.size()));
+        RESULT_ASSIGN_OR_RETURN(auto header_size, BgzfHeaderSize(raw.data(), n));
+        if (static_cast<int64_t>(n) < header_size) {
+            raw.resize(std::min<uint64_t>(available, header_size));
+            RESULT_ASSIGN_OR_RETURN(n, file_->read_at(static_cast<off_t>(block_offset), raw.data(), raw.size()));
+        }
+        RESULT_ASSIGN_OR_RETURN(auto block_size, BgzfBlockSize(raw.data(), n));
+        if (static_cast<uint64_t>(block_size) > available) {
+            return turbo::Status(turbo::StatusCode::kDataLoss, "truncated bgzf block");
+        }
+        raw.resize(block_size);
+        size_t read_size = n;
+        while (read_size < raw.size()) {
+            RESULT_ASSIGN_OR_RETURN(n, file_->read_at(static_cast<off_t>(block_offset + read_size),
+                                                      raw.data() + read_size, raw.size() - read_size));
+            if (n == 0) {
+                return turbo::Status(turbo::StatusCode::kDataLoss, "truncated bgzf block");
+            }
+            read_size += n;
+        }
+        RESULT_ASSIGN_OR_RETURN(block_, DecompressBgzfBlock(raw.data(), raw.size()));
+        block_offset_ = block_offset;
+        block_size_ = block_size;
+        return turbo::OkStatus();
+    }
+
+}  // namespace alkaid
@@ -0,0 +1,246 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <any>
+#include <deque>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <alkaid/compress/bgzf.h>
+#include <alkaid/compress/compression.h>
+#include <alkaid/files/interface.h>
+#include <alkaid/utility/thread_pool.h>
+
+namespace alkaid {
+
+    struct BgzfWriteOptions {
+        int compression_level{kUseDefaultCompressionLevel};
+        /// threads compressing blocks, 1 compresses inline and 0 uses the hardware concurrency
+        int threads{1};
+        /// passed to open() of the underlying file
+        std::any file_options;
+    };
+
+    struct BgzfReadOptions {
+        /// threads inflating blocks ahead of the reader, 1 inflates inline and
+        /// 0 uses the hardware concurrency
+        int threads{1};
+        /// passed to open() of the underlying file
+        std::any file_options;
+    };
+
+    /// \brief Writes a BGZF file through an underlying file.
+    ///
+    /// Blocks are compressed on a thread pool and written in order.  When an
+    /// index file is given, the ".gzi" index is written to path + ".gzi" on close.
+    class TURBO_EXPORT BgzfFileWriter : public SequentialFileWriter {
+    public:
+        explicit BgzfFileWriter(std::shared_ptr<SequentialFileWriter> file,
+                                std::shared_ptr<SequentialFileWriter> index_file = nullptr);
+
+        ~BgzfFileWriter() override;
+
+        turbo::Status open(const std::string &path, std::any options, FileEventListener listener) noexcept override;
+
+        turbo::Status close() noexcept override {
+            return close_impl();
+        }
+
+        /// uncompressed bytes appended
+        turbo::Result<int64_t> tell() const noexcept override;
+
+        FileMode mode() const noexcept override {
+            return FileMode::WRITE;
+        }
+
+        const std::string &path() const noexcept override {
+            return path_;
+        }
+
+        /// uncompressed bytes appended
+        turbo::Result<size_t> size() const noexcept override;
+
+        /// ends the current block, so a reader sees everything appended so far
+        turbo::Status flush() override;
+
+        turbo::Status truncate(size_t size) noexcept override;
+
+        /// virtual offset of the next byte appended, waits for the blocks in flight
+        turbo::Result<uint64_t> virtual_tell();
+
+        const BgzfIndex &index() const { return index_; }
+
+    private:
+        turbo::Status append_impl(const void *buff, size_t len) noexcept override;
+
+        turbo::Status dispatch_block();
+
+        turbo::Status write_blocks(bool wait_all);
+
+        turbo::Status write_block(const std::vector<uint8_t> &block, size_t data_len);
+
+        turbo::Status close_impl() noexcept;
+
+    private:
+        struct PendingBlock {
+            std::future<turbo::Result<std::vector<uint8_t>>> block;
+            size_t data_len{0};
+        };
+
+        std::shared_ptr<SequentialFileWriter> file_;
+        std::shared_ptr<SequentialFileWriter> index_file_;
+        std::string path_;
+        BgzfWriteOptions options_;
+        std::shared_ptr<ThreadPool> pool_;
+        size_t max_in_flight_{0};
+        bool opened_{false};
+
+        std::vector<uint8_t> block_;
+        std::deque<PendingBlock> pending_;
+        uint64_t uncompressed_size_{0};
+        uint64_t compressed_written_{0};
+        uint64_t uncompressed_written_{0};
+        BgzfIndex index_;
+    };
+
+    /// \brief Reads a BGZF file sequentially, inflating blocks ahead of the
+    /// reader on a thread pool.
+    class TURBO_EXPORT BgzfFileReader : public SequentialFileReader {
+    public:
+        explicit BgzfFileReader(std::shared_ptr<SequentialFileReader> file);
+
+        ~BgzfFileReader() override;
+
+        turbo::Status open(const std::string &path, std::any options, FileEventListener listener) noexcept override;
+
+        turbo::Status close() noexcept override;
+
+        /// uncompressed bytes read
+        turbo::Result<int64_t> tell() const noexcept override;
+
+        FileMode mode() const noexcept override {
+            return FileMode::READ;
+        }
+
+        const std::string &path() const noexcept override {
+            return path_;
+        }
+
+        /// the uncompressed size is only known from the index, see BgzfRandomReadFile
+        turbo::Result<size_t> size() const noexcept override;
+
+        turbo::Status advance(off_t n) noexcept override;
+
+        /// virtual offset of the next byte read
+        uint64_t virtual_tell() const;
+
+    private:
+        turbo::Result<size_t> read_impl(void *buff, size_t len) noexcept override;
+
+        turbo::Status fill_block();
+
+        turbo::Result<bool> read_raw_block(std::vector<uint8_t> *block);
+
+        turbo::Result<size_t> read_fully(uint8_t *buff, size_t len);
+
+    private:
+        struct PendingBlock {
+            std::future<turbo::Result<std::vector<uint8_t>>> data;
+            uint64_t offset{0};
+            uint64_t size{0};
+        };
+
+        std::shared_ptr<SequentialFileReader> file_;
+        std::string path_;
+        std::shared_ptr<ThreadPool> pool_;
+        size_t max_in_flight_{1};
+
+        std::deque<PendingBlock> pending_;
+        // compressed offset of the next block to read from the file
+        uint64_t next_offset_{0};
+        bool file_eof_{false};
+
+        std::vector<uint8_t> block_;
+        size_t block_pos_{0};
+        uint64_t block_offset_{0};
+        uint64_t block_size_{0};
+        uint64_t position_{0};
+    };
+
+    /// \brief Random access to a BGZF file.
+    ///
+    /// read_at() takes virtual offsets.  With an index file, the ".gzi" index
+    /// at path + ".gzi" is loaded on open, which gives size() and
+    /// read_uncompressed_at().  The last block read is cached, so reads close
+    /// to each other inflate it once.  Not thread safe.
+    class TURBO_EXPORT BgzfRandomReadFile : public RandomAccessFileReader {
+    public:
+        explicit BgzfRandomReadFile(std::shared_ptr<RandomAccessFileReader> file,
+                                    std::shared_ptr<RandomAccessFileReader> index_file = nullptr);
+
+        ~BgzfRandomReadFile() override;
+
+        /// options are passed to open() of the underlying files
+        turbo::Status open(const std::string &path, std::any options, FileEventListener listener) noexcept override;
+
+        turbo::Status close() noexcept override;
+
+        turbo::Result<int64_t> tell() const noexcept override;
+
+        FileMode mode() const noexcept override {
+            return FileMode::READ;
+        }
+
+        const std::string &path() const noexcept override {
+            return path_;
+        }
+
+        /// uncompressed size, needs the index
+        turbo::Result<size_t> size() const noexcept override;
+
+        /// read at an uncompressed offset, needs the index
+        turbo::Result<size_t> read_uncompressed_at(uint64_t offset, void *buff, size_t len);
+
+        bool has_index() const { return has_index_; }
+
+        const BgzfIndex &index() const { return index_; }
+
+    private:
+        turbo::Result<size_t> read_at_impl(off_t offset, void *buff, size_t len) override;
+
+        turbo::Status load_block(uint64_t block_offset);
+
+    private:
+        std::shared_ptr<RandomAccessFileReader> file_;
+        std::shared_ptr<RandomAccessFileReader> index_file_;
+        std::string path_;
+        uint64_t file_size_{0};
+        BgzfIndex index_;
+        bool has_index_{false};
+
+        // the last block inflated, block_size_ is 0 past the end of the file
+        std::vector<uint8_t> block_;
+        uint64_t block_offset_{std::numeric_limits<uint64_t>::max()};
+        uint64_t block_size_{0};
+    };
+
+}  // namespace alkaid
@@ -0,0 +1,1070 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <alkaid/files/cachingfs.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+
+#include <alkaid/files/filesystem.h>
+#include <alkaid/files/local/defines.h>
+#include <turbo/strings/str_cat.h>
+#include <turbo/times/time.h>
+
+namespace alkaid {
+
+    namespace {
+
+        // "" for the current directory
+        std::string normalize(const std::string_view &path) {
+            auto key = alkaid::filesystem::path(std::string(path)).lexically_normal().generic_string();
+            if (key == "." || key == "./") {
+                key.clear();
+            }
+            while (key.size() > 1 && key.back() == '/') {
+                key.pop_back();
+            }
+            return key;
+        }
+
+        // key is prefix or below it
+        bool under(const std::string &key, const std::string &prefix) {
+            if (prefix.empty()) {
+                return key.empty() || key.front() != '/';
+            }
+            return key == prefix || (key.size() > prefix.size() && key.compare(0, prefix.size(), prefix) == 0 &&
+                                     (prefix.back() == '/' || key[prefix.size()] == '/'));
+        }
+
+    }  // namespace
+
+    namespace cache {
+
+        // ------------------------------------------------------------------------
+        // CachedFile implementation
+
+        /// A file as seen when it was opened, read through the tiers.
+        class CachedFile {
+        public:
+            CachedFile(CachingFilesystem *fs, std::string path, std::any options)
+                    : fs_(fs), path_(std::move(path)), options_(std::move(options)) {}
+
+            size_t size() const {
+                return size_;
+            }
+
+            turbo::Result<size_t> read_at(uint64_t offset, void *buff, size_t len) {
+                if (offset >= size_) {
+                    return 0;
+                }
+                len = std::min<uint64_t>(len, size_ - offset);
+                if (dirty_ != nullptr) {
+                    std::memcpy(buff, dirty_->data() + offset, len);
+                    return len;
+                }
+                auto out = static_cast<char *>(buff);
+                for (size_t done = 0; done < len;) {
+                    auto pos = offset + done;
+                    RESULT_ASSIGN_OR_RETURN(auto block, fs_->read_block(this, pos / span_));
+                    auto n = std::min<size_t>(len - done, block->size() - pos % span_);
+                    std::memcpy(out + done, block->data() + pos % span_, n);
+                    done += n;
+                }
+                return len;
+            }
+
+        private:
+            friend class alkaid::CachingFilesystem;
+
+            std::string block_key(uint64_t index) const {
+                return turbo::str_cat(key_, "#", version_, "#", index);
+            }
+
+            size_t block_length(uint64_t index) const {
+                return std::min<uint64_t>(span_, size_ - index * span_);
+            }
+
+            turbo::Result<std::shared_ptr<const std::string>> read_base(uint64_t index) {
+                std::lock_guard lock(mutex_);
+                if (base_ == nullptr) {
+                    RESULT_ASSIGN_OR_RETURN(base_, fs_->base()->create_random_read_file());
+                    auto rs = base_->open(path_, options_, {});
+                    if (!rs.ok()) {
+                        base_.reset();
+                        return rs;
+                    }
+                }
+                auto data = std::make_shared<std::string>();
+                auto length = block_length(index);
+                RESULT_ASSIGN_OR_RETURN(auto n, base_->read_at(static_cast<off_t>(index * span_), data.get(), length));
+                if (n != length) {
+                    return turbo::aborted_error(turbo::str_cat("file changed while being read: ", path_));
+                }
+                return data;
+            }
+
+        private:
+            CachingFilesystem *fs_;
+            std::string path_;
+            std::any options_;
+            std::string key_;
+            uint64_t version_{0};
+            size_t size_{0};
+            // bytes of a block, the whole file when small
+            size_t span_{1};
+            // the file kept by WRITE_BACK
+            std::shared_ptr<const std::string> dirty_;
+            std::mutex mutex_;
+            std::shared_ptr<RandomAccessFileReader> base_;
+        };
+
+        // ------------------------------------------------------------------------
+        // CachingSequentialReader implementation
+
+        class CachingSequentialReader : public SequentialFileReader {
+        public:
+            explicit CachingSequentialReader(CachingFilesystem *fs) : fs_(fs) {}
+
+            ~CachingSequentialReader() override {
+                auto r = close_impl();
+                (void) r;
+            }
+
+            turbo::Status open(const std::string &path, std::any options, FileEventListener listener) noexcept override {
+                STATUS_RETURN_IF_ERROR(close_impl());
+                listener_ = std::move(listener);
+                path_ = path;
+                if (listener_.before_open) {
+                    listener_.before_open(this);
+                }
+                RESULT_ASSIGN_OR_RETURN(file_, fs_->open_cached(path, std::move(options)));
+                position_ = 0;
+                if (listener_.after_open) {
+                    listener_.after_open(this);
+                }
+                return turbo::OkStatus();
+            }
+
+            turbo::Status close() noexcept override {
+                return close_impl();
+            }
+
+            turbo::Result<int64_t> tell() const noexcept override {
+                if (file_ == nullptr) {
+                    return turbo::unavailable_error("file not opened");
+                }
+                return static_cast<int64_t>(position_);
+            }
+
+            FileMode mode() const noexcept override {
+                return FileMode::READ;
+            }
+
+            const std::string &path() const noexcept override {
+                return path_;
+            }
+
+            turbo::Result<size_t> size() const noexcept override {
+                if (file_ == nullptr) {
+                    return turbo::unavailable_error("file not opened");
+                }
+                return file_->size();
+            }
+
+            turbo::Status advance(off_t n) noexcept override {
+                if (file_ == nullptr) {
+                    return turbo::unavailable_error("file not opened");
+                }
+                if (n < 0 && static_cast<uint64_t>(-n) > position_) {
+                    return turbo::invalid_argument_error("advance before the start of file");
+                }
+                position_ += n;
+                return turbo::OkStatus();
+            }
+
+        protected:
+            turbo::Result<size_t> read_impl(void *buff, size_t len) noexcept override {
+                if (file_ == nullptr) {
+                    return turbo::unavailable_error("file not opened");
+                }
+                RESULT_ASSIGN_OR_RETURN(auto n, file_->read_at(position_, buff, len));
+                position_ += n;
+                return n;
+            }
+
+        private:
+            turbo::Status close_impl() noexcept {
+                if (file_ != nullptr) {
+                    if (listener_.before_close) {
+                        listener_.before_close(this);
+                    }
+                    file_.reset();
+                    if (listener_.after_close) {
+                        listener_.after_close(this);
+                    }
+                }
+                return turbo::OkStatus();
+            }
+
+        private:
+            CachingFilesystem *fs_;
+            FileEventListener listener_;
+            std::string path_;
+            std::shared_ptr<CachedFile> file_;
+            uint64_t position_{0};
+        };
+
+        // ------------------------------------------------------------------------
+        // CachingRandomReader implementation
+
+        class CachingRandomReader : public RandomAccessFileReader {
+        public:
+            explicit CachingRandomReader(CachingFilesystem *fs) : fs_(fs) {}
+
+            ~CachingRandomReader() override {
+                auto r = close_impl();
+                (void) r;
+            }
+
+            turbo::Status open(const std::string &path, std::any options, FileEventListener listener) noexcept override {
+                STATUS_RETURN_IF_ERROR(close_impl());
+                listener_ = std::move(listener);
+                path_ = path;
+                if (listener_.before_open) {
+                    listener_.before_open(this);
+                }
+                RESULT_ASSIGN_OR_RETURN(file_, fs_->open_cached(path, std::move(options)));
+                if (listener_.after_open) {
+                    listener_.after_open(this);
+                }
+                return turbo::OkStatus();
+            }
+
+            turbo::Status close() noexcept override {
+                return close_impl();
+            }
+
+            turbo::Result<int64_t> tell() const noexcept override {
+                if (file_ == nullptr) {
+                    return turbo::unavailable_error("file not opened");
+                }
+                return 0;
+            }
+
+            FileMode mode() const noexcept override {
+                return FileMode::READ;
+            }
+
+            const std::string &path() const noexcept override {
+                return path_;
+            }
+
+            turbo::Result<size_t> size() const noexcept override {
+                if (file_ == nullptr) {
+                    return turbo::unavailable_error("file not opened");
+                }
+                return file_->size();
+            }
+
+        protected:
+            turbo::Result<size_t> read_at_impl(off_t offset, void *buff, size_t len) override {
+                if (file_ == nullptr) {
+                    return turbo::unavailable_error("file not opened");
+                }
+                if (offset < 0) {
+                    return turbo::invalid_argument_error("negative offset");
+                }
+                return file_->read_at(static_cast<uint64_t>(offset), buff, len);
+            }
+
+        private:
+            turbo::Status close_impl() noexcept {
+                if (file_ != nullptr) {
+                    if (listener_.before_close) {
+                        listener_.before_close(this);
+                    }
+                    file_.reset();
+                    if (listener_.after_close) {
+                        listener_.after_close(this);
+                    }
+                }
+                return turbo::OkStatus();
+            }
+
+        private:
+            CachingFilesystem *fs_;
+            FileEventListener listener_;
+            std::string path_;
+            std::shared_ptr<CachedFile> file_;
+        };
+
+        // ------------------------------------------------------------------------
+        // CachingSequentialWriter implementation
+
+        /// Writes through to a writer of the base filesystem, what is cached of
+        /// the file is dropped on every flush and on close.
+        class CachingSequentialWriter : public SequentialFileWriter {
+        public:
+            CachingSequentialWriter(CachingFilesystem *fs, std::shared_ptr<SequentialFileWriter> base)
+                    : fs_(fs), base_(std::move(base)) {}
+
+            ~CachingSequentialWriter() override {
+                auto r = close_impl();
+                (void) r;
+            }
+
+            turbo::Status open(const std::string &path, std::any options, FileEventListener listener) noexcept override {
+                STATUS_RETURN_IF_ERROR(close_impl());
+                listener_ = std::move(listener);
+                path_ = path;
+                if (listener_.before_open) {
+                    listener_.before_open(this);
+                }
+                STATUS_RETURN_IF_ERROR(fs_->sync_file(path));
+                STATUS_RETURN_IF_ERROR(base_->open(path, std::move(options), {}));
+                fs_->invalidate(path_);
+                opened_ = true;
+                if (listener_.after_open) {
+                    listener_.after_open(this);
+                }
+                return turbo::OkStatus();
+            }
+
+            turbo::Status close() noexcept override {
+                return close_impl();
+            }
+
+            turbo::Result<int64_t> tell() const noexcept override {
+                return base_->tell();
+            }
+
+            FileMode mode() const noexcept override {
+                return FileMode::WRITE;
+            }
+
+            const std::string &path() const noexcept override {
+                return path_;
+            }
+
+            turbo::Result<size_t> size() const noexcept override {
+                return base_->size();
+            }
+
+            turbo::Status flush() override {
+                auto rs = base_->flush();
+                fs_->invalidate(path_);
+                return rs;
+            }
+
+            turbo::Status truncate(size_t size) noexcept override {
+                auto rs = base_->truncate(size);
+                fs_->invalidate(path_);
+                return rs;
+            }
+
+        protected:
+            turbo::Status append_impl(const void *buff, size_t len) noexcept override {
+                return base_->append(buff, len);
+            }
+
+        private:
+            turbo::Status close_impl() noexcept {
+                if (!opened_) {
+                    return turbo::OkStatus();
+                }
+                opened_ = false;
+                if (listener_.before_close) {
+                    listener_.before_close(this);
+                }
+                auto rs = base_->close();
+                fs_->invalidate(path_);
+                if (listener_.after_close) {
+                    listener_.after_close(this);
+                }
+                return rs;
+            }
+
+        private:
+            CachingFilesystem *fs_;
+            std::shared_ptr<SequentialFileWriter> base_;
+            FileEventListener listener_;
+            std::string path_;
+            bool opened_{false};
+        };
+
+        // ------------------------------------------------------------------------
+        // CachingRandomWriter implementation
+
+        class CachingRandomWriter : public RandomAccessFileWriter {
+        public:
+            CachingRandomWriter(CachingFilesystem *fs, std::shared_ptr<RandomAccessFileWriter> base)
+                    : fs_(fs), base_(std::move(base)) {}
+
+            ~CachingRandomWriter() override {
+                auto r = close_impl();
+                (void) r;
+            }
+
+            turbo::Status open(const std::string &path, std::any options, FileEventListener listener) noexcept override {
+                STATUS_RETURN_IF_ERROR(close_impl());
+                listener_ = std::move(listener);
+                path_ = path;
+                if (listener_.before_open) {
+                    listener_.before_open(this);
+                }
+                STATUS_RETURN_IF_ERROR(fs_->sync_file(path));
+                STATUS_RETURN_IF_ERROR(base_->open(path, std::move(options), {}));
+                fs_->invalidate(path_);
+                opened_ = true;
+                if (listener_.after_open) {
+                    listener_.after_open(this);
+                }
+                return turbo::OkStatus();
+            }
+
+            turbo::Status close() noexcept override {
+                return close_impl();
+            }
+
+            turbo::Result<int64_t> tell() const noexcept override {
+                return base_->tell();
+            }
+
+            FileMode mode() const noexcept override {
+                return FileMode::WRITE;
+            }
+
+            const std::string &path() const noexcept override {
+                return path_;
+            }
+
+            turbo::Result<size_t> size() const noexcept override {
+                return base_->size();
+            }
+
+            turbo::Status flush() override {
+                auto rs = base_->flush();
+                fs_->invalidate(path_);
+                return rs;
+            }
+
+            turbo::Status truncate(size_t size) noexcept override {
+                auto rs = base_->truncate(size);
+                fs_->invalidate(path_);
+                return rs;
+            }
+
+        private:
+            turbo::Status write_at_impl(off_t offset, const void *buff, size_t len) noexcept override {
+                return base_->write_at(offset, buff, len);
+            }
+
+            turbo::Status close_impl() noexcept {
+                if (!opened_) {
+                    return turbo::OkStatus();
+                }
+                opened_ = false;
+                if (listener_.before_close) {
+                    listener_.before_close(this);
+                }
+                auto rs = base_->close();
+                fs_->invalidate(path_);
+                if (listener_.after_close) {
+                    listener_.after_close(this);
+                }
+                return rs;
+            }
+
+        private:
+            CachingFilesystem *fs_;
+            std::shared_ptr<RandomAccessFileWriter> base_;
+            FileEventListener listener_;
+            std::string path_;
+            bool opened_{false};
+        };
+
+        // ------------------------------------------------------------------------
+        // WriteBackFile implementation
+
+        /// Gathers the file in memory, it is handed to the cache on flush and close.
+        class WriteBackFile : public SequentialFileWriter {
+        public:
+            explicit WriteBackFile(CachingFilesystem *fs) : fs_(fs) {}
+
+            ~WriteBackFile() override {
+                auto r = close_impl();
+                (void) r;
+            }
+
+            turbo::Status open(const std::string &path, std::any options, FileEventListener listener) noexcept override {
+                STATUS_RETURN_IF_ERROR(close_impl());
+                lfs::OpenOption option = lfs::kDefaultAppendWriteOption;
+                if (options.has_value()) {
+                    try {
+                        option = std::any_cast<lfs::OpenOption>(options);
+                    } catch (const std::bad_any_cast &e) {
+                        return turbo::invalid_argument_error("invalid options");
+                    }
+                }
+                listener_ = std::move(listener);
+                path_ = path;
+                if (listener_.before_open) {
+                    listener_.before_open(this);
+                }
+                content_.clear();
+                if (!(option.flags & O_TRUNC)) {
+                    STATUS_RETURN_IF_ERROR(fs_->load_for_append(path_, &content_));
+                }
+                opened_ = true;
+                if (listener_.after_open) {
+                    listener_.after_open(this);
+                }
+                return turbo::OkStatus();
+            }
+
+            turbo::Status close() noexcept override {
+                return close_impl();
+            }
+
+            turbo::Result<int64_t> tell() const noexcept override {
+                if (!opened_) {
+                    return turbo::unavailable_error("file not opened");
+                }
+                return static_cast<int64_t>(content_.size());
+            }
+
+            FileMode mode() const noexcept override {
+                return FileMode::WRITE;
+            }
+
+            const std::string &path() const noexcept override {
+                return path_;
+            }
+
+            turbo::Result<size_t> size() const noexcept override {
+                if (!opened_) {
+                    return turbo::unavailable_error("file not opened");
+                }
+                return content_.size();
+            }
+
+            turbo::Status flush() override {
+                if (!opened_) {
+                    return turbo::unavailable_error("file not opened");
+                }
+                return fs_->stage_dirty(normalize(path_), content_);
+            }
+
+            turbo::Status truncate(size_t size) noexcept override {
+                if (!opened_) {
+                    return turbo::unavailable_error("file not opened");
+                }
+                content_.resize(size);
+                return turbo::OkStatus();
+            }
+
+        protected:
+            turbo::Status append_impl(const void *buff, size_t len) noexcept override {
+                if (!opened_) {
+                    return turbo::unavailable_error("file not opened");
+                }
+                content_.append(static_cast<const char *>(buff), len);
+                return turbo::OkStatus();
+            }
+
+        private:
+            turbo::Status close_impl() noexcept {
+                if (!opened_) {
+                    return turbo::OkStatus();
+                }
+                opened_ = false;
+                if (listener_.before_close) {
+                    listener_.before_close(this);
+                }
+                auto rs = fs_->stage_dirty(normalize(path_), std::move(content_));
+                content_.clear();
+                if (listener_.after_close) {
+                    listener_.after_close(this);
+                }
+                return rs;
+            }
+
+        private:
+            CachingFilesystem *fs_;
+            FileEventListener listener_;
+            std::string path_;
+            std::string content_;
+            bool opened_{false};
+        };
+
+    }  // namespace cache
+
+    // ------------------------------------------------------------------------
+    // CachingFilesystem implementation
+
+    CachingFilesystem::CachingFilesystem(Filesystem *base, const CachingFilesystemOptions &options)
+            : base_(base), options_(options) {
+        memory_.capacity = options_.memory_capacity;
+        disk_.capacity = options_.disk_directory.empty() ? 0 : options_.disk_capacity;
+    }
+
+    CachingFilesystem::~CachingFilesystem() {
+        auto rs = sync();
+        (void) rs;
+        if (initialized_ && !options_.disk_directory.empty()) {
+            rs = Filesystem::localfs()->remove_all_if_exists(options_.disk_directory);
+            (void) rs;
+        }
+    }
+
+    turbo::Status CachingFilesystem::initialize() {
+        std::lock_guard lock(mutex_);
+        if (initialized_) {
+            return turbo::OkStatus();
+        }
+        if (!options_.disk_directory.empty()) {
+            auto local = Filesystem::localfs();
+            STATUS_RETURN_IF_ERROR(local->remove_all_if_exists(options_.disk_directory));
+            STATUS_RETURN_IF_ERROR(local->create_directories(options_.disk_directory));
+        }
+        initialized_ = true;
+        return turbo::OkStatus();
+    }
+
+    CacheStats CachingFilesystem::stats() const {
+        std::lock_guard lock(mutex_);
+        CacheStats stats;
+        stats.memory_hits = memory_hits_;
+        stats.disk_hits = disk_hits_;
+        stats.misses = misses_;
+        stats.memory_size = memory_.size;
+        stats.disk_size = disk_.size;
+        stats.dirty_size = dirty_size_;
+        return stats;
+    }
+
+    turbo::Result<std::shared_ptr<SequentialFileReader>> CachingFilesystem::create_sequential_read_file() {
+        return std::make_shared<cache::CachingSequentialReader>(this);
+    }
+
+    turbo::Result<std::shared_ptr<RandomAccessFileReader>> CachingFilesystem::create_random_read_file() {
+        return std::make_shared<cache::CachingRandomReader>(this);
+    }
+
+    turbo::Result<std::shared_ptr<SequentialFileWriter>> CachingFilesystem::create_sequential_write_file() {
+        if (options_.write_policy == CacheWritePolicy::WRITE_BACK) {
+            return std::make_shared<cache::WriteBackFile>(this);
+        }
+        RESULT_ASSIGN_OR_RETURN(auto base, base_->create_sequential_write_file());
+        return std::make_shared<cache::CachingSequentialWriter>(this, std::move(base));
+    }
+
+    turbo::Result<std::shared_ptr<RandomAccessFileWriter>> CachingFilesystem::create_random_write_file() {
+        RESULT_ASSIGN_OR_RETURN(auto base, base_->create_random_write_file());
+        return std::make_shared<cache::CachingRandomWriter>(this, std::move(base));
+    }
+
+    turbo::Result<std::shared_ptr<TempFileWriter>> CachingFilesystem::create_temp_file() {
+        return base_->create_temp_file();
+    }
+
+    turbo::Result<std::shared_ptr<cache::CachedFile>>
+    CachingFilesystem::open_cached(const std::string &path, std::any options) {
+        STATUS_RETURN_IF_ERROR(initialize());
+        auto file = std::make_shared<cache::CachedFile>(this, path, std::move(options));
+        file->key_ = normalize(path);
+        if (auto dirty = dirty_file(file->key_); dirty != nullptr) {
+            file->dirty_ = std::move(dirty);
+            file->size_ = file->dirty_->size();
+            return file;
+        }
+        auto now = std::chrono::steady_clock::now();
+        bool fresh = false;
+        if (options_.revalidate_interval_ms > 0) {
+            std::lock_guard lock(mutex_);
+            auto it = files_.find(file->key_);
+            fresh = it != files_.end() &&
+                    now - it->second.validated < std::chrono::milliseconds(options_.revalidate_interval_ms);
+            if (fresh) {
+                file->version_ = it->second.version;
+                file->size_ = it->second.size;
+            }
+        }
+        if (!fresh) {
+            RESULT_ASSIGN_OR_RETURN(auto size, base_->file_size(path));
+            RESULT_ASSIGN_OR_RETURN(auto mtime, base_->last_modified_time(path));
+            std::lock_guard lock(mutex_);
+            auto &entry = files_[file->key_];
+            if (entry.version == 0 || entry.size != size || entry.mtime != mtime) {
+                // the blocks of the old version are not reached any more and age out of the tiers
+                entry.version = ++next_version_;
+                entry.size = size;
+                entry.mtime = mtime;
+            }
+            entry.validated = now;
+            file->version_ = entry.version;
+            file->size_ = size;
+        }
+        file->span_ = file->size_ <= options_.small_file_size ? std::max<size_t>(file->size_, 1)
+                                                             : options_.block_size;
+        return file;
+    }
+
+    void CachingFilesystem::put_locked(Tier &tier, Tier::Block block, std::vector<std::string> *dropped_files) {
+        if (block.size > tier.capacity) {
+            if (!block.disk_path.empty()) {
+                dropped_files->push_back(std::move(block.disk_path));
+            }
+            return;
+        }
+        if (auto it = tier.index.find(block.key); it != tier.index.end()) {
+            tier.size -= it->second->size;
+            if (!it->second->disk_path.empty()) {
+                dropped_files->push_back(std::move(it->second->disk_path));
+            }
+            tier.blocks.erase(it->second);
+            tier.index.erase(it);
+        }
+        tier.size += block.size;
+        auto key = block.key;
+        tier.blocks.push_back(std::move(block));
+        tier.index.emplace(std::move(key), std::prev(tier.blocks.end()));
+        while (tier.size > tier.capacity) {
+            auto &victim = tier.blocks.front();
+            tier.size -= victim.size;
+            if (!victim.disk_path.empty()) {
+                dropped_files->push_back(std::move(victim.disk_path));
+            }
+            tier.index.erase(victim.key);
+            tier.blocks.pop_front();
+        }
+    }
+
+    void CachingFilesystem::remove_disk_files(const std::vector<std::string> &files) {
+        for (auto &file: files) {
+            auto rs = Filesystem::localfs()->remove_if_exists(file);
+            (void) rs;
+        }
+    }
+
+    turbo::Result<std::shared_ptr<const std::string>>
+    CachingFilesystem::read_block(cache::CachedFile *file, uint64_t index) {
+        auto key = file->block_key(index);
+        auto length = file->block_length(index);
+        std::string disk_path;
+        {
+            std::lock_guard lock(mutex_);
+            if (auto it = memory_.index.find(key); it != memory_.index.end()) {
+                memory_.blocks.splice(memory_.blocks.end(), memory_.blocks, it->second);
+                ++memory_hits_;
+                return it->second->data;
+            }
+            if (auto it = disk_.index.find(key); it != disk_.index.end()) {
+                disk_.blocks.splice(disk_.blocks.end(), disk_.blocks, it->second);
+                disk_path = it->second->disk_path;
+            }
+        }
+
+        std::vector<std::string> dropped;
+        if (!disk_path.empty()) {
+            // the block may be evicted meanwhile, then it is read from the base filesystem
+            auto data = std::make_shared<std::string>();
+            if (Filesystem::localfs()->read_file(disk_path, data.get()).ok() && data->size() == length) {
+                {
+                    std::lock_guard lock(mutex_);
+                    ++disk_hits_;
+                    put_locked(memory_, Tier::Block{key, data, {}, length}, &dropped);
+                }
+                return data;
+            }
+        }
+
+        RESULT_ASSIGN_OR_RETURN(auto data, file->read_base(index));
+        {
+            std::lock_guard lock(mutex_);
+            ++misses_;
+            put_locked(memory_, Tier::Block{key, data, {}, length}, &dropped);
+            if (disk_.capacity >= length) {
+                disk_path = turbo::str_cat(options_.disk_directory, "/", ++next_disk_file_, ".block");
+            } else {
+                disk_path.clear();
+            }
+        }
+        if (!disk_path.empty() && Filesystem::localfs()->write_file(disk_path, *data).ok()) {
+            std::lock_guard lock(mutex_);
+            put_locked(disk_, Tier::Block{key, nullptr, disk_path, length}, &dropped);
+        }
+        remove_disk_files(dropped);
+        return data;
+    }
+
+    std::shared_ptr<const std::string> CachingFilesystem::dirty_file(const std::string &key) const {
+        std::lock_guard lock(mutex_);
+        auto it = dirty_.find(key);
+        return it == dirty_.end() ? nullptr : it->second;
+    }
+
+    turbo::Status CachingFilesystem::load_for_append(const std::string &path, std::string *content) {
+        auto key = normalize(path);
+        if (auto dirty = dirty_file(key); dirty != nullptr) {
+            *content = *dirty;
+            return turbo::OkStatus();
+        }
+        RESULT_ASSIGN_OR_RETURN(auto exists, base_->exists(path));
+        if (exists) {
+            return read_file(path, content);
+        }
+        // the base filesystem has to take the file on sync
+        auto parent = alkaid::filesystem::path(key).parent_path().string();
+        if (!parent.empty()) {
+            RESULT_ASSIGN_OR_RETURN(auto parent_exists, base_->exists(parent));
+            if (!parent_exists) {
+                return turbo::not_found_error(turbo::str_cat("parent directory not found: ", path));
+            }
+        }
+        return turbo::OkStatus();
+    }
+
+    turbo::Status CachingFilesystem::stage_dirty(const std::string &key, std::string content) {
+        bool full;
+        {
+            std::lock_guard lock(mutex_);
+            auto &slot = dirty_[key];
+            if (slot != nullptr) {
+                dirty_size_ -= slot->size();
+            }
+            dirty_size_ += content.size();
+            slot = std::make_shared<const std::string>(std::move(content));
+            files_.erase(key);
+            full = dirty_size_ > options_.memory_capacity;
+        }
+        return full ? sync() : turbo::OkStatus();
+    }
+
+    turbo::Status CachingFilesystem::sync_if(const std::function<bool(const std::string &)> &match) {
+        std::vector<std::pair<std::string, std::shared_ptr<const std::string>>> pending;
+        {
+            std::lock_guard lock(mutex_);
+            for (auto &it: dirty_) {
+                if (match(it.first)) {
+                    pending.emplace_back(it);
+                }
+            }
+        }
+        turbo::Status status;
+        for (auto &[key, content]: pending) {
+            auto rs = base_->write_file(key, *content);
+            if (!rs.ok()) {
+                if (status.ok()) {
+                    status = rs;
+                }
+                continue;
+            }
+            // kept when it was written again meanwhile
+            std::lock_guard lock(mutex_);
+            auto it = dirty_.find(key);
+            if (it != dirty_.end() && it->second == content) {
+                dirty_size_ -= content->size();
+                dirty_.erase(it);
+            }
+            files_.erase(key);
+        }
+        return status;
+    }
+
+    turbo::Status CachingFilesystem::sync() {
+        return sync_if([](const std::string &) { return true; });
+    }
+
+    turbo::Status CachingFilesystem::sync_file(const std::string_view &path) {
+        auto key = normalize(path);
+        return sync_if([&key](const std::string &dirty) { return dirty == key; });
+    }
+
+    turbo::Status CachingFilesystem::sync_prefix(const std::string_view &path) {
+        auto key = normalize(path);
+        return sync_if([&key](const std::string &dirty) { return under(dirty, key); });
+    }
+
+    void CachingFilesystem::drop_dirty(const std::string_view &path) {
+        auto key = normalize(path);
+        std::lock_guard lock(mutex_);
+        for (auto it = dirty_.begin(); it != dirty_.end();) {
+            if (under(it->first, key)) {
+                dirty_size_ -= it->second->size();
+                it = dirty_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    void CachingFilesystem::invalidate(const std::string_view &path) {
+        auto key = normalize(path);
+        std::lock_guard lock(mutex_);
+        for (auto it = files_.lower_bound(key); it != files_.end() && it->first.compare(0, key.size(), key) == 0;) {
+            if (under(it->first, key)) {
+                it = files_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    turbo::Status CachingFilesystem::read_file(const std::string &file_path, std::string *result) noexcept {
+        RESULT_ASSIGN_OR_RETURN(auto file, open_cached(file_path, std::any{}));
+        auto original_size = result->size();
+        result->resize(original_size + file->size());
+        auto rs = file->read_at(0, result->data() + original_size, file->size());
+        if (!rs.ok()) {
+            result->resize(original_size);
+            return rs.status();
+        }
+        return turbo::OkStatus();
+    }
+
+    turbo::Status CachingFilesystem::write_file(const std::string &file_path, const std::string_view &content) noexcept {
+        if (options_.write_policy == CacheWritePolicy::WRITE_BACK) {
+            auto parent = alkaid::filesystem::path(normalize(file_path)).parent_path().string();
+            if (!parent.empty()) {
+                RESULT_ASSIGN_OR_RETURN(auto parent_exists, base_->exists(parent));
+                if (!parent_exists) {
+                    return turbo::not_found_error(turbo::str_cat("parent directory not found: ", file_path));
+                }
+            }
+            return stage_dirty(normalize(file_path), std::string(content));
+        }
+        auto rs = base_->write_file(file_path, content);
+        invalidate(file_path);
+        return rs;
+    }
+
+    turbo::Status CachingFilesystem::append_file(const std::string &file_path, const std::string_view &content) noexcept {
+        if (options_.write_policy == CacheWritePolicy::WRITE_BACK) {
+            std::string data;
+            STATUS_RETURN_IF_ERROR(load_for_append(file_path, &data));
+            data.append(content);
+            return stage_dirty(normalize(file_path), std::move(data));
+        }
+        auto rs = base_->append_file(file_path, content);
+        invalidate(file_path);
+        return rs;
+    }
+
+    turbo::Status CachingFilesystem::list_files(const std::string_view &root_path, std::vector<std::string> &result,
+                                                bool full_path) noexcept {
+        STATUS_RETURN_IF_ERROR(sync_prefix(root_path));
+        return base_->list_files(root_path, result, full_path);
+    }
+
+    turbo::Status CachingFilesystem::list_directories(const std::string_view &root_path, std::vector<std::string> &result,
+                                                      bool full_path) noexcept {
+        STATUS_RETURN_IF_ERROR(sync_prefix(root_path));
+        return base_->list_directories(root_path, result, full_path);
+    }
+
+    turbo::Result<bool> CachingFilesystem::exists(const std::string_view &path) noexcept {
+        if (dirty_file(normalize(path)) != nullptr) {
+            return true;
+        }
+        return base_->exists(path);
+    }
+
+    turbo::Status CachingFilesystem::remove(const std::string_view &path) noexcept {
+        drop_dirty(path);
+        invalidate(path);
+        return base_->remove(path);
+    }
+
+    turbo::Status CachingFilesystem::remove_all(const std::string_view &path) noexcept {
+        drop_dirty(path);
+        invalidate(path);
+        return base_->remove_all(path);
+    }
+
+    turbo::Status CachingFilesystem::remove_if_exists(const std::string_view &path) noexcept {
+        drop_dirty(path);
+        invalidate(path);
+        return base_->remove_if_exists(path);
+    }
+
+    turbo::Status CachingFilesystem::remove_all_if_exists(const std::string_view &path) noexcept {
+        drop_dirty(path);
+        invalidate(path);
+        return base_->remove_all_if_exists(path);
+    }
+
+    turbo::Result<size_t> CachingFilesystem::file_size(const std::string_view &path) noexcept {
+        if (auto dirty = dirty_file(normalize(path)); dirty != nullptr) {
+            return dirty->size();
+        }
+        return base_->file_size(path);
+    }
+
+    turbo::Status CachingFilesystem::file_resize(const std::string_view &path, size_t size) noexcept {
+        STATUS_RETURN_IF_ERROR(sync_file(path));
+        auto rs = base_->file_resize(path, size);
+        invalidate(path);
+        return rs;
+    }
+
+    turbo::Result<turbo::Time> CachingFilesystem::last_modified_time(const std::string_view &path) noexcept {
+        STATUS_RETURN_IF_ERROR(sync_file(path));
+        return base_->last_modified_time(path);
+    }
+
+    turbo::Status CachingFilesystem::rename(const std::string_view &old_path, const std::string_view &new_path) noexcept {
+        STATUS_RETURN_IF_ERROR(sync_prefix(old_path));
+        drop_dirty(new_path);
+        auto rs = base_->rename(old_path, new_path);
+        invalidate(old_path);
+        invalidate(new_path);
+        return rs;
+    }
+
+    turbo::Status CachingFilesystem::copy_file(const std::string_view &src_path, const std::string_view &dst_path) noexcept {
+        STATUS_RETURN_IF_ERROR(sync_file(src_path));
+        STATUS_RETURN_IF_ERROR(sync_file(dst_path));
+        auto rs = base_->copy_file(src_path, dst_path);
+        invalidate(dst_path);
+        return rs;
+    }
+
+    turbo::Result<std::string> CachingFilesystem::temp_directory_path() noexcept {
+        return base_->temp_directory_path();
+    }
+
+    turbo::Status CachingFilesystem::create_directory(const std::string_view &path) noexcept {
+        return base_->create_directory(path);
+    }
+
+    turbo::Status CachingFilesystem::create_directories(const std::string_view &path) noexcept {
+        return base_->create_directories(path);
+    }
+
+    turbo::Status CachingFilesystem::copy_directory(const std::string_view &src_path, const std::string_view &dst_path,
+                                                    CopyOptions options) noexcept {
+        STATUS_RETURN_IF_ERROR(sync_prefix(src_path));
+        STATUS_RETURN_IF_ERROR(sync_prefix(dst_path));
+        auto rs = base_->copy_directory(src_path, dst_path, options);
+        invalidate(dst_path);
+        return rs;
+    }
+
+}  // namespace alkaid
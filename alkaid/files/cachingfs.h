@@ -0,0 +1,240 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <alkaid/files/interface.h>
+#include <alkaid/files/internal/filesystem_fwd.h>
+
+namespace alkaid {
+
+    enum class CacheWritePolicy {
+        /// writes go to the base filesystem at once
+        WRITE_THROUGH,
+        /// sequential writes and write_file() are kept in memory until sync()
+        WRITE_BACK
+    };
+
+    struct CachingFilesystemOptions {
+        /// bytes of the memory tier
+        size_t memory_capacity{256 * 1024 * 1024};
+        /// files up to this size are cached whole, larger ones in blocks
+        size_t small_file_size{1024 * 1024};
+        size_t block_size{1024 * 1024};
+        /// directory of the disk tier on the local filesystem, no disk tier when empty.
+        /// It is owned by the cache, what is in it is removed when the cache is created.
+        std::string disk_directory;
+        size_t disk_capacity{16ULL * 1024 * 1024 * 1024};
+        CacheWritePolicy write_policy{CacheWritePolicy::WRITE_THROUGH};
+        /// a file opened again within this time is not checked against the base
+        /// filesystem, 0 checks its size and last_modified_time on every open
+        int64_t revalidate_interval_ms{0};
+    };
+
+    struct CacheStats {
+        uint64_t memory_hits{0};
+        uint64_t disk_hits{0};
+        uint64_t misses{0};
+        size_t memory_size{0};
+        size_t disk_size{0};
+        /// bytes written back but not synced yet
+        size_t dirty_size{0};
+    };
+
+    namespace cache {
+        class CachedFile;
+        class CachingSequentialReader;
+        class CachingRandomReader;
+        class CachingSequentialWriter;
+        class CachingRandomWriter;
+        class WriteBackFile;
+    }  // namespace cache
+
+    /// \brief A Filesystem caching the files of another one.
+    ///
+    /// Files up to small_file_size are cached whole, larger ones in blocks of
+    /// block_size, in a memory tier and, when disk_directory is set, in a disk
+    /// tier below it.  Both tiers drop the least recently used blocks first.
+    /// A file is checked against the base filesystem when opened, a change of
+    /// its size or last_modified_time drops what is cached of it.
+    ///
+    /// With WRITE_BACK, sequential writers, write_file() and append_file()
+    /// keep the file in memory, readers see it at once and the base
+    /// filesystem with sync(), on pressure or when the cache is destroyed.
+    /// Listing, renaming and copying sync first.  Random writers always
+    /// write through.
+    class TURBO_EXPORT CachingFilesystem : public Filesystem {
+    public:
+        /// base must outlive the cache
+        explicit CachingFilesystem(Filesystem *base,
+                                   const CachingFilesystemOptions &options = CachingFilesystemOptions{});
+
+        ~CachingFilesystem() override;
+
+        std::string name() const override {
+            return "CachingFilesystem";
+        }
+
+        /// creates the disk tier directory, called by the first reader when not called
+        turbo::Status initialize();
+
+        turbo::Result<std::shared_ptr<SequentialFileReader>> create_sequential_read_file() override;
+
+        turbo::Result<std::shared_ptr<RandomAccessFileReader>> create_random_read_file() override;
+
+        turbo::Result<std::shared_ptr<SequentialFileWriter>> create_sequential_write_file() override;
+
+        turbo::Result<std::shared_ptr<RandomAccessFileWriter>> create_random_write_file() override;
+
+        turbo::Result<std::shared_ptr<TempFileWriter>> create_temp_file() override;
+
+        turbo::Status read_file(const std::string &file_path, std::string *result) noexcept override;
+
+        turbo::Status write_file(const std::string &file_path, const std::string_view &content) noexcept override;
+
+        turbo::Status append_file(const std::string &file_path, const std::string_view &content) noexcept override;
+
+        turbo::Status list_files(const std::string_view &root_path, std::vector<std::string> &result,
+                                 bool full_path = true) noexcept override;
+
+        turbo::Status list_directories(const std::string_view &root_path, std::vector<std::string> &result,
+                                       bool full_path = true) noexcept override;
+
+        turbo::Result<bool> exists(const std::string_view &path) noexcept override;
+
+        turbo::Status remove(const std::string_view &path) noexcept override;
+
+        turbo::Status remove_all(const std::string_view &path) noexcept override;
+
+        turbo::Status remove_if_exists(const std::string_view &path) noexcept override;
+
+        turbo::Status remove_all_if_exists(const std::string_view &path) noexcept override;
+
+        turbo::Result<size_t> file_size(const std::string_view &path) noexcept override;
+
+        turbo::Status file_resize(const std::string_view &path, size_t size) noexcept override;
+
+        turbo::Result<turbo::Time> last_modified_time(const std::string_view &path) noexcept override;
+
+        turbo::Status rename(const std::string_view &old_path, const std::string_view &new_path) noexcept override;
+
+        turbo::Status copy_file(const std::string_view &src_path, const std::string_view &dst_path) noexcept override;
+
+        turbo::Result<std::string> temp_directory_path() noexcept override;
+
+        turbo::Status create_directory(const std::string_view &path) noexcept override;
+
+        turbo::Status create_directories(const std::string_view &path) noexcept override;
+
+        turbo::Status copy_directory(const std::string_view &src_path, const std::string_view &dst_path, CopyOptions options) noexcept override;
+
+        /// writes the files kept by WRITE_BACK to the base filesystem
+        turbo::Status sync();
+
+        /// drops what is cached of path and of the files below it
+        void invalidate(const std::string_view &path);
+
+        CacheStats stats() const;
+
+        Filesystem *base() const {
+            return base_;
+        }
+
+    private:
+        friend class cache::CachedFile;
+        friend class cache::CachingSequentialReader;
+        friend class cache::CachingRandomReader;
+        friend class cache::CachingSequentialWriter;
+        friend class cache::CachingRandomWriter;
+        friend class cache::WriteBackFile;
+
+        // what was last seen of a file in the base filesystem
+        struct FileEntry {
+            uint64_t version{0};
+            size_t size{0};
+            turbo::Time mtime;
+            std::chrono::steady_clock::time_point validated;
+        };
+
+        // a tier, least recently used first, with the bytes or the disk file of every block
+        struct Tier {
+            struct Block {
+                std::string key;
+                std::shared_ptr<const std::string> data;
+                std::string disk_path;
+                size_t size{0};
+            };
+            size_t capacity{0};
+            size_t size{0};
+            std::list<Block> blocks;
+            std::unordered_map<std::string, std::list<Block>::iterator> index;
+        };
+
+        turbo::Result<std::shared_ptr<cache::CachedFile>> open_cached(const std::string &path, std::any options);
+
+        turbo::Result<std::shared_ptr<const std::string>> read_block(cache::CachedFile *file, uint64_t index);
+
+        void put_locked(Tier &tier, Tier::Block block, std::vector<std::string> *dropped_files);
+
+        std::shared_ptr<const std::string> dirty_file(const std::string &key) const;
+
+        // the content of path to append to, with WRITE_BACK
+        turbo::Status load_for_append(const std::string &path, std::string *content);
+
+        turbo::Status stage_dirty(const std::string &key, std::string content);
+
+        // syncs the dirty files for which match returns true
+        turbo::Status sync_if(const std::function<bool(const std::string &)> &match);
+
+        turbo::Status sync_file(const std::string_view &path);
+
+        turbo::Status sync_prefix(const std::string_view &path);
+
+        void drop_dirty(const std::string_view &path);
+
+        void remove_disk_files(const std::vector<std::string> &files);
+
+    private:
+        Filesystem *base_;
+        CachingFilesystemOptions options_;
+        bool initialized_{false};
+        mutable std::mutex mutex_;
+        std::map<std::string, FileEntry> files_;
+        std::map<std::string, std::shared_ptr<const std::string>> dirty_;
+        size_t dirty_size_{0};
+        Tier memory_;
+        Tier disk_;
+        uint64_t next_version_{0};
+        uint64_t next_disk_file_{0};
+        uint64_t memory_hits_{0};
+        uint64_t disk_hits_{0};
+        uint64_t misses_{0};
+    };
+
+}  // namespace alkaid
@@ -0,0 +1,510 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <alkaid/files/checksum_file.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include <alkaid/compress/crc32c.h>
+#include <alkaid/compress/xxhash.h>
+#include <turbo/base/endian.h>
+#include <turbo/strings/str_cat.h>
+
+namespace alkaid {
+
+    namespace {
+
+        // sidecar checksums are batched into writes of this size
+        constexpr size_t kSidecarWriteSize = 4096;
+
+        size_t checksum_size(ChecksumType type) {
+            return type == ChecksumType::CRC32C ? 4 : 8;
+        }
+
+        void compute_checksum(ChecksumType type, const uint8_t *data, size_t len, uint8_t *sum) {
+            if (type == ChecksumType::CRC32C) {
+                turbo::little_endian::store32(sum, crc32c::value(data, len));
+            } else {
+                turbo::little_endian::store64(sum, xxh3::hash64(data, len));
+            }
+        }
+
+        bool matches_checksum(ChecksumType type, const uint8_t *data, size_t len, const uint8_t *sum) {
+            uint8_t actual[8];
+            compute_checksum(type, data, len, actual);
+            return memcmp(actual, sum, checksum_size(type)) == 0;
+        }
+
+        turbo::Status parse_options(const std::any &options, ChecksumOptions *result) {
+            *result = ChecksumOptions();
+            if (options.has_value()) {
+                try {
+                    *result = std::any_cast<ChecksumOptions>(options);
+                } catch (const std::bad_any_cast &e) {
+                    return turbo::invalid_argument_error("invalid options");
+                }
+            }
+            if (result->block_size == 0) {
+                return turbo::invalid_argument_error("checksum block size must be positive");
+            }
+            return turbo::OkStatus();
+        }
+
+        // data bytes in a file of file_size bytes, with inline checksums or not
+        uint64_t data_size(uint64_t file_size, const ChecksumOptions &options, bool inline_sums) {
+            if (!inline_sums) {
+                return file_size;
+            }
+            const uint64_t cs = checksum_size(options.type);
+            const uint64_t stride = options.block_size + cs;
+            const uint64_t rest = file_size % stride;
+            return file_size / stride * options.block_size + (rest > cs ? rest - cs : 0);
+        }
+
+        turbo::Status checksum_mismatch(const std::string &path, uint64_t block) {
+            return turbo::Status(turbo::StatusCode::kDataLoss,
+                                 turbo::str_cat("checksum mismatch in block ", block, " of ", path));
+        }
+
+        turbo::Status truncated(const std::string &path) {
+            return turbo::Status(turbo::StatusCode::kDataLoss, turbo::str_cat("truncated checksum file ", path));
+        }
+
+    }  // namespace
+
+    // ----------------------------------------------------------------------
+    // ChecksumFileWriter implementation
+
+    ChecksumFileWriter::ChecksumFileWriter(std::shared_ptr<SequentialFileWriter> file,
+                                           std::shared_ptr<SequentialFileWriter> sidecar_file)
+            : file_(std::move(file)), sidecar_file_(std::move(sidecar_file)) {
+    }
+
+    ChecksumFileWriter::~ChecksumFileWriter() {
+        auto r = close_impl();
+        (void) r;
+    }
+
+    turbo::Status
+    ChecksumFileWriter::open(const std::string &path, std::any options, FileEventListener listener) noexcept {
+        auto r = close_impl();
+        (void) r;
+        STATUS_RETURN_IF_ERROR(parse_options(options, &options_));
+        path_ = path;
+        block_.clear();
+        block_.reserve(options_.block_size);
+        sums_.clear();
+        size_ = 0;
+        STATUS_RETURN_IF_ERROR(file_->open(path, options_.file_options, listener));
+        if (sidecar_file_ != nullptr) {
+            auto status = sidecar_file_->open(path + kChecksumSidecarSuffix, options_.file_options);
+            if (!status.ok()) {
+                r = file_->close();
+                return status;
+            }
+        }
+        opened_ = true;
+        return turbo::OkStatus();
+    }
+
+    turbo::Result<int64_t> ChecksumFileWriter::tell() const noexcept {
+        if (!opened_) {
+            return turbo::invalid_argument_error("file not open");
+        }
+        return static_cast<int64_t>(size_);
+    }
+
+    turbo::Result<size_t> ChecksumFileWriter::size() const noexcept {
+        if (!opened_) {
+            return turbo::unavailable_error("file not opened");
+        }
+        return size_;
+    }
+
+    turbo::Status ChecksumFileWriter::flush() {
+        if (!opened_) {
+            return turbo::invalid_argument_error("file not open");
+        }
+        STATUS_RETURN_IF_ERROR(flush_sums());
+        if (sidecar_file_ != nullptr) {
+            STATUS_RETURN_IF_ERROR(sidecar_file_->flush());
+        }
+        return file_->flush();
+    }
+
+    turbo::Status ChecksumFileWriter::truncate(size_t size) noexcept {
+        (void) size;
+        return turbo::unimplemented_error("checksum files can not be truncated");
+    }
+
+    turbo::Status ChecksumFileWriter::append_impl(const void *buff, size_t len) noexcept {
+        if (!opened_) {
+            return turbo::invalid_argument_error("file not open");
+        }
+        auto data = static_cast<const uint8_t *>(buff);
+        size_ += len;
+        if (!block_.empty()) {
+            auto n = std::min(len, options_.block_size - block_.size());
+            block_.insert(block_.end(), data, data + n);
+            data += n;
+            len -= n;
+            if (block_.size() < options_.block_size) {
+                return turbo::OkStatus();
+            }
+            STATUS_RETURN_IF_ERROR(write_block(block_.data(), block_.size()));
+            block_.clear();
+        }
+        // whole blocks are checksummed and written from the caller's buffer
+        while (len >= options_.block_size) {
+            STATUS_RETURN_IF_ERROR(write_block(data, options_.block_size));
+            data += options_.block_size;
+            len -= options_.block_size;
+        }
+        block_.insert(block_.end(), data, data + len);
+        return turbo::OkStatus();
+    }
+
+    turbo::Status ChecksumFileWriter::write_block(const uint8_t *data, size_t len) {
+        uint8_t sum[8];
+        compute_checksum(options_.type, data, len, sum);
+        STATUS_RETURN_IF_ERROR(file_->append(data, len));
+        if (sidecar_file_ == nullptr) {
+            return file_->append(sum, checksum_size(options_.type));
+        }
+        sums_.append(reinterpret_cast<const char *>(sum), checksum_size(options_.type));
+        if (sums_.size() >= kSidecarWriteSize) {
+            return flush_sums();
+        }
+        return turbo::OkStatus();
+    }
+
+    turbo::Status ChecksumFileWriter::flush_sums() {
+        if (sums_.empty()) {
+            return turbo::OkStatus();
+        }
+        STATUS_RETURN_IF_ERROR(sidecar_file_->append(sums_));
+        sums_.clear();
+        return turbo::OkStatus();
+    }
+
+    turbo::Status ChecksumFileWriter::close_impl() noexcept {
+        if (!opened_) {
+            return turbo::OkStatus();
+        }
+        opened_ = false;
+        turbo::Status status;
+        if (!block_.empty()) {
+            status = write_block(block_.data(), block_.size());
+            block_.clear();
+        }
+        if (status.ok()) {
+            status = flush_sums();
+        }
+        auto close_status = file_->close();
+        if (status.ok()) {
+            status = close_status;
+        }
+        if (sidecar_file_ != nullptr) {
+            close_status = sidecar_file_->close();
+            if (status.ok()) {
+                status = close_status;
+            }
+        }
+        return status;
+    }
+
+    // ----------------------------------------------------------------------
+    // ChecksumFileReader implementation
+
+    ChecksumFileReader::ChecksumFileReader(std::shared_ptr<SequentialFileReader> file,
+                                           std::shared_ptr<SequentialFileReader> sidecar_file)
+            : file_(std::move(file)), sidecar_file_(std::move(sidecar_file)) {
+    }
+
+    ChecksumFileReader::~ChecksumFileReader() {
+        auto r = close();
+        (void) r;
+    }
+
+    turbo::Status
+    ChecksumFileReader::open(const std::string &path, std::any options, FileEventListener listener) noexcept {
+        auto r = close();
+        (void) r;
+        STATUS_RETURN_IF_ERROR(parse_options(options, &options_));
+        path_ = path;
+        block_.clear();
+        block_pos_ = 0;
+        block_index_ = 0;
+        position_ = 0;
+        eof_ = false;
+        STATUS_RETURN_IF_ERROR(file_->open(path, options_.file_options, listener));
+        if (sidecar_file_ != nullptr) {
+            return sidecar_file_->open(path + kChecksumSidecarSuffix, options_.file_options);
+        }
+        return turbo::OkStatus();
+    }
+
+    turbo::Status ChecksumFileReader::close() noexcept {
+        block_.clear();
+        block_pos_ = 0;
+        auto status = file_->close();
+        if (sidecar_file_ != nullptr) {
+            auto sidecar_status = sidecar_file_->close();
+            if (status.ok()) {
+                status = sidecar_status;
+            }
+        }
+        return status;
+    }
+
+    turbo::Result<int64_t> ChecksumFileReader::tell() const noexcept {
+        return static_cast<int64_t>(position_);
+    }
+
+    turbo::Result<size_t> ChecksumFileReader::size() const noexcept {
+        RESULT_ASSIGN_OR_RETURN(auto file_size, file_->size());
+        return data_size(file_size, options_, sidecar_file_ == nullptr);
+    }
+
+    turbo::Status ChecksumFileReader::advance(off_t n) noexcept {
+        std::vector<uint8_t> buff(std::min(static_cast<size_t>(std::max<off_t>(n, 0)), options_.block_size));
+        while (n > 0) {
+            RESULT_ASSIGN_OR_RETURN(auto read_size,
+                                    read_impl(buff.data(), std::min(static_cast<size_t>(n), buff.size())));
+            if (read_size == 0) {
+                return turbo::out_of_range_error("advance past the end of the file");
+            }
+            n -= static_cast<off_t>(read_size);
+        }
+        return turbo::OkStatus();
+    }
+
+    turbo::Result<size_t> ChecksumFileReader::read_impl(void *buff, size_t len) noexcept {
+        auto out = static_cast<uint8_t *>(buff);
+        const size_t block_size = options_.block_size;
+        size_t total = 0;
+        while (total < len) {
+            if (block_pos_ < block_.size()) {
+                auto n = std::min(len - total, block_.size() - block_pos_);
+                memcpy(out + total, block_.data() + block_pos_, n);
+                block_pos_ += n;
+                total += n;
+                continue;
+            }
+            if (eof_) {
+                break;
+            }
+            size_t n;
+            if (len - total >= block_size) {
+                RESULT_ASSIGN_OR_RETURN(n, read_block(out + total));
+                total += n;
+            } else {
+                block_.resize(block_size);
+                RESULT_ASSIGN_OR_RETURN(n, read_block(block_.data()));
+                block_.resize(n);
+                block_pos_ = 0;
+            }
+            eof_ = n < block_size;
+        }
+        position_ += total;
+        return total;
+    }
+
+    turbo::Result<size_t> ChecksumFileReader::read_block(uint8_t *buff) {
+        const size_t block_size = options_.block_size;
+        const size_t cs = checksum_size(options_.type);
+        uint8_t sum[8];
+        RESULT_ASSIGN_OR_RETURN(auto n, read_fully(file_.get(), buff, block_size));
+        size_t data_len = n;
+        if (sidecar_file_ != nullptr) {
+            if (n == 0) {
+                return 0;
+            }
+            RESULT_ASSIGN_OR_RETURN(auto m, read_fully(sidecar_file_.get(), sum, cs));
+            if (m != cs) {
+                return truncated(path_ + kChecksumSidecarSuffix);
+            }
+        } else {
+            size_t m = 0;
+            if (n == block_size) {
+                RESULT_ASSIGN_OR_RETURN(m, read_fully(file_.get(), sum, cs));
+            }
+            if (n + m == 0) {
+                return 0;
+            }
+            if (n + m < cs) {
+                return truncated(path_);
+            }
+            data_len = n + m - cs;
+            if (m < cs) {
+                // the last block is short, its checksum was read into buff
+                uint8_t tail[8];
+                for (size_t i = 0; i < cs; ++i) {
+                    auto pos = data_len + i;
+                    tail[i] = pos < n ? buff[pos] : sum[pos - n];
+                }
+                memcpy(sum, tail, cs);
+            }
+        }
+        if (!matches_checksum(options_.type, buff, data_len, sum)) {
+            return checksum_mismatch(path_, block_index_);
+        }
+        ++block_index_;
+        return data_len;
+    }
+
+    turbo::Result<size_t> ChecksumFileReader::read_fully(SequentialFileReader *file, uint8_t *buff, size_t len) {
+        size_t total = 0;
+        while (total < len) {
+            RESULT_ASSIGN_OR_RETURN(auto n, file->read(buff + total, len - total));
+            if (n == 0) {
+                break;
+            }
+            total += n;
+        }
+        return total;
+    }
+
+    // ----------------------------------------------------------------------
+    // ChecksumRandomReadFile implementation
+
+    ChecksumRandomReadFile::ChecksumRandomReadFile(std::shared_ptr<RandomAccessFileReader> file,
+                                                   std::shared_ptr<RandomAccessFileReader> sidecar_file)
+            : file_(std::move(file)), sidecar_file_(std::move(sidecar_file)) {
+    }
+
+    ChecksumRandomReadFile::~ChecksumRandomReadFile() {
+        auto r = close();
+        (void) r;
+    }
+
+    turbo::Status ChecksumRandomReadFile::open(const std::string &path, std::any options,
+                                               FileEventListener listener) noexcept {
+        auto r = close();
+        (void) r;
+        STATUS_RETURN_IF_ERROR(parse_options(options, &options_));
+        path_ = path;
+        sums_.clear();
+        block_.clear();
+        block_index_ = std::numeric_limits<uint64_t>::max();
+        block_len_ = 0;
+        STATUS_RETURN_IF_ERROR(file_->open(path, options_.file_options, listener));
+        RESULT_ASSIGN_OR_RETURN(auto file_size, file_->size());
+        size_ = data_size(file_size, options_, sidecar_file_ == nullptr);
+        if (sidecar_file_ != nullptr) {
+            STATUS_RETURN_IF_ERROR(sidecar_file_->open(path + kChecksumSidecarSuffix, options_.file_options));
+            const uint64_t blocks = (size_ + options_.block_size - 1) / options_.block_size;
+            sums_.resize(blocks * checksum_size(options_.type));
+            STATUS_RETURN_IF_ERROR(read_at_fully(sidecar_file_.get(), 0, sums_.data(), sums_.size()));
+        }
+        return turbo::OkStatus();
+    }
+
+    turbo::Status ChecksumRandomReadFile::close() noexcept {
+        block_.clear();
+        block_index_ = std::numeric_limits<uint64_t>::max();
+        auto status = file_->close();
+        if (sidecar_file_ != nullptr) {
+            auto sidecar_status = sidecar_file_->close();
+            if (status.ok()) {
+                status = sidecar_status;
+            }
+        }
+        return status;
+    }
+
+    turbo::Result<int64_t> ChecksumRandomReadFile::tell() const noexcept {
+        return file_->tell();
+    }
+
+    turbo::Result<size_t> ChecksumRandomReadFile::size() const noexcept {
+        return size_;
+    }
+
+    turbo::Result<size_t> ChecksumRandomReadFile::read_at_impl(off_t offset, void *buff, size_t len) {
+        if (offset < 0) {
+            return turbo::invalid_argument_error("negative offset");
+        }
+        auto pos = static_cast<uint64_t>(offset);
+        if (pos >= size_) {
+            return 0;
+        }
+        len = static_cast<size_t>(std::min<uint64_t>(len, size_ - pos));
+        const size_t block_size = options_.block_size;
+        auto out = static_cast<uint8_t *>(buff);
+        size_t total = 0;
+        while (total < len) {
+            const uint64_t index = pos / block_size;
+            const size_t in_block = pos % block_size;
+            const auto block_len = static_cast<size_t>(std::min<uint64_t>(block_size, size_ - index * block_size));
+            size_t n;
+            if (in_block == 0 && len - total >= block_len) {
+                RESULT_ASSIGN_OR_RETURN(n, read_block(index, out + total));
+            } else {
+                if (block_index_ != index) {
+                    block_.resize(block_size);
+                    block_index_ = std::numeric_limits<uint64_t>::max();
+                    RESULT_ASSIGN_OR_RETURN(block_len_, read_block(index, block_.data()));
+                    block_index_ = index;
+                }
+                n = std::min(len - total, block_len_ - in_block);
+                memcpy(out + total, block_.data() + in_block, n);
+            }
+            total += n;
+            pos += n;
+        }
+        return total;
+    }
+
+    turbo::Result<size_t> ChecksumRandomReadFile::read_block(uint64_t index, uint8_t *buff) {
+        const size_t block_size = options_.block_size;
+        const size_t cs = checksum_size(options_.type);
+        const auto data_len = static_cast<size_t>(std::min<uint64_t>(block_size, size_ - index * block_size));
+        uint8_t inline_sum[8];
+        const uint8_t *sum;
+        if (sidecar_file_ != nullptr) {
+            STATUS_RETURN_IF_ERROR(read_at_fully(file_.get(), index * block_size, buff, data_len));
+            sum = sums_.data() + index * cs;
+        } else {
+            const uint64_t offset = index * (block_size + cs);
+            STATUS_RETURN_IF_ERROR(read_at_fully(file_.get(), offset, buff, data_len));
+            STATUS_RETURN_IF_ERROR(read_at_fully(file_.get(), offset + data_len, inline_sum, cs));
+            sum = inline_sum;
+        }
+        if (!matches_checksum(options_.type, buff, data_len, sum)) {
+            return checksum_mismatch(path_, index);
+        }
+        return data_len;
+    }
+
+    turbo::Status ChecksumRandomReadFile::read_at_fully(RandomAccessFileReader *file, uint64_t offset,
+                                                        uint8_t *buff, size_t len) {
+        size_t total = 0;
+        while (total < len) {
+            RESULT_ASSIGN_OR_RETURN(auto n, file->read_at(static_cast<off_t>(offset + total), buff + total,
+                                                          len - total));
+            if (n == 0) {
+                return truncated(file->path());
+            }
+            total += n;
+        }
+        return turbo::OkStatus();
+    }
+
+}  // namespace alkaid
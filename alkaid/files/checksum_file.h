@@ -0,0 +1,220 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <any>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <alkaid/files/interface.h>
+
+// Per-block checksums, to catch data corrupted at rest.  The data is cut in
+// blocks of block_size bytes, the last one may be shorter, and each block
+// gets a little endian crc32c (4 bytes) or xxh3 (8 bytes).
+//
+// Without a sidecar file the checksum follows each block in the file
+// itself.  With one, the data file is left as is and the checksums are
+// written back to back to path + ".sum".  Readers must be given the same
+// ChecksumOptions as the writer.
+
+namespace alkaid {
+
+    enum class ChecksumType : uint8_t {
+        /// crc32c, on the SSE4.2 or ARMv8 crc instructions when available
+        CRC32C,
+        /// 64 bit xxh3
+        XXH3,
+    };
+
+    static constexpr const char *kChecksumSidecarSuffix = ".sum";
+
+    struct ChecksumOptions {
+        ChecksumType type{ChecksumType::CRC32C};
+        /// data bytes covered by each checksum
+        size_t block_size{64 * 1024};
+        /// passed to open() of the underlying files
+        std::any file_options;
+    };
+
+    /// \brief Writes a file through an underlying file, computing a checksum
+    /// per block.
+    ///
+    /// A block is written once full, the last partial block on close.
+    /// flush() flushes the full blocks only, since a partial block can not
+    /// be extended once its checksum is written.
+    class TURBO_EXPORT ChecksumFileWriter : public SequentialFileWriter {
+    public:
+        explicit ChecksumFileWriter(std::shared_ptr<SequentialFileWriter> file,
+                                    std::shared_ptr<SequentialFileWriter> sidecar_file = nullptr);
+
+        ~ChecksumFileWriter() override;
+
+        turbo::Status open(const std::string &path, std::any options, FileEventListener listener) noexcept override;
+
+        turbo::Status close() noexcept override {
+            return close_impl();
+        }
+
+        /// data bytes appended
+        turbo::Result<int64_t> tell() const noexcept override;
+
+        FileMode mode() const noexcept override {
+            return FileMode::WRITE;
+        }
+
+        const std::string &path() const noexcept override {
+            return path_;
+        }
+
+        /// data bytes appended
+        turbo::Result<size_t> size() const noexcept override;
+
+        turbo::Status flush() override;
+
+        turbo::Status truncate(size_t size) noexcept override;
+
+    private:
+        turbo::Status append_impl(const void *buff, size_t len) noexcept override;
+
+        turbo::Status write_block(const uint8_t *data, size_t len);
+
+        turbo::Status flush_sums();
+
+        turbo::Status close_impl() noexcept;
+
+    private:
+        std::shared_ptr<SequentialFileWriter> file_;
+        std::shared_ptr<SequentialFileWriter> sidecar_file_;
+        std::string path_;
+        ChecksumOptions options_;
+        bool opened_{false};
+
+        std::vector<uint8_t> block_;
+        // sidecar checksums not written yet
+        std::string sums_;
+        uint64_t size_{0};
+    };
+
+    /// \brief Reads a file written by ChecksumFileWriter, verifying each block
+    /// as it is read.
+    ///
+    /// Reads of whole blocks go straight to the caller's buffer.  A block
+    /// which doesn't match its checksum fails the read with a data loss error.
+    class TURBO_EXPORT ChecksumFileReader : public SequentialFileReader {
+    public:
+        explicit ChecksumFileReader(std::shared_ptr<SequentialFileReader> file,
+                                    std::shared_ptr<SequentialFileReader> sidecar_file = nullptr);
+
+        ~ChecksumFileReader() override;
+
+        turbo::Status open(const std::string &path, std::any options, FileEventListener listener) noexcept override;
+
+        turbo::Status close() noexcept override;
+
+        /// data bytes read
+        turbo::Result<int64_t> tell() const noexcept override;
+
+        FileMode mode() const noexcept override {
+            return FileMode::READ;
+        }
+
+        const std::string &path() const noexcept override {
+            return path_;
+        }
+
+        /// data bytes in the file
+        turbo::Result<size_t> size() const noexcept override;
+
+        turbo::Status advance(off_t n) noexcept override;
+
+    private:
+        turbo::Result<size_t> read_impl(void *buff, size_t len) noexcept override;
+
+        // reads and verifies the next block into buff of block_size bytes
+        turbo::Result<size_t> read_block(uint8_t *buff);
+
+        turbo::Result<size_t> read_fully(SequentialFileReader *file, uint8_t *buff, size_t len);
+
+    private:
+        std::shared_ptr<SequentialFileReader> file_;
+        std::shared_ptr<SequentialFileReader> sidecar_file_;
+        std::string path_;
+        ChecksumOptions options_;
+
+        std::vector<uint8_t> block_;
+        size_t block_pos_{0};
+        uint64_t block_index_{0};
+        uint64_t position_{0};
+        bool eof_{false};
+    };
+
+    /// \brief Random access to a file written by ChecksumFileWriter.
+    ///
+    /// Every block a read touches is verified.  The last block verified is
+    /// cached, reads covering whole blocks go straight to the caller's
+    /// buffer.  Not thread safe.
+    class TURBO_EXPORT ChecksumRandomReadFile : public RandomAccessFileReader {
+    public:
+        explicit ChecksumRandomReadFile(std::shared_ptr<RandomAccessFileReader> file,
+                                        std::shared_ptr<RandomAccessFileReader> sidecar_file = nullptr);
+
+        ~ChecksumRandomReadFile() override;
+
+        turbo::Status open(const std::string &path, std::any options, FileEventListener listener) noexcept override;
+
+        turbo::Status close() noexcept override;
+
+        turbo::Result<int64_t> tell() const noexcept override;
+
+        FileMode mode() const noexcept override {
+            return FileMode::READ;
+        }
+
+        const std::string &path() const noexcept override {
+            return path_;
+        }
+
+        /// data bytes in the file
+        turbo::Result<size_t> size() const noexcept override;
+
+    private:
+        turbo::Result<size_t> read_at_impl(off_t offset, void *buff, size_t len) override;
+
+        // reads and verifies block index into buff, returns its data length
+        turbo::Result<size_t> read_block(uint64_t index, uint8_t *buff);
+
+        turbo::Status read_at_fully(RandomAccessFileReader *file, uint64_t offset, uint8_t *buff, size_t len);
+
+    private:
+        std::shared_ptr<RandomAccessFileReader> file_;
+        std::shared_ptr<RandomAccessFileReader> sidecar_file_;
+        std::string path_;
+        ChecksumOptions options_;
+        uint64_t size_{0};
+        // the whole sidecar, it is block_size / 8 times smaller than the data
+        std::vector<uint8_t> sums_;
+
+        std::vector<uint8_t> block_;
+        uint64_t block_index_{std::numeric_limits<uint64_t>::max()};
+        size_t block_len_{0};
+    };
+
+}  // namespace alkaid
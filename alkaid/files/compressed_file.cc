@@ -0,0 +1,250 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <alkaid/files/compressed_file.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <limits>
+
+#include <turbo/base/endian.h>
+#include <turbo/strings/str_cat.h>
+
+namespace alkaid {
+
+    namespace {
+
+        constexpr size_t kFrameHeaderSize = 8;
+
+        bool is_ready(const std::future<turbo::Result<std::vector<uint8_t>>> &future) {
+            return future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+        }
+
+        // formats whose compressed blocks concatenate into one readable stream
+        bool concatenates(CompressionType compression) {
+            switch (compression) {
+                case CompressionType::GZIP:
+                case CompressionType::ZSTD:
+                case CompressionType::BZ2:
+                case CompressionType::LZ4_FRAME:
+                case CompressionType::LZ4_HADOOP:
+                case CompressionType::LZO:
+                    return true;
+                default:
+                    return false;
+            }
+        }
+
+    }  // namespace
+
+    // ----------------------------------------------------------------------
+    // CompressedFileWriter implementation
+
+    turbo::Result<std::unique_ptr<Codec>> CompressedFileWriter::CodecPool::acquire() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!codecs.empty()) {
+                auto codec = std::move(codecs.back());
+                codecs.pop_back();
+                return codec;
+            }
+        }
+        return Codec::Create(compression, *codec_options);
+    }
+
+    void CompressedFileWriter::CodecPool::release(std::unique_ptr<Codec> codec) {
+        std::lock_guard<std::mutex> lock(mutex);
+        codecs.push_back(std::move(codec));
+    }
+
+    CompressedFileWriter::CompressedFileWriter(std::shared_ptr<SequentialFileWriter> file)
+            : file_(std::move(file)) {
+    }
+
+    CompressedFileWriter::~CompressedFileWriter() {
+        auto r = close_impl();
+        (void) r;
+    }
+
+    turbo::Status
+    CompressedFileWriter::open(const std::string &path, std::any options, FileEventListener listener) noexcept {
+        auto r = close_impl();
+        (void) r;
+        options_ = CompressedWriteOptions();
+        if (options.has_value()) {
+            try {
+                options_ = std::any_cast<CompressedWriteOptions>(options);
+            } catch (const std::bad_any_cast &e) {
+                return turbo::invalid_argument_error("invalid options");
+            }
+        }
+        if (options_.block_size == 0 || options_.block_size > std::numeric_limits<uint32_t>::max()) {
+            return turbo::invalid_argument_error(turbo::str_cat("invalid block size: ", options_.block_size));
+        }
+        if (!options_.framed && !concatenates(options_.compression)) {
+            return turbo::invalid_argument_error(
+                    turbo::str_cat("codec '", Codec::GetCodecAsString(options_.compression),
+                                   "' needs framed blocks"));
+        }
+        codecs_ = std::make_shared<CodecPool>();
+        codecs_->compression = options_.compression;
+        codecs_->codec_options = options_.codec_options != nullptr
+                                 ? options_.codec_options
+                                 : std::make_shared<CodecOptions>(options_.compression_level);
+        // create one codec up front, so bad options fail here and not on a worker
+        RESULT_ASSIGN_OR_RETURN(auto codec, codecs_->acquire());
+        if (codec == nullptr) {
+            return turbo::invalid_argument_error("no codec to compress with");
+        }
+        codecs_->release(std::move(codec));
+
+        path_ = path;
+        pool_ = options_.threads == 1
+                ? nullptr : std::make_shared<ThreadPool>(static_cast<size_t>(std::max(options_.threads, 0)));
+        max_in_flight_ = pool_ == nullptr ? 0 : options_.max_in_flight > 0 ? options_.max_in_flight : 2 * pool_->size();
+        block_.clear();
+        block_.reserve(options_.block_size);
+        uncompressed_size_ = 0;
+        compressed_written_ = 0;
+        STATUS_RETURN_IF_ERROR(file_->open(path, options_.file_options, listener));
+        opened_ = true;
+        return turbo::OkStatus();
+    }
+
+    turbo::Result<int64_t> CompressedFileWriter::tell() const noexcept {
+        if (!opened_) {
+            return turbo::invalid_argument_error("file not open");
+        }
+        return static_cast<int64_t>(uncompressed_size_);
+    }
+
+    turbo::Result<size_t> CompressedFileWriter::size() const noexcept {
+        if (!opened_) {
+            return turbo::unavailable_error("file not opened");
+        }
+        return uncompressed_size_;
+    }
+
+    turbo::Status CompressedFileWriter::flush() {
+        if (!opened_) {
+            return turbo::invalid_argument_error("file not open");
+        }
+        STATUS_RETURN_IF_ERROR(dispatch_block());
+        STATUS_RETURN_IF_ERROR(write_blocks(true));
+        return file_->flush();
+    }
+
+    turbo::Status CompressedFileWriter::truncate(size_t size) noexcept {
+        (void) size;
+        return turbo::unimplemented_error("compressed files can not be truncated");
+    }
+
+    turbo::Status CompressedFileWriter::append_impl(const void *buff, size_t len) noexcept {
+        if (!opened_) {
+            return turbo::invalid_argument_error("file not open");
+        }
+        auto data = static_cast<const uint8_t *>(buff);
+        while (len > 0) {
+            auto n = std::min(len, options_.block_size - block_.size());
+            block_.insert(block_.end(), data, data + n);
+            data += n;
+            len -= n;
+            uncompressed_size_ += n;
+            if (block_.size() == options_.block_size) {
+                STATUS_RETURN_IF_ERROR(dispatch_block());
+            }
+        }
+        return turbo::OkStatus();
+    }
+
+    turbo::Result<std::vector<uint8_t>>
+    CompressedFileWriter::compress_block(CodecPool *codecs, const std::vector<uint8_t> &data, bool framed) {
+        RESULT_ASSIGN_OR_RETURN(auto codec, codecs->acquire());
+        const size_t header = framed ? kFrameHeaderSize : 0;
+        auto input_len = static_cast<int64_t>(data.size());
+        std::vector<uint8_t> block(header + codec->MaxCompressedLen(input_len, data.data()));
+        auto result = codec->Compress(input_len, data.data(), static_cast<int64_t>(block.size() - header),
+                                      block.data() + header);
+        codecs->release(std::move(codec));
+        RESULT_ASSIGN_OR_RETURN(auto compressed_len, std::move(result));
+        if (framed) {
+            turbo::big_endian::store32(block.data(), static_cast<uint32_t>(data.size()));
+            turbo::big_endian::store32(block.data() + 4, static_cast<uint32_t>(compressed_len));
+        }
+        block.resize(header + compressed_len);
+        return block;
+    }
+
+    turbo::Status CompressedFileWriter::dispatch_block() {
+        if (block_.empty()) {
+            return turbo::OkStatus();
+        }
+        std::vector<uint8_t> data = std::move(block_);
+        block_.clear();
+        block_.reserve(options_.block_size);
+        if (pool_ == nullptr) {
+            RESULT_ASSIGN_OR_RETURN(auto block, compress_block(codecs_.get(), data, options_.framed));
+            STATUS_RETURN_IF_ERROR(file_->append(block.data(), block.size()));
+            compressed_written_ += block.size();
+            return turbo::OkStatus();
+        }
+        pending_.push_back(pool_->submit([codecs = codecs_, data = std::move(data), framed = options_.framed]() {
+            return compress_block(codecs.get(), data, framed);
+        }));
+        return write_blocks(false);
+    }
+
+    turbo::Status CompressedFileWriter::write_blocks(bool wait_all) {
+        while (!pending_.empty()) {
+            // write what is ready, and wait only once too many blocks are in flight
+            if (!wait_all && pending_.size() <= max_in_flight_ && !is_ready(pending_.front())) {
+                break;
+            }
+            auto result = pending_.front().get();
+            pending_.pop_front();
+            RESULT_ASSIGN_OR_RETURN(auto block, std::move(result));
+            STATUS_RETURN_IF_ERROR(file_->append(block.data(), block.size()));
+            compressed_written_ += block.size();
+        }
+        return turbo::OkStatus();
+    }
+
+    turbo::Status CompressedFileWriter::close_impl() noexcept {
+        if (!opened_) {
+            return turbo::OkStatus();
+        }
+        opened_ = false;
+        auto status = dispatch_block();
+        auto write_status = write_blocks(true);
+        if (status.ok()) {
+            status = write_status;
+        }
+        // a failed write leaves blocks behind, they still need to finish
+        for (auto &pending: pending_) {
+            pending.wait();
+        }
+        pending_.clear();
+        auto close_status = file_->close();
+        if (status.ok()) {
+            status = close_status;
+        }
+        return status;
+    }
+
+}  // namespace alkaid
@@ -0,0 +1,136 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <any>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <alkaid/compress/compression.h>
+#include <alkaid/files/interface.h>
+#include <alkaid/utility/thread_pool.h>
+
+namespace alkaid {
+
+    struct CompressedWriteOptions {
+        CompressionType compression{CompressionType::ZSTD};
+        /// codec options, the compression level when not set
+        std::shared_ptr<const CodecOptions> codec_options;
+        int compression_level{kUseDefaultCompressionLevel};
+        /// uncompressed size of a block
+        size_t block_size{1024 * 1024};
+        /// threads compressing blocks, 1 compresses inline and 0 uses the hardware concurrency
+        int threads{0};
+        /// blocks compressed or waiting to be written, 0 keeps 2 per thread
+        size_t max_in_flight{0};
+        /// prefix each block with its big endian uncompressed and compressed
+        /// sizes, as Hadoop does.  Without it the blocks are written back to
+        /// back, which only gzip, zstd, bz2, lz4 and the Hadoop framed codecs
+        /// decode as one stream.
+        bool framed{false};
+        /// passed to open() of the underlying file
+        std::any file_options;
+    };
+
+    /// \brief Compresses appends in blocks through any codec and writes them
+    /// through an underlying file.
+    ///
+    /// Full blocks are compressed on a thread pool while the blocks before
+    /// them are written, so the CPU and the disk are busy at the same time.
+    /// Blocks are written in the order they were appended.  Each worker takes
+    /// a codec of its own, since codecs are not thread safe.
+    class TURBO_EXPORT CompressedFileWriter : public SequentialFileWriter {
+    public:
+        explicit CompressedFileWriter(std::shared_ptr<SequentialFileWriter> file);
+
+        ~CompressedFileWriter() override;
+
+        turbo::Status open(const std::string &path, std::any options, FileEventListener listener) noexcept override;
+
+        turbo::Status close() noexcept override {
+            return close_impl();
+        }
+
+        /// uncompressed bytes appended
+        turbo::Result<int64_t> tell() const noexcept override;
+
+        FileMode mode() const noexcept override {
+            return FileMode::WRITE;
+        }
+
+        const std::string &path() const noexcept override {
+            return path_;
+        }
+
+        /// uncompressed bytes appended
+        turbo::Result<size_t> size() const noexcept override;
+
+        /// compressed bytes written to the underlying file so far
+        uint64_t compressed_size() const { return compressed_written_; }
+
+        /// compresses the current block, short of block_size, and waits until
+        /// every block is written
+        turbo::Status flush() override;
+
+        turbo::Status truncate(size_t size) noexcept override;
+
+    private:
+        // codecs not in use by a worker, shared with the tasks in flight
+        struct CodecPool {
+            CompressionType compression;
+            std::shared_ptr<const CodecOptions> codec_options;
+            std::mutex mutex;
+            std::vector<std::unique_ptr<Codec>> codecs;
+
+            turbo::Result<std::unique_ptr<Codec>> acquire();
+
+            void release(std::unique_ptr<Codec> codec);
+        };
+
+        turbo::Status append_impl(const void *buff, size_t len) noexcept override;
+
+        turbo::Status dispatch_block();
+
+        turbo::Status write_blocks(bool wait_all);
+
+        turbo::Status close_impl() noexcept;
+
+        static turbo::Result<std::vector<uint8_t>> compress_block(CodecPool *codecs, const std::vector<uint8_t> &data,
+                                                                  bool framed);
+
+    private:
+        std::shared_ptr<SequentialFileWriter> file_;
+        std::string path_;
+        CompressedWriteOptions options_;
+        std::shared_ptr<CodecPool> codecs_;
+        std::shared_ptr<ThreadPool> pool_;
+        size_t max_in_flight_{0};
+        bool opened_{false};
+
+        std::vector<uint8_t> block_;
+        std::deque<std::future<turbo::Result<std::vector<uint8_t>>>> pending_;
+        uint64_t uncompressed_size_{0};
+        uint64_t compressed_written_{0};
+    };
+
+}  // namespace alkaid
@@ -0,0 +1,662 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <alkaid/files/external_sort.h>
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <utility>
+
+#include <alkaid/compress/compression.h>
+#include <alkaid/files/compressed_file.h>
+#include <alkaid/files/filesystem.h>
+#include <alkaid/utility/thread_pool.h>
+#include <turbo/base/endian.h>
+
+namespace alkaid {
+
+    namespace {
+
+        constexpr size_t kLengthSize = 4;
+        constexpr size_t kFrameHeaderSize = 8;
+        constexpr size_t kReadChunkSize = 1024 * 1024;
+        constexpr size_t kWriteBufferSize = 1024 * 1024;
+        constexpr size_t kMinMergeBufferSize = 64 * 1024;
+        constexpr size_t kMaxMergeBufferSize = 4 * 1024 * 1024;
+
+        struct BytewiseLess {
+            bool operator()(std::string_view a, std::string_view b) const {
+                return a < b;
+            }
+        };
+
+        struct CustomLess {
+            const std::function<bool(std::string_view, std::string_view)> *less;
+
+            bool operator()(std::string_view a, std::string_view b) const {
+                return (*less)(a, b);
+            }
+        };
+
+        turbo::Result<size_t> read_fully(SequentialFileReader *file, void *buff, size_t len) {
+            auto data = static_cast<char *>(buff);
+            size_t total = 0;
+            while (total < len) {
+                RESULT_ASSIGN_OR_RETURN(auto n, file->read(data + total, len - total));
+                if (n == 0) {
+                    break;
+                }
+                total += n;
+            }
+            return total;
+        }
+
+        // cuts a stream of bytes in records, a record spanning two chunks is
+        // gathered in pending_
+        class RecordSplitter {
+        public:
+            explicit RecordSplitter(RecordFormat format) : format_(format) {
+            }
+
+            template<typename F>
+            turbo::Status feed(std::string_view data, F &&on_record) {
+                if (format_ == RecordFormat::LENGTH_PREFIXED) {
+                    return feed_length_prefixed(data, on_record);
+                }
+                size_t pos = 0;
+                while (pos < data.size()) {
+                    const size_t end = find_end(data, pos);
+                    if (end == std::string_view::npos) {
+                        pending_.append(data.data() + pos, data.size() - pos);
+                        break;
+                    }
+                    auto piece = data.substr(pos, end - pos);
+                    pos = end + 1;
+                    if (pending_.empty()) {
+                        STATUS_RETURN_IF_ERROR(on_record(piece));
+                    } else {
+                        pending_.append(piece.data(), piece.size());
+                        STATUS_RETURN_IF_ERROR(on_record(pending_));
+                        pending_.clear();
+                    }
+                }
+                return turbo::OkStatus();
+            }
+
+            template<typename F>
+            turbo::Status finish(F &&on_record) {
+                if (pending_.empty()) {
+                    return turbo::OkStatus();
+                }
+                if (format_ == RecordFormat::LENGTH_PREFIXED) {
+                    return turbo::Status(turbo::StatusCode::kDataLoss, "input ends within a record");
+                }
+                // the last record has no terminator
+                STATUS_RETURN_IF_ERROR(on_record(pending_));
+                pending_.clear();
+                return turbo::OkStatus();
+            }
+
+        private:
+            size_t find_end(std::string_view data, size_t pos) {
+                if (format_ == RecordFormat::LINES) {
+                    auto end = static_cast<const char *>(std::memchr(data.data() + pos, '\n', data.size() - pos));
+                    return end == nullptr ? std::string_view::npos : static_cast<size_t>(end - data.data());
+                }
+                // a quoted field may hold newlines, "" within quotes toggles twice
+                while (pos < data.size()) {
+                    if (in_quotes_) {
+                        auto quote = static_cast<const char *>(std::memchr(data.data() + pos, '"', data.size() - pos));
+                        if (quote == nullptr) {
+                            return std::string_view::npos;
+                        }
+                        in_quotes_ = false;
+                        pos = static_cast<size_t>(quote - data.data()) + 1;
+                        continue;
+                    }
+                    const char c = data[pos];
+                    if (c == '\n') {
+                        return pos;
+                    }
+                    if (c == '"') {
+                        in_quotes_ = true;
+                    }
+                    ++pos;
+                }
+                return std::string_view::npos;
+            }
+
+            template<typename F>
+            turbo::Status feed_length_prefixed(std::string_view data, F &&on_record) {
+                size_t pos = 0;
+                while (pos < data.size()) {
+                    if (!pending_.empty()) {
+                        // complete the record begun in an earlier chunk
+                        if (pending_.size() < kLengthSize) {
+                            auto n = std::min(kLengthSize - pending_.size(), data.size() - pos);
+                            pending_.append(data.data() + pos, n);
+                            pos += n;
+                            if (pending_.size() < kLengthSize) {
+                                break;
+                            }
+                        }
+                        const size_t want = kLengthSize + turbo::little_endian::load32(pending_.data());
+                        auto n = std::min(want - pending_.size(), data.size() - pos);
+                        pending_.append(data.data() + pos, n);
+                        pos += n;
+                        if (pending_.size() < want) {
+                            break;
+                        }
+                        STATUS_RETURN_IF_ERROR(on_record(std::string_view(pending_).substr(kLengthSize)));
+                        pending_.clear();
+                        continue;
+                    }
+                    const size_t left = data.size() - pos;
+                    if (left < kLengthSize ||
+                        left - kLengthSize < turbo::little_endian::load32(data.data() + pos)) {
+                        pending_.append(data.data() + pos, left);
+                        break;
+                    }
+                    const size_t length = turbo::little_endian::load32(data.data() + pos);
+                    STATUS_RETURN_IF_ERROR(on_record(data.substr(pos + kLengthSize, length)));
+                    pos += kLengthSize + length;
+                }
+                return turbo::OkStatus();
+            }
+
+        private:
+            RecordFormat format_;
+            bool in_quotes_{false};
+            std::string pending_;
+        };
+
+        // buffers records and appends them to a file in a format
+        class RecordWriter {
+        public:
+            RecordWriter(SequentialFileWriter *file, RecordFormat format) : file_(file), format_(format) {
+            }
+
+            turbo::Status add(std::string_view record) {
+                if (format_ == RecordFormat::LENGTH_PREFIXED) {
+                    char length[kLengthSize];
+                    turbo::little_endian::store32(length, static_cast<uint32_t>(record.size()));
+                    buffer_.append(length, kLengthSize);
+                    buffer_.append(record.data(), record.size());
+                } else {
+                    buffer_.append(record.data(), record.size());
+                    buffer_.push_back('\n');
+                }
+                ++records_;
+                if (buffer_.size() >= kWriteBufferSize) {
+                    return flush();
+                }
+                return turbo::OkStatus();
+            }
+
+            turbo::Status flush() {
+                if (buffer_.empty()) {
+                    return turbo::OkStatus();
+                }
+                STATUS_RETURN_IF_ERROR(file_->append(buffer_));
+                buffer_.clear();
+                return turbo::OkStatus();
+            }
+
+            uint64_t records() const {
+                return records_;
+            }
+
+        private:
+            SequentialFileWriter *file_;
+            RecordFormat format_;
+            std::string buffer_;
+            uint64_t records_{0};
+        };
+
+        // the records of a run being read, and their offsets and lengths
+        struct RunBuffer {
+            std::string data;
+            std::vector<std::pair<size_t, size_t>> records;
+
+            size_t memory() const {
+                return data.size() + records.size() * sizeof(records[0]);
+            }
+
+            std::string_view record(size_t i) const {
+                return std::string_view(data).substr(records[i].first, records[i].second);
+            }
+        };
+
+        // a sorted run spilled to a temp file, as length-prefixed records
+        struct Run {
+            // the temp file, deleted once the run is released
+            std::shared_ptr<TempFileWriter> file;
+            // the writer of the records, through LZ4 when runs are compressed
+            std::shared_ptr<SequentialFileWriter> writer;
+            uint64_t records{0};
+        };
+
+        // reads the records of a run, the next chunk of it being read ahead on
+        // the pool
+        class RunReader {
+        public:
+            ~RunReader() {
+                if (prefetch_.valid()) {
+                    prefetch_.wait();
+                }
+            }
+
+            turbo::Status open(Filesystem *fs, const Run &run, bool compressed, size_t chunk_size, ThreadPool *pool) {
+                RESULT_ASSIGN_OR_RETURN(file_, fs->create_sequential_read_file());
+                STATUS_RETURN_IF_ERROR(file_->open(run.file->path(), {}, {}));
+                if (compressed) {
+                    RESULT_ASSIGN_OR_RETURN(codec_, Codec::Create(CompressionType::LZ4));
+                }
+                chunk_size_ = chunk_size;
+                pool_ = pool;
+                remaining_ = run.records;
+                prefetch();
+                return next();
+            }
+
+            bool valid() const {
+                return valid_;
+            }
+
+            std::string_view record() const {
+                return record_;
+            }
+
+            turbo::Status next() {
+                if (remaining_ == 0) {
+                    valid_ = false;
+                    return turbo::OkStatus();
+                }
+                STATUS_RETURN_IF_ERROR(fill(kLengthSize));
+                const size_t length = turbo::little_endian::load32(buffer_.data() + pos_);
+                STATUS_RETURN_IF_ERROR(fill(kLengthSize + length));
+                record_ = std::string_view(buffer_).substr(pos_ + kLengthSize, length);
+                pos_ += kLengthSize + length;
+                --remaining_;
+                valid_ = true;
+                return turbo::OkStatus();
+            }
+
+        private:
+            void prefetch() {
+                prefetch_ = pool_->submit([file = file_.get(), codec = codec_.get(), size = chunk_size_]() {
+                    return read_chunk(file, codec, size);
+                });
+            }
+
+            // makes n bytes available from pos_
+            turbo::Status fill(size_t n) {
+                while (buffer_.size() - pos_ < n) {
+                    RESULT_ASSIGN_OR_RETURN(auto chunk, prefetch_.get());
+                    if (chunk.empty()) {
+                        return turbo::Status(turbo::StatusCode::kDataLoss, "sort run cut short");
+                    }
+                    if (pos_ == buffer_.size()) {
+                        buffer_.swap(chunk);
+                    } else {
+                        buffer_.erase(0, pos_);
+                        buffer_.append(chunk);
+                    }
+                    pos_ = 0;
+                    prefetch();
+                }
+                return turbo::OkStatus();
+            }
+
+            static turbo::Result<std::string> read_chunk(SequentialFileReader *file, Codec *codec, size_t size) {
+                if (codec == nullptr) {
+                    std::string chunk(size, '\0');
+                    RESULT_ASSIGN_OR_RETURN(auto n, read_fully(file, chunk.data(), size));
+                    chunk.resize(n);
+                    return chunk;
+                }
+                // a block framed by CompressedFileWriter
+                uint8_t header[kFrameHeaderSize];
+                RESULT_ASSIGN_OR_RETURN(auto n, read_fully(file, header, kFrameHeaderSize));
+                if (n == 0) {
+                    return std::string();
+                }
+                if (n < kFrameHeaderSize) {
+                    return turbo::Status(turbo::StatusCode::kDataLoss, "sort run cut short");
+                }
+                const uint32_t uncompressed_len = turbo::big_endian::load32(header);
+                const uint32_t compressed_len = turbo::big_endian::load32(header + 4);
+                std::string compressed(compressed_len, '\0');
+                RESULT_ASSIGN_OR_RETURN(n, read_fully(file, compressed.data(), compressed_len));
+                if (n < compressed_len) {
+                    return turbo::Status(turbo::StatusCode::kDataLoss, "sort run cut short");
+                }
+                std::string chunk(uncompressed_len, '\0');
+                RESULT_ASSIGN_OR_RETURN(auto decompressed_len,
+                                        codec->Decompress(compressed_len,
+                                                          reinterpret_cast<const uint8_t *>(compressed.data()),
+                                                          uncompressed_len, reinterpret_cast<uint8_t *>(chunk.data())));
+                if (decompressed_len != uncompressed_len) {
+                    return turbo::Status(turbo::StatusCode::kDataLoss, "sort run block length mismatch");
+                }
+                return chunk;
+            }
+
+        private:
+            std::shared_ptr<SequentialFileReader> file_;
+            std::unique_ptr<Codec> codec_;
+            size_t chunk_size_{0};
+            ThreadPool *pool_{nullptr};
+            uint64_t remaining_{0};
+            std::future<turbo::Result<std::string>> prefetch_;
+
+            std::string buffer_;
+            size_t pos_{0};
+            std::string_view record_;
+            bool valid_{false};
+        };
+
+        // a tournament tree whose inner nodes keep the loser of their match,
+        // so replacing the winner replays log2(k) matches against losers only
+        template<typename Less>
+        class LoserTree {
+        public:
+            LoserTree(std::vector<RunReader *> sources, Less less)
+                    : sources_(std::move(sources)), less_(less), tree_(sources_.size()) {
+                if (!sources_.empty()) {
+                    tree_[0] = build(1);
+                }
+            }
+
+            // the source holding the smallest record, null once all are exhausted
+            RunReader *top() const {
+                if (sources_.empty()) {
+                    return nullptr;
+                }
+                auto *source = sources_[tree_[0]];
+                return source->valid() ? source : nullptr;
+            }
+
+            // to call once the top source moved to its next record
+            void replay() {
+                const size_t k = sources_.size();
+                size_t winner = tree_[0];
+                for (size_t node = (winner + k) / 2; node > 0; node /= 2) {
+                    if (beats(tree_[node], winner)) {
+                        std::swap(tree_[node], winner);
+                    }
+                }
+                tree_[0] = winner;
+            }
+
+        private:
+            // nodes 1 to k - 1 are inner nodes, k to 2k - 1 the sources
+            size_t build(size_t node) {
+                const size_t k = sources_.size();
+                if (node >= k) {
+                    return node - k;
+                }
+                const size_t left = build(2 * node);
+                const size_t right = build(2 * node + 1);
+                if (beats(left, right)) {
+                    tree_[node] = right;
+                    return left;
+                }
+                tree_[node] = left;
+                return right;
+            }
+
+            // ties go to the earlier run, which keeps the sort stable
+            bool beats(size_t a, size_t b) const {
+                auto *ra = sources_[a];
+                auto *rb = sources_[b];
+                if (!ra->valid()) {
+                    return false;
+                }
+                if (!rb->valid()) {
+                    return true;
+                }
+                if (less_(ra->record(), rb->record())) {
+                    return true;
+                }
+                if (less_(rb->record(), ra->record())) {
+                    return false;
+                }
+                return a < b;
+            }
+
+        private:
+            std::vector<RunReader *> sources_;
+            Less less_;
+            std::vector<size_t> tree_;
+        };
+
+    }  // namespace
+
+    // ----------------------------------------------------------------------
+    // ExternalSorter implementation
+
+    struct ExternalSorter::Impl {
+        const ExternalSortOptions &options;
+        Filesystem *fs;
+        ExternalSortStats *stats;
+        std::shared_ptr<ThreadPool> pool;
+        size_t run_budget{0};
+        size_t merge_buffer_size{0};
+
+        std::vector<Run> runs;
+        std::deque<std::future<turbo::Result<Run>>> pending;
+
+        Impl(const ExternalSortOptions &o, Filesystem *f, ExternalSortStats *s) : options(o), fs(f), stats(s) {
+            pool = std::make_shared<ThreadPool>(static_cast<size_t>(std::max(options.threads, 0)));
+            // runs being sorted and the one being read share the budget
+            run_budget = std::max<size_t>(options.memory_budget / (pool->size() + 1), 1);
+            // each source of a merge holds a chunk and reads the next one ahead
+            merge_buffer_size = std::clamp(options.memory_budget / (2 * options.max_merge_fan_in),
+                                           kMinMergeBufferSize, kMaxMergeBufferSize);
+        }
+
+        ~Impl() {
+            // the tasks still running use this
+            for (auto &future: pending) {
+                future.wait();
+            }
+        }
+
+        template<typename Less>
+        static void sort_run(RunBuffer *buffer, Less less) {
+            std::stable_sort(buffer->records.begin(), buffer->records.end(),
+                             [buffer, &less](const auto &a, const auto &b) {
+                                 return less(std::string_view(buffer->data).substr(a.first, a.second),
+                                             std::string_view(buffer->data).substr(b.first, b.second));
+                             });
+        }
+
+        turbo::Result<Run> create_run() const {
+            Run run;
+            RESULT_ASSIGN_OR_RETURN(run.file, fs->create_temp_file());
+            if (options.compress_runs) {
+                CompressedWriteOptions write_options;
+                write_options.compression = CompressionType::LZ4;
+                write_options.block_size = merge_buffer_size;
+                write_options.threads = 1;
+                write_options.framed = true;
+                auto writer = std::make_shared<CompressedFileWriter>(run.file);
+                STATUS_RETURN_IF_ERROR(writer->open(options.temp_prefix, write_options, {}));
+                run.writer = std::move(writer);
+            } else {
+                STATUS_RETURN_IF_ERROR(run.file->open(options.temp_prefix, {}, {}));
+                run.writer = run.file;
+            }
+            return run;
+        }
+
+        // the run stays open for writing, closing it would delete it
+        turbo::Status finish_run(Run *run, RecordWriter *writer) const {
+            STATUS_RETURN_IF_ERROR(writer->flush());
+            STATUS_RETURN_IF_ERROR(run->writer->flush());
+            run->records = writer->records();
+            return turbo::OkStatus();
+        }
+
+        turbo::Result<Run> spill(const RunBuffer &buffer) const {
+            RESULT_ASSIGN_OR_RETURN(auto run, create_run());
+            RecordWriter writer(run.writer.get(), RecordFormat::LENGTH_PREFIXED);
+            for (size_t i = 0; i < buffer.records.size(); ++i) {
+                STATUS_RETURN_IF_ERROR(writer.add(buffer.record(i)));
+            }
+            STATUS_RETURN_IF_ERROR(finish_run(&run, &writer));
+            return run;
+        }
+
+        turbo::Status collect_run() {
+            auto result = pending.front().get();
+            pending.pop_front();
+            RESULT_ASSIGN_OR_RETURN(auto run, std::move(result));
+            RESULT_ASSIGN_OR_RETURN(auto size, run.file->size());
+            stats->spilled_bytes += size;
+            runs.push_back(std::move(run));
+            return turbo::OkStatus();
+        }
+
+        template<typename Less>
+        turbo::Status dispatch_run(RunBuffer buffer, Less less) {
+            if (pending.size() >= pool->size()) {
+                STATUS_RETURN_IF_ERROR(collect_run());
+            }
+            pending.push_back(pool->submit([this, buffer = std::move(buffer), less]() mutable {
+                sort_run(&buffer, less);
+                return spill(buffer);
+            }));
+            return turbo::OkStatus();
+        }
+
+        template<typename Less>
+        turbo::Status merge(const std::vector<Run> &sources, RecordWriter *out, Less less) {
+            std::vector<std::unique_ptr<RunReader>> readers;
+            std::vector<RunReader *> tree_sources;
+            for (auto &run: sources) {
+                readers.push_back(std::make_unique<RunReader>());
+                STATUS_RETURN_IF_ERROR(readers.back()->open(fs, run, options.compress_runs, merge_buffer_size,
+                                                            pool.get()));
+                tree_sources.push_back(readers.back().get());
+            }
+            LoserTree<Less> tree(std::move(tree_sources), less);
+            while (auto *top = tree.top()) {
+                STATUS_RETURN_IF_ERROR(out->add(top->record()));
+                STATUS_RETURN_IF_ERROR(top->next());
+                tree.replay();
+            }
+            return turbo::OkStatus();
+        }
+
+        template<typename Less>
+        turbo::Status sort(SequentialFileReader *input, SequentialFileWriter *output, Less less) {
+            RecordSplitter splitter(options.format);
+            RecordWriter out(output, options.format);
+            bool header = options.has_header && options.format != RecordFormat::LENGTH_PREFIXED;
+            RunBuffer buffer;
+            auto on_record = [&](std::string_view record) -> turbo::Status {
+                if (header) {
+                    header = false;
+                    return out.add(record);
+                }
+                ++stats->records;
+                buffer.records.emplace_back(buffer.data.size(), record.size());
+                buffer.data.append(record.data(), record.size());
+                if (buffer.memory() >= run_budget) {
+                    STATUS_RETURN_IF_ERROR(dispatch_run(std::move(buffer), less));
+                    buffer = RunBuffer();
+                }
+                return turbo::OkStatus();
+            };
+            std::string chunk(kReadChunkSize, '\0');
+            while (true) {
+                RESULT_ASSIGN_OR_RETURN(auto n, input->read(chunk.data(), chunk.size()));
+                if (n == 0) {
+                    break;
+                }
+                STATUS_RETURN_IF_ERROR(splitter.feed(std::string_view(chunk.data(), n), on_record));
+            }
+            STATUS_RETURN_IF_ERROR(splitter.finish(on_record));
+
+            if (runs.empty() && pending.empty()) {
+                // everything fits in memory
+                sort_run(&buffer, less);
+                for (size_t i = 0; i < buffer.records.size(); ++i) {
+                    STATUS_RETURN_IF_ERROR(out.add(buffer.record(i)));
+                }
+                stats->runs = buffer.records.empty() ? 0 : 1;
+                return out.flush();
+            }
+            if (!buffer.records.empty()) {
+                STATUS_RETURN_IF_ERROR(dispatch_run(std::move(buffer), less));
+            }
+            while (!pending.empty()) {
+                STATUS_RETURN_IF_ERROR(collect_run());
+            }
+            stats->runs = runs.size();
+
+            // merge groups of consecutive runs until one pass can merge them all
+            while (runs.size() > options.max_merge_fan_in) {
+                std::vector<Run> merged;
+                for (size_t i = 0; i < runs.size(); i += options.max_merge_fan_in) {
+                    auto end = std::min(i + options.max_merge_fan_in, runs.size());
+                    if (end - i == 1) {
+                        merged.push_back(std::move(runs[i]));
+                        continue;
+                    }
+                    std::vector<Run> group(std::make_move_iterator(runs.begin() + i),
+                                           std::make_move_iterator(runs.begin() + end));
+                    RESULT_ASSIGN_OR_RETURN(auto run, create_run());
+                    RecordWriter writer(run.writer.get(), RecordFormat::LENGTH_PREFIXED);
+                    STATUS_RETURN_IF_ERROR(merge(group, &writer, less));
+                    STATUS_RETURN_IF_ERROR(finish_run(&run, &writer));
+                    RESULT_ASSIGN_OR_RETURN(auto size, run.file->size());
+                    stats->spilled_bytes += size;
+                    merged.push_back(std::move(run));
+                }
+                runs = std::move(merged);
+                ++stats->merge_passes;
+            }
+            STATUS_RETURN_IF_ERROR(merge(runs, &out, less));
+            ++stats->merge_passes;
+            runs.clear();
+            return out.flush();
+        }
+    };
+
+    ExternalSorter::ExternalSorter(ExternalSortOptions options, Filesystem *fs)
+            : options_(std::move(options)), fs_(fs != nullptr ? fs : Filesystem::localfs()) {
+    }
+
+    turbo::Status ExternalSorter::sort(SequentialFileReader *input, SequentialFileWriter *output) {
+        if (options_.max_merge_fan_in < 2) {
+            return turbo::invalid_argument_error("the merge fan in must be at least 2");
+        }
+        stats_ = ExternalSortStats();
+        Impl impl(options_, fs_, &stats_);
+        if (options_.less) {
+            return impl.sort(input, output, CustomLess{&options_.less});
+        }
+        return impl.sort(input, output, BytewiseLess());
+    }
+
+}  // namespace alkaid
@@ -0,0 +1,99 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <alkaid/files/interface.h>
+#include <alkaid/files/internal/filesystem_fwd.h>
+
+// External merge sort, for inputs larger than memory.
+//
+// The input is cut in runs that fit the memory budget.  Runs are sorted on
+// a thread pool while the next one is read, and spilled to temp files as
+// length-prefixed records, LZ4 compressed if asked.  The runs are then
+// merged with a loser tree, each run read ahead on the pool, in as many
+// passes as max_merge_fan_in requires.  An input that fits in one run is
+// sorted in memory and never spilled.  The sort is stable.
+
+namespace alkaid {
+
+    enum class RecordFormat : uint8_t {
+        /// records end with '\n', the last one may not
+        LINES,
+        /// CSV rows, a '\n' within double quotes doesn't end the row
+        CSV,
+        /// a little endian 32 bit length, then the record
+        LENGTH_PREFIXED,
+    };
+
+    struct ExternalSortOptions {
+        RecordFormat format{RecordFormat::LINES};
+        /// for LINES and CSV, the first record is written first and not sorted
+        bool has_header{false};
+        /// orders the records, bytewise when not set
+        std::function<bool(std::string_view, std::string_view)> less;
+        /// memory for the records of the runs being read and sorted
+        size_t memory_budget{256 * 1024 * 1024};
+        /// threads sorting runs and reading ahead when merging, 0 uses the hardware concurrency
+        int threads{0};
+        /// compress the spilled runs with LZ4
+        bool compress_runs{false};
+        /// runs merged at once, more runs are merged in several passes
+        size_t max_merge_fan_in{64};
+        /// where the temp files go, the prefix of their names
+        std::string temp_prefix{"/tmp/alkaid-sort-"};
+    };
+
+    struct ExternalSortStats {
+        uint64_t records{0};
+        uint64_t runs{0};
+        uint64_t merge_passes{0};
+        /// bytes written to the temp files, after compression
+        uint64_t spilled_bytes{0};
+    };
+
+    /// \brief Sorts the records of a file into another, within a memory budget.
+    class TURBO_EXPORT ExternalSorter {
+    public:
+        /// fs provides the temp files and reads them back, the local filesystem when null
+        explicit ExternalSorter(ExternalSortOptions options = ExternalSortOptions(), Filesystem *fs = nullptr);
+
+        /// \brief Sort the records of input into output, in the same format
+        ///
+        /// Both files must be open, output is neither flushed nor closed.
+        turbo::Status sort(SequentialFileReader *input, SequentialFileWriter *output);
+
+        const ExternalSortStats &stats() const { return stats_; }
+
+    private:
+        // the state of one sort() call
+        struct Impl;
+
+        ExternalSortOptions options_;
+        Filesystem *fs_;
+        ExternalSortStats stats_;
+    };
+
+}  // namespace alkaid
@@ -83,6 +83,12 @@ namespace alkaid {
         return read_at_impl(offset, buff, len);
     }
 
+    std::future<turbo::Result<size_t>> RandomAccessFileReader::read_at_async(off_t offset, void *buff, size_t len) {
+        std::promise<turbo::Result<size_t>> promise;
+        promise.set_value(read_at(offset, buff, len));
+        return promise.get_future();
+    }
+
     turbo::Result<size_t> RandomAccessFileReader::read_at(off_t offset, std::string *result, size_t length) {
         auto len = length;
         if (len == kInfiniteFileSize) {
@@ -25,6 +25,7 @@
 #include <turbo/base/macros.h>
 #include <string_view>
 #include <any>
+#include <future>
 #include <turbo/strings/cord.h>
 
 namespace alkaid {
@@ -121,6 +122,11 @@ namespace alkaid {
 
         virtual turbo::Result<size_t> read_at(off_t offset, turbo::Cord &buffer, size_t size = kInfiniteFileSize);
 
+        /// \brief Reads without holding the caller on the disk where the file
+        /// can, buff and the file must outlive the future.  By default the
+        /// read is done at once and the future returned is ready.
+        virtual std::future<turbo::Result<size_t>> read_at_async(off_t offset, void *buff, size_t len);
+
     protected:
         RandomAccessFileReader() = default;
 
@@ -168,6 +174,12 @@ namespace alkaid {
     };
 
     class TempFileWriter : public SequentialFileWriter {
+    public:
+        /// \brief Give the temp file the name path, it is kept once closed
+        virtual turbo::Status keep(const std::string &path) noexcept {
+            (void) path;
+            return turbo::unimplemented_error("temp file can not be kept");
+        }
     };
 
 }  // namespace alkaid
@@ -106,6 +106,21 @@ namespace alkaid::lfs {
         }
     };
 
+    /// a range of a file
+    struct FileExtent {
+        off_t offset{0};
+        size_t length{0};
+    };
+
+    struct TempFileOption {
+        /// an O_TMPFILE file, freed on close and never left behind by a crash.
+        /// While open it is at /proc/self/fd/<fd>.  Where the filesystem has no
+        /// O_TMPFILE, a named file removed on close is used instead.
+        bool anonymous{true};
+        /// small and often read, place it on tmpfs (/dev/shm) when there is one
+        bool small_and_hot{false};
+    };
+
     static constexpr OpenOption kDefaultReadOption = OpenOption{1, 0, O_RDONLY | O_CLOEXEC, 0644, false};
     static constexpr OpenOption kDefaultAppendWriteOption = OpenOption{1, 0, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC,
                                                                        0644, false};
@@ -24,7 +24,10 @@
 #include <iterator>
 #include <string>
 #include <system_error>
+#include <algorithm>
 #include <cstdint>
+#include <utility>
+#include <vector>
 
 #ifndef _WIN32
 
@@ -373,6 +376,23 @@ namespace alkaid {
         typename std::enable_if<A == access_mode::write, void>::type
         sync(std::error_code &error);
 
+        /**
+         * Reports which pages of [offset, offset + length), relative to `data`, are
+         * in memory, one entry per page starting with the page holding `offset`, bit 0
+         * set when the page is resident. Uses `mincore(2)`, not supported on Windows.
+         */
+        void residency(size_type offset, size_type length, std::vector<unsigned char> &pages,
+                       std::error_code &error) const;
+
+        /** Asks the kernel to read [offset, offset + length) ahead, `MADV_WILLNEED`. */
+        void prefetch(size_type offset, size_type length, std::error_code &error) const;
+
+        /**
+         * Drops the pages of [offset, offset + length) from this mapping, `MADV_DONTNEED`.
+         * They stay in the page cache until evicted through the file handle too.
+         */
+        void evict(size_type offset, size_type length, std::error_code &error) const;
+
         /**
          * All operators compare the address of the first byte and size of the two mapped
          * regions.
@@ -391,6 +411,11 @@ namespace alkaid {
             return !data() ? nullptr : data() - mapping_offset();
         }
 
+        // the page aligned start and the length of the pages holding [offset, offset + length)
+        std::pair<void *, size_type> page_range(size_type offset, size_type length) const noexcept;
+
+        void advise(size_type offset, size_type length, int advice, std::error_code &error) const;
+
         /**
          * The destructor syncs changes to disk if `AccessMode` is `write`, but not
          * if it's `read`, but since the destructor cannot be templated, we need to
@@ -840,6 +865,86 @@ typename std::enable_if<
 #endif
     }
 
+    template<access_mode AccessMode, typename ByteT>
+    std::pair<void *, typename basic_mmap<AccessMode, ByteT>::size_type>
+    basic_mmap<AccessMode, ByteT>::page_range(const size_type offset, const size_type length) const noexcept {
+        if (!data() || offset >= length_) {
+            return {nullptr, 0};
+        }
+        const size_type begin = mapping_offset() + offset;
+        const size_type end = mapping_offset() + offset + std::min(length, length_ - offset);
+        const size_type aligned_begin = make_offset_page_aligned(begin);
+        return {const_cast<char *>(reinterpret_cast<const char *>(get_mapping_start())) + aligned_begin,
+                end - aligned_begin};
+    }
+
+    template<access_mode AccessMode, typename ByteT>
+    void basic_mmap<AccessMode, ByteT>::residency(const size_type offset, const size_type length,
+                                                  std::vector<unsigned char> &pages, std::error_code &error) const {
+        error.clear();
+        pages.clear();
+        if (!is_open()) {
+            error = std::make_error_code(std::errc::bad_file_descriptor);
+            return;
+        }
+#ifdef _WIN32
+        error = std::make_error_code(std::errc::function_not_supported);
+#else // POSIX
+        const auto range = page_range(offset, length);
+        if (range.second == 0) {
+            return;
+        }
+        pages.resize((range.second + page_size() - 1) / page_size());
+#ifdef __APPLE__
+        if (::mincore(range.first, range.second, reinterpret_cast<char *>(pages.data())) != 0)
+#else
+        if (::mincore(range.first, range.second, pages.data()) != 0)
+#endif
+        {
+            error = detail::last_error();
+            pages.clear();
+        }
+#endif
+    }
+
+    template<access_mode AccessMode, typename ByteT>
+    void basic_mmap<AccessMode, ByteT>::advise(const size_type offset, const size_type length, const int advice,
+                                               std::error_code &error) const {
+        error.clear();
+        if (!is_open()) {
+            error = std::make_error_code(std::errc::bad_file_descriptor);
+            return;
+        }
+#ifdef _WIN32
+        error = std::make_error_code(std::errc::function_not_supported);
+#else // POSIX
+        const auto range = page_range(offset, length);
+        if (range.second > 0 && ::madvise(range.first, range.second, advice) != 0) {
+            error = detail::last_error();
+        }
+#endif
+    }
+
+    template<access_mode AccessMode, typename ByteT>
+    void basic_mmap<AccessMode, ByteT>::prefetch(const size_type offset, const size_type length,
+                                                 std::error_code &error) const {
+#ifdef _WIN32
+        advise(offset, length, 0, error);
+#else
+        advise(offset, length, MADV_WILLNEED, error);
+#endif
+    }
+
+    template<access_mode AccessMode, typename ByteT>
+    void basic_mmap<AccessMode, ByteT>::evict(const size_type offset, const size_type length,
+                                              std::error_code &error) const {
+#ifdef _WIN32
+        advise(offset, length, 0, error);
+#else
+        advise(offset, length, MADV_DONTNEED, error);
+#endif
+    }
+
     template<access_mode AccessMode, typename ByteT>
     void basic_mmap<AccessMode, ByteT>::unmap() {
         if (!is_open()) { return; }
@@ -89,17 +89,91 @@ namespace alkaid::lfs {
 
     turbo::Result<size_t> RandomReadFile::read_at_impl(int64_t offset, void *buff, size_t len) noexcept {
         INVALID_FD_RETURN(_fd);
-        size_t has_read = 0;
         /// _fd may > 0 with _fp valid
         ssize_t read_size = sys_pread(_fd, buff, len, static_cast<off_t>(offset));
         if(read_size < 0 ) {
-            return turbo::errno_to_status(errno, "Failed reading file  for reading");
+            return turbo::errno_to_status(errno, "Failed reading file %s", path_);
         }
-        // read_size > 0 means read the end of file
-        return has_read;
+        // read_size < len means read the end of file
+        return static_cast<size_t>(read_size);
+    }
+
+    std::future<turbo::Result<size_t>> RandomReadFile::read_at_async(off_t offset, void *buff, size_t len) {
+        if (pool_ == nullptr || _fd == INVALID_FILE_HANDLER) {
+            return RandomAccessFileReader::read_at_async(offset, buff, len);
+        }
+        auto out = static_cast<char *>(buff);
+        size_t done = 0;
+        bool at_end = false;
+        while (done < len && nowait_supported_.load(std::memory_order_relaxed)) {
+            auto n = sys_pread_nowait(_fd, out + done, len - done, offset + static_cast<off_t>(done));
+            if (n > 0) {
+                done += n;
+                continue;
+            }
+            if (n == 0) {
+                at_end = true;
+                break;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN) {
+                // not in the page cache
+                break;
+            }
+            if (errno == EOPNOTSUPP || errno == ENOSYS || errno == EINVAL) {
+                nowait_supported_.store(false, std::memory_order_relaxed);
+                break;
+            }
+            std::promise<turbo::Result<size_t>> promise;
+            promise.set_value(turbo::errno_to_status(errno, "Failed reading file %s", path_));
+            return promise.get_future();
+        }
+        if (done == len || at_end) {
+            nowait_reads_.fetch_add(1, std::memory_order_relaxed);
+            std::promise<turbo::Result<size_t>> promise;
+            promise.set_value(done);
+            return promise.get_future();
+        }
+        offloaded_reads_.fetch_add(1, std::memory_order_relaxed);
+        {
+            // close_impl() waits for the read, so that it never reads a closed or reused fd
+            std::lock_guard lock(pending_mutex_);
+            ++pending_reads_;
+        }
+        return pool_->submit([this, offset, out, len, done]() -> turbo::Result<size_t> {
+            auto n = read_at_impl(offset + static_cast<off_t>(done), out + done, len - done);
+            {
+                std::lock_guard lock(pending_mutex_);
+                --pending_reads_;
+                pending_cv_.notify_all();
+            }
+            RESULT_ASSIGN_OR_RETURN(auto read, n);
+            return done + read;
+        });
+    }
+
+    turbo::Result<std::vector<FileExtent>> RandomReadFile::resident_extents(off_t offset, size_t len) const {
+        INVALID_FD_RETURN(_fd);
+        return lfs::resident_extents(_fd, offset, len);
+    }
+
+    turbo::Status RandomReadFile::prefetch(off_t offset, size_t len) {
+        INVALID_FD_RETURN(_fd);
+        return lfs::prefetch(_fd, offset, len);
+    }
+
+    turbo::Status RandomReadFile::evict(off_t offset, size_t len) {
+        INVALID_FD_RETURN(_fd);
+        return lfs::evict(_fd, offset, len);
     }
 
     turbo::Status RandomReadFile::close_impl() noexcept {
+        {
+            std::unique_lock lock(pending_mutex_);
+            pending_cv_.wait(lock, [this] { return pending_reads_ == 0; });
+        }
         if (_fd > 0) {
             if (listener_.before_close) {
                 listener_.before_close(this);
@@ -18,8 +18,15 @@
 //
 // Created by jeff on 24-6-9.
 //
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <vector>
+
 #include <alkaid/files/interface.h>
 #include <alkaid/files/local/defines.h>
+#include <alkaid/utility/thread_pool.h>
 
 namespace alkaid::lfs {
 
@@ -42,6 +49,41 @@ namespace alkaid::lfs {
 
         turbo::Result<size_t> size() const noexcept override;
 
+        /// \brief With an io pool, read_at_async() reads what is in the page
+        /// cache on the calling thread with preadv2(RWF_NOWAIT) and the rest
+        /// on the pool, so a page cache miss does not hold the caller.
+        /// close() and the destructor wait for the reads on the pool.
+        void set_io_pool(std::shared_ptr<ThreadPool> pool) {
+            pool_ = std::move(pool);
+        }
+
+        std::future<turbo::Result<size_t>> read_at_async(off_t offset, void *buff, size_t len) override;
+
+        /// false once the kernel turned down preadv2(RWF_NOWAIT)
+        bool nowait_supported() const {
+            return nowait_supported_.load(std::memory_order_relaxed);
+        }
+
+        /// reads of read_at_async() done at once from the page cache
+        uint64_t nowait_reads() const {
+            return nowait_reads_.load(std::memory_order_relaxed);
+        }
+
+        /// reads of read_at_async() sent to the io pool
+        uint64_t offloaded_reads() const {
+            return offloaded_reads_.load(std::memory_order_relaxed);
+        }
+
+        /// the ranges of [offset, offset + len) in the page cache
+        turbo::Result<std::vector<FileExtent>> resident_extents(off_t offset, size_t len) const;
+
+        /// asks the kernel to read [offset, offset + len) ahead of use
+        turbo::Status prefetch(off_t offset, size_t len);
+
+        /// \brief Drops [offset, offset + len) from the page cache, for data
+        /// read once, so that it does not push out the data read often.
+        turbo::Status evict(off_t offset, size_t len);
+
     private:
         turbo::Result<size_t> read_at_impl(int64_t offset, void *buff, size_t len) noexcept override;
 
@@ -52,6 +94,13 @@ namespace alkaid::lfs {
         std::string path_;
         OpenOption open_option_{kDefaultReadOption};
         FileEventListener listener_;
-
+        std::shared_ptr<ThreadPool> pool_;
+        std::atomic<bool> nowait_supported_{true};
+        std::atomic<uint64_t> nowait_reads_{0};
+        std::atomic<uint64_t> offloaded_reads_{0};
+        std::mutex pending_mutex_;
+        std::condition_variable pending_cv_;
+        // reads on the pool not done yet
+        size_t pending_reads_{0};
     };
 }  // namespace alkaid::lfs
@@ -24,6 +24,8 @@
 #include <alkaid/files/local/random_read_mmap_file.h>
 #include <alkaid/files/local/sys_io.h>
 
+#include <algorithm>
+
 namespace alkaid::lfs {
     RandomReadMMapFile::~RandomReadMMapFile() {
         auto r = close_impl();
@@ -96,6 +98,48 @@ namespace alkaid::lfs {
             return len;
     }
 
+    turbo::Result<std::vector<FileExtent>> RandomReadMMapFile::resident_extents(off_t offset, size_t len) const {
+        if (!mmap_source_.is_open()) {
+            return turbo::unavailable_error("file not open");
+        }
+        const size_t size = mmap_source_.size();
+        if (offset < 0 || static_cast<size_t>(offset) >= size) {
+            return std::vector<FileExtent>{};
+        }
+        std::vector<unsigned char> pages;
+        std::error_code ec;
+        mmap_source_.residency(offset, len, pages, ec);
+        if (ec) {
+            return turbo::errno_to_status(ec.value(), "mincore failed");
+        }
+        return page_extents(pages, offset, std::min(len, size - offset));
+    }
+
+    turbo::Status RandomReadMMapFile::prefetch(off_t offset, size_t len) {
+        if (!mmap_source_.is_open()) {
+            return turbo::unavailable_error("file not open");
+        }
+        std::error_code ec;
+        mmap_source_.prefetch(offset, len, ec);
+        if (ec) {
+            return turbo::errno_to_status(ec.value(), "madvise failed");
+        }
+        return turbo::OkStatus();
+    }
+
+    turbo::Status RandomReadMMapFile::evict(off_t offset, size_t len) {
+        if (!mmap_source_.is_open()) {
+            return turbo::unavailable_error("file not open");
+        }
+        // the pages mapped here are not dropped by the page cache
+        std::error_code ec;
+        mmap_source_.evict(offset, len, ec);
+        if (ec) {
+            return turbo::errno_to_status(ec.value(), "madvise failed");
+        }
+        return lfs::evict(mmap_source_.file_handle(), offset, len);
+    }
+
     turbo::Status RandomReadMMapFile::close_impl() noexcept {
         if (mmap_source_.is_open()) {
             if (listener_.before_close) {
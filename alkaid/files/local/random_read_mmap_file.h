@@ -18,6 +18,8 @@
 //
 // Created by jeff on 24-6-9.
 //
+#include <vector>
+
 #include <alkaid/files/interface.h>
 #include <alkaid/files/local/defines.h>
 #include <alkaid/files/local/mmap.h>
@@ -43,6 +45,16 @@ namespace alkaid::lfs {
 
         turbo::Result<size_t> size() const noexcept override;
 
+        /// the ranges of [offset, offset + len) in the page cache
+        turbo::Result<std::vector<FileExtent>> resident_extents(off_t offset, size_t len) const;
+
+        /// asks the kernel to read [offset, offset + len) ahead of use
+        turbo::Status prefetch(off_t offset, size_t len);
+
+        /// \brief Drops [offset, offset + len) from the page cache, for data
+        /// read once, so that it does not push out the data read often.
+        turbo::Status evict(off_t offset, size_t len);
+
     private:
         turbo::Result<size_t> read_at_impl(int64_t offset, void *buff, size_t len) noexcept override;
 
@@ -22,6 +22,9 @@
 #include <alkaid/files/local/sequential_read_file.h>
 #include <alkaid/files/local/sys_io.h>
 
+#include <algorithm>
+#include <cstring>
+
 namespace alkaid::lfs {
 
     SequentialReadFile::~SequentialReadFile() {
@@ -51,6 +54,11 @@ namespace alkaid::lfs {
             auto rs = open_file(path_, open_option_);
             if (rs.ok()) {
                 _fd = rs.value();
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+                sparse_ = is_sparse(_fd);
+#endif
+                pos_ = 0;
+                data_end_ = 0;
                 if (listener_.after_open) {
                     listener_.after_open(this);
                 }
@@ -105,6 +113,7 @@ namespace alkaid::lfs {
         if (r == -1) {
             return turbo::errno_to_status(errno, "advance file failed");
         }
+        pos_ = r;
         return turbo::OkStatus();
 
     }
@@ -116,6 +125,9 @@ namespace alkaid::lfs {
         if (len == 0) {
             return 0;
         }
+        if (sparse_) {
+            return read_sparse(buff, len);
+        }
         auto nread = sys_read(_fd, buff, len);
         if (nread < 0) {
             return turbo::errno_to_status(errno, "read file failed");
@@ -123,4 +135,57 @@ namespace alkaid::lfs {
         return nread;
     }
 
+    turbo::Result<size_t> SequentialReadFile::read_sparse(void *buff, size_t len) noexcept {
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+        auto out = static_cast<char *>(buff);
+        size_t done = 0;
+        while (done < len) {
+            if (pos_ >= data_end_) {
+                auto data = ::lseek(_fd, pos_, SEEK_DATA);
+                if (data < 0 && errno != ENXIO) {
+                    // the filesystem can not tell, read the holes
+                    sparse_ = false;
+                    if (::lseek(_fd, pos_, SEEK_SET) < 0) {
+                        return turbo::errno_to_status(errno, "seek file failed");
+                    }
+                    RESULT_ASSIGN_OR_RETURN(auto n, read_impl(out + done, len - done));
+                    return done + n;
+                }
+                // ENXIO, a hole up to the end of the file
+                auto hole_end = data >= 0 ? data : std::max<off_t>(file_size(_fd), pos_);
+                if (hole_end > pos_) {
+                    auto n = std::min<size_t>(len - done, hole_end - pos_);
+                    std::memset(out + done, 0, n);
+                    done += n;
+                    pos_ += static_cast<off_t>(n);
+                    if (::lseek(_fd, pos_, SEEK_SET) < 0) {
+                        return turbo::errno_to_status(errno, "seek file failed");
+                    }
+                    continue;
+                }
+                if (data < 0) {
+                    break;
+                }
+                data_end_ = ::lseek(_fd, pos_, SEEK_HOLE);
+                if (data_end_ < 0 || ::lseek(_fd, pos_, SEEK_SET) < 0) {
+                    return turbo::errno_to_status(errno, "seek hole failed");
+                }
+            }
+            auto nread = sys_read(_fd, out + done, std::min<size_t>(len - done, data_end_ - pos_));
+            if (nread < 0) {
+                return turbo::errno_to_status(errno, "read file failed");
+            }
+            if (nread == 0) {
+                break;
+            }
+            done += nread;
+            pos_ += nread;
+        }
+        return done;
+#else
+        sparse_ = false;
+        return read_impl(buff, len);
+#endif
+    }
+
 }  // namespace alkaid::lfs
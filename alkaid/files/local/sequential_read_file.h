@@ -54,12 +54,18 @@ namespace alkaid::lfs {
 
         turbo::Status close_impl() noexcept;
 
+        // reads a file with holes, they are filled with zeros instead of read
+        turbo::Result<size_t> read_sparse(void *buff, size_t len) noexcept;
 
     private:
         FILE_HANDLER _fd{INVALID_FILE_HANDLER};
         std::string path_;
         OpenOption open_option_{kDefaultReadOption};
         FileEventListener listener_;
+        bool sparse_{false};
+        off_t pos_{0};
+        // where the data extent at pos_ ends
+        off_t data_end_{0};
     };
 }  // namespace alkaid::lfs
 
@@ -132,7 +132,7 @@ namespace alkaid::lfs {
             return turbo::errno_to_status(errno, "Failed truncate file %s for size:%ld ", path_,
                                           static_cast<off_t>(size));
         }
-        if (::lseek(_fd, static_cast<off_t>(size), SEEK_SET) != 0) {
+        if (::lseek(_fd, static_cast<off_t>(size), SEEK_SET) < 0) {
             return turbo::errno_to_status(errno, "Failed seek file end %s for size:%ld ", path_,
                                           static_cast<off_t>(size));
         }
@@ -19,9 +19,12 @@
 
 #include <alkaid/files/local/sys_io.h>
 #include <alkaid/files/fd_guard.h>
+#include <alkaid/files/internal/page.h>
 #include <turbo/log/logging.h>
 #include <turbo/strings/substitute.h>
 #include <fcntl.h>
+#include <algorithm>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
@@ -161,6 +164,20 @@ namespace alkaid::lfs {
         return sys_preadv(fd, &iov, 1, offset);
     }
 
+    ssize_t sys_pread_nowait(FILE_HANDLER fd, void *data, size_t count, off_t offset) {
+#if defined(__linux__) && defined(RWF_NOWAIT)
+        struct iovec iov = {data, count};
+        return ::preadv2(fd, &iov, 1, offset, RWF_NOWAIT);
+#else
+        (void) fd;
+        (void) data;
+        (void) count;
+        (void) offset;
+        errno = EOPNOTSUPP;
+        return -1;
+#endif
+    }
+
     ssize_t sys_writev(FILE_HANDLER fd, const struct iovec *vector, int count) {
         return ::writev(fd, vector, count);
     }
@@ -199,6 +216,182 @@ namespace alkaid::lfs {
         return open_file(filename, kDefaultAppendWriteOption);
     }
 
+    bool is_sparse(FILE_HANDLER fd) {
+        struct stat st;
+        if (::fstat(fd, &st) != 0) {
+            return false;
+        }
+        return static_cast<off_t>(st.st_blocks) * 512 < st.st_size;
+    }
+
+    turbo::Status for_each_data_extent(FILE_HANDLER fd, const std::function<bool(const FileExtent &)> &fn) {
+        auto size = file_size(fd);
+        if (size < 0) {
+            return turbo::errno_to_status(errno, "get file size failed");
+        }
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+        auto current = ::lseek(fd, 0, SEEK_CUR);
+        if (current < 0) {
+            return turbo::errno_to_status(errno, "get file offset failed");
+        }
+        off_t pos = 0;
+        turbo::Status status;
+        while (pos < size) {
+            auto data = ::lseek(fd, pos, SEEK_DATA);
+            if (data < 0) {
+                if (errno == ENXIO) {
+                    // a hole up to the end
+                    break;
+                }
+                if (errno == EINVAL && pos == 0) {
+                    // not supported by the filesystem
+                    fn(FileExtent{0, static_cast<size_t>(size)});
+                    break;
+                }
+                status = turbo::errno_to_status(errno, "seek data failed");
+                break;
+            }
+            auto hole = ::lseek(fd, data, SEEK_HOLE);
+            if (hole < 0) {
+                status = turbo::errno_to_status(errno, "seek hole failed");
+                break;
+            }
+            hole = std::min<off_t>(hole, size);
+            if (data >= hole || !fn(FileExtent{data, static_cast<size_t>(hole - data)})) {
+                break;
+            }
+            pos = hole;
+        }
+        ::lseek(fd, current, SEEK_SET);
+        return status;
+#else
+        if (size > 0) {
+            fn(FileExtent{0, static_cast<size_t>(size)});
+        }
+        return turbo::OkStatus();
+#endif
+    }
+
+    turbo::Result<std::vector<FileExtent>> data_extents(FILE_HANDLER fd) {
+        std::vector<FileExtent> extents;
+        STATUS_RETURN_IF_ERROR(for_each_data_extent(fd, [&extents](const FileExtent &extent) {
+            extents.push_back(extent);
+            return true;
+        }));
+        return extents;
+    }
+
+    turbo::Status punch_hole(FILE_HANDLER fd, off_t offset, size_t length) {
+#if defined(__linux__) && defined(FALLOC_FL_PUNCH_HOLE)
+        if (::fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset, static_cast<off_t>(length)) != 0) {
+            return turbo::errno_to_status(errno, "punch hole failed");
+        }
+        return turbo::OkStatus();
+#else
+        (void) fd;
+        (void) offset;
+        (void) length;
+        return turbo::unimplemented_error("punch hole is not supported");
+#endif
+    }
+
+    std::vector<FileExtent> page_extents(const std::vector<unsigned char> &pages, off_t offset, size_t length) {
+        const auto page = static_cast<off_t>(alkaid::page_size());
+        const off_t begin = offset / page * page;
+        const off_t end = offset + static_cast<off_t>(length);
+        std::vector<FileExtent> extents;
+        for (size_t i = 0; i < pages.size(); ++i) {
+            if ((pages[i] & 1) == 0) {
+                continue;
+            }
+            auto first = std::max(begin + static_cast<off_t>(i) * page, offset);
+            auto last = std::min(begin + static_cast<off_t>(i + 1) * page, end);
+            if (first >= last) {
+                continue;
+            }
+            if (!extents.empty() && extents.back().offset + static_cast<off_t>(extents.back().length) == first) {
+                extents.back().length += last - first;
+            } else {
+                extents.push_back(FileExtent{first, static_cast<size_t>(last - first)});
+            }
+        }
+        return extents;
+    }
+
+    turbo::Result<std::vector<FileExtent>> resident_extents(FILE_HANDLER fd, off_t offset, size_t length) {
+        // mapped a piece at a time, so that a large file needs no large mapping
+        static constexpr size_t kPiece = 1024 * 1024 * 1024;
+        auto size = file_size(fd);
+        if (size < 0) {
+            return turbo::errno_to_status(errno, "get file size failed");
+        }
+        std::vector<FileExtent> extents;
+        if (offset < 0 || offset >= size) {
+            return extents;
+        }
+        const auto end = offset + static_cast<off_t>(std::min<size_t>(length, size - offset));
+        std::vector<unsigned char> pages;
+        for (auto pos = offset; pos < end;) {
+            const auto begin = static_cast<off_t>(alkaid::make_offset_page_aligned(pos));
+            const auto piece_end = std::min<off_t>(end, begin + static_cast<off_t>(kPiece));
+            const auto map_length = static_cast<size_t>(piece_end - begin);
+            auto addr = ::mmap(nullptr, map_length, PROT_READ, MAP_SHARED, fd, begin);
+            if (addr == MAP_FAILED) {
+                return turbo::errno_to_status(errno, "map file failed");
+            }
+            pages.assign((map_length + alkaid::page_size() - 1) / alkaid::page_size(), 0);
+#ifdef __APPLE__
+            auto rc = ::mincore(addr, map_length, reinterpret_cast<char *>(pages.data()));
+#else
+            auto rc = ::mincore(addr, map_length, pages.data());
+#endif
+            auto saved_errno = errno;
+            ::munmap(addr, map_length);
+            if (rc != 0) {
+                return turbo::errno_to_status(saved_errno, "mincore failed");
+            }
+            for (auto &extent: page_extents(pages, pos, static_cast<size_t>(piece_end - pos))) {
+                if (!extents.empty() && extents.back().offset + static_cast<off_t>(extents.back().length) == extent.offset) {
+                    extents.back().length += extent.length;
+                } else {
+                    extents.push_back(extent);
+                }
+            }
+            pos = piece_end;
+        }
+        return extents;
+    }
+
+    turbo::Status prefetch(FILE_HANDLER fd, off_t offset, size_t length) {
+#if defined(POSIX_FADV_WILLNEED)
+        auto rc = ::posix_fadvise(fd, offset, static_cast<off_t>(length), POSIX_FADV_WILLNEED);
+        if (rc != 0) {
+            return turbo::errno_to_status(rc, "posix_fadvise failed");
+        }
+        return turbo::OkStatus();
+#else
+        (void) fd;
+        (void) offset;
+        (void) length;
+        return turbo::unimplemented_error("posix_fadvise is not supported");
+#endif
+    }
+
+    turbo::Status evict(FILE_HANDLER fd, off_t offset, size_t length) {
+#if defined(POSIX_FADV_DONTNEED)
+        auto rc = ::posix_fadvise(fd, offset, static_cast<off_t>(length), POSIX_FADV_DONTNEED);
+        if (rc != 0) {
+            return turbo::errno_to_status(rc, "posix_fadvise failed");
+        }
+        return turbo::OkStatus();
+#else
+        (void) fd;
+        (void) offset;
+        (void) length;
+        return turbo::unimplemented_error("posix_fadvise is not supported");
+#endif
+    }
+
 }
 
 #if defined(__linux__)
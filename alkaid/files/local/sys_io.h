@@ -23,6 +23,9 @@
 #include <fcntl.h>
 #include <unistd.h>
 
+#include <functional>
+#include <vector>
+
 #include <alkaid/files/local/defines.h>
 
 namespace alkaid::lfs {
@@ -36,6 +39,10 @@ namespace alkaid::lfs {
 
     ssize_t sys_pread(FILE_HANDLER fd, const void *data, int count, off_t offset);
 
+    /// \brief preadv2() with RWF_NOWAIT, reads only what is in the page cache,
+    /// -1 with EAGAIN when none of it is and with EOPNOTSUPP where not supported.
+    ssize_t sys_pread_nowait(FILE_HANDLER fd, void *data, size_t count, off_t offset);
+
     ssize_t sys_writev(FILE_HANDLER fd, const struct iovec *vector, int count);
 
     ssize_t sys_readv(FILE_HANDLER fd, const struct iovec *vector, int count);
@@ -51,4 +58,35 @@ namespace alkaid::lfs {
     turbo::Result<FILE_HANDLER> open_file_read(const std::string &filename);
 
     turbo::Result<FILE_HANDLER> open_file_write(const std::string &filename, bool truncate = false);
+
+    /// true when fd has fewer blocks allocated than its size, so it may have holes
+    bool is_sparse(FILE_HANDLER fd);
+
+    /// \brief Calls fn with the data extents of fd in order, the holes between
+    /// them are skipped, until fn returns false.  Where there is no
+    /// SEEK_DATA/SEEK_HOLE the whole file is one extent.  The file offset of
+    /// fd is kept.
+    turbo::Status for_each_data_extent(FILE_HANDLER fd, const std::function<bool(const FileExtent &)> &fn);
+
+    turbo::Result<std::vector<FileExtent>> data_extents(FILE_HANDLER fd);
+
+    /// deallocates a range of fd keeping its size, the range reads zeros after
+    turbo::Status punch_hole(FILE_HANDLER fd, off_t offset, size_t length);
+
+    /// \brief The ranges of [offset, offset + length) of fd in the page cache,
+    /// in pages, from mincore(2) on a mapping of the range.  The range ends
+    /// at the end of the file.
+    turbo::Result<std::vector<FileExtent>> resident_extents(FILE_HANDLER fd, off_t offset, size_t length);
+
+    /// \brief The ranges of the pages set resident by mincore(2), pages[0] is
+    /// the page holding offset, clipped to [offset, offset + length).
+    std::vector<FileExtent> page_extents(const std::vector<unsigned char> &pages, off_t offset, size_t length);
+
+    /// asks the kernel to read a range of fd into the page cache, posix_fadvise(POSIX_FADV_WILLNEED)
+    turbo::Status prefetch(FILE_HANDLER fd, off_t offset, size_t length);
+
+    /// \brief Drops the pages of a range of fd from the page cache,
+    /// posix_fadvise(POSIX_FADV_DONTNEED).  Dirty pages and pages mapped by
+    /// a process stay, sync and unmap them first.
+    turbo::Status evict(FILE_HANDLER fd, off_t offset, size_t length);
 }  // namespace alkaid::lfs
@@ -27,21 +27,39 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <random>
-#include <mutex>
+#include <thread>
+#if defined(__linux__)
+#include <sys/vfs.h>
+#include <linux/magic.h>
+#endif
 
 namespace alkaid::lfs {
 
-    static std::mt19937 temp_file_bit_gen(std::random_device{}());
-    static std::mutex temp_file_spin_lock;
+    namespace {
+        // tmpfs mount for small and hot temp files, empty when there is none
+        const std::string &tmpfs_dir() {
+            static const std::string dir = []() -> std::string {
+#if defined(__linux__)
+                struct statfs st;
+                if (::statfs("/dev/shm", &st) == 0 && st.f_type == TMPFS_MAGIC &&
+                    ::access("/dev/shm", W_OK) == 0) {
+                    return "/dev/shm";
+                }
+#endif
+                return {};
+            }();
+            return dir;
+        }
+    }  // namespace
 
     std::string TempFile::generate_temp_file_name(std::string_view prefix, std::string_view ext, size_t bits) {
+        // names only have to be unlikely to collide, every thread draws from its own generator
+        thread_local std::mt19937_64 bit_gen(
+                std::random_device{}() ^ std::hash<std::thread::id>{}(std::this_thread::get_id()));
         std::string gen_name;
-        std::uniform_int_distribution<char> uniform('a', 'z');
-        {
-            std::lock_guard lock(temp_file_spin_lock);
-            for (size_t i = 0; i < bits; ++i) {
-                gen_name.push_back(uniform(temp_file_bit_gen));
-            }
+        gen_name.reserve(bits);
+        for (size_t i = 0; i < bits; ++i) {
+            gen_name.push_back(static_cast<char>('a' + bit_gen() % 26));
         }
         std::string result;
         if (!ext.empty()) {
@@ -62,13 +80,53 @@ namespace alkaid::lfs {
         if (!r.ok()) {
             return r;
         }
-        path_ = generate_temp_file_name(path, "tmp", 6);
-        auto rs = open_file(path, kDefaultTruncateWriteOption);
-        if (!rs.ok()) {
-            return rs.status();
+        TempFileOption option;
+        if (options.has_value()) {
+            try {
+                option = std::any_cast<TempFileOption>(options);
+            } catch (const std::bad_any_cast &e) {
+                return turbo::invalid_argument_error("invalid options");
+            }
+        }
+        auto prefix = alkaid::filesystem::path(path);
+        auto dir = prefix.parent_path();
+        if (dir.empty()) {
+            dir = ".";
         }
-        _fd = rs.value();
-        return turbo::OkStatus();
+        if (option.small_and_hot && !tmpfs_dir().empty()) {
+            dir = tmpfs_dir();
+        }
+        anonymous_ = false;
+        kept_ = false;
+#if defined(__linux__) && defined(O_TMPFILE)
+        if (option.anonymous) {
+            auto fd = ::open(dir.c_str(), O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+            if (fd != -1) {
+                _fd = fd;
+                anonymous_ = true;
+                path_ = turbo::str_cat("/proc/self/fd/", fd);
+                return turbo::OkStatus();
+            }
+            // the kernel or the filesystem has no O_TMPFILE, fall back to a named file
+            if (errno != EOPNOTSUPP && errno != EISDIR && errno != EINVAL) {
+                return turbo::errno_to_status(errno, "Failed to create temp file in %s", dir.string());
+            }
+        }
+#endif
+        auto name_prefix = (dir / prefix.filename()).string();
+        for (int tries = 0; tries < 16; ++tries) {
+            path_ = generate_temp_file_name(name_prefix, "tmp", 6);
+            auto fd = ::open(path_.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+            if (fd != -1) {
+                _fd = fd;
+                return turbo::OkStatus();
+            }
+            if (errno != EEXIST) {
+                return turbo::errno_to_status(errno, "Failed to create temp file %s", path_);
+            }
+        }
+        path_.clear();
+        return turbo::already_exists_error(turbo::str_cat("no free temp file name for prefix ", name_prefix));
     }
 
     turbo::Result<int64_t> TempFile::tell() const noexcept {
@@ -112,8 +170,30 @@ namespace alkaid::lfs {
             }
             _fd = INVALID_FILE_HANDLER;
         }
-        std::error_code ec;
-        alkaid::filesystem::remove(path_, ec);
+        // an anonymous file is gone with its descriptor
+        if (!anonymous_ && !kept_ && !path_.empty()) {
+            std::error_code ec;
+            alkaid::filesystem::remove(path_, ec);
+        }
+        return turbo::OkStatus();
+    }
+
+    turbo::Status TempFile::keep(const std::string &path) noexcept {
+        if (_fd == INVALID_FILE_HANDLER) {
+            return turbo::unavailable_error("file not opened");
+        }
+        if (anonymous_) {
+#if defined(__linux__)
+            if (::linkat(AT_FDCWD, path_.c_str(), AT_FDCWD, path.c_str(), AT_SYMLINK_FOLLOW) != 0) {
+                return turbo::errno_to_status(errno, "Failed to link temp file to %s", path);
+            }
+#endif
+        } else if (::rename(path_.c_str(), path.c_str()) != 0) {
+            return turbo::errno_to_status(errno, "Failed to rename temp file %s to %s", path_, path);
+        }
+        anonymous_ = false;
+        kept_ = true;
+        path_ = path;
         return turbo::OkStatus();
     }
 
@@ -125,7 +205,7 @@ namespace alkaid::lfs {
             return turbo::errno_to_status(errno, "Failed truncate file %s for size:%ld ", path_,
                                           static_cast<off_t>(size));
         }
-        if (::lseek(_fd, static_cast<off_t>(size), SEEK_SET) != 0) {
+        if (::lseek(_fd, static_cast<off_t>(size), SEEK_SET) == -1) {
             return turbo::errno_to_status(errno, "Failed seek file end %s for size:%ld ", path_,
                                           static_cast<off_t>(size));
         }
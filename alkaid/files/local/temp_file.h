@@ -25,6 +25,11 @@
 
 namespace alkaid::lfs {
 
+    /// \brief A temp file, removed on close unless kept.
+    ///
+    /// open() takes the prefix of the name, the file goes to the directory
+    /// of the prefix, or to tmpfs when TempFileOption::small_and_hot is set.
+    /// The options are a TempFileOption.
     class TempFile : public TempFileWriter {
     public:
         TempFile() = default;
@@ -51,6 +56,9 @@ namespace alkaid::lfs {
 
         turbo::Status truncate(size_t size) noexcept override;
 
+        /// links an anonymous file at path, renames a named one
+        turbo::Status keep(const std::string &path) noexcept override;
+
     private:
         turbo::Status append_impl(const void *buff, size_t len) noexcept override;
 
@@ -59,6 +67,9 @@ namespace alkaid::lfs {
     private:
         FILE_HANDLER _fd{INVALID_FILE_HANDLER};
         std::string path_;
+        // an O_TMPFILE file, path_ is its /proc/self/fd link
+        bool anonymous_{false};
+        bool kept_{false};
     };
 
 }  // namespace alkaid::lfs
@@ -27,37 +27,86 @@
 #include <alkaid/files/local/random_read_mmap_file.h>
 #include <alkaid/files/local/random_write_file.h>
 #include <alkaid/files/local/temp_file.h>
+#include <alkaid/files/local/sys_io.h>
+#include <alkaid/files/fd_guard.h>
 #include <turbo/strings/substitute.h>
 
+#include <sys/stat.h>
+
 namespace alkaid {
 
+    namespace {
+
+        // the permission bits of the source, as filesystem::copy_file gives them
+        turbo::Status copy_permissions(FILE_HANDLER src_fd, const std::string &dst_path) {
+            struct stat st;
+            if (::fstat(src_fd, &st) != 0) {
+                return turbo::errno_to_status(errno, "stat file failed");
+            }
+            RESULT_ASSIGN_OR_RETURN(auto dst_fd, lfs::open_file_read(dst_path));
+            FDGuard guard(dst_fd);
+            if (::fchmod(dst_fd, st.st_mode & 07777) != 0) {
+                return turbo::errno_to_status(errno, "Failed to set permissions of file %s", dst_path);
+            }
+            return turbo::OkStatus();
+        }
+
+    }  // namespace
+
+    LocalFilesystem::LocalFilesystem(const LocalFilesystemOptions &options) : options_(options) {}
+
     turbo::Result<std::shared_ptr<SequentialFileReader>> LocalFilesystem::create_sequential_read_file() {
         auto file = std::make_shared<lfs::SequentialReadFile>();
+        if (options_.rate_limiter != nullptr) {
+            return std::make_shared<RateLimitedFileReader>(file, options_.rate_limiter, options_.io_priority,
+                                                 options_.set_thread_io_priority);
+        }
         return file;
     }
 
     turbo::Result<std::shared_ptr<SequentialFileReader>> LocalFilesystem::create_sequential_read_mmap_file() {
         auto file = std::make_shared<lfs::SequentialReadMMapFile>();
+        if (options_.rate_limiter != nullptr) {
+            return std::make_shared<RateLimitedFileReader>(file, options_.rate_limiter, options_.io_priority,
+                                                 options_.set_thread_io_priority);
+        }
         return file;
     }
 
     turbo::Result<std::shared_ptr<RandomAccessFileReader>> LocalFilesystem::create_random_read_file() {
         auto file = std::make_shared<lfs::RandomReadFile>();
+        file->set_io_pool(options_.io_pool);
+        if (options_.rate_limiter != nullptr) {
+            return std::make_shared<RateLimitedRandomReadFile>(file, options_.rate_limiter, options_.io_priority,
+                                                 options_.set_thread_io_priority);
+        }
         return file;
     }
 
     turbo::Result<std::shared_ptr<RandomAccessFileReader>> LocalFilesystem::create_random_read_mmap_file() {
         auto file = std::make_shared<lfs::RandomReadMMapFile>();
+        if (options_.rate_limiter != nullptr) {
+            return std::make_shared<RateLimitedRandomReadFile>(file, options_.rate_limiter, options_.io_priority,
+                                                 options_.set_thread_io_priority);
+        }
         return file;
     }
 
     turbo::Result<std::shared_ptr<SequentialFileWriter>> LocalFilesystem::create_sequential_write_file() {
         auto file = std::make_shared<lfs::SequentialWriteFile>();
+        if (options_.rate_limiter != nullptr) {
+            return std::make_shared<RateLimitedFileWriter>(file, options_.rate_limiter, options_.io_priority,
+                                                 options_.set_thread_io_priority);
+        }
         return file;
     }
 
     turbo::Result<std::shared_ptr<RandomAccessFileWriter>> LocalFilesystem::create_random_write_file() {
         auto file = std::make_shared<lfs::RandomWriteFile>();
+        if (options_.rate_limiter != nullptr) {
+            return std::make_shared<RateLimitedRandomWriteFile>(file, options_.rate_limiter, options_.io_priority,
+                                                 options_.set_thread_io_priority);
+        }
         return file;
     }
 
@@ -67,16 +116,16 @@ namespace alkaid {
     }
 
     turbo::Status LocalFilesystem::read_file(const std::string &file_path, std::string *result) noexcept {
-        lfs::SequentialReadFile file;
-        auto rs = file.open(file_path, std::any{}, FileEventListener{});
+        RESULT_ASSIGN_OR_RETURN(auto file, create_sequential_read_file());
+        auto rs = file->open(file_path, std::any{}, FileEventListener{});
         if (!rs.ok()) {
             return rs;
         }
-        auto rsize = file.size();
+        auto rsize = file->size();
         if (!rsize.ok()) {
             return rsize.status();
         }
-        auto r = file.read(result, rsize.value());
+        auto r = file->read(result, rsize.value());
         if (!r.ok()) {
             return r.status();
         }
@@ -84,13 +133,13 @@ namespace alkaid {
     }
 
     turbo::Status LocalFilesystem::write_file(const std::string &file_path, const std::string_view &content) noexcept {
-        lfs::SequentialWriteFile file;
-        auto rs = file.open(file_path, lfs::kDefaultTruncateWriteOption, FileEventListener{});
+        RESULT_ASSIGN_OR_RETURN(auto file, create_sequential_write_file());
+        auto rs = file->open(file_path, lfs::kDefaultTruncateWriteOption, FileEventListener{});
         if (!rs.ok()) {
             return rs;
         }
 
-        rs = file.append(content);
+        rs = file->append(content);
         if (!rs.ok()) {
             return rs;
         }
@@ -98,13 +147,13 @@ namespace alkaid {
     }
 
     turbo::Status LocalFilesystem::append_file(const std::string &file_path, const std::string_view &content) noexcept {
-        lfs::SequentialWriteFile file;
-        auto rs = file.open(file_path, lfs::kDefaultAppendWriteOption, FileEventListener{});
+        RESULT_ASSIGN_OR_RETURN(auto file, create_sequential_write_file());
+        auto rs = file->open(file_path, lfs::kDefaultAppendWriteOption, FileEventListener{});
         if (!rs.ok()) {
             return rs;
         }
 
-        rs = file.append(content);
+        rs = file->append(content);
         if (!rs.ok()) {
             return rs;
         }
@@ -269,11 +318,14 @@ namespace alkaid {
         if (alkaid::filesystem::is_directory(src_path, ec)) {
             return turbo::invalid_argument_error(turbo::substitute("source path is a directory:$0", src_path));
         }
-        alkaid::filesystem::copy_file(src_path, dst_path, ec);
-        if (ec) {
-            return turbo::errno_to_status(ec.value(), turbo::substitute("copy file error:$0", ec.message()));
+        // fifos, sockets and devices are not copied, reading them may block
+        if (alkaid::filesystem::exists(src_path, ec) && !alkaid::filesystem::is_regular_file(src_path, ec)) {
+            return turbo::unimplemented_error(turbo::substitute("can not copy special file:$0", src_path));
         }
-        return turbo::OkStatus();
+        if (alkaid::filesystem::exists(dst_path, ec)) {
+            return turbo::already_exists_error(turbo::substitute("destination file exists:$0", dst_path));
+        }
+        return copy_content(std::string(src_path), std::string(dst_path));
     }
 
     turbo::Result<std::string> LocalFilesystem::temp_directory_path() noexcept {
@@ -306,6 +358,13 @@ namespace alkaid {
 
     turbo::Status LocalFilesystem::copy_directory(const std::string_view &src_path, const std::string_view &dst_path, CopyOptions opt) noexcept {
         std::error_code ec;
+        constexpr auto kSymlinkOptions = static_cast<uint16_t>(CopyOptions::CopySymlinks) |
+                                         static_cast<uint16_t>(CopyOptions::SkipSymlinks) |
+                                         static_cast<uint16_t>(CopyOptions::CreateSymlinks);
+        if (options_.rate_limiter != nullptr || (static_cast<uint16_t>(opt) & kSymlinkOptions) == 0) {
+            return copy_directory_files(alkaid::filesystem::path(src_path), alkaid::filesystem::path(dst_path), opt,
+                                        false);
+        }
         auto options = static_cast<alkaid::filesystem::copy_options>(opt);
         alkaid::filesystem::copy(src_path, dst_path, options, ec);
         if (ec) {
@@ -315,4 +374,141 @@ namespace alkaid {
 
     }
 
+    turbo::Result<std::vector<lfs::FileExtent>> LocalFilesystem::data_extents(const std::string_view &path) noexcept {
+        RESULT_ASSIGN_OR_RETURN(auto fd, lfs::open_file_read(std::string(path)));
+        FDGuard guard(fd);
+        return lfs::data_extents(fd);
+    }
+
+    turbo::Result<std::vector<lfs::FileExtent>> LocalFilesystem::resident_extents(const std::string_view &path,
+                                                                                  off_t offset, size_t len) noexcept {
+        RESULT_ASSIGN_OR_RETURN(auto fd, lfs::open_file_read(std::string(path)));
+        FDGuard guard(fd);
+        return lfs::resident_extents(fd, offset, len);
+    }
+
+    turbo::Status LocalFilesystem::prefetch(const std::string_view &path, off_t offset, size_t len) noexcept {
+        RESULT_ASSIGN_OR_RETURN(auto fd, lfs::open_file_read(std::string(path)));
+        FDGuard guard(fd);
+        return lfs::prefetch(fd, offset, len);
+    }
+
+    turbo::Status LocalFilesystem::evict(const std::string_view &path, off_t offset, size_t len) noexcept {
+        RESULT_ASSIGN_OR_RETURN(auto fd, lfs::open_file_read(std::string(path)));
+        FDGuard guard(fd);
+        return lfs::evict(fd, offset, len);
+    }
+
+    turbo::Status LocalFilesystem::copy_content(const std::string &src_path, const std::string &dst_path) {
+        static constexpr size_t kCopyBufferSize = 1024 * 1024;
+        RESULT_ASSIGN_OR_RETURN(auto fd, lfs::open_file_read(src_path));
+        FDGuard guard(fd);
+        if (!lfs::is_sparse(fd)) {
+            if (options_.rate_limiter == nullptr) {
+                std::error_code ec;
+                alkaid::filesystem::copy_file(src_path, dst_path, alkaid::filesystem::copy_options::overwrite_existing,
+                                              ec);
+                if (ec) {
+                    return turbo::errno_to_status(ec.value(), turbo::substitute("copy file error:$0", ec.message()));
+                }
+                return turbo::OkStatus();
+            }
+            RESULT_ASSIGN_OR_RETURN(auto src, create_sequential_read_file());
+            STATUS_RETURN_IF_ERROR(src->open(src_path));
+            RESULT_ASSIGN_OR_RETURN(auto dst, create_sequential_write_file());
+            STATUS_RETURN_IF_ERROR(dst->open(dst_path, lfs::kDefaultTruncateWriteOption, FileEventListener{}));
+            std::string buffer(kCopyBufferSize, '\0');
+            while (true) {
+                RESULT_ASSIGN_OR_RETURN(auto n, src->read(buffer.data(), buffer.size()));
+                if (n == 0) {
+                    break;
+                }
+                STATUS_RETURN_IF_ERROR(dst->append(buffer.data(), n));
+            }
+            STATUS_RETURN_IF_ERROR(dst->close());
+            return copy_permissions(fd, dst_path);
+        }
+        // the destination is created empty, what is not written stays a hole
+        auto size = lfs::file_size(fd);
+        if (size < 0) {
+            return turbo::errno_to_status(errno, "get file size failed");
+        }
+        RESULT_ASSIGN_OR_RETURN(auto extents, lfs::data_extents(fd));
+        RESULT_ASSIGN_OR_RETURN(auto src, create_random_read_file());
+        STATUS_RETURN_IF_ERROR(src->open(src_path));
+        RESULT_ASSIGN_OR_RETURN(auto dst, create_random_write_file());
+        STATUS_RETURN_IF_ERROR(dst->open(dst_path, lfs::kDefaultTruncateWriteOption, FileEventListener{}));
+        std::string buffer(kCopyBufferSize, '\0');
+        for (auto &extent: extents) {
+            for (size_t done = 0; done < extent.length;) {
+                auto offset = extent.offset + static_cast<off_t>(done);
+                RESULT_ASSIGN_OR_RETURN(auto n, src->read_at(offset, buffer.data(),
+                                                             std::min(buffer.size(), extent.length - done)));
+                if (n == 0) {
+                    break;
+                }
+                STATUS_RETURN_IF_ERROR(dst->write_at(offset, buffer.data(), n));
+                done += n;
+            }
+        }
+        STATUS_RETURN_IF_ERROR(dst->truncate(static_cast<size_t>(size)));
+        STATUS_RETURN_IF_ERROR(dst->close());
+        return copy_permissions(fd, dst_path);
+    }
+
+    // follows alkaid::filesystem::copy, symlinks are copied as the files they point to
+    turbo::Status LocalFilesystem::copy_directory_files(const alkaid::filesystem::path &src,
+                                                        const alkaid::filesystem::path &dst, CopyOptions opt,
+                                                        bool nested) {
+        auto has = [opt](CopyOptions option) {
+            return (static_cast<uint16_t>(opt) & static_cast<uint16_t>(option)) != 0;
+        };
+        std::error_code ec;
+        if (!alkaid::filesystem::is_directory(src, ec)) {
+            if (ec) {
+                return turbo::errno_to_status(ec.value(), turbo::substitute("copy directory error:$0", ec.message()));
+            }
+            // fifos, sockets and devices are not copied, reading them may block
+            if (!alkaid::filesystem::is_regular_file(src, ec)) {
+                return turbo::unimplemented_error(turbo::substitute("can not copy special file:$0", src.string()));
+            }
+            if (has(CopyOptions::DirectoriesOnly)) {
+                return turbo::OkStatus();
+            }
+            auto target = alkaid::filesystem::is_directory(dst, ec) ? dst / src.filename() : dst;
+            if (alkaid::filesystem::exists(target, ec)) {
+                if (has(CopyOptions::SkipExisting)) {
+                    return turbo::OkStatus();
+                }
+                if (has(CopyOptions::OverwriteExistingIfNewer) &&
+                    alkaid::filesystem::last_write_time(src, ec) <= alkaid::filesystem::last_write_time(target, ec)) {
+                    return turbo::OkStatus();
+                }
+                if (!has(CopyOptions::OverwriteExisting) && !has(CopyOptions::OverwriteExistingIfNewer)) {
+                    return turbo::already_exists_error(turbo::substitute("destination file exists:$0", target.string()));
+                }
+            }
+            return copy_content(src.string(), target.string());
+        }
+        if (!has(CopyOptions::Recursive) && (nested || opt != CopyOptions::None)) {
+            return turbo::OkStatus();
+        }
+        // with the permissions of the source directory
+        alkaid::filesystem::create_directory(dst, src, ec);
+        if (ec) {
+            return turbo::errno_to_status(ec.value(), turbo::substitute("create directory error:$0", ec.message()));
+        }
+        alkaid::filesystem::directory_iterator itr(src, ec);
+        if (ec) {
+            return turbo::errno_to_status(ec.value(), turbo::substitute("open directory error:$0", ec.message()));
+        }
+        for (alkaid::filesystem::directory_iterator end; itr != end; itr.increment(ec)) {
+            STATUS_RETURN_IF_ERROR(copy_directory_files(itr->path(), dst / itr->path().filename(), opt, true));
+        }
+        if (ec) {
+            return turbo::errno_to_status(ec.value(), turbo::substitute("open directory error:$0", ec.message()));
+        }
+        return turbo::OkStatus();
+    }
+
 }  // namespace alkaid
\ No newline at end of file
@@ -22,18 +22,33 @@
 #include <alkaid/files/interface.h>
 #include <alkaid/files/internal/filesystem_fwd.h>
 #include <alkaid/files/local/defines.h>
+#include <alkaid/files/rate_limiter.h>
+#include <alkaid/utility/thread_pool.h>
 
 namespace alkaid {
 
 
     struct LocalFilesystemOptions {
         bool use_mmap{false};
+        /// shared by the filesystems of all the priority classes of a disk,
+        /// the files created are not limited when null
+        std::shared_ptr<RateLimiter> rate_limiter;
+        IOPriority io_priority{IOPriority::HIGH};
+        /// set the io priority of the threads reading and writing, see set_thread_io_priority()
+        bool set_thread_io_priority{false};
+        /// the random readers do read_at_async() on it when their data is not
+        /// in the page cache, see lfs::RandomReadFile::set_io_pool()
+        std::shared_ptr<ThreadPool> io_pool;
     };
 
     class TURBO_EXPORT LocalFilesystem : public Filesystem {
     public:
         LocalFilesystem() = default;
 
+        /// with a rate limiter, the readers and writers created ask it for
+        /// every read and write, copies included, temp files excepted
+        explicit LocalFilesystem(const LocalFilesystemOptions &options);
+
         std::string name() const override {
             return "LocalFilesystem";
         }
@@ -92,6 +107,31 @@ namespace alkaid {
 
         turbo::Status copy_directory(const std::string_view &src_path, const std::string_view &dst_path, CopyOptions options) noexcept override;
 
+        /// the ranges of a file holding data, in order, the holes between them read zeros
+        turbo::Result<std::vector<lfs::FileExtent>> data_extents(const std::string_view &path) noexcept;
+
+        /// the ranges of [offset, offset + len) of a file in the page cache
+        turbo::Result<std::vector<lfs::FileExtent>> resident_extents(const std::string_view &path, off_t offset,
+                                                                     size_t len) noexcept;
+
+        /// asks the kernel to read [offset, offset + len) of a file ahead of use
+        turbo::Status prefetch(const std::string_view &path, off_t offset, size_t len) noexcept;
+
+        /// \brief Drops [offset, offset + len) of a file from the page cache.
+        /// The page cache is shared by all the opens of a file, so this works
+        /// for the files handed out by this filesystem whatever wraps them.
+        turbo::Status evict(const std::string_view &path, off_t offset, size_t len) noexcept;
+
+    private:
+        // copies through the files this filesystem creates, only the data extents
+        // of a file with holes, so the copy has the same holes
+        turbo::Status copy_content(const std::string &src_path, const std::string &dst_path);
+
+        turbo::Status copy_directory_files(const alkaid::filesystem::path &src, const alkaid::filesystem::path &dst,
+                                           CopyOptions options, bool nested);
+
+    private:
+        LocalFilesystemOptions options_;
     };
 
 }  // namespace alkaid
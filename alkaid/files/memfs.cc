@@ -0,0 +1,1179 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <alkaid/files/memfs.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <mutex>
+#include <typeinfo>
+
+#include <alkaid/files/local/defines.h>
+#include <turbo/strings/str_cat.h>
+#include <turbo/times/time.h>
+
+namespace alkaid {
+
+    namespace {
+
+        constexpr std::string_view kTempDirectory = "/tmp";
+
+        // the key of a path, absolute and normal, "/" for the root
+        std::string normalize(const std::string_view &path) {
+            auto key = alkaid::filesystem::path(std::string(path)).lexically_normal().generic_string();
+            if (key == ".") {
+                key.clear();
+            }
+            if (key.empty() || key.front() != '/') {
+                key.insert(0, "/");
+            }
+            // nothing is above the root
+            while (key.compare(0, 3, "/..") == 0 && (key.size() == 3 || key[3] == '/')) {
+                key.erase(0, 3);
+            }
+            while (key.size() > 1 && key.back() == '/') {
+                key.pop_back();
+            }
+            return key.empty() ? "/" : key;
+        }
+
+        std::string parent_of(const std::string &key) {
+            auto pos = key.rfind('/');
+            return pos == 0 ? "/" : key.substr(0, pos);
+        }
+
+        std::string name_of(const std::string &key) {
+            return key.substr(key.rfind('/') + 1);
+        }
+
+        std::string child_of(const std::string &key, const std::string_view &name) {
+            return key == "/" ? turbo::str_cat("/", name) : turbo::str_cat(key, "/", name);
+        }
+
+        // the prefix of the keys below key
+        std::string children_prefix(const std::string &key) {
+            return key == "/" ? key : key + "/";
+        }
+
+        // the entries below key, they do not follow key in the map as '.' and '-'
+        // sort before '/', "/a.b" is between "/a" and "/a/x"
+        template<typename Map>
+        std::pair<typename Map::iterator, typename Map::iterator> children_range(Map &entries, const std::string &key) {
+            auto prefix = children_prefix(key);
+            auto first = entries.lower_bound(prefix);
+            auto last = first;
+            while (last != entries.end() && last->first.compare(0, prefix.size(), prefix) == 0) {
+                ++last;
+            }
+            return {first, last};
+        }
+
+        bool has_option(CopyOptions options, CopyOptions option) {
+            return (static_cast<uint16_t>(options) & static_cast<uint16_t>(option)) != 0;
+        }
+
+    }  // namespace
+
+    namespace mem {
+
+        struct Space {
+            size_t capacity{0};
+            std::atomic<size_t> used{0};
+
+            bool reserve(size_t n) {
+                auto now = used.load(std::memory_order_relaxed);
+                do {
+                    if (capacity != 0 && now + n > capacity) {
+                        return false;
+                    }
+                } while (!used.compare_exchange_weak(now, now + n, std::memory_order_relaxed));
+                return true;
+            }
+
+            void release(size_t n) {
+                used.fetch_sub(n, std::memory_order_relaxed);
+            }
+        };
+
+        // ------------------------------------------------------------------------
+        // MemoryFile implementation
+
+        /// The bytes of a file, in blocks of kBlockSize.  The bytes past the size in
+        /// the last block are zero.  A block held by anyone else, a Cord or a copy
+        /// of the file, is copied before it is written.
+        class MemoryFile {
+        public:
+            static constexpr size_t kBlockSize = 64 * 1024;
+            static constexpr size_t kAppend = std::numeric_limits<size_t>::max();
+
+            using Block = std::shared_ptr<char[]>;
+
+            explicit MemoryFile(std::shared_ptr<Space> space) : space_(std::move(space)), mtime_(turbo::time_now()) {}
+
+            ~MemoryFile() {
+                space_->release(size_);
+            }
+
+            size_t size() const {
+                std::shared_lock lock(mutex_);
+                return size_;
+            }
+
+            turbo::Time mtime() const {
+                std::shared_lock lock(mutex_);
+                return mtime_;
+            }
+
+            size_t read(size_t offset, void *buff, size_t len) const {
+                std::shared_lock lock(mutex_);
+                if (offset >= size_) {
+                    return 0;
+                }
+                len = std::min(len, size_ - offset);
+                auto out = static_cast<char *>(buff);
+                for (size_t done = 0; done < len;) {
+                    auto pos = offset + done;
+                    auto n = std::min(len - done, kBlockSize - pos % kBlockSize);
+                    std::memcpy(out + done, blocks_[pos / kBlockSize].get() + pos % kBlockSize, n);
+                    done += n;
+                }
+                return len;
+            }
+
+            // appends slices of the blocks to cord, nothing is copied
+            size_t read(size_t offset, size_t len, turbo::Cord *cord) const {
+                std::shared_lock lock(mutex_);
+                if (offset >= size_) {
+                    return 0;
+                }
+                len = std::min(len, size_ - offset);
+                for (size_t done = 0; done < len;) {
+                    auto pos = offset + done;
+                    auto n = std::min(len - done, kBlockSize - pos % kBlockSize);
+                    const auto &block = blocks_[pos / kBlockSize];
+                    cord->append(turbo::make_cord_from_external(
+                            std::string_view(block.get() + pos % kBlockSize, n), [block](std::string_view) {}));
+                    done += n;
+                }
+                return len;
+            }
+
+            turbo::Status write(size_t offset, const void *data, size_t len) {
+                std::unique_lock lock(mutex_);
+                if (offset == kAppend) {
+                    offset = size_;
+                }
+                if (offset + len > size_) {
+                    STATUS_RETURN_IF_ERROR(resize_locked(offset + len));
+                }
+                auto in = static_cast<const char *>(data);
+                for (size_t done = 0; done < len;) {
+                    auto pos = offset + done;
+                    auto n = std::min(len - done, kBlockSize - pos % kBlockSize);
+                    std::memcpy(writable(pos / kBlockSize) + pos % kBlockSize, in + done, n);
+                    done += n;
+                }
+                mtime_ = turbo::time_now();
+                return turbo::OkStatus();
+            }
+
+            turbo::Status resize(size_t size) {
+                std::unique_lock lock(mutex_);
+                STATUS_RETURN_IF_ERROR(resize_locked(size));
+                mtime_ = turbo::time_now();
+                return turbo::OkStatus();
+            }
+
+            // a copy sharing the blocks
+            turbo::Result<std::shared_ptr<MemoryFile>> clone() const {
+                std::shared_lock lock(mutex_);
+                if (!space_->reserve(size_)) {
+                    return turbo::resource_exhausted_error("memory filesystem is full");
+                }
+                auto file = std::make_shared<MemoryFile>(space_);
+                file->blocks_ = blocks_;
+                file->size_ = size_;
+                return file;
+            }
+
+        private:
+            static Block new_block() {
+                return Block(new char[kBlockSize]());
+            }
+
+            char *writable(size_t index) {
+                auto &block = blocks_[index];
+                if (block.use_count() > 1) {
+                    auto copy = new_block();
+                    std::memcpy(copy.get(), block.get(), kBlockSize);
+                    block = std::move(copy);
+                }
+                return block.get();
+            }
+
+            turbo::Status resize_locked(size_t size) {
+                if (size > size_) {
+                    if (!space_->reserve(size - size_)) {
+                        return turbo::resource_exhausted_error("memory filesystem is full");
+                    }
+                    while (blocks_.size() * kBlockSize < size) {
+                        blocks_.push_back(new_block());
+                    }
+                } else if (size < size_) {
+                    space_->release(size_ - size);
+                    blocks_.resize((size + kBlockSize - 1) / kBlockSize);
+                    if (size % kBlockSize != 0) {
+                        auto tail = size % kBlockSize;
+                        std::memset(writable(blocks_.size() - 1) + tail, 0, kBlockSize - tail);
+                    }
+                }
+                size_ = size;
+                return turbo::OkStatus();
+            }
+
+        private:
+            mutable std::shared_mutex mutex_;
+            std::shared_ptr<Space> space_;
+            std::vector<Block> blocks_;
+            size_t size_{0};
+            turbo::Time mtime_;
+        };
+
+        // ------------------------------------------------------------------------
+        // MemorySequentialReader implementation
+
+        class MemorySequentialReader : public SequentialFileReader {
+        public:
+            explicit MemorySequentialReader(MemoryFilesystem *fs) : fs_(fs) {}
+
+            ~MemorySequentialReader() override {
+                auto r = close_impl();
+                (void) r;
+            }
+
+            turbo::Status open(const std::string &path, std::any options, FileEventListener listener) noexcept override {
+                STATUS_RETURN_IF_ERROR(close_impl());
+                if (options.has_value() && options.type() != typeid(lfs::OpenOption)) {
+                    return turbo::invalid_argument_error("invalid options");
+                }
+                listener_ = std::move(listener);
+                path_ = path;
+                if (listener_.before_open) {
+                    listener_.before_open(this);
+                }
+                RESULT_ASSIGN_OR_RETURN(file_, fs_->find_file(path));
+                position_ = 0;
+                if (listener_.after_open) {
+                    listener_.after_open(this);
+                }
+                return turbo::OkStatus();
+            }
+
+            turbo::Status close() noexcept override {
+                return close_impl();
+            }
+
+            turbo::Result<int64_t> tell() const noexcept override {
+                if (file_ == nullptr) {
+                    return turbo::unavailable_error("file not opened");
+                }
+                return static_cast<int64_t>(position_);
+            }
+
+            FileMode mode() const noexcept override {
+                return FileMode::READ;
+            }
+
+            const std::string &path() const noexcept override {
+                return path_;
+            }
+
+            turbo::Result<size_t> size() const noexcept override {
+                if (file_ == nullptr) {
+                    return turbo::unavailable_error("file not opened");
+                }
+                return file_->size();
+            }
+
+            turbo::Status advance(off_t n) noexcept override {
+                if (file_ == nullptr) {
+                    return turbo::unavailable_error("file not opened");
+                }
+                if (n < 0 && static_cast<size_t>(-n) > position_) {
+                    return turbo::invalid_argument_error("advance before the start of file");
+                }
+                position_ += n;
+                return turbo::OkStatus();
+            }
+
+            using SequentialFileReader::read;
+
+            turbo::Result<size_t> read(turbo::Cord *buffer, size_t size) noexcept override {
+                if (file_ == nullptr) {
+                    return turbo::unavailable_error("file not opened");
+                }
+                auto n = file_->read(position_, size, buffer);
+                position_ += n;
+                return n;
+            }
+
+        protected:
+            turbo::Result<size_t> read_impl(void *buff, size_t len) noexcept override {
+                if (file_ == nullptr) {
+                    return turbo::unavailable_error("file not opened");
+                }
+                auto n = file_->read(position_, buff, len);
+                position_ += n;
+                return n;
+            }
+
+        private:
+            turbo::Status close_impl() noexcept {
+                if (file_ != nullptr) {
+                    if (listener_.before_close) {
+                        listener_.before_close(this);
+                    }
+                    file_.reset();
+                    if (listener_.after_close) {
+                        listener_.after_close(this);
+                    }
+                }
+                return turbo::OkStatus();
+            }
+
+        private:
+            MemoryFilesystem *fs_;
+            FileEventListener listener_;
+            std::string path_;
+            std::shared_ptr<MemoryFile> file_;
+            size_t position_{0};
+        };
+
+        // ------------------------------------------------------------------------
+        // MemoryRandomReader implementation
+
+        class MemoryRandomReader : public RandomAccessFileReader {
+        public:
+            explicit MemoryRandomReader(MemoryFilesystem *fs) : fs_(fs) {}
+
+            ~MemoryRandomReader() override {
+                auto r = close_impl();
+                (void) r;
+            }
+
+            turbo::Status open(const std::string &path, std::any options, FileEventListener listener) noexcept override {
+                STATUS_RETURN_IF_ERROR(close_impl());
+                if (options.has_value() && options.type() != typeid(lfs::OpenOption)) {
+                    return turbo::invalid_argument_error("invalid options");
+                }
+                listener_ = std::move(listener);
+                path_ = path;
+                if (listener_.before_open) {
+                    listener_.before_open(this);
+                }
+                RESULT_ASSIGN_OR_RETURN(file_, fs_->find_file(path));
+                if (listener_.after_open) {
+                    listener_.after_open(this);
+                }
+                return turbo::OkStatus();
+            }
+
+            turbo::Status close() noexcept override {
+                return close_impl();
+            }
+
+            turbo::Result<int64_t> tell() const noexcept override {
+                if (file_ == nullptr) {
+                    return turbo::unavailable_error("file not opened");
+                }
+                return 0;
+            }
+
+            FileMode mode() const noexcept override {
+                return FileMode::READ;
+            }
+
+            const std::string &path() const noexcept override {
+                return path_;
+            }
+
+            turbo::Result<size_t> size() const noexcept override {
+                if (file_ == nullptr) {
+                    return turbo::unavailable_error("file not opened");
+                }
+                return file_->size();
+            }
+
+            using RandomAccessFileReader::read_at;
+
+            turbo::Result<size_t> read_at(off_t offset, turbo::Cord &buffer, size_t size) override {
+                if (file_ == nullptr) {
+                    return turbo::unavailable_error("file not opened");
+                }
+                if (offset < 0) {
+                    return turbo::invalid_argument_error("negative offset");
+                }
+                return file_->read(static_cast<size_t>(offset), size, &buffer);
+            }
+
+        protected:
+            turbo::Result<size_t> read_at_impl(off_t offset, void *buff, size_t len) override {
+                if (file_ == nullptr) {
+                    return turbo::unavailable_error("file not opened");
+                }
+                if (offset < 0) {
+                    return turbo::invalid_argument_error("negative offset");
+                }
+                return file_->read(static_cast<size_t>(offset), buff, len);
+            }
+
+        private:
+            turbo::Status close_impl() noexcept {
+                if (file_ != nullptr) {
+                    if (listener_.before_close) {
+                        listener_.before_close(this);
+                    }
+                    file_.reset();
+                    if (listener_.after_close) {
+                        listener_.after_close(this);
+                    }
+                }
+                return turbo::OkStatus();
+            }
+
+        private:
+            MemoryFilesystem *fs_;
+            FileEventListener listener_;
+            std::string path_;
+            std::shared_ptr<MemoryFile> file_;
+        };
+
+        // ------------------------------------------------------------------------
+        // MemorySequentialWriter implementation
+
+        class MemorySequentialWriter : public SequentialFileWriter {
+        public:
+            explicit MemorySequentialWriter(MemoryFilesystem *fs) : fs_(fs) {}
+
+            ~MemorySequentialWriter() override {
+                auto r = close_impl();
+                (void) r;
+            }
+
+            turbo::Status open(const std::string &path, std::any options, FileEventListener listener) noexcept override {
+                STATUS_RETURN_IF_ERROR(close_impl());
+                lfs::OpenOption option = lfs::kDefaultAppendWriteOption;
+                if (options.has_value()) {
+                    try {
+                        option = std::any_cast<lfs::OpenOption>(options);
+                    } catch (const std::bad_any_cast &e) {
+                        return turbo::invalid_argument_error("invalid options");
+                    }
+                }
+                listener_ = std::move(listener);
+                path_ = path;
+                if (listener_.before_open) {
+                    listener_.before_open(this);
+                }
+                RESULT_ASSIGN_OR_RETURN(file_, fs_->open_file(path, option));
+                if (listener_.after_open) {
+                    listener_.after_open(this);
+                }
+                return turbo::OkStatus();
+            }
+
+            turbo::Status close() noexcept override {
+                return close_impl();
+            }
+
+            turbo::Result<int64_t> tell() const noexcept override {
+                if (file_ == nullptr) {
+                    return turbo::unavailable_error("file not opened");
+                }
+                return static_cast<int64_t>(file_->size());
+            }
+
+            FileMode mode() const noexcept override {
+                return FileMode::WRITE;
+            }
+
+            const std::string &path() const noexcept override {
+                return path_;
+            }
+
+            turbo::Result<size_t> size() const noexcept override {
+                if (file_ == nullptr) {
+                    return turbo::unavailable_error("file not opened");
+                }
+                return file_->size();
+            }
+
+            turbo::Status truncate(size_t size) noexcept override {
+                if (file_ == nullptr) {
+                    return turbo::unavailable_error("file not opened");
+                }
+                return file_->resize(size);
+            }
+
+        protected:
+            turbo::Status append_impl(const void *buff, size_t len) noexcept override {
+                if (file_ == nullptr) {
+                    return turbo::unavailable_error("file not opened");
+                }
+                return file_->write(MemoryFile::kAppend, buff, len);
+            }
+
+            turbo::Status close_impl() noexcept {
+                if (file_ != nullptr) {
+                    if (listener_.before_close) {
+                        listener_.before_close(this);
+                    }
+                    file_.reset();
+                    if (listener_.after_close) {
+                        listener_.after_close(this);
+                    }
+                }
+                return turbo::OkStatus();
+            }
+
+        protected:
+            MemoryFilesystem *fs_;
+            FileEventListener listener_;
+            std::string path_;
+            std::shared_ptr<MemoryFile> file_;
+        };
+
+        // ------------------------------------------------------------------------
+        // MemoryRandomWriter implementation
+
+        class MemoryRandomWriter : public RandomAccessFileWriter {
+        public:
+            explicit MemoryRandomWriter(MemoryFilesystem *fs) : fs_(fs) {}
+
+            ~MemoryRandomWriter() override {
+                auto r = close_impl();
+                (void) r;
+            }
+
+            turbo::Status open(const std::string &path, std::any options, FileEventListener listener) noexcept override {
+                STATUS_RETURN_IF_ERROR(close_impl());
+                lfs::OpenOption option = lfs::kDefaultAppendWriteOption;
+                if (options.has_value()) {
+                    try {
+                        option = std::any_cast<lfs::OpenOption>(options);
+                    } catch (const std::bad_any_cast &e) {
+                        return turbo::invalid_argument_error("invalid options");
+                    }
+                }
+                listener_ = std::move(listener);
+                path_ = path;
+                if (listener_.before_open) {
+                    listener_.before_open(this);
+                }
+                RESULT_ASSIGN_OR_RETURN(file_, fs_->open_file(path, option));
+                if (listener_.after_open) {
+                    listener_.after_open(this);
+                }
+                return turbo::OkStatus();
+            }
+
+            turbo::Status close() noexcept override {
+                return close_impl();
+            }
+
+            turbo::Result<int64_t> tell() const noexcept override {
+                if (file_ == nullptr) {
+                    return turbo::unavailable_error("file not opened");
+                }
+                return static_cast<int64_t>(file_->size());
+            }
+
+            FileMode mode() const noexcept override {
+                return FileMode::WRITE;
+            }
+
+            const std::string &path() const noexcept override {
+                return path_;
+            }
+
+            turbo::Result<size_t> size() const noexcept override {
+                if (file_ == nullptr) {
+                    return turbo::unavailable_error("file not opened");
+                }
+                return file_->size();
+            }
+
+            turbo::Status truncate(size_t size) noexcept override {
+                if (file_ == nullptr) {
+                    return turbo::unavailable_error("file not opened");
+                }
+                return file_->resize(size);
+            }
+
+        private:
+            turbo::Status write_at_impl(off_t offset, const void *buff, size_t len) noexcept override {
+                if (file_ == nullptr) {
+                    return turbo::unavailable_error("file not opened");
+                }
+                if (offset < 0) {
+                    return turbo::invalid_argument_error("negative offset");
+                }
+                return file_->write(static_cast<size_t>(offset), buff, len);
+            }
+
+            turbo::Status close_impl() noexcept {
+                if (file_ != nullptr) {
+                    if (listener_.before_close) {
+                        listener_.before_close(this);
+                    }
+                    file_.reset();
+                    if (listener_.after_close) {
+                        listener_.after_close(this);
+                    }
+                }
+                return turbo::OkStatus();
+            }
+
+        private:
+            MemoryFilesystem *fs_;
+            FileEventListener listener_;
+            std::string path_;
+            std::shared_ptr<MemoryFile> file_;
+        };
+
+        // ------------------------------------------------------------------------
+        // MemoryTempFile implementation
+
+        /// Named <prefix><n>.tmp so that readers can open it, the name is removed
+        /// on close unless kept.
+        class MemoryTempFile : public TempFileWriter {
+        public:
+            explicit MemoryTempFile(MemoryFilesystem *fs) : fs_(fs) {}
+
+            ~MemoryTempFile() override {
+                auto r = close_impl();
+                (void) r;
+            }
+
+            turbo::Status open(const std::string &path, std::any options, FileEventListener listener) noexcept override {
+                STATUS_RETURN_IF_ERROR(close_impl());
+                if (options.has_value() && options.type() != typeid(lfs::TempFileOption)) {
+                    return turbo::invalid_argument_error("invalid options");
+                }
+                listener_ = std::move(listener);
+                auto option = lfs::kDefaultTruncateWriteOption;
+                option.flags |= O_EXCL;
+                for (int tries = 0; tries < 16; ++tries) {
+                    path_ = turbo::str_cat(path, fs_->next_temp_.fetch_add(1), ".tmp");
+                    auto rs = fs_->open_file(path_, option);
+                    if (rs.ok()) {
+                        file_ = std::move(rs).value();
+                        kept_ = false;
+                        return turbo::OkStatus();
+                    }
+                    if (rs.status().code() != turbo::StatusCode::kAlreadyExists) {
+                        return rs.status();
+                    }
+                }
+                return turbo::already_exists_error(turbo::str_cat("no free temp file name for prefix ", path));
+            }
+
+            turbo::Status close() noexcept override {
+                return close_impl();
+            }
+
+            turbo::Result<int64_t> tell() const noexcept override {
+                if (file_ == nullptr) {
+                    return turbo::unavailable_error("file not opened");
+                }
+                return static_cast<int64_t>(file_->size());
+            }
+
+            FileMode mode() const noexcept override {
+                return FileMode::WRITE;
+            }
+
+            const std::string &path() const noexcept override {
+                return path_;
+            }
+
+            turbo::Result<size_t> size() const noexcept override {
+                if (file_ == nullptr) {
+                    return turbo::unavailable_error("file not opened");
+                }
+                return file_->size();
+            }
+
+            turbo::Status truncate(size_t size) noexcept override {
+                if (file_ == nullptr) {
+                    return turbo::unavailable_error("file not opened");
+                }
+                return file_->resize(size);
+            }
+
+            turbo::Status keep(const std::string &path) noexcept override {
+                if (file_ == nullptr) {
+                    return turbo::unavailable_error("file not opened");
+                }
+                STATUS_RETURN_IF_ERROR(fs_->rename(path_, path));
+                path_ = path;
+                kept_ = true;
+                return turbo::OkStatus();
+            }
+
+        private:
+            turbo::Status append_impl(const void *buff, size_t len) noexcept override {
+                if (file_ == nullptr) {
+                    return turbo::unavailable_error("file not opened");
+                }
+                return file_->write(MemoryFile::kAppend, buff, len);
+            }
+
+            turbo::Status close_impl() noexcept {
+                if (file_ != nullptr) {
+                    if (listener_.before_close) {
+                        listener_.before_close(this);
+                    }
+                    file_.reset();
+                    if (!kept_) {
+                        STATUS_RETURN_IF_ERROR(fs_->remove_if_exists(path_));
+                    }
+                    if (listener_.after_close) {
+                        listener_.after_close(this);
+                    }
+                }
+                return turbo::OkStatus();
+            }
+
+        private:
+            MemoryFilesystem *fs_;
+            FileEventListener listener_;
+            std::string path_;
+            std::shared_ptr<MemoryFile> file_;
+            bool kept_{false};
+        };
+
+    }  // namespace mem
+
+    // ------------------------------------------------------------------------
+    // MemoryFilesystem implementation
+
+    MemoryFilesystem::MemoryFilesystem(const MemoryFilesystemOptions &options)
+            : options_(options), space_(std::make_shared<mem::Space>()) {
+        space_->capacity = options_.capacity;
+        auto now = turbo::time_now();
+        entries_.emplace("/", Entry{nullptr, now});
+        entries_.emplace(std::string(kTempDirectory), Entry{nullptr, now});
+    }
+
+    MemoryFilesystem::~MemoryFilesystem() = default;
+
+    size_t MemoryFilesystem::used_size() const {
+        return space_->used.load(std::memory_order_relaxed);
+    }
+
+    turbo::Result<std::shared_ptr<SequentialFileReader>> MemoryFilesystem::create_sequential_read_file() {
+        return std::make_shared<mem::MemorySequentialReader>(this);
+    }
+
+    turbo::Result<std::shared_ptr<SequentialFileReader>> MemoryFilesystem::create_sequential_read_mmap_file() {
+        return std::make_shared<mem::MemorySequentialReader>(this);
+    }
+
+    turbo::Result<std::shared_ptr<RandomAccessFileReader>> MemoryFilesystem::create_random_read_file() {
+        return std::make_shared<mem::MemoryRandomReader>(this);
+    }
+
+    turbo::Result<std::shared_ptr<RandomAccessFileReader>> MemoryFilesystem::create_random_read_mmap_file() {
+        return std::make_shared<mem::MemoryRandomReader>(this);
+    }
+
+    turbo::Result<std::shared_ptr<SequentialFileWriter>> MemoryFilesystem::create_sequential_write_file() {
+        return std::make_shared<mem::MemorySequentialWriter>(this);
+    }
+
+    turbo::Result<std::shared_ptr<RandomAccessFileWriter>> MemoryFilesystem::create_random_write_file() {
+        return std::make_shared<mem::MemoryRandomWriter>(this);
+    }
+
+    turbo::Result<std::shared_ptr<TempFileWriter>> MemoryFilesystem::create_temp_file() {
+        return std::make_shared<mem::MemoryTempFile>(this);
+    }
+
+    turbo::Result<std::shared_ptr<mem::MemoryFile>> MemoryFilesystem::find_file(const std::string_view &path) const {
+        auto key = normalize(path);
+        std::shared_lock lock(mutex_);
+        auto it = entries_.find(key);
+        if (it == entries_.end()) {
+            return turbo::not_found_error(turbo::str_cat("file not found: ", path));
+        }
+        if (it->second.file == nullptr) {
+            return turbo::invalid_argument_error(turbo::str_cat("path is a directory: ", path));
+        }
+        return it->second.file;
+    }
+
+    turbo::Result<std::shared_ptr<mem::MemoryFile>>
+    MemoryFilesystem::open_file(const std::string_view &path, const lfs::OpenOption &option) {
+        auto key = normalize(path);
+        std::unique_lock lock(mutex_);
+        auto it = entries_.find(key);
+        if (it != entries_.end()) {
+            if (it->second.file == nullptr) {
+                return turbo::invalid_argument_error(turbo::str_cat("path is a directory: ", path));
+            }
+            if ((option.flags & O_CREAT) && (option.flags & O_EXCL)) {
+                return turbo::already_exists_error(turbo::str_cat("file exists: ", path));
+            }
+            if (option.flags & O_TRUNC) {
+                STATUS_RETURN_IF_ERROR(it->second.file->resize(0));
+            }
+            return it->second.file;
+        }
+        if (!(option.flags & O_CREAT)) {
+            return turbo::not_found_error(turbo::str_cat("file not found: ", path));
+        }
+        auto parent = parent_of(key);
+        if (!is_directory_locked(parent)) {
+            if (!option.create_dir_if_miss) {
+                return turbo::not_found_error(turbo::str_cat("parent directory not found: ", path));
+            }
+            STATUS_RETURN_IF_ERROR(create_directories_locked(parent));
+        }
+        auto file = std::make_shared<mem::MemoryFile>(space_);
+        entries_.emplace(key, Entry{file, turbo::time_now()});
+        return file;
+    }
+
+    bool MemoryFilesystem::is_directory_locked(const std::string &key) const {
+        auto it = entries_.find(key);
+        return it != entries_.end() && it->second.file == nullptr;
+    }
+
+    turbo::Status MemoryFilesystem::create_directories_locked(const std::string &key) {
+        auto it = entries_.find(key);
+        if (it != entries_.end()) {
+            if (it->second.file != nullptr) {
+                return turbo::already_exists_error(turbo::str_cat("path is a file: ", key));
+            }
+            return turbo::OkStatus();
+        }
+        STATUS_RETURN_IF_ERROR(create_directories_locked(parent_of(key)));
+        entries_.emplace(key, Entry{nullptr, turbo::time_now()});
+        return turbo::OkStatus();
+    }
+
+    turbo::Status MemoryFilesystem::read_file(const std::string &file_path, std::string *result) noexcept {
+        RESULT_ASSIGN_OR_RETURN(auto file, find_file(file_path));
+        // the size may change before the read, resize to what was read
+        auto original_size = result->size();
+        result->resize(original_size + file->size());
+        auto n = file->read(0, result->data() + original_size, result->size() - original_size);
+        result->resize(original_size + n);
+        return turbo::OkStatus();
+    }
+
+    turbo::Status MemoryFilesystem::write_file(const std::string &file_path, const std::string_view &content) noexcept {
+        RESULT_ASSIGN_OR_RETURN(auto file, open_file(file_path, lfs::kDefaultTruncateWriteOption));
+        return file->write(mem::MemoryFile::kAppend, content.data(), content.size());
+    }
+
+    turbo::Status MemoryFilesystem::append_file(const std::string &file_path, const std::string_view &content) noexcept {
+        RESULT_ASSIGN_OR_RETURN(auto file, open_file(file_path, lfs::kDefaultAppendWriteOption));
+        return file->write(mem::MemoryFile::kAppend, content.data(), content.size());
+    }
+
+    void MemoryFilesystem::list_locked(const std::string &key, bool directories, const std::string_view &root_path,
+                                       bool full_path, std::vector<std::string> &result) const {
+        auto prefix = children_prefix(key);
+        for (auto it = entries_.upper_bound(prefix);
+             it != entries_.end() && it->first.compare(0, prefix.size(), prefix) == 0; ++it) {
+            if (it->first.find('/', prefix.size()) != std::string::npos) {
+                continue;
+            }
+            if ((it->second.file == nullptr) != directories) {
+                continue;
+            }
+            auto name = it->first.substr(prefix.size());
+            if (full_path) {
+                result.emplace_back((alkaid::filesystem::path(std::string(root_path)) / name).string());
+            } else {
+                result.emplace_back(std::move(name));
+            }
+        }
+    }
+
+    turbo::Status MemoryFilesystem::list_files(const std::string_view &root_path, std::vector<std::string> &result,
+                                               bool full_path) noexcept {
+        auto key = normalize(root_path);
+        std::shared_lock lock(mutex_);
+        if (!is_directory_locked(key)) {
+            return turbo::not_found_error(turbo::str_cat("directory not found: ", root_path));
+        }
+        list_locked(key, false, root_path, full_path, result);
+        return turbo::OkStatus();
+    }
+
+    turbo::Status MemoryFilesystem::list_directories(const std::string_view &root_path, std::vector<std::string> &result,
+                                                     bool full_path) noexcept {
+        auto key = normalize(root_path);
+        std::shared_lock lock(mutex_);
+        if (!is_directory_locked(key)) {
+            return turbo::not_found_error(turbo::str_cat("directory not found: ", root_path));
+        }
+        list_locked(key, true, root_path, full_path, result);
+        return turbo::OkStatus();
+    }
+
+    turbo::Result<bool> MemoryFilesystem::exists(const std::string_view &path) noexcept {
+        auto key = normalize(path);
+        std::shared_lock lock(mutex_);
+        return entries_.find(key) != entries_.end();
+    }
+
+    turbo::Status MemoryFilesystem::remove(const std::string_view &path) noexcept {
+        auto key = normalize(path);
+        if (key == "/") {
+            return turbo::invalid_argument_error("can not remove the root");
+        }
+        std::unique_lock lock(mutex_);
+        auto it = entries_.find(key);
+        if (it == entries_.end()) {
+            return turbo::OkStatus();
+        }
+        if (it->second.file == nullptr) {
+            auto children = children_range(entries_, key);
+            if (children.first != children.second) {
+                return turbo::failed_precondition_error(turbo::str_cat("directory not empty: ", path));
+            }
+        }
+        entries_.erase(it);
+        return turbo::OkStatus();
+    }
+
+    turbo::Status MemoryFilesystem::remove_all(const std::string_view &path) noexcept {
+        auto key = normalize(path);
+        if (key == "/") {
+            return turbo::invalid_argument_error("can not remove the root");
+        }
+        std::unique_lock lock(mutex_);
+        auto it = entries_.find(key);
+        if (it == entries_.end()) {
+            return turbo::OkStatus();
+        }
+        if (it->second.file == nullptr) {
+            auto children = children_range(entries_, key);
+            entries_.erase(children.first, children.second);
+        }
+        entries_.erase(it);
+        return turbo::OkStatus();
+    }
+
+    turbo::Status MemoryFilesystem::remove_if_exists(const std::string_view &path) noexcept {
+        return remove(path);
+    }
+
+    turbo::Status MemoryFilesystem::remove_all_if_exists(const std::string_view &path) noexcept {
+        return remove_all(path);
+    }
+
+    turbo::Result<size_t> MemoryFilesystem::file_size(const std::string_view &path) noexcept {
+        RESULT_ASSIGN_OR_RETURN(auto file, find_file(path));
+        return file->size();
+    }
+
+    turbo::Status MemoryFilesystem::file_resize(const std::string_view &path, size_t size) noexcept {
+        RESULT_ASSIGN_OR_RETURN(auto file, find_file(path));
+        return file->resize(size);
+    }
+
+    turbo::Result<turbo::Time> MemoryFilesystem::last_modified_time(const std::string_view &path) noexcept {
+        auto key = normalize(path);
+        std::shared_lock lock(mutex_);
+        auto it = entries_.find(key);
+        if (it == entries_.end()) {
+            return turbo::not_found_error(turbo::str_cat("path not found: ", path));
+        }
+        return it->second.file != nullptr ? it->second.file->mtime() : it->second.mtime;
+    }
+
+    turbo::Status MemoryFilesystem::rename(const std::string_view &old_path, const std::string_view &new_path) noexcept {
+        auto from = normalize(old_path);
+        auto to = normalize(new_path);
+        if (from == to) {
+            return turbo::OkStatus();
+        }
+        auto from_prefix = children_prefix(from);
+        if (from == "/" || to.compare(0, from_prefix.size(), from_prefix) == 0) {
+            return turbo::invalid_argument_error(turbo::str_cat("can not move ", old_path, " into itself"));
+        }
+        std::unique_lock lock(mutex_);
+        auto src = entries_.find(from);
+        if (src == entries_.end()) {
+            return turbo::not_found_error(turbo::str_cat("path not found: ", old_path));
+        }
+        if (!is_directory_locked(parent_of(to))) {
+            return turbo::not_found_error(turbo::str_cat("parent directory not found: ", new_path));
+        }
+        bool directory = src->second.file == nullptr;
+        auto dst = entries_.find(to);
+        if (dst != entries_.end()) {
+            if ((dst->second.file == nullptr) != directory) {
+                return turbo::invalid_argument_error(turbo::str_cat("can not replace ", new_path, " by ", old_path));
+            }
+            if (directory) {
+                auto children = children_range(entries_, to);
+                if (children.first != children.second) {
+                    return turbo::failed_precondition_error(turbo::str_cat("directory not empty: ", new_path));
+                }
+            }
+            entries_.erase(dst);
+        }
+        std::vector<std::pair<std::string, Entry>> moved;
+        moved.emplace_back(to, std::move(src->second));
+        entries_.erase(src);
+        if (directory) {
+            auto children = children_range(entries_, from);
+            for (auto it = children.first; it != children.second; ++it) {
+                moved.emplace_back(to + it->first.substr(from.size()), std::move(it->second));
+            }
+            entries_.erase(children.first, children.second);
+        }
+        for (auto &entry: moved) {
+            entries_.emplace(std::move(entry.first), std::move(entry.second));
+        }
+        return turbo::OkStatus();
+    }
+
+    turbo::Status MemoryFilesystem::copy_file_locked(const std::string &src, const std::string &dst, CopyOptions options) {
+        auto from = entries_.find(src);
+        if (from == entries_.end()) {
+            return turbo::not_found_error(turbo::str_cat("file not found: ", src));
+        }
+        if (from->second.file == nullptr) {
+            return turbo::invalid_argument_error(turbo::str_cat("source path is a directory: ", src));
+        }
+        auto to = entries_.find(dst);
+        if (to != entries_.end()) {
+            if (to->second.file == nullptr) {
+                return turbo::invalid_argument_error(turbo::str_cat("destination path is a directory: ", dst));
+            }
+            if (has_option(options, CopyOptions::SkipExisting)) {
+                return turbo::OkStatus();
+            }
+            if (has_option(options, CopyOptions::OverwriteExistingIfNewer) &&
+                !(to->second.file->mtime() < from->second.file->mtime())) {
+                return turbo::OkStatus();
+            }
+            if (!has_option(options, CopyOptions::OverwriteExisting) &&
+                !has_option(options, CopyOptions::OverwriteExistingIfNewer)) {
+                return turbo::already_exists_error(turbo::str_cat("file exists: ", dst));
+            }
+        } else if (!is_directory_locked(parent_of(dst))) {
+            return turbo::not_found_error(turbo::str_cat("parent directory not found: ", dst));
+        }
+        RESULT_ASSIGN_OR_RETURN(auto file, from->second.file->clone());
+        entries_[dst] = Entry{std::move(file), turbo::time_now()};
+        return turbo::OkStatus();
+    }
+
+    turbo::Status
+    MemoryFilesystem::copy_file(const std::string_view &src_path, const std::string_view &dst_path) noexcept {
+        auto src = normalize(src_path);
+        auto dst = normalize(dst_path);
+        std::unique_lock lock(mutex_);
+        return copy_file_locked(src, dst, CopyOptions::None);
+    }
+
+    turbo::Result<std::string> MemoryFilesystem::temp_directory_path() noexcept {
+        return std::string(kTempDirectory);
+    }
+
+    turbo::Status MemoryFilesystem::create_directory(const std::string_view &path) noexcept {
+        auto key = normalize(path);
+        std::unique_lock lock(mutex_);
+        auto it = entries_.find(key);
+        if (it != entries_.end()) {
+            if (it->second.file != nullptr) {
+                return turbo::already_exists_error(turbo::str_cat("path is a file: ", path));
+            }
+            return turbo::OkStatus();
+        }
+        if (!is_directory_locked(parent_of(key))) {
+            return turbo::not_found_error(turbo::str_cat("parent directory not found: ", path));
+        }
+        entries_.emplace(key, Entry{nullptr, turbo::time_now()});
+        return turbo::OkStatus();
+    }
+
+    turbo::Status MemoryFilesystem::create_directories(const std::string_view &path) noexcept {
+        auto key = normalize(path);
+        std::unique_lock lock(mutex_);
+        return create_directories_locked(key);
+    }
+
+    // follows std::filesystem::copy: without Recursive only the files right in
+    // a directory are copied, and only when no option is given
+    turbo::Status MemoryFilesystem::copy_locked(const std::string &src, const std::string &dst, CopyOptions options,
+                                                bool nested) {
+        auto from = entries_.find(src);
+        if (from == entries_.end()) {
+            return turbo::not_found_error(turbo::str_cat("path not found: ", src));
+        }
+        if (from->second.file != nullptr) {
+            if (has_option(options, CopyOptions::DirectoriesOnly)) {
+                return turbo::OkStatus();
+            }
+            auto target = is_directory_locked(dst) ? child_of(dst, name_of(src)) : dst;
+            return copy_file_locked(src, target, options);
+        }
+        if (!has_option(options, CopyOptions::Recursive) && (nested || options != CopyOptions::None)) {
+            return turbo::OkStatus();
+        }
+        auto to = entries_.find(dst);
+        if (to == entries_.end()) {
+            if (!is_directory_locked(parent_of(dst))) {
+                return turbo::not_found_error(turbo::str_cat("parent directory not found: ", dst));
+            }
+            entries_.emplace(dst, Entry{nullptr, turbo::time_now()});
+        } else if (to->second.file != nullptr) {
+            return turbo::invalid_argument_error(turbo::str_cat("destination path is a file: ", dst));
+        }
+        std::vector<std::string> children;
+        list_locked(src, false, "", false, children);
+        list_locked(src, true, "", false, children);
+        for (auto &name: children) {
+            STATUS_RETURN_IF_ERROR(copy_locked(child_of(src, name), child_of(dst, name), options, true));
+        }
+        return turbo::OkStatus();
+    }
+
+    turbo::Status MemoryFilesystem::copy_directory(const std::string_view &src_path, const std::string_view &dst_path,
+                                                   CopyOptions options) noexcept {
+        auto src = normalize(src_path);
+        auto dst = normalize(dst_path);
+        auto src_prefix = children_prefix(src);
+        if (dst.compare(0, src_prefix.size(), src_prefix) == 0) {
+            return turbo::invalid_argument_error(turbo::str_cat("can not copy ", src_path, " into itself"));
+        }
+        std::unique_lock lock(mutex_);
+        return copy_locked(src, dst, options, false);
+    }
+
+}  // namespace alkaid
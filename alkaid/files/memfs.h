@@ -0,0 +1,179 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+
+#include <alkaid/files/interface.h>
+#include <alkaid/files/internal/filesystem_fwd.h>
+
+namespace alkaid {
+
+    struct MemoryFilesystemOptions {
+        /// bytes all the files may hold together, 0 for no limit
+        size_t capacity{0};
+    };
+
+    namespace lfs {
+        struct OpenOption;
+    }  // namespace lfs
+
+    namespace mem {
+        class MemoryFile;
+        class MemorySequentialReader;
+        class MemoryRandomReader;
+        class MemorySequentialWriter;
+        class MemoryRandomWriter;
+        class MemoryTempFile;
+
+        struct Space;
+    }  // namespace mem
+
+    /// \brief A filesystem kept in process memory, with the API of LocalFilesystem.
+    ///
+    /// Paths are taken from the root of the filesystem, a relative path
+    /// included.  "/" and temp_directory_path() exist from the start.  A file
+    /// stays readable by the readers that opened it after it is removed or
+    /// replaced.
+    ///
+    /// Files are kept in fixed size blocks, shared with the Cords read into
+    /// and with the copies copy_file() makes.  A shared block is copied before
+    /// it is written, so reading into a Cord copies nothing.  Files may be
+    /// read and written from any number of threads, every read and write is
+    /// atomic.
+    ///
+    /// Writers take an lfs::OpenOption like the local ones, O_CREAT, O_EXCL,
+    /// O_TRUNC and create_dir_if_miss are honoured, and sequential writes
+    /// always go to the end of the file.  Symlinks are not supported.
+    class TURBO_EXPORT MemoryFilesystem : public Filesystem {
+    public:
+        explicit MemoryFilesystem(const MemoryFilesystemOptions &options = MemoryFilesystemOptions{});
+
+        ~MemoryFilesystem() override;
+
+        std::string name() const override {
+            return "MemoryFilesystem";
+        }
+
+        turbo::Result<std::shared_ptr<SequentialFileReader>> create_sequential_read_file() override;
+
+        /// the same reader as create_sequential_read_file(), reads of memory are already zero copy
+        turbo::Result<std::shared_ptr<SequentialFileReader>> create_sequential_read_mmap_file() override;
+
+        turbo::Result<std::shared_ptr<RandomAccessFileReader>> create_random_read_file() override;
+
+        /// the same reader as create_random_read_file()
+        turbo::Result<std::shared_ptr<RandomAccessFileReader>> create_random_read_mmap_file() override;
+
+        turbo::Result<std::shared_ptr<SequentialFileWriter>> create_sequential_write_file() override;
+
+        turbo::Result<std::shared_ptr<RandomAccessFileWriter>> create_random_write_file() override;
+
+        turbo::Result<std::shared_ptr<TempFileWriter>> create_temp_file() override;
+
+        turbo::Status read_file(const std::string &file_path, std::string *result) noexcept override;
+
+        turbo::Status write_file(const std::string &file_path, const std::string_view &content) noexcept override;
+
+        turbo::Status append_file(const std::string &file_path, const std::string_view &content) noexcept override;
+
+        turbo::Status list_files(const std::string_view &root_path, std::vector<std::string> &result,
+                                 bool full_path = true) noexcept override;
+
+        turbo::Status list_directories(const std::string_view &root_path, std::vector<std::string> &result,
+                                       bool full_path = true) noexcept override;
+
+        turbo::Result<bool> exists(const std::string_view &path) noexcept override;
+
+        turbo::Status remove(const std::string_view &path) noexcept override;
+
+        turbo::Status remove_all(const std::string_view &path) noexcept override;
+
+        turbo::Status remove_if_exists(const std::string_view &path) noexcept override;
+
+        turbo::Status remove_all_if_exists(const std::string_view &path) noexcept override;
+
+        turbo::Result<size_t> file_size(const std::string_view &path) noexcept override;
+
+        turbo::Status file_resize(const std::string_view &path, size_t size) noexcept override;
+
+        turbo::Result<turbo::Time> last_modified_time(const std::string_view &path) noexcept override;
+
+        turbo::Status rename(const std::string_view &old_path, const std::string_view &new_path) noexcept override;
+
+        turbo::Status copy_file(const std::string_view &src_path, const std::string_view &dst_path) noexcept override;
+
+        turbo::Result<std::string> temp_directory_path() noexcept override;
+
+        turbo::Status create_directory(const std::string_view &path) noexcept override;
+
+        turbo::Status create_directories(const std::string_view &path) noexcept override;
+
+        turbo::Status copy_directory(const std::string_view &src_path, const std::string_view &dst_path, CopyOptions options) noexcept override;
+
+        /// bytes held by the files, the removed ones still open included
+        size_t used_size() const;
+
+        size_t capacity() const {
+            return options_.capacity;
+        }
+
+    private:
+        friend class mem::MemorySequentialReader;
+        friend class mem::MemoryRandomReader;
+        friend class mem::MemorySequentialWriter;
+        friend class mem::MemoryRandomWriter;
+        friend class mem::MemoryTempFile;
+
+        // a directory when file is null
+        struct Entry {
+            std::shared_ptr<mem::MemoryFile> file;
+            turbo::Time mtime;
+        };
+
+        turbo::Result<std::shared_ptr<mem::MemoryFile>> find_file(const std::string_view &path) const;
+
+        turbo::Result<std::shared_ptr<mem::MemoryFile>> open_file(const std::string_view &path,
+                                                                  const lfs::OpenOption &option);
+
+        bool is_directory_locked(const std::string &key) const;
+
+        turbo::Status create_directories_locked(const std::string &key);
+
+        turbo::Status copy_file_locked(const std::string &src, const std::string &dst, CopyOptions options);
+
+        turbo::Status copy_locked(const std::string &src, const std::string &dst, CopyOptions options, bool nested);
+
+        void list_locked(const std::string &key, bool directories, const std::string_view &root_path,
+                         bool full_path, std::vector<std::string> &result) const;
+
+    private:
+        MemoryFilesystemOptions options_;
+        std::shared_ptr<mem::Space> space_;
+        mutable std::shared_mutex mutex_;
+        std::map<std::string, Entry> entries_;
+        std::atomic<uint64_t> next_temp_{0};
+    };
+
+}  // namespace alkaid
@@ -0,0 +1,270 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <alkaid/files/rate_limiter.h>
+
+#include <algorithm>
+
+#if defined(__linux__)
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace alkaid {
+
+    namespace {
+
+        // the io priority last set on this thread, -1 when never set
+        thread_local int thread_io_priority = -1;
+
+        void apply_thread_io_priority(bool enabled, IOPriority priority) {
+            if (enabled && thread_io_priority != static_cast<int>(priority)) {
+                if (set_thread_io_priority(priority).ok()) {
+                    thread_io_priority = static_cast<int>(priority);
+                }
+            }
+        }
+
+    }  // namespace
+
+    turbo::Status set_thread_io_priority(IOPriority priority) {
+#if defined(__linux__) && defined(SYS_ioprio_set)
+        constexpr int kWhoProcess = 1;
+        constexpr int kClassShift = 13;
+        constexpr int kClassBestEffort = 2;
+        const int level = priority == IOPriority::HIGH ? 0 : 7;
+        // who 0 is the calling thread
+        if (::syscall(SYS_ioprio_set, kWhoProcess, 0, (kClassBestEffort << kClassShift) | level) != 0) {
+            return turbo::errno_to_status(errno, "ioprio_set failed");
+        }
+        return turbo::OkStatus();
+#else
+        (void) priority;
+        return turbo::unimplemented_error("ioprio_set is not supported");
+#endif
+    }
+
+    // ------------------------------------------------------------------------
+    // RateLimiter implementation
+
+    RateLimiter::RateLimiter(const RateLimiterOptions &options) : options_(options) {
+        options_.refill_period_us = std::max<int64_t>(options_.refill_period_us, 1000);
+        options_.fairness = std::max<int32_t>(options_.fairness, 1);
+        auto now = std::chrono::steady_clock::now();
+        read_.rate = options_.read_bytes_per_second;
+        read_.last_refill = now;
+        write_.rate = options_.write_bytes_per_second;
+        write_.last_refill = now;
+    }
+
+    size_t RateLimiter::burst_locked(const Bucket &bucket) const {
+        return std::max<size_t>(1, bucket.rate * options_.refill_period_us / 1000000);
+    }
+
+    void RateLimiter::refill_locked(Bucket &bucket) {
+        auto now = std::chrono::steady_clock::now();
+        std::chrono::duration<double> elapsed = now - bucket.last_refill;
+        bucket.last_refill = now;
+        bucket.available = std::min<double>(static_cast<double>(burst_locked(bucket)),
+                                            bucket.available + elapsed.count() * static_cast<double>(bucket.rate));
+    }
+
+    void RateLimiter::grant_locked(Bucket &bucket) {
+        auto &high = bucket.waiting[static_cast<int>(IOPriority::HIGH)];
+        auto &low = bucket.waiting[static_cast<int>(IOPriority::LOW)];
+        while (!high.empty() || !low.empty()) {
+            bool take_low = !low.empty() && (high.empty() || bucket.high_streak >= options_.fairness);
+            auto &queue = take_low ? low : high;
+            auto *request = queue.front();
+            // the burst may have shrunk by set_bytes_per_second() since the request was queued,
+            // the request then gets what it was charged and asks again for the rest
+            auto need = std::min(request->bytes, burst_locked(bucket));
+            if (bucket.available < static_cast<double>(need)) {
+                break;
+            }
+            bucket.available -= static_cast<double>(need);
+            request->bytes = need;
+            request->granted = true;
+            queue.pop_front();
+            bucket.high_streak = take_low || low.empty() ? 0 : bucket.high_streak + 1;
+            cv_.notify_all();
+        }
+    }
+
+    void RateLimiter::request(FileMode direction, size_t bytes, IOPriority priority) {
+        std::unique_lock lock(mutex_);
+        auto &bucket = this->bucket(direction);
+        auto &queue = bucket.waiting[static_cast<int>(priority)];
+        while (bytes > 0) {
+            if (bucket.rate <= 0) {
+                bucket.total_bytes += bytes;
+                return;
+            }
+            Request request{std::min(bytes, burst_locked(bucket))};
+            queue.push_back(&request);
+            while (true) {
+                refill_locked(bucket);
+                grant_locked(bucket);
+                if (request.granted) {
+                    break;
+                }
+                if (bucket.rate <= 0) {
+                    // the limit was lifted
+                    queue.erase(std::find(queue.begin(), queue.end(), &request));
+                    break;
+                }
+                // until the tokens of the request are in, a refill period at most
+                auto missing = static_cast<double>(std::min(request.bytes, burst_locked(bucket))) - bucket.available;
+                auto wait_us = std::clamp<int64_t>(static_cast<int64_t>(missing * 1e6 / bucket.rate), 100,
+                                                   options_.refill_period_us);
+                cv_.wait_for(lock, std::chrono::microseconds(wait_us));
+            }
+            bucket.total_bytes += request.bytes;
+            bytes -= request.bytes;
+        }
+    }
+
+    void RateLimiter::set_bytes_per_second(FileMode direction, int64_t bytes_per_second) {
+        std::lock_guard lock(mutex_);
+        auto &bucket = this->bucket(direction);
+        refill_locked(bucket);
+        bucket.rate = bytes_per_second;
+        bucket.available = std::min<double>(bucket.available, static_cast<double>(burst_locked(bucket)));
+        cv_.notify_all();
+    }
+
+    int64_t RateLimiter::bytes_per_second(FileMode direction) const {
+        std::lock_guard lock(mutex_);
+        return bucket(direction).rate;
+    }
+
+    uint64_t RateLimiter::total_bytes(FileMode direction) const {
+        std::lock_guard lock(mutex_);
+        return bucket(direction).total_bytes;
+    }
+
+    size_t RateLimiter::burst_bytes(FileMode direction) const {
+        std::lock_guard lock(mutex_);
+        const auto &bucket = this->bucket(direction);
+        return bucket.rate <= 0 ? std::numeric_limits<size_t>::max() : burst_locked(bucket);
+    }
+
+    // ------------------------------------------------------------------------
+    // RateLimitedFileReader implementation
+
+    RateLimitedFileReader::RateLimitedFileReader(std::shared_ptr<SequentialFileReader> file,
+                                                 std::shared_ptr<RateLimiter> limiter, IOPriority priority,
+                                                 bool thread_io_priority)
+            : file_(std::move(file)), limiter_(std::move(limiter)), priority_(priority),
+              thread_io_priority_(thread_io_priority) {}
+
+    turbo::Result<size_t> RateLimitedFileReader::read_impl(void *buff, size_t len) noexcept {
+        apply_thread_io_priority(thread_io_priority_, priority_);
+        auto out = static_cast<char *>(buff);
+        const auto burst = limiter_->burst_bytes(FileMode::READ);
+        size_t done = 0;
+        while (done < len) {
+            auto piece = std::min(len - done, burst);
+            limiter_->request(FileMode::READ, piece, priority_);
+            RESULT_ASSIGN_OR_RETURN(auto n, file_->read(out + done, piece));
+            done += n;
+            if (n < piece) {
+                break;
+            }
+        }
+        return done;
+    }
+
+    // ------------------------------------------------------------------------
+    // RateLimitedRandomReadFile implementation
+
+    RateLimitedRandomReadFile::RateLimitedRandomReadFile(std::shared_ptr<RandomAccessFileReader> file,
+                                                         std::shared_ptr<RateLimiter> limiter, IOPriority priority,
+                                                         bool thread_io_priority)
+            : file_(std::move(file)), limiter_(std::move(limiter)), priority_(priority),
+              thread_io_priority_(thread_io_priority) {}
+
+    turbo::Result<size_t> RateLimitedRandomReadFile::read_at_impl(off_t offset, void *buff, size_t len) {
+        apply_thread_io_priority(thread_io_priority_, priority_);
+        auto out = static_cast<char *>(buff);
+        const auto burst = limiter_->burst_bytes(FileMode::READ);
+        size_t done = 0;
+        while (done < len) {
+            auto piece = std::min(len - done, burst);
+            limiter_->request(FileMode::READ, piece, priority_);
+            RESULT_ASSIGN_OR_RETURN(auto n, file_->read_at(offset + static_cast<off_t>(done), out + done, piece));
+            done += n;
+            if (n < piece) {
+                break;
+            }
+        }
+        return done;
+    }
+
+    std::future<turbo::Result<size_t>> RateLimitedRandomReadFile::read_at_async(off_t offset, void *buff,
+                                                                                 size_t len) {
+        apply_thread_io_priority(thread_io_priority_, priority_);
+        limiter_->request(FileMode::READ, len, priority_);
+        return file_->read_at_async(offset, buff, len);
+    }
+
+    // ------------------------------------------------------------------------
+    // RateLimitedFileWriter implementation
+
+    RateLimitedFileWriter::RateLimitedFileWriter(std::shared_ptr<SequentialFileWriter> file,
+                                                 std::shared_ptr<RateLimiter> limiter, IOPriority priority,
+                                                 bool thread_io_priority)
+            : file_(std::move(file)), limiter_(std::move(limiter)), priority_(priority),
+              thread_io_priority_(thread_io_priority) {}
+
+    turbo::Status RateLimitedFileWriter::append_impl(const void *buff, size_t len) noexcept {
+        apply_thread_io_priority(thread_io_priority_, priority_);
+        auto in = static_cast<const char *>(buff);
+        const auto burst = limiter_->burst_bytes(FileMode::WRITE);
+        for (size_t done = 0; done < len;) {
+            auto piece = std::min(len - done, burst);
+            limiter_->request(FileMode::WRITE, piece, priority_);
+            STATUS_RETURN_IF_ERROR(file_->append(in + done, piece));
+            done += piece;
+        }
+        return turbo::OkStatus();
+    }
+
+    // ------------------------------------------------------------------------
+    // RateLimitedRandomWriteFile implementation
+
+    RateLimitedRandomWriteFile::RateLimitedRandomWriteFile(std::shared_ptr<RandomAccessFileWriter> file,
+                                                           std::shared_ptr<RateLimiter> limiter, IOPriority priority,
+                                                           bool thread_io_priority)
+            : file_(std::move(file)), limiter_(std::move(limiter)), priority_(priority),
+              thread_io_priority_(thread_io_priority) {}
+
+    turbo::Status RateLimitedRandomWriteFile::write_at_impl(off_t offset, const void *buff, size_t len) noexcept {
+        apply_thread_io_priority(thread_io_priority_, priority_);
+        auto in = static_cast<const char *>(buff);
+        const auto burst = limiter_->burst_bytes(FileMode::WRITE);
+        for (size_t done = 0; done < len;) {
+            auto piece = std::min(len - done, burst);
+            limiter_->request(FileMode::WRITE, piece, priority_);
+            STATUS_RETURN_IF_ERROR(file_->write_at(offset + static_cast<off_t>(done), in + done, piece));
+            done += piece;
+        }
+        return turbo::OkStatus();
+    }
+
+}  // namespace alkaid
@@ -0,0 +1,312 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <any>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <alkaid/files/interface.h>
+
+namespace alkaid {
+
+    enum class IOPriority : uint8_t {
+        /// foreground serving, granted first
+        HIGH = 0,
+        /// background work such as compaction and bulk copies
+        LOW = 1,
+    };
+
+    struct RateLimiterOptions {
+        /// 0 for no limit
+        int64_t read_bytes_per_second{0};
+        int64_t write_bytes_per_second{0};
+        /// tokens are added at this period, a bucket holds one period of them at most
+        int64_t refill_period_us{100 * 1000};
+        /// a waiting LOW request goes first after this many HIGH ones were granted
+        int32_t fairness{10};
+    };
+
+    /// \brief Token buckets for the bytes read and written, shared by any
+    /// number of files.
+    ///
+    /// request() blocks until the bucket of its direction has the tokens.
+    /// Waiting requests are granted in order, HIGH ones before LOW ones,
+    /// except that one LOW request goes first after every `fairness` HIGH
+    /// ones, so background work is slowed down but never stopped.  Requests
+    /// larger than what a bucket holds are granted in pieces.
+    class TURBO_EXPORT RateLimiter {
+    public:
+        explicit RateLimiter(const RateLimiterOptions &options);
+
+        /// blocks until bytes may be read (READ) or written (WRITE)
+        void request(FileMode direction, size_t bytes, IOPriority priority);
+
+        /// 0 lifts the limit, the waiting requests are granted
+        void set_bytes_per_second(FileMode direction, int64_t bytes_per_second);
+
+        int64_t bytes_per_second(FileMode direction) const;
+
+        /// bytes granted so far
+        uint64_t total_bytes(FileMode direction) const;
+
+        /// the largest piece granted at once
+        size_t burst_bytes(FileMode direction) const;
+
+    private:
+        struct Request {
+            size_t bytes;
+            bool granted{false};
+        };
+
+        struct Bucket {
+            int64_t rate{0};
+            double available{0};
+            std::chrono::steady_clock::time_point last_refill;
+            std::deque<Request *> waiting[2];
+            // HIGH requests granted since a LOW one waits
+            int32_t high_streak{0};
+            uint64_t total_bytes{0};
+        };
+
+        Bucket &bucket(FileMode direction) {
+            return direction == FileMode::READ ? read_ : write_;
+        }
+
+        const Bucket &bucket(FileMode direction) const {
+            return direction == FileMode::READ ? read_ : write_;
+        }
+
+        size_t burst_locked(const Bucket &bucket) const;
+
+        void refill_locked(Bucket &bucket);
+
+        void grant_locked(Bucket &bucket);
+
+    private:
+        RateLimiterOptions options_;
+        mutable std::mutex mutex_;
+        std::condition_variable cv_;
+        Bucket read_;
+        Bucket write_;
+    };
+
+    /// \brief Sets the io priority class of the calling thread, best effort
+    /// level 0 for HIGH and 7 for LOW.  Linux only, ioprio_set(2).
+    turbo::Status set_thread_io_priority(IOPriority priority);
+
+    /// \brief Reads a file through an underlying file, asking a RateLimiter
+    /// for every read.
+    ///
+    /// Large reads are split into pieces of the limiter's burst size, so
+    /// that other readers get their turns.  With thread_io_priority the io
+    /// priority of the calling thread is set to the file's first.
+    class TURBO_EXPORT RateLimitedFileReader : public SequentialFileReader {
+    public:
+        RateLimitedFileReader(std::shared_ptr<SequentialFileReader> file, std::shared_ptr<RateLimiter> limiter,
+                              IOPriority priority = IOPriority::HIGH, bool thread_io_priority = false);
+
+        /// options and listener go to the underlying file
+        turbo::Status open(const std::string &path, std::any options, FileEventListener listener) noexcept override {
+            return file_->open(path, std::move(options), std::move(listener));
+        }
+
+        turbo::Status close() noexcept override {
+            return file_->close();
+        }
+
+        turbo::Result<int64_t> tell() const noexcept override {
+            return file_->tell();
+        }
+
+        FileMode mode() const noexcept override {
+            return FileMode::READ;
+        }
+
+        const std::string &path() const noexcept override {
+            return file_->path();
+        }
+
+        turbo::Result<size_t> size() const noexcept override {
+            return file_->size();
+        }
+
+        turbo::Status advance(off_t n) noexcept override {
+            return file_->advance(n);
+        }
+
+    private:
+        turbo::Result<size_t> read_impl(void *buff, size_t len) noexcept override;
+
+    private:
+        std::shared_ptr<SequentialFileReader> file_;
+        std::shared_ptr<RateLimiter> limiter_;
+        IOPriority priority_;
+        bool thread_io_priority_;
+    };
+
+    /// \brief Random access through an underlying file, asking a RateLimiter
+    /// for every read.
+    class TURBO_EXPORT RateLimitedRandomReadFile : public RandomAccessFileReader {
+    public:
+        RateLimitedRandomReadFile(std::shared_ptr<RandomAccessFileReader> file, std::shared_ptr<RateLimiter> limiter,
+                                  IOPriority priority = IOPriority::HIGH, bool thread_io_priority = false);
+
+        turbo::Status open(const std::string &path, std::any options, FileEventListener listener) noexcept override {
+            return file_->open(path, std::move(options), std::move(listener));
+        }
+
+        turbo::Status close() noexcept override {
+            return file_->close();
+        }
+
+        turbo::Result<int64_t> tell() const noexcept override {
+            return file_->tell();
+        }
+
+        FileMode mode() const noexcept override {
+            return FileMode::READ;
+        }
+
+        const std::string &path() const noexcept override {
+            return file_->path();
+        }
+
+        turbo::Result<size_t> size() const noexcept override {
+            return file_->size();
+        }
+
+        /// takes the tokens of the whole read, then reads through the
+        /// underlying file's read_at_async()
+        std::future<turbo::Result<size_t>> read_at_async(off_t offset, void *buff, size_t len) override;
+
+    private:
+        turbo::Result<size_t> read_at_impl(off_t offset, void *buff, size_t len) override;
+
+    private:
+        std::shared_ptr<RandomAccessFileReader> file_;
+        std::shared_ptr<RateLimiter> limiter_;
+        IOPriority priority_;
+        bool thread_io_priority_;
+    };
+
+    /// \brief Writes a file through an underlying file, asking a RateLimiter
+    /// for every append.  Large appends are split into pieces of the burst size.
+    class TURBO_EXPORT RateLimitedFileWriter : public SequentialFileWriter {
+    public:
+        RateLimitedFileWriter(std::shared_ptr<SequentialFileWriter> file, std::shared_ptr<RateLimiter> limiter,
+                              IOPriority priority = IOPriority::HIGH, bool thread_io_priority = false);
+
+        turbo::Status open(const std::string &path, std::any options, FileEventListener listener) noexcept override {
+            return file_->open(path, std::move(options), std::move(listener));
+        }
+
+        turbo::Status close() noexcept override {
+            return file_->close();
+        }
+
+        turbo::Result<int64_t> tell() const noexcept override {
+            return file_->tell();
+        }
+
+        FileMode mode() const noexcept override {
+            return FileMode::WRITE;
+        }
+
+        const std::string &path() const noexcept override {
+            return file_->path();
+        }
+
+        turbo::Result<size_t> size() const noexcept override {
+            return file_->size();
+        }
+
+        turbo::Status flush() override {
+            return file_->flush();
+        }
+
+        turbo::Status truncate(size_t size) noexcept override {
+            return file_->truncate(size);
+        }
+
+    private:
+        turbo::Status append_impl(const void *buff, size_t len) noexcept override;
+
+    private:
+        std::shared_ptr<SequentialFileWriter> file_;
+        std::shared_ptr<RateLimiter> limiter_;
+        IOPriority priority_;
+        bool thread_io_priority_;
+    };
+
+    /// \brief Random writes through an underlying file, asking a RateLimiter
+    /// for every write.
+    class TURBO_EXPORT RateLimitedRandomWriteFile : public RandomAccessFileWriter {
+    public:
+        RateLimitedRandomWriteFile(std::shared_ptr<RandomAccessFileWriter> file, std::shared_ptr<RateLimiter> limiter,
+                                   IOPriority priority = IOPriority::HIGH, bool thread_io_priority = false);
+
+        turbo::Status open(const std::string &path, std::any options, FileEventListener listener) noexcept override {
+            return file_->open(path, std::move(options), std::move(listener));
+        }
+
+        turbo::Status close() noexcept override {
+            return file_->close();
+        }
+
+        turbo::Result<int64_t> tell() const noexcept override {
+            return file_->tell();
+        }
+
+        FileMode mode() const noexcept override {
+            return FileMode::WRITE;
+        }
+
+        const std::string &path() const noexcept override {
+            return file_->path();
+        }
+
+        turbo::Result<size_t> size() const noexcept override {
+            return file_->size();
+        }
+
+        turbo::Status flush() override {
+            return file_->flush();
+        }
+
+        turbo::Status truncate(size_t size) noexcept override {
+            return file_->truncate(size);
+        }
+
+    private:
+        turbo::Status write_at_impl(off_t offset, const void *buff, size_t len) noexcept override;
+
+    private:
+        std::shared_ptr<RandomAccessFileWriter> file_;
+        std::shared_ptr<RateLimiter> limiter_;
+        IOPriority priority_;
+        bool thread_io_priority_;
+    };
+
+}  // namespace alkaid
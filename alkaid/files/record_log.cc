@@ -0,0 +1,324 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <alkaid/files/record_log.h>
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#include <alkaid/compress/crc32c.h>
+#include <turbo/base/endian.h>
+#include <turbo/strings/str_cat.h>
+
+namespace alkaid {
+
+    using namespace record_log;
+
+    namespace {
+
+        // room for the uncompressed length in front of a compressed record
+        constexpr size_t kCompressedPrefixSize = 4;
+
+        uint32_t fragment_crc(RecordType type, const char *data, size_t length) {
+            const auto type_byte = static_cast<uint8_t>(type);
+            return crc32c::mask(crc32c::extend(crc32c::value(&type_byte, 1), data, length));
+        }
+
+    }  // namespace
+
+    // ----------------------------------------------------------------------
+    // RecordLogWriter implementation
+
+    RecordLogWriter::RecordLogWriter(std::shared_ptr<SequentialFileWriter> file,
+                                     const RecordLogWriterOptions &options, uint64_t initial_length)
+            : file_(std::move(file)), options_(options), block_offset_(initial_length % kBlockSize),
+              size_(initial_length) {
+    }
+
+    turbo::Status RecordLogWriter::add_record(std::string_view record) {
+        return add_records({record});
+    }
+
+    turbo::Status RecordLogWriter::add_records(const std::vector<std::string_view> &records) {
+        if (options_.compression != CompressionType::UNCOMPRESSED && codec_ == nullptr) {
+            RESULT_ASSIGN_OR_RETURN(codec_, Codec::Create(options_.compression, options_.compression_level));
+        }
+        buffer_.clear();
+        auto block_offset = block_offset_;
+        for (auto record: records) {
+            auto status = frame_record(record);
+            if (!status.ok()) {
+                // nothing of the batch is written
+                block_offset_ = block_offset;
+                return status;
+            }
+        }
+        STATUS_RETURN_IF_ERROR(file_->append(buffer_));
+        size_ += buffer_.size();
+        if (!buffer_.empty()) {
+            compression_written_ = true;
+        }
+        return turbo::OkStatus();
+    }
+
+    turbo::Status RecordLogWriter::flush() {
+        return file_->flush();
+    }
+
+    turbo::Status RecordLogWriter::frame_record(std::string_view record) {
+        if (!compression_written_ && buffer_.empty()) {
+            // also when uncompressed: an earlier session may have appended compressed records
+            const auto type = static_cast<char>(options_.compression);
+            emit_physical_record(kSetCompressionType, &type, 1);
+        }
+        if (codec_ != nullptr) {
+            if (record.size() > std::numeric_limits<uint32_t>::max()) {
+                return turbo::invalid_argument_error("compressed records are limited to 4GB");
+            }
+            auto input = reinterpret_cast<const uint8_t *>(record.data());
+            auto max_len = codec_->MaxCompressedLen(static_cast<int64_t>(record.size()), input);
+            compressed_.resize(kCompressedPrefixSize + static_cast<size_t>(max_len));
+            auto output = reinterpret_cast<uint8_t *>(compressed_.data());
+            turbo::little_endian::store32(output, static_cast<uint32_t>(record.size()));
+            RESULT_ASSIGN_OR_RETURN(auto compressed_len,
+                                    codec_->Compress(static_cast<int64_t>(record.size()), input, max_len,
+                                                     output + kCompressedPrefixSize));
+            compressed_.resize(kCompressedPrefixSize + static_cast<size_t>(compressed_len));
+            record = compressed_;
+        }
+
+        // an empty record still gets a FULL fragment
+        const char *ptr = record.data();
+        size_t left = record.size();
+        bool begin = true;
+        do {
+            const size_t leftover = kBlockSize - block_offset_;
+            if (leftover < kHeaderSize) {
+                // zero fill the block trailer, the header goes to the next block
+                buffer_.append(leftover, '\0');
+                block_offset_ = 0;
+            }
+            const size_t avail = kBlockSize - block_offset_ - kHeaderSize;
+            const size_t fragment_length = std::min(left, avail);
+            const bool end = left == fragment_length;
+            RecordType type;
+            if (begin && end) {
+                type = kFullType;
+            } else if (begin) {
+                type = kFirstType;
+            } else if (end) {
+                type = kLastType;
+            } else {
+                type = kMiddleType;
+            }
+            emit_physical_record(type, ptr, fragment_length);
+            ptr += fragment_length;
+            left -= fragment_length;
+            begin = false;
+        } while (left > 0);
+        return turbo::OkStatus();
+    }
+
+    void RecordLogWriter::emit_physical_record(RecordType type, const char *data, size_t length) {
+        char header[kHeaderSize];
+        turbo::little_endian::store32(header, fragment_crc(type, data, length));
+        header[4] = static_cast<char>(length & 0xff);
+        header[5] = static_cast<char>(length >> 8);
+        header[6] = static_cast<char>(type);
+        buffer_.append(header, kHeaderSize);
+        buffer_.append(data, length);
+        block_offset_ += kHeaderSize + length;
+    }
+
+    // ----------------------------------------------------------------------
+    // RecordLogReader implementation
+
+    RecordLogReader::RecordLogReader(std::shared_ptr<SequentialFileReader> file, RecordLogReaderOptions options)
+            : file_(std::move(file)), options_(std::move(options)) {
+    }
+
+    void RecordLogReader::report_drop(size_t bytes, std::string_view reason) {
+        if (options_.corruption_reporter) {
+            options_.corruption_reporter(bytes, turbo::Status(turbo::StatusCode::kDataLoss, reason));
+        }
+    }
+
+    turbo::Result<bool> RecordLogReader::read_record(std::string *record) {
+        scratch_.clear();
+        bool in_fragmented_record = false;
+        uint64_t prospective_record_offset = 0;
+        std::string_view fragment;
+        while (true) {
+            RESULT_ASSIGN_OR_RETURN(auto type, read_physical_record(&fragment));
+            // offset of the fragment just read, header included
+            const uint64_t physical_record_offset =
+                    end_of_buffer_offset_ - buffer_.size() - kHeaderSize - fragment.size();
+            switch (type) {
+                case kFullType:
+                    if (in_fragmented_record && !scratch_.empty()) {
+                        report_drop(scratch_.size(), "partial record without end");
+                    }
+                    last_record_offset_ = physical_record_offset;
+                    valid_end_offset_ = end_of_buffer_offset_ - buffer_.size();
+                    STATUS_RETURN_IF_ERROR(decode_record(fragment, record));
+                    return true;
+                case kFirstType:
+                    if (in_fragmented_record && !scratch_.empty()) {
+                        report_drop(scratch_.size(), "partial record without end");
+                    }
+                    prospective_record_offset = physical_record_offset;
+                    scratch_.assign(fragment.data(), fragment.size());
+                    in_fragmented_record = true;
+                    break;
+                case kMiddleType:
+                    if (!in_fragmented_record) {
+                        report_drop(fragment.size(), "missing start of fragmented record");
+                    } else {
+                        scratch_.append(fragment.data(), fragment.size());
+                    }
+                    break;
+                case kLastType:
+                    if (!in_fragmented_record) {
+                        report_drop(fragment.size(), "missing start of fragmented record");
+                        break;
+                    }
+                    scratch_.append(fragment.data(), fragment.size());
+                    last_record_offset_ = prospective_record_offset;
+                    valid_end_offset_ = end_of_buffer_offset_ - buffer_.size();
+                    STATUS_RETURN_IF_ERROR(decode_record(scratch_, record));
+                    return true;
+                case kSetCompressionType: {
+                    if (fragment.size() != 1) {
+                        report_drop(fragment.size(), "bad compression record");
+                        break;
+                    }
+                    auto compression = static_cast<CompressionType>(static_cast<uint8_t>(fragment[0]));
+                    if (compression == CompressionType::UNCOMPRESSED) {
+                        codec_.reset();
+                    } else {
+                        RESULT_ASSIGN_OR_RETURN(codec_, Codec::Create(compression));
+                    }
+                    valid_end_offset_ = end_of_buffer_offset_ - buffer_.size();
+                    break;
+                }
+                case kEof:
+                    // a record cut short by a crashed writer is dropped silently
+                    scratch_.clear();
+                    return false;
+                case kBadRecord:
+                    if (in_fragmented_record) {
+                        report_drop(scratch_.size(), "error in middle of record");
+                        in_fragmented_record = false;
+                        scratch_.clear();
+                    }
+                    break;
+                default:
+                    report_drop(fragment.size() + (in_fragmented_record ? scratch_.size() : 0),
+                                turbo::str_cat("unknown record type ", type));
+                    in_fragmented_record = false;
+                    scratch_.clear();
+                    break;
+            }
+        }
+    }
+
+    turbo::Status RecordLogReader::decode_record(std::string_view data, std::string *record) {
+        if (codec_ == nullptr) {
+            record->assign(data.data(), data.size());
+            return turbo::OkStatus();
+        }
+        if (data.size() < kCompressedPrefixSize) {
+            return turbo::Status(turbo::StatusCode::kDataLoss, "compressed record too short");
+        }
+        auto input = reinterpret_cast<const uint8_t *>(data.data());
+        const uint32_t length = turbo::little_endian::load32(input);
+        record->resize(length);
+        RESULT_ASSIGN_OR_RETURN(auto decompressed_len,
+                                codec_->Decompress(static_cast<int64_t>(data.size() - kCompressedPrefixSize),
+                                                   input + kCompressedPrefixSize, length,
+                                                   reinterpret_cast<uint8_t *>(record->data())));
+        if (decompressed_len != length) {
+            return turbo::Status(turbo::StatusCode::kDataLoss, "compressed record length mismatch");
+        }
+        return turbo::OkStatus();
+    }
+
+    turbo::Result<int> RecordLogReader::read_physical_record(std::string_view *fragment) {
+        while (true) {
+            if (buffer_.size() < kHeaderSize) {
+                if (eof_) {
+                    // a header cut short at the end of the file, the writer
+                    // died while writing it
+                    buffer_ = {};
+                    return static_cast<int>(kEof);
+                }
+                // skip the block trailer and read the next block
+                backing_.resize(kBlockSize);
+                size_t total = 0;
+                while (total < kBlockSize) {
+                    RESULT_ASSIGN_OR_RETURN(auto n, file_->read(backing_.data() + total, kBlockSize - total));
+                    if (n == 0) {
+                        break;
+                    }
+                    total += n;
+                }
+                buffer_ = std::string_view(backing_.data(), total);
+                end_of_buffer_offset_ += total;
+                if (total < kBlockSize) {
+                    eof_ = true;
+                }
+                continue;
+            }
+
+            auto header = reinterpret_cast<const uint8_t *>(buffer_.data());
+            const size_t length = header[4] | (static_cast<size_t>(header[5]) << 8);
+            const auto type = static_cast<RecordType>(header[6]);
+            if (kHeaderSize + length > buffer_.size()) {
+                const size_t drop_size = buffer_.size();
+                buffer_ = {};
+                if (!eof_) {
+                    report_drop(drop_size, "bad record length");
+                    return static_cast<int>(kBadRecord);
+                }
+                // the payload is cut short at the end of the file
+                return static_cast<int>(kEof);
+            }
+            if (type == kZeroType && length == 0) {
+                // the rest of the block was preallocated, not written
+                buffer_ = {};
+                return static_cast<int>(kBadRecord);
+            }
+            if (options_.verify_checksums) {
+                const uint32_t expected = turbo::little_endian::load32(header);
+                if (fragment_crc(type, buffer_.data() + kHeaderSize, length) != expected) {
+                    // the length may be corrupted too, so drop the whole
+                    // rest of the block
+                    const size_t drop_size = buffer_.size();
+                    buffer_ = {};
+                    report_drop(drop_size, "checksum mismatch");
+                    return static_cast<int>(kBadRecord);
+                }
+            }
+            *fragment = buffer_.substr(kHeaderSize, length);
+            buffer_.remove_prefix(kHeaderSize + length);
+            return static_cast<int>(type);
+        }
+    }
+
+}  // namespace alkaid
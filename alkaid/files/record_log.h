@@ -0,0 +1,169 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <alkaid/compress/compression.h>
+#include <alkaid/files/interface.h>
+
+// A record log in the LevelDB write ahead log format.
+//
+// The file is a sequence of 32KB blocks.  A record is cut in fragments so
+// that no fragment crosses a block boundary, each fragment having a 7 byte
+// header: masked crc32c of type and payload (4 bytes), payload length
+// (2 bytes, little endian) and type (FULL, FIRST, MIDDLE or LAST).  A
+// block tail too short for a header is zero filled.  A corrupted fragment
+// costs at most the rest of its block: the reader skips to the next block
+// and carries on.
+//
+// Each writer session starts with a SET_COMPRESSION record, so that a log
+// appended to with other options still reads back.  With compression, each
+// record after it holds the 4 byte little endian uncompressed length and
+// the codec's one-shot output.  Compression is per record, so fragments
+// keep the block alignment that recovery relies on.
+
+namespace alkaid {
+
+    namespace record_log {
+
+        static constexpr size_t kBlockSize = 32768;
+
+        // checksum (4 bytes), length (2 bytes), type (1 byte)
+        static constexpr size_t kHeaderSize = 4 + 2 + 1;
+
+        enum RecordType : uint8_t {
+            // preallocated files are zero filled
+            kZeroType = 0,
+            kFullType = 1,
+            kFirstType = 2,
+            kMiddleType = 3,
+            kLastType = 4,
+            // payload is the CompressionType of the records that follow
+            kSetCompressionType = 9,
+        };
+
+    }  // namespace record_log
+
+    struct RecordLogWriterOptions {
+        CompressionType compression{CompressionType::UNCOMPRESSED};
+        int compression_level{kUseDefaultCompressionLevel};
+    };
+
+    /// \brief Appends records to an open file in the record log format.
+    ///
+    /// Records are framed in memory and reach the file in one append per
+    /// add_record() or add_records() call.  To append to an existing log,
+    /// pass its length as initial_length.  Not thread safe.
+    class TURBO_EXPORT RecordLogWriter {
+    public:
+        explicit RecordLogWriter(std::shared_ptr<SequentialFileWriter> file,
+                                 const RecordLogWriterOptions &options = RecordLogWriterOptions(),
+                                 uint64_t initial_length = 0);
+
+        turbo::Status add_record(std::string_view record);
+
+        /// \brief Append several records with a single write to the file
+        turbo::Status add_records(const std::vector<std::string_view> &records);
+
+        turbo::Status flush();
+
+        /// log bytes written, including initial_length
+        uint64_t size() const { return size_; }
+
+    private:
+        turbo::Status frame_record(std::string_view record);
+
+        void emit_physical_record(record_log::RecordType type, const char *data, size_t length);
+
+    private:
+        std::shared_ptr<SequentialFileWriter> file_;
+        RecordLogWriterOptions options_;
+        std::unique_ptr<Codec> codec_;
+        bool compression_written_{false};
+        // current offset in the block
+        size_t block_offset_;
+        uint64_t size_;
+        // framed records not appended to the file yet
+        std::string buffer_;
+        std::string compressed_;
+    };
+
+    struct RecordLogReaderOptions {
+        /// verify the crc32c of each fragment
+        bool verify_checksums{true};
+        /// called with the number of bytes dropped and the reason, for every
+        /// corruption skipped over.  A record cut short at the end of the
+        /// file, as left by a crashed writer, is not reported.
+        std::function<void(size_t bytes, const turbo::Status &reason)> corruption_reporter;
+    };
+
+    /// \brief Reads the records of a record log from an open file.
+    class TURBO_EXPORT RecordLogReader {
+    public:
+        explicit RecordLogReader(std::shared_ptr<SequentialFileReader> file,
+                                 RecordLogReaderOptions options = RecordLogReaderOptions());
+
+        /// \brief Read the next record into record, false at the end of the log
+        ///
+        /// Corrupted fragments are skipped and reported, errors of the
+        /// underlying file are returned.
+        turbo::Result<bool> read_record(std::string *record);
+
+        /// offset in the file of the last record returned
+        uint64_t last_record_offset() const { return last_record_offset_; }
+
+        /// offset just past the last record returned.  After a crash, the
+        /// log can be truncated there before appending to it again.
+        uint64_t valid_end_offset() const { return valid_end_offset_; }
+
+    private:
+        // kEof and kBadRecord extend the record types
+        enum : int {
+            kEof = 256,
+            kBadRecord = 257,
+        };
+
+        turbo::Result<int> read_physical_record(std::string_view *fragment);
+
+        turbo::Status decode_record(std::string_view data, std::string *record);
+
+        void report_drop(size_t bytes, std::string_view reason);
+
+    private:
+        std::shared_ptr<SequentialFileReader> file_;
+        RecordLogReaderOptions options_;
+        std::unique_ptr<Codec> codec_;
+
+        std::string backing_;
+        std::string_view buffer_;
+        bool eof_{false};
+        // file offset just past the end of buffer_
+        uint64_t end_of_buffer_offset_{0};
+        uint64_t last_record_offset_{0};
+        uint64_t valid_end_offset_{0};
+        std::string scratch_;
+    };
+
+}  // namespace alkaid
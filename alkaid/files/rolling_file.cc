@@ -0,0 +1,295 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <alkaid/files/rolling_file.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <vector>
+
+#include <alkaid/files/filesystem.h>
+#include <turbo/strings/str_cat.h>
+
+namespace alkaid {
+
+    namespace {
+
+        constexpr size_t kSegmentIndexDigits = 6;
+        constexpr size_t kCompressChunkSize = 1024 * 1024;
+        constexpr const char *kTempSuffix = ".tmp";
+
+        bool is_ready(const std::future<turbo::Status> &future) {
+            return future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+        }
+
+        bool ends_with(std::string_view s, std::string_view suffix) {
+            return s.size() >= suffix.size() && s.substr(s.size() - suffix.size()) == suffix;
+        }
+
+    }  // namespace
+
+    // ----------------------------------------------------------------------
+    // RollingFileWriter implementation
+
+    RollingFileWriter::RollingFileWriter(Filesystem *fs) : fs_(fs != nullptr ? fs : Filesystem::localfs()) {
+    }
+
+    RollingFileWriter::~RollingFileWriter() {
+        auto r = close_impl();
+        (void) r;
+    }
+
+    turbo::Status
+    RollingFileWriter::open(const std::string &path, std::any options, FileEventListener listener) noexcept {
+        auto r = close_impl();
+        (void) r;
+        options_ = RollingWriteOptions();
+        if (options.has_value()) {
+            try {
+                options_ = std::any_cast<RollingWriteOptions>(options);
+            } catch (const std::bad_any_cast &e) {
+                return turbo::invalid_argument_error("invalid options");
+            }
+        }
+        suffix_.clear();
+        if (options_.compression.has_value()) {
+            options_.compression->threads = 1;
+            if (!options_.compression->file_options.has_value()) {
+                options_.compression->file_options = lfs::kDefaultTruncateWriteOption;
+            }
+            suffix_ = turbo::str_cat(".", Codec::GetCodecAsString(options_.compression->compression));
+        }
+        path_ = path;
+        listener_ = listener;
+        size_ = 0;
+        background_status_ = turbo::OkStatus();
+        finished_.clear();
+        pool_ = std::make_shared<ThreadPool>(1);
+        STATUS_RETURN_IF_ERROR(scan_segments());
+        auto status = open_segment();
+        if (!status.ok()) {
+            // the segments submitted by the scan refer to this writer
+            (void) collect_background(true);
+            return status;
+        }
+        opened_ = true;
+        return turbo::OkStatus();
+    }
+
+    std::string RollingFileWriter::segment_name(uint64_t index) const {
+        char digits[32];
+        std::snprintf(digits, sizeof(digits), "%0*llu", static_cast<int>(kSegmentIndexDigits),
+                      static_cast<unsigned long long>(index));
+        return turbo::str_cat(path_, ".", digits);
+    }
+
+    turbo::Status RollingFileWriter::scan_segments() {
+        auto file_path = alkaid::filesystem::path(path_);
+        const std::string prefix = turbo::str_cat(file_path.filename().string(), ".");
+        auto dir = file_path.parent_path();
+        std::vector<std::string> names;
+        STATUS_RETURN_IF_ERROR(fs_->list_files(dir.empty() ? "." : dir.string(), names, false));
+
+        // index -> whether the segment is finished, and whether it is still there uncompressed
+        std::map<uint64_t, std::pair<bool, bool>> segments;
+        for (auto &name: names) {
+            if (name.size() < prefix.size() + kSegmentIndexDigits || name.compare(0, prefix.size(), prefix) != 0) {
+                continue;
+            }
+            auto digits = std::string_view(name).substr(prefix.size(), kSegmentIndexDigits);
+            if (!std::all_of(digits.begin(), digits.end(), [](char c) { return c >= '0' && c <= '9'; })) {
+                continue;
+            }
+            const uint64_t index = std::stoull(std::string(digits));
+            auto rest = std::string_view(name).substr(prefix.size() + kSegmentIndexDigits);
+            if (ends_with(rest, kTempSuffix)) {
+                // a compression cut short, the segment itself is still there
+                STATUS_RETURN_IF_ERROR(fs_->remove_if_exists((dir / name).string()));
+            } else if (rest == suffix_) {
+                segments[index].first = true;
+            } else if (rest.empty()) {
+                segments[index].second = true;
+            }
+        }
+
+        segment_index_ = segments.empty() ? 0 : segments.rbegin()->first;
+        // finished_ belongs to the background thread once a segment is submitted
+        std::vector<std::string> unfinished;
+        for (auto &[index, state]: segments) {
+            auto [done, raw] = state;
+            if (!done) {
+                // left uncompressed by a crash
+                unfinished.push_back(segment_name(index));
+                continue;
+            }
+            if (raw && !suffix_.empty()) {
+                // a crash between the rename and the remove
+                STATUS_RETURN_IF_ERROR(fs_->remove(segment_name(index)));
+            }
+            finished_.push_back(segment_name(index) + suffix_);
+        }
+        for (auto &segment: unfinished) {
+            submit_segment(std::move(segment));
+        }
+        return turbo::OkStatus();
+    }
+
+    turbo::Status RollingFileWriter::open_segment() {
+        RESULT_ASSIGN_OR_RETURN(file_, fs_->create_sequential_write_file());
+        segment_path_ = segment_name(++segment_index_);
+        STATUS_RETURN_IF_ERROR(file_->open(segment_path_, options_.file_options, listener_));
+        segment_size_ = 0;
+        segment_opened_ = std::chrono::steady_clock::now();
+        return turbo::OkStatus();
+    }
+
+    void RollingFileWriter::submit_segment(std::string segment) {
+        pending_.push_back(pool_->submit([this, segment = std::move(segment)]() {
+            return finish_segment(segment);
+        }));
+    }
+
+    turbo::Status RollingFileWriter::finish_segment(const std::string &segment) {
+        std::string finished = segment;
+        if (options_.compression.has_value()) {
+            finished = segment + suffix_;
+            const std::string temp = finished + kTempSuffix;
+            RESULT_ASSIGN_OR_RETURN(auto reader, fs_->create_sequential_read_file());
+            STATUS_RETURN_IF_ERROR(reader->open(segment, {}, {}));
+            RESULT_ASSIGN_OR_RETURN(auto output, fs_->create_sequential_write_file());
+            CompressedFileWriter writer(output);
+            STATUS_RETURN_IF_ERROR(writer.open(temp, *options_.compression, {}));
+            std::vector<uint8_t> chunk(kCompressChunkSize);
+            while (true) {
+                RESULT_ASSIGN_OR_RETURN(auto n, reader->read(chunk.data(), chunk.size()));
+                if (n == 0) {
+                    break;
+                }
+                STATUS_RETURN_IF_ERROR(writer.append(chunk.data(), n));
+            }
+            STATUS_RETURN_IF_ERROR(writer.close());
+            STATUS_RETURN_IF_ERROR(reader->close());
+            // the compressed segment shows up complete or not at all
+            STATUS_RETURN_IF_ERROR(fs_->rename(temp, finished));
+            STATUS_RETURN_IF_ERROR(fs_->remove(segment));
+        }
+        finished_.push_back(std::move(finished));
+        while (options_.max_segments > 0 && finished_.size() > options_.max_segments) {
+            STATUS_RETURN_IF_ERROR(fs_->remove(finished_.front()));
+            finished_.pop_front();
+        }
+        return turbo::OkStatus();
+    }
+
+    turbo::Status RollingFileWriter::collect_background(bool wait_all) {
+        while (!pending_.empty() && (wait_all || is_ready(pending_.front()))) {
+            auto status = pending_.front().get();
+            pending_.pop_front();
+            if (background_status_.ok()) {
+                background_status_ = status;
+            }
+        }
+        return background_status_;
+    }
+
+    turbo::Status RollingFileWriter::roll() {
+        if (!opened_) {
+            return turbo::invalid_argument_error("file not open");
+        }
+        if (segment_size_ == 0) {
+            return turbo::OkStatus();
+        }
+        STATUS_RETURN_IF_ERROR(file_->close());
+        submit_segment(segment_path_);
+        // a background error is not the appends' problem, flush() reports it
+        auto r = collect_background(false);
+        (void) r;
+        return open_segment();
+    }
+
+    turbo::Result<int64_t> RollingFileWriter::tell() const noexcept {
+        if (!opened_) {
+            return turbo::invalid_argument_error("file not open");
+        }
+        return static_cast<int64_t>(size_);
+    }
+
+    turbo::Result<size_t> RollingFileWriter::size() const noexcept {
+        if (!opened_) {
+            return turbo::unavailable_error("file not opened");
+        }
+        return size_;
+    }
+
+    turbo::Status RollingFileWriter::flush() {
+        if (!opened_) {
+            return turbo::invalid_argument_error("file not open");
+        }
+        STATUS_RETURN_IF_ERROR(file_->flush());
+        return collect_background(false);
+    }
+
+    turbo::Status RollingFileWriter::truncate(size_t size) noexcept {
+        (void) size;
+        return turbo::unimplemented_error("rolling files can not be truncated");
+    }
+
+    turbo::Status RollingFileWriter::append_impl(const void *buff, size_t len) noexcept {
+        if (!opened_) {
+            return turbo::invalid_argument_error("file not open");
+        }
+        if (segment_size_ > 0) {
+            const bool too_big = options_.max_segment_size > 0 && segment_size_ >= options_.max_segment_size;
+            const bool too_old = options_.max_segment_age_ms > 0 &&
+                                 std::chrono::steady_clock::now() - segment_opened_ >=
+                                 std::chrono::milliseconds(options_.max_segment_age_ms);
+            if (too_big || too_old) {
+                STATUS_RETURN_IF_ERROR(roll());
+            }
+        }
+        STATUS_RETURN_IF_ERROR(file_->append(buff, len));
+        segment_size_ += len;
+        size_ += len;
+        return turbo::OkStatus();
+    }
+
+    turbo::Status RollingFileWriter::close_impl() noexcept {
+        if (!opened_) {
+            return turbo::OkStatus();
+        }
+        opened_ = false;
+        auto status = file_->close();
+        if (segment_size_ > 0) {
+            submit_segment(segment_path_);
+        } else {
+            auto remove_status = fs_->remove(segment_path_);
+            if (status.ok()) {
+                status = remove_status;
+            }
+        }
+        auto background_status = collect_background(true);
+        if (status.ok()) {
+            status = background_status;
+        }
+        pool_.reset();
+        file_.reset();
+        return status;
+    }
+
+}  // namespace alkaid
@@ -0,0 +1,142 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <any>
+#include <chrono>
+#include <deque>
+#include <future>
+#include <memory>
+#include <optional>
+#include <string>
+
+#include <alkaid/files/compressed_file.h>
+#include <alkaid/files/interface.h>
+#include <alkaid/files/internal/filesystem_fwd.h>
+#include <alkaid/utility/thread_pool.h>
+
+namespace alkaid {
+
+    struct RollingWriteOptions {
+        /// roll to a new segment once the current one holds this many bytes, 0 never rolls on size
+        size_t max_segment_size{64 * 1024 * 1024};
+        /// roll to a new segment once the current one is this old, 0 never rolls on time
+        int64_t max_segment_age_ms{0};
+        /// compress completed segments with these options.  threads is forced
+        /// to 1, so the compression stays on the background thread.
+        std::optional<CompressedWriteOptions> compression;
+        /// completed segments kept, the oldest are removed first, 0 keeps them all
+        size_t max_segments{0};
+        /// passed to open() of the segment files
+        std::any file_options;
+    };
+
+    /// \brief Writes to a sequence of segment files, rolling to the next one
+    /// at a size or age threshold.
+    ///
+    /// Segments of path are named path.000001, path.000002 and so on, and get
+    /// the codec name as a suffix once compressed.  An append is never split
+    /// across segments, the thresholds are checked before each append.  Closed
+    /// segments are compressed and the old ones removed on a background
+    /// thread, so rolling costs the writer a close and an open only.  open()
+    /// picks up the numbering and the retention of segments already there,
+    /// and compresses the ones a crash left uncompressed.
+    ///
+    /// Background errors are returned by the next flush() or close().
+    class TURBO_EXPORT RollingFileWriter : public SequentialFileWriter {
+    public:
+        /// fs holds the segments, the local filesystem when null
+        explicit RollingFileWriter(Filesystem *fs = nullptr);
+
+        ~RollingFileWriter() override;
+
+        turbo::Status open(const std::string &path, std::any options, FileEventListener listener) noexcept override;
+
+        turbo::Status close() noexcept override {
+            return close_impl();
+        }
+
+        /// bytes appended since open
+        turbo::Result<int64_t> tell() const noexcept override;
+
+        FileMode mode() const noexcept override {
+            return FileMode::WRITE;
+        }
+
+        const std::string &path() const noexcept override {
+            return path_;
+        }
+
+        /// bytes appended since open
+        turbo::Result<size_t> size() const noexcept override;
+
+        turbo::Status flush() override;
+
+        turbo::Status truncate(size_t size) noexcept override;
+
+        /// the segment appends go to
+        const std::string &segment_path() const {
+            return segment_path_;
+        }
+
+        /// rolls to a new segment now, unless the current one is empty
+        turbo::Status roll();
+
+    private:
+        turbo::Status append_impl(const void *buff, size_t len) noexcept override;
+
+        std::string segment_name(uint64_t index) const;
+
+        turbo::Status scan_segments();
+
+        turbo::Status open_segment();
+
+        void submit_segment(std::string segment);
+
+        // runs on the background thread
+        turbo::Status finish_segment(const std::string &segment);
+
+        turbo::Status collect_background(bool wait_all);
+
+        turbo::Status close_impl() noexcept;
+
+    private:
+        Filesystem *fs_;
+        std::string path_;
+        RollingWriteOptions options_;
+        FileEventListener listener_;
+        std::string suffix_;
+        bool opened_{false};
+
+        std::shared_ptr<SequentialFileWriter> file_;
+        std::string segment_path_;
+        uint64_t segment_index_{0};
+        size_t segment_size_{0};
+        std::chrono::steady_clock::time_point segment_opened_;
+        uint64_t size_{0};
+
+        // a single thread, so segments are finished in order
+        std::shared_ptr<ThreadPool> pool_;
+        std::deque<std::future<turbo::Status>> pending_;
+        turbo::Status background_status_;
+        // finished segments, oldest first, only used by the background thread
+        std::deque<std::string> finished_;
+    };
+
+}  // namespace alkaid
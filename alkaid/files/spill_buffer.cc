@@ -0,0 +1,379 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <alkaid/files/spill_buffer.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include <alkaid/files/filesystem.h>
+#include <turbo/strings/str_cat.h>
+
+namespace alkaid {
+
+    // ----------------------------------------------------------------------
+    // SpillBuffer views
+
+    class SpillBufferReader : public SequentialFileReader {
+    public:
+        explicit SpillBufferReader(const SpillBuffer *buffer) : buffer_(buffer) {
+        }
+
+        // the buffer is the file, path is not used
+        turbo::Status open(const std::string &path, std::any options, FileEventListener listener) noexcept override {
+            (void) path;
+            (void) options;
+            (void) listener;
+            position_ = 0;
+            return turbo::OkStatus();
+        }
+
+        turbo::Status close() noexcept override {
+            state_ = SpillBuffer::ReadState();
+            return turbo::OkStatus();
+        }
+
+        turbo::Result<int64_t> tell() const noexcept override {
+            return static_cast<int64_t>(position_);
+        }
+
+        FileMode mode() const noexcept override {
+            return FileMode::READ;
+        }
+
+        const std::string &path() const noexcept override {
+            return buffer_->path();
+        }
+
+        turbo::Result<size_t> size() const noexcept override {
+            return buffer_->size();
+        }
+
+        turbo::Status advance(off_t n) noexcept override {
+            RESULT_ASSIGN_OR_RETURN(auto size, buffer_->size());
+            position_ = std::min<uint64_t>(position_ + n, size);
+            return turbo::OkStatus();
+        }
+
+    private:
+        turbo::Result<size_t> read_impl(void *buff, size_t len) noexcept override {
+            RESULT_ASSIGN_OR_RETURN(auto n, buffer_->read_at(&state_, position_, buff, len));
+            position_ += n;
+            return n;
+        }
+
+    private:
+        const SpillBuffer *buffer_;
+        SpillBuffer::ReadState state_;
+        uint64_t position_{0};
+    };
+
+    class SpillBufferRandomReader : public RandomAccessFileReader {
+    public:
+        explicit SpillBufferRandomReader(const SpillBuffer *buffer) : buffer_(buffer) {
+        }
+
+        // the buffer is the file, path is not used
+        turbo::Status open(const std::string &path, std::any options, FileEventListener listener) noexcept override {
+            (void) path;
+            (void) options;
+            (void) listener;
+            return turbo::OkStatus();
+        }
+
+        turbo::Status close() noexcept override {
+            state_ = SpillBuffer::ReadState();
+            return turbo::OkStatus();
+        }
+
+        turbo::Result<int64_t> tell() const noexcept override {
+            return 0;
+        }
+
+        FileMode mode() const noexcept override {
+            return FileMode::READ;
+        }
+
+        const std::string &path() const noexcept override {
+            return buffer_->path();
+        }
+
+        turbo::Result<size_t> size() const noexcept override {
+            return buffer_->size();
+        }
+
+    private:
+        turbo::Result<size_t> read_at_impl(off_t offset, void *buff, size_t len) override {
+            return buffer_->read_at(&state_, static_cast<uint64_t>(offset), buff, len);
+        }
+
+    private:
+        const SpillBuffer *buffer_;
+        SpillBuffer::ReadState state_;
+    };
+
+    // ----------------------------------------------------------------------
+    // SpillBuffer implementation
+
+    SpillBuffer::SpillBuffer(Filesystem *fs) : fs_(fs != nullptr ? fs : Filesystem::localfs()) {
+    }
+
+    SpillBuffer::~SpillBuffer() {
+        auto r = close_impl();
+        (void) r;
+    }
+
+    turbo::Status SpillBuffer::open(const std::string &path, std::any options, FileEventListener listener) noexcept {
+        (void) listener;
+        auto r = close_impl();
+        (void) r;
+        options_ = SpillBufferOptions();
+        if (options.has_value()) {
+            try {
+                options_ = std::any_cast<SpillBufferOptions>(options);
+            } catch (const std::bad_any_cast &e) {
+                return turbo::invalid_argument_error("invalid options");
+            }
+        }
+        if (options_.block_size == 0) {
+            return turbo::invalid_argument_error("invalid block size: 0");
+        }
+        codec_.reset();
+        if (options_.compression != CompressionType::UNCOMPRESSED) {
+            RESULT_ASSIGN_OR_RETURN(codec_, Codec::Create(options_.compression, options_.compression_level));
+        }
+        prefix_ = path;
+        opened_ = true;
+        return turbo::OkStatus();
+    }
+
+    turbo::Result<int64_t> SpillBuffer::tell() const noexcept {
+        RESULT_ASSIGN_OR_RETURN(auto size, this->size());
+        return static_cast<int64_t>(size);
+    }
+
+    turbo::Result<size_t> SpillBuffer::size() const noexcept {
+        if (!opened_) {
+            return turbo::unavailable_error("file not opened");
+        }
+        return head_.size() + blocks_.size() * options_.block_size + tail_.size();
+    }
+
+    turbo::Status SpillBuffer::truncate(size_t size) noexcept {
+        if (!opened_) {
+            return turbo::invalid_argument_error("file not open");
+        }
+        const uint64_t spilled_end = head_.size() + blocks_.size() * options_.block_size;
+        if (size >= spilled_end) {
+            tail_.resize(std::min<uint64_t>(size - spilled_end, tail_.size()));
+            return turbo::OkStatus();
+        }
+        if (size > head_.size()) {
+            return turbo::unimplemented_error("spilled blocks can not be truncated");
+        }
+        head_.resize(size);
+        tail_.clear();
+        blocks_.clear();
+        spilled_size_ = 0;
+        ++truncations_;
+        if (spill_file_ != nullptr) {
+            STATUS_RETURN_IF_ERROR(spill_file_->truncate(0));
+        }
+        return turbo::OkStatus();
+    }
+
+    turbo::Result<std::shared_ptr<SequentialFileReader>> SpillBuffer::new_reader() const {
+        if (!opened_) {
+            return turbo::invalid_argument_error("file not open");
+        }
+        return std::make_shared<SpillBufferReader>(this);
+    }
+
+    turbo::Result<std::shared_ptr<RandomAccessFileReader>> SpillBuffer::new_random_reader() const {
+        if (!opened_) {
+            return turbo::invalid_argument_error("file not open");
+        }
+        return std::make_shared<SpillBufferRandomReader>(this);
+    }
+
+    turbo::Status SpillBuffer::append_impl(const void *buff, size_t len) noexcept {
+        if (!opened_) {
+            return turbo::invalid_argument_error("file not open");
+        }
+        auto data = static_cast<const uint8_t *>(buff);
+        if (blocks_.empty() && tail_.empty() && head_.size() < options_.memory_budget) {
+            auto n = std::min(len, options_.memory_budget - head_.size());
+            head_.append(reinterpret_cast<const char *>(data), n);
+            data += n;
+            len -= n;
+        }
+        if (!tail_.empty()) {
+            auto n = std::min(len, options_.block_size - tail_.size());
+            tail_.append(reinterpret_cast<const char *>(data), n);
+            data += n;
+            len -= n;
+            if (tail_.size() < options_.block_size) {
+                return turbo::OkStatus();
+            }
+            STATUS_RETURN_IF_ERROR(spill_block(reinterpret_cast<const uint8_t *>(tail_.data())));
+            tail_.clear();
+        }
+        // whole blocks are spilled straight from the caller's buffer
+        while (len >= options_.block_size) {
+            STATUS_RETURN_IF_ERROR(spill_block(data));
+            data += options_.block_size;
+            len -= options_.block_size;
+        }
+        tail_.append(reinterpret_cast<const char *>(data), len);
+        return turbo::OkStatus();
+    }
+
+    turbo::Status SpillBuffer::spill_block(const uint8_t *data) {
+        if (spill_file_ == nullptr) {
+            RESULT_ASSIGN_OR_RETURN(spill_file_, fs_->create_temp_file());
+            STATUS_RETURN_IF_ERROR(spill_file_->open(prefix_, {}, {}));
+            spill_path_ = spill_file_->path();
+        }
+        const auto block_size = static_cast<int64_t>(options_.block_size);
+        Block block{spilled_size_, options_.block_size};
+        if (codec_ == nullptr) {
+            STATUS_RETURN_IF_ERROR(spill_file_->append(data, options_.block_size));
+        } else {
+            compressed_.resize(codec_->MaxCompressedLen(block_size, data));
+            RESULT_ASSIGN_OR_RETURN(auto n, codec_->Compress(block_size, data,
+                                                             static_cast<int64_t>(compressed_.size()),
+                                                             compressed_.data()));
+            STATUS_RETURN_IF_ERROR(spill_file_->append(compressed_.data(), n));
+            block.length = n;
+        }
+        spilled_size_ += block.length;
+        blocks_.push_back(block);
+        return turbo::OkStatus();
+    }
+
+    turbo::Result<size_t> SpillBuffer::read_at(ReadState *state, uint64_t offset, void *buff, size_t len) const {
+        if (!opened_) {
+            return turbo::invalid_argument_error("file not open");
+        }
+        const uint64_t spilled_end = head_.size() + blocks_.size() * options_.block_size;
+        const uint64_t end = spilled_end + tail_.size();
+        if (offset >= end) {
+            return 0;
+        }
+        len = std::min<uint64_t>(len, end - offset);
+        auto out = static_cast<uint8_t *>(buff);
+        size_t done = 0;
+        while (done < len) {
+            const uint64_t position = offset + done;
+            size_t n;
+            if (position < head_.size()) {
+                n = std::min<uint64_t>(len - done, head_.size() - position);
+                std::memcpy(out + done, head_.data() + position, n);
+            } else if (position < spilled_end) {
+                n = std::min<uint64_t>(len - done, spilled_end - position);
+                STATUS_RETURN_IF_ERROR(read_spilled(state, position - head_.size(), out + done, n));
+            } else {
+                n = len - done;
+                std::memcpy(out + done, tail_.data() + (position - spilled_end), n);
+            }
+            done += n;
+        }
+        return len;
+    }
+
+    turbo::Status SpillBuffer::read_spilled(ReadState *state, uint64_t offset, uint8_t *buff, size_t len) const {
+        if (state->file == nullptr) {
+            RESULT_ASSIGN_OR_RETURN(state->file, fs_->create_random_read_file());
+            STATUS_RETURN_IF_ERROR(state->file->open(spill_path_, {}, {}));
+            if (codec_ != nullptr) {
+                RESULT_ASSIGN_OR_RETURN(state->codec, Codec::Create(options_.compression));
+            }
+        }
+        if (state->truncations != truncations_) {
+            state->block_index = std::numeric_limits<uint64_t>::max();
+            state->truncations = truncations_;
+        }
+        if (codec_ == nullptr) {
+            // blocks are stored as is, the range is contiguous in the file
+            size_t done = 0;
+            while (done < len) {
+                RESULT_ASSIGN_OR_RETURN(auto n, state->file->read_at(static_cast<off_t>(offset + done), buff + done,
+                                                                     len - done));
+                if (n == 0) {
+                    return turbo::Status(turbo::StatusCode::kDataLoss, "spill file cut short");
+                }
+                done += n;
+            }
+            return turbo::OkStatus();
+        }
+        while (len > 0) {
+            const uint64_t index = offset / options_.block_size;
+            const size_t within = offset % options_.block_size;
+            if (state->block_index != index) {
+                auto &block = blocks_[index];
+                std::string compressed(block.length, '\0');
+                size_t done = 0;
+                while (done < block.length) {
+                    RESULT_ASSIGN_OR_RETURN(auto n, state->file->read_at(static_cast<off_t>(block.offset + done),
+                                                                         compressed.data() + done,
+                                                                         block.length - done));
+                    if (n == 0) {
+                        return turbo::Status(turbo::StatusCode::kDataLoss, "spill file cut short");
+                    }
+                    done += n;
+                }
+                state->block.resize(options_.block_size);
+                state->block_index = std::numeric_limits<uint64_t>::max();
+                RESULT_ASSIGN_OR_RETURN(auto n, state->codec->Decompress(
+                        static_cast<int64_t>(block.length), reinterpret_cast<const uint8_t *>(compressed.data()),
+                        static_cast<int64_t>(options_.block_size), reinterpret_cast<uint8_t *>(state->block.data())));
+                if (static_cast<size_t>(n) != options_.block_size) {
+                    return turbo::Status(turbo::StatusCode::kDataLoss,
+                                         turbo::str_cat("spilled block ", index, " has the wrong length"));
+                }
+                state->block_index = index;
+            }
+            const size_t n = std::min(len, options_.block_size - within);
+            std::memcpy(buff, state->block.data() + within, n);
+            buff += n;
+            offset += n;
+            len -= n;
+        }
+        return turbo::OkStatus();
+    }
+
+    turbo::Status SpillBuffer::close_impl() noexcept {
+        if (!opened_) {
+            return turbo::OkStatus();
+        }
+        opened_ = false;
+        head_ = std::string();
+        tail_ = std::string();
+        blocks_.clear();
+        spilled_size_ = 0;
+        turbo::Status status;
+        if (spill_file_ != nullptr) {
+            // a temp file is removed once closed
+            status = spill_file_->close();
+            spill_file_.reset();
+        }
+        spill_path_.clear();
+        return status;
+    }
+
+}  // namespace alkaid
@@ -0,0 +1,147 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <any>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <alkaid/compress/compression.h>
+#include <alkaid/files/interface.h>
+#include <alkaid/files/internal/filesystem_fwd.h>
+
+namespace alkaid {
+
+    struct SpillBufferOptions {
+        /// bytes kept in memory before spilling, not counting the block being filled
+        size_t memory_budget{64 * 1024 * 1024};
+        /// the spilled bytes are written and compressed in blocks of this size
+        size_t block_size{256 * 1024};
+        /// compression of the spilled blocks
+        CompressionType compression{CompressionType::UNCOMPRESSED};
+        int compression_level{kUseDefaultCompressionLevel};
+    };
+
+    /// \brief A growable byte buffer, kept in memory up to a budget and
+    /// spilled to a temp file beyond it.
+    ///
+    /// The first memory_budget bytes stay in memory.  The bytes after them
+    /// are gathered in blocks of block_size, and every full block goes to a
+    /// temp file, compressed one by one if asked, so any offset can be read
+    /// back by decompressing a single block.  The temp file is created on the
+    /// first spill and removed on close().
+    ///
+    /// open() takes the prefix of the temp file name.  The buffer is read
+    /// through the views new_reader() and new_random_reader() return, which
+    /// see everything appended so far and must not outlive the buffer.
+    /// Appends and reads must not run concurrently.
+    class TURBO_EXPORT SpillBuffer : public SequentialFileWriter {
+    public:
+        /// fs provides the temp file and reads it back, the local filesystem when null
+        explicit SpillBuffer(Filesystem *fs = nullptr);
+
+        ~SpillBuffer() override;
+
+        turbo::Status open(const std::string &path, std::any options, FileEventListener listener) noexcept override;
+
+        turbo::Status close() noexcept override {
+            return close_impl();
+        }
+
+        turbo::Result<int64_t> tell() const noexcept override;
+
+        FileMode mode() const noexcept override {
+            return FileMode::WRITE;
+        }
+
+        /// the temp file, empty until the first spill
+        const std::string &path() const noexcept override {
+            return spill_path_;
+        }
+
+        turbo::Result<size_t> size() const noexcept override;
+
+        /// only within the bytes kept in memory, the spilled blocks go as a whole
+        turbo::Status truncate(size_t size) noexcept override;
+
+        /// bytes held in memory
+        size_t memory_size() const {
+            return head_.size() + tail_.size();
+        }
+
+        /// bytes written to the temp file, after compression
+        uint64_t spilled_size() const {
+            return spilled_size_;
+        }
+
+        turbo::Result<std::shared_ptr<SequentialFileReader>> new_reader() const;
+
+        turbo::Result<std::shared_ptr<RandomAccessFileReader>> new_random_reader() const;
+
+    private:
+        friend class SpillBufferReader;
+        friend class SpillBufferRandomReader;
+
+        // a spilled block in the temp file
+        struct Block {
+            uint64_t offset;
+            size_t length;
+        };
+
+        // the temp file and the last block decompressed, one per view
+        struct ReadState {
+            std::shared_ptr<RandomAccessFileReader> file;
+            std::unique_ptr<Codec> codec;
+            std::string block;
+            uint64_t block_index{std::numeric_limits<uint64_t>::max()};
+            uint64_t truncations{0};
+        };
+
+        turbo::Status append_impl(const void *buff, size_t len) noexcept override;
+
+        turbo::Status spill_block(const uint8_t *data);
+
+        turbo::Result<size_t> read_at(ReadState *state, uint64_t offset, void *buff, size_t len) const;
+
+        turbo::Status read_spilled(ReadState *state, uint64_t offset, uint8_t *buff, size_t len) const;
+
+        turbo::Status close_impl() noexcept;
+
+    private:
+        Filesystem *fs_;
+        std::string prefix_;
+        SpillBufferOptions options_;
+        std::unique_ptr<Codec> codec_;
+        bool opened_{false};
+
+        std::string head_;
+        std::vector<Block> blocks_;
+        std::string tail_;
+        std::shared_ptr<TempFileWriter> spill_file_;
+        std::string spill_path_;
+        uint64_t spilled_size_{0};
+        // the views' cached blocks are stale once the blocks are dropped
+        uint64_t truncations_{0};
+        std::vector<uint8_t> compressed_;
+    };
+
+}  // namespace alkaid
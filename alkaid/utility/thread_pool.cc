@@ -0,0 +1,74 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <alkaid/utility/thread_pool.h>
+
+namespace alkaid {
+
+    ThreadPool::ThreadPool(size_t num_threads) {
+        if (num_threads == 0) {
+            num_threads = default_concurrency();
+        }
+        workers_.reserve(num_threads);
+        for (size_t i = 0; i < num_threads; ++i) {
+            workers_.emplace_back(&ThreadPool::worker_loop, this);
+        }
+    }
+
+    ThreadPool::~ThreadPool() {
+        {
+            std::lock_guard lock(mutex_);
+            stopping_ = true;
+        }
+        cond_.notify_all();
+        for (auto &worker: workers_) {
+            worker.join();
+        }
+    }
+
+    size_t ThreadPool::default_concurrency() {
+        auto n = std::thread::hardware_concurrency();
+        return n == 0 ? 1 : n;
+    }
+
+    void ThreadPool::enqueue(std::function<void()> task) {
+        {
+            std::lock_guard lock(mutex_);
+            tasks_.push_back(std::move(task));
+        }
+        cond_.notify_one();
+    }
+
+    void ThreadPool::worker_loop() {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock lock(mutex_);
+                cond_.wait(lock, [this] { return stopping_ || !tasks_.empty(); });
+                if (tasks_.empty()) {
+                    // stopping_ and nothing left to run
+                    return;
+                }
+                task = std::move(tasks_.front());
+                tasks_.pop_front();
+            }
+            task();
+        }
+    }
+
+}  // namespace alkaid
@@ -0,0 +1,79 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include <turbo/base/macros.h>
+
+namespace alkaid {
+
+    /// \brief A fixed size FIFO thread pool.
+    ///
+    /// Tasks are run in submission order by whichever worker is free first.
+    /// The destructor runs every task already submitted before joining.
+    class TURBO_EXPORT ThreadPool {
+    public:
+        /// \brief Create a pool with num_threads workers, 0 means hardware concurrency
+        explicit ThreadPool(size_t num_threads = 0);
+
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool &) = delete;
+
+        ThreadPool &operator=(const ThreadPool &) = delete;
+
+        /// \brief Queue f for execution, the returned future carries its result
+        template<typename F>
+        auto submit(F &&f) -> std::future<std::invoke_result_t<std::decay_t<F>>> {
+            using R = std::invoke_result_t<std::decay_t<F>>;
+            auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(f));
+            auto future = task->get_future();
+            enqueue([task]() { (*task)(); });
+            return future;
+        }
+
+        size_t size() const { return workers_.size(); }
+
+        /// \brief Number of threads to use when the caller asks for the default (0)
+        static size_t default_concurrency();
+
+    private:
+        void enqueue(std::function<void()> task);
+
+        void worker_loop();
+
+    private:
+        std::mutex mutex_;
+        std::condition_variable cond_;
+        std::deque<std::function<void()>> tasks_;
+        std::vector<std::thread> workers_;
+        bool stopping_{false};
+    };
+
+}  // namespace alkaid
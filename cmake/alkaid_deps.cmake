@@ -97,11 +97,21 @@ if(BZIP2_LIBRARY AND BZIP2_INCLUDE_DIR)
     list(APPEND ALKAID_COMPRESS_LIBRARIES ${BZIP2_LIBRARY})
 endif()
 
+################################################
+# find lzo
+find_library(LZO_LIBRARY NAMES lzo2 liblzo2.a HINTS ${EA_LIB})
+find_path(LZO_INCLUDE_DIR lzo/lzo1x.h HINTS ${EA_INCLUDE})
+if(LZO_LIBRARY AND LZO_INCLUDE_DIR)
+    set(ENABLE_LZO TRUE)
+    list(APPEND ALKAID_COMPRESS_LIBRARIES ${LZO_LIBRARY})
+endif()
+
 message(STATUS "ENABLE_ZLIB: ${ENABLE_ZLIB}")
 message(STATUS "ENABLE_LZ4: ${ENABLE_LZ4}")
 message(STATUS "ENABLE_SNAPPY: ${ENABLE_SNAPPY}")
 message(STATUS "ENABLE_ZSTD: ${ENABLE_ZSTD}")
 message(STATUS "ENABLE_BZIP2: ${ENABLE_BZIP2}")
+message(STATUS "ENABLE_LZO: ${ENABLE_LZO}")
 
 
 
@@ -27,7 +27,11 @@
 #include <gtest/gtest.h>
 
 #include <turbo/utility/status.h>
+#include <alkaid/compress/codec_metrics.h>
 #include <alkaid/compress/compression.h>
+#include <alkaid/compress/crc32c.h>
+#include <alkaid/compress/filter.h>
+#include <alkaid/compress/xxhash.h>
 
 
 #define ALKAID_ASSIGN_OR_RAISE_NAME(x, y) TURBO_CONCAT(x, y)
@@ -368,9 +372,6 @@ namespace alkaid {
 
     TEST_P(CodecTest, CodecRoundtrip) {
         const auto compression = GetCompression();
-        if (compression == CompressionType::BZ2) {
-            GTEST_SKIP() << "BZ2 does not support one-shot compression";
-        }
 
         int sizes[] = {0, 10000, 100000};
 
@@ -544,6 +545,156 @@ namespace alkaid {
         }
     }
 
+    TEST(TestCodecMisc, SpecifyCodecOptionsZstd) {
+        if (!Codec::IsAvailable(CompressionType::ZSTD)) {
+            GTEST_SKIP() << "Test requires ZSTD compression";
+        }
+        struct CombinationOption {
+            int level;
+            bool long_distance_matching;
+            int window_log;
+            int strategy;
+            int compression_threads;
+            bool checksum;
+            bool expect_success;
+        };
+        constexpr CombinationOption combinations[] = {{3,  true,  0,  0,  1, false, true},
+                                                      {3,  true,  28, 0,  1, true,  true},
+                                                      {1,  false, 20, 9,  1, true,  true},
+                                                      {5,  false, 0,  0,  2, false, true},
+                                                      {3,  false, 0,  10, 1, false, false},
+                                                      {3,  false, 40, 0,  1, false, false}};
+
+        std::vector<uint8_t> data = MakeCompressibleData(300000);
+        for (const auto &combination: combinations) {
+            auto codec_options = alkaid::ZstdCodecOptions();
+            codec_options.compression_level = combination.level;
+            codec_options.enable_long_distance_matching = combination.long_distance_matching;
+            codec_options.window_log = combination.window_log;
+            codec_options.strategy = combination.strategy;
+            codec_options.compression_threads = combination.compression_threads;
+            codec_options.checksum = combination.checksum;
+            codec_options.target_block_size = 4096;
+            auto result1 = Codec::Create(CompressionType::ZSTD, codec_options);
+            auto result2 = Codec::Create(CompressionType::ZSTD, codec_options);
+            ASSERT_EQ(combination.expect_success, result1.ok());
+            ASSERT_EQ(combination.expect_success, result2.ok());
+            if (combination.expect_success) {
+                CheckCodecRoundtrip(*result1, *result2, data);
+                CheckStreamingRoundtrip(result1->get(), data);
+            }
+        }
+    }
+
+    TEST(TestCodecMisc, ZstdLongDistanceMatching) {
+        if (!Codec::IsAvailable(CompressionType::ZSTD)) {
+            GTEST_SKIP() << "Test requires ZSTD compression";
+        }
+        // a repeat 4MB back, beyond the window of level 1
+        std::vector<uint8_t> repeated = MakeRandomData(1 << 20);
+        std::vector<uint8_t> data = repeated;
+        auto filler = MakeRandomData(3 << 20);
+        data.insert(data.end(), filler.begin(), filler.end());
+        data.insert(data.end(), repeated.begin(), repeated.end());
+
+        auto compressed_size = [&](const ZstdCodecOptions &options) -> int64_t {
+            auto codec = *Codec::Create(CompressionType::ZSTD, options);
+            std::vector<uint8_t> compressed(codec->MaxCompressedLen(data.size(), data.data()));
+            auto compressed_len = *codec->Compress(data.size(), data.data(), compressed.size(), compressed.data());
+            compressed.resize(compressed_len);
+            auto decompressed = *codec->Decompress(compressed.size(), compressed.data());
+            EXPECT_EQ(data, decompressed);
+            return compressed_len;
+        };
+        ZstdCodecOptions options;
+        options.compression_level = 1;
+        auto plain_size = compressed_size(options);
+        options.enable_long_distance_matching = true;
+        auto ldm_size = compressed_size(options);
+        ASSERT_LT(ldm_size, plain_size - (1 << 19));
+    }
+
+    TEST(TestCodecMisc, SpecifyCodecOptionsLz4) {
+        if (!Codec::IsAvailable(CompressionType::LZ4_FRAME)) {
+            GTEST_SKIP() << "Test requires LZ4 compression";
+        }
+        struct CombinationOption {
+            int level;
+            int64_t block_size;
+            bool linked_blocks;
+            bool checksums;
+            bool favor_decompression_speed;
+            bool expect_success;
+        };
+        constexpr CombinationOption combinations[] = {{1,  0,       true,  true,  false, true},
+                                                      {9,  1 << 20, true,  false, false, true},
+                                                      {12, 4 << 20, false, true,  true,  true},
+                                                      {3,  256 << 10, true, true, true,  true},
+                                                      {1,  100000,  false, false, false, false}};
+
+        std::vector<uint8_t> data = MakeCompressibleData(300000);
+        for (const auto &combination: combinations) {
+            auto codec_options = alkaid::Lz4CodecOptions();
+            codec_options.compression_level = combination.level;
+            codec_options.block_size = combination.block_size;
+            codec_options.linked_blocks = combination.linked_blocks;
+            codec_options.content_checksum = combination.checksums;
+            codec_options.block_checksum = combination.checksums;
+            codec_options.favor_decompression_speed = combination.favor_decompression_speed;
+            auto result1 = Codec::Create(CompressionType::LZ4_FRAME, codec_options);
+            auto result2 = Codec::Create(CompressionType::LZ4_FRAME, codec_options);
+            ASSERT_EQ(combination.expect_success, result1.ok());
+            ASSERT_EQ(combination.expect_success, result2.ok());
+            if (combination.expect_success) {
+                CheckCodecRoundtrip(*result1, *result2, data);
+                CheckStreamingRoundtrip(result1->get(), data);
+            }
+        }
+
+        // the content checksum catches corrupted data
+        auto codec_options = alkaid::Lz4CodecOptions();
+        codec_options.content_checksum = true;
+        RESULT_OK_AND_ASSIGN(auto codec, Codec::Create(CompressionType::LZ4_FRAME, codec_options));
+        std::vector<uint8_t> compressed(codec->MaxCompressedLen(data.size(), data.data()));
+        RESULT_OK_AND_ASSIGN(auto compressed_len,
+                             codec->Compress(data.size(), data.data(), compressed.size(), compressed.data()));
+        compressed.resize(compressed_len);
+        compressed[compressed.size() - 1] ^= 0x01;
+        std::vector<uint8_t> decompressed(data.size());
+        ASSERT_FALSE(codec->Decompress(compressed.size(), compressed.data(), decompressed.size(),
+                                       decompressed.data()).ok());
+    }
+
+    TEST(TestCodecMisc, Lz4HighCompression) {
+        if (!Codec::IsAvailable(CompressionType::LZ4)) {
+            GTEST_SKIP() << "Test requires LZ4 compression";
+        }
+        // words in random order, where the HC match search pays off
+        const char *words[] = {"alkaid ", "compress ", "block ", "frame ", "level ", "stream ", "data ", "\n"};
+        std::default_random_engine engine(42);
+        std::uniform_int_distribution<int> word(0, 7);
+        std::vector<uint8_t> data;
+        while (data.size() < 300000) {
+            const char *w = words[word(engine)];
+            data.insert(data.end(), w, w + strlen(w));
+        }
+        for (auto type: {CompressionType::LZ4, CompressionType::LZ4_HADOOP, CompressionType::LZ4_FRAME}) {
+            int64_t sizes[2];
+            int i = 0;
+            for (int level: {1, 12}) {
+                RESULT_OK_AND_ASSIGN(auto codec, Codec::Create(type, level));
+                ASSERT_EQ(level, codec->compression_level());
+                std::vector<uint8_t> compressed(codec->MaxCompressedLen(data.size(), data.data()));
+                RESULT_OK_AND_ASSIGN(sizes[i++], codec->Compress(data.size(), data.data(), compressed.size(),
+                                                                 compressed.data()));
+                compressed.resize(sizes[i - 1]);
+                RESULT_OK_AND_ASSIGN(auto decompressed, codec->Decompress(compressed.size(), compressed.data()));
+                ASSERT_EQ(data, decompressed);
+            }
+            ASSERT_LT(sizes[1], sizes[0]);
+        }
+    }
+
     TEST_P(CodecTest, MinMaxCompressionLevel) {
         auto type = GetCompression();
         RESULT_OK_AND_ASSIGN(auto codec, Codec::Create(type));
@@ -596,12 +747,71 @@ namespace alkaid {
                                                      decompressed.size(), decompressed.data()).status().code(), turbo::StatusCode::kInvalidArgument);
     }
 
+    TEST_P(CodecTest, DecompressUnknownLength) {
+        auto type = GetCompression();
+        auto codec = MakeCodec();
+        for (int data_size: {0, 10, 100000, 1000000}) {
+            for (const auto &data: {MakeRandomData(data_size), MakeCompressibleData(data_size)}) {
+                std::vector<uint8_t> compressed(codec->MaxCompressedLen(data.size(), data.data()));
+                RESULT_OK_AND_ASSIGN(auto compressed_len,
+                                     codec->Compress(data.size(), data.data(), compressed.size(),
+                                                     compressed.data()));
+                compressed.resize(compressed_len);
+                if (data_size > 0 && (type == CompressionType::ZSTD || type == CompressionType::SNAPPY ||
+                                      type == CompressionType::LZ4_FRAME || type == CompressionType::LZO ||
+                                      type == CompressionType::LZ4_HADOOP)) {
+                    ASSERT_EQ(static_cast<int64_t>(data.size()),
+                              codec->DecompressedLength(compressed.size(), compressed.data()));
+                }
+                RESULT_OK_AND_ASSIGN(auto decompressed, codec->Decompress(compressed.size(), compressed.data()));
+                ASSERT_EQ(data, decompressed);
+
+                if (type == CompressionType::ZSTD || type == CompressionType::GZIP ||
+                    type == CompressionType::BZ2 || type == CompressionType::LZ4_FRAME) {
+                    // the streaming format records no length, the output has to grow
+                    turbo::Cord streamed;
+                    ASSERT_TRUE(codec->Compress(turbo::Cord(std::string_view(
+                            reinterpret_cast<const char *>(data.data()), data.size())), &streamed).ok());
+                    std::string flat(streamed);
+                    RESULT_OK_AND_ASSIGN(decompressed,
+                                         codec->Decompress(flat.size(), reinterpret_cast<const uint8_t *>(flat.data())));
+                    ASSERT_EQ(data, decompressed);
+                }
+            }
+        }
+    }
+
+    TEST(TestCodecMisc, DecompressForgedLength) {
+        if (!Codec::IsAvailable(CompressionType::SNAPPY)) {
+            GTEST_SKIP() << "Test requires snappy compression";
+        }
+        RESULT_OK_AND_ASSIGN(auto codec, Codec::Create(CompressionType::SNAPPY));
+        // a snappy varint claiming 4GB of output, followed by garbage
+        const uint8_t forged[] = {0xff, 0xff, 0xff, 0xff, 0x0f, 0x00, 0x01, 0x02, 0x03, 0x04};
+        ASSERT_EQ(codec->DecompressedLength(sizeof(forged), forged), int64_t{0xffffffff});
+        ASSERT_FALSE(codec->Decompress(sizeof(forged), forged).ok());
+
+        if (!Codec::IsAvailable(CompressionType::ZSTD)) {
+            return;
+        }
+        // a valid frame recording a length beyond the cap still decompresses
+        RESULT_OK_AND_ASSIGN(auto zstd, Codec::Create(CompressionType::ZSTD));
+        auto data = MakeCompressibleData(1 << 20);
+        std::vector<uint8_t> compressed(zstd->MaxCompressedLen(data.size(), data.data()));
+        RESULT_OK_AND_ASSIGN(auto compressed_len,
+                             zstd->Compress(data.size(), data.data(), compressed.size(), compressed.data()));
+        ASSERT_LT(compressed_len * 256, static_cast<int64_t>(data.size()));
+        ASSERT_EQ(zstd->DecompressedLength(compressed_len, compressed.data()), static_cast<int64_t>(data.size()));
+        RESULT_OK_AND_ASSIGN(auto decompressed, zstd->Decompress(compressed_len, compressed.data()));
+        ASSERT_EQ(data, decompressed);
+    }
+
     TEST_P(CodecTest, StreamingCompressor) {
         if (GetCompression() == CompressionType::SNAPPY) {
-            GTEST_SKIP() << "snappy doesn't support streaming compression";
+            GTEST_SKIP() << "snappy streaming uses the framing format, one-shot uses raw blocks";
         }
-        if (GetCompression() == CompressionType::BZ2) {
-            GTEST_SKIP() << "Z2 doesn't support one-shot decompression";
+        if (GetCompression() == CompressionType::LZO) {
+            GTEST_SKIP() << "LZO streaming uses the lzop container, one-shot uses Hadoop block framing";
         }
         if (GetCompression() == CompressionType::LZ4 ||
             GetCompression() == CompressionType::LZ4_HADOOP) {
@@ -622,10 +832,10 @@ namespace alkaid {
 
     TEST_P(CodecTest, StreamingDecompressor) {
         if (GetCompression() == CompressionType::SNAPPY) {
-            GTEST_SKIP() << "snappy doesn't support streaming decompression.";
+            GTEST_SKIP() << "snappy streaming uses the framing format, one-shot uses raw blocks";
         }
-        if (GetCompression() == CompressionType::BZ2) {
-            GTEST_SKIP() << "Z2 doesn't support one-shot compression";
+        if (GetCompression() == CompressionType::LZO) {
+            GTEST_SKIP() << "LZO streaming uses the lzop container, one-shot uses Hadoop block framing";
         }
         if (GetCompression() == CompressionType::LZ4 ||
             GetCompression() == CompressionType::LZ4_HADOOP) {
@@ -646,7 +856,7 @@ namespace alkaid {
 
     TEST_P(CodecTest, StreamingRoundtrip) {
         if (GetCompression() == CompressionType::SNAPPY) {
-            GTEST_SKIP() << "snappy doesn't support streaming decompression";
+            GTEST_SKIP() << "snappy framing has no end marker, see TestCodecSnappy";
         }
         if (GetCompression() == CompressionType::LZ4 ||
             GetCompression() == CompressionType::LZ4_HADOOP) {
@@ -665,9 +875,35 @@ namespace alkaid {
         }
     }
 
+    TEST_P(CodecTest, CordRoundtrip) {
+        if (GetCompression() == CompressionType::LZ4 ||
+            GetCompression() == CompressionType::LZ4_HADOOP) {
+            GTEST_SKIP() << "LZ4 raw format doesn't support streaming compression.";
+        }
+        auto codec = MakeCodec();
+        for (int data_size: {0, 10, 100000}) {
+            for (const auto &data: {MakeRandomData(data_size), MakeCompressibleData(data_size)}) {
+                // input spread over many chunks, output appended after existing content
+                turbo::Cord input;
+                for (size_t pos = 0; pos < data.size(); pos += 3000) {
+                    input.append(std::string_view(reinterpret_cast<const char *>(data.data()) + pos,
+                                                  std::min<size_t>(3000, data.size() - pos)));
+                }
+                turbo::Cord compressed("header");
+                ASSERT_TRUE(codec->Compress(input, &compressed).ok());
+                compressed.remove_prefix(6);
+
+                turbo::Cord decompressed("header");
+                ASSERT_TRUE(codec->Decompress(compressed, &decompressed).ok());
+                ASSERT_EQ(std::string("header") + std::string(data.begin(), data.end()),
+                          std::string(decompressed));
+            }
+        }
+    }
+
     TEST_P(CodecTest, StreamingDecompressorReuse) {
         if (GetCompression() == CompressionType::SNAPPY) {
-            GTEST_SKIP() << "snappy doesn't support streaming decompression";
+            GTEST_SKIP() << "snappy framing has no end marker, see TestCodecSnappy";
         }
         if (GetCompression() == CompressionType::LZ4 ||
             GetCompression() == CompressionType::LZ4_HADOOP) {
@@ -690,9 +926,6 @@ namespace alkaid {
     }
 
     TEST_P(CodecTest, StreamingMultiFlush) {
-        if (GetCompression() == CompressionType::SNAPPY) {
-            GTEST_SKIP() << "snappy doesn't support streaming decompression";
-        }
         if (GetCompression() == CompressionType::LZ4 ||
             GetCompression() == CompressionType::LZ4_HADOOP) {
             GTEST_SKIP() << "LZ4 raw format doesn't support streaming decompression.";
@@ -763,6 +996,270 @@ namespace alkaid {
     INSTANTIATE_TEST_SUITE_P(TestZSTD, CodecTest, ::testing::Values(CompressionType::ZSTD));
 #endif
 
+#ifdef ENABLE_LZO
+    INSTANTIATE_TEST_SUITE_P(TestLZO, CodecTest, ::testing::Values(CompressionType::LZO));
+#endif
+
+    // Compress the whole input with the streaming compressor, feeding it in
+    // pieces of varying size.
+    std::vector<uint8_t> StreamingCompressAll(Compressor *compressor, const std::vector<uint8_t> &data) {
+        std::vector<uint8_t> compressed(16);
+        int64_t compressed_size = 0;
+        const uint8_t *input = data.data();
+        int64_t remaining = data.size();
+        while (remaining > 0) {
+            int64_t input_len = std::min(remaining, static_cast<int64_t>(777));
+            auto result = compressor->Compress(input_len, input, compressed.size() - compressed_size,
+                                               compressed.data() + compressed_size);
+            EXPECT_TRUE(result.ok());
+            compressed_size += result->bytes_written;
+            input += result->bytes_read;
+            remaining -= result->bytes_read;
+            if (result->bytes_read == 0) {
+                compressed.resize(compressed.size() * 2);
+            }
+        }
+        while (true) {
+            auto result = compressor->End(compressed.size() - compressed_size, compressed.data() + compressed_size);
+            EXPECT_TRUE(result.ok());
+            compressed_size += result->bytes_written;
+            if (!result->should_retry) {
+                break;
+            }
+            compressed.resize(compressed.size() * 2);
+        }
+        compressed.resize(compressed_size);
+        return compressed;
+    }
+
+    // Decompress the whole input with the streaming decompressor.  Framed
+    // snappy has no end-of-stream marker, so only stop once all input is fed
+    // and the decompressor rests on a chunk boundary.
+    turbo::Result<std::vector<uint8_t>> StreamingDecompressAll(Decompressor *decompressor,
+                                                               const std::vector<uint8_t> &compressed) {
+        std::vector<uint8_t> decompressed(16);
+        int64_t decompressed_size = 0;
+        const uint8_t *input = compressed.data();
+        int64_t remaining = compressed.size();
+        while (remaining > 0 || !decompressor->IsFinished()) {
+            int64_t input_len = std::min(remaining, static_cast<int64_t>(31));
+            RESULT_ASSIGN_OR_RETURN(auto result,
+                                    decompressor->Decompress(input_len, input,
+                                                             decompressed.size() - decompressed_size,
+                                                             decompressed.data() + decompressed_size));
+            if (result.need_more_output) {
+                decompressed.resize(decompressed.size() * 2);
+            } else if (result.bytes_read == 0 && result.bytes_written == 0) {
+                return turbo::unavailable_error("truncated compressed stream");
+            }
+            decompressed_size += result.bytes_written;
+            input += result.bytes_read;
+            remaining -= result.bytes_read;
+        }
+        decompressed.resize(decompressed_size);
+        return decompressed;
+    }
+
+#ifdef ENABLE_SNAPPY
+    TEST(TestCodecSnappy, FramedStreamingRoundtrip) {
+        RESULT_OK_AND_ASSIGN(auto codec, Codec::Create(CompressionType::SNAPPY));
+        for (int data_size: {0, 10, 65536, 100000, 300000}) {
+            for (const auto &data: {MakeRandomData(data_size), MakeCompressibleData(data_size)}) {
+                RESULT_OK_AND_ASSIGN(auto compressor, codec->MakeCompressor());
+                RESULT_OK_AND_ASSIGN(auto decompressor, codec->MakeDecompressor());
+                auto compressed = StreamingCompressAll(compressor.get(), data);
+                RESULT_OK_AND_ASSIGN(auto decompressed, StreamingDecompressAll(decompressor.get(), compressed));
+                ASSERT_EQ(data, decompressed);
+                ASSERT_TRUE(decompressor->IsFinished());
+            }
+        }
+    }
+
+    TEST(TestCodecSnappy, FramedStreamFormat) {
+        RESULT_OK_AND_ASSIGN(auto codec, Codec::Create(CompressionType::SNAPPY));
+        RESULT_OK_AND_ASSIGN(auto compressor, codec->MakeCompressor());
+        auto data = MakeCompressibleData(1000);
+        auto compressed = StreamingCompressAll(compressor.get(), data);
+
+        // stream identifier chunk followed by one compressed data chunk
+        const std::string stream_identifier("\xff\x06\x00\x00sNaPpY", 10);
+        ASSERT_GT(compressed.size(), stream_identifier.size() + 8);
+        ASSERT_EQ(stream_identifier, std::string(compressed.begin(), compressed.begin() + 10));
+        ASSERT_EQ(compressed[10], 0x00);
+
+        // A flipped bit in the payload must be caught by the masked CRC32C
+        compressed.back() ^= 0x01;
+        RESULT_OK_AND_ASSIGN(auto decompressor, codec->MakeDecompressor());
+        ASSERT_FALSE(StreamingDecompressAll(decompressor.get(), compressed).ok());
+
+        // Data before the stream identifier is rejected
+        ASSERT_TRUE(decompressor->Reset().ok());
+        std::vector<uint8_t> headless(compressed.begin() + 10, compressed.end());
+        ASSERT_FALSE(StreamingDecompressAll(decompressor.get(), headless).ok());
+    }
+#endif
+
+#ifdef ENABLE_ZLIB
+    TEST(TestCodecGZip, ParallelCompress) {
+        for (auto format: {GZipFormat::GZIP, GZipFormat::ZLIB, GZipFormat::DEFLATE}) {
+            GZipCodecOptions options;
+            options.gzip_format = format;
+            RESULT_OK_AND_ASSIGN(auto serial, Codec::Create(CompressionType::GZIP, options));
+            options.compression_threads = 4;
+            options.block_size = 128 * 1024;
+            RESULT_OK_AND_ASSIGN(auto parallel, Codec::Create(CompressionType::GZIP, options));
+
+            // 1000000 bytes span several blocks, the serial codec checks the combined CRC
+            for (int data_size: {0, 10, 1000000}) {
+                for (const auto &data: {MakeRandomData(data_size), MakeCompressibleData(data_size)}) {
+                    std::vector<uint8_t> compressed(parallel->MaxCompressedLen(data.size(), data.data()));
+                    RESULT_OK_AND_ASSIGN(auto compressed_size,
+                                         parallel->Compress(data.size(), data.data(),
+                                                            compressed.size(), compressed.data()));
+                    compressed.resize(compressed_size);
+                    std::vector<uint8_t> decompressed(data.size());
+                    RESULT_OK_AND_ASSIGN(auto decompressed_size,
+                                         serial->Decompress(compressed.size(), compressed.data(),
+                                                            decompressed.size(), decompressed.data()));
+                    ASSERT_EQ(data.size(), decompressed_size);
+                    ASSERT_EQ(data, decompressed);
+
+                    // the streaming compressor writes the same stream
+                    RESULT_OK_AND_ASSIGN(auto compressor, parallel->MakeCompressor());
+                    ASSERT_EQ(compressed, StreamingCompressAll(compressor.get(), data));
+
+                    CheckStreamingCompressor(parallel.get(), data);
+                }
+            }
+        }
+    }
+#endif
+
+#ifdef ENABLE_BZIP2
+    TEST(TestCodecBZ2, ParallelDecompress) {
+        // level 1 uses 100k blocks, so these inputs span several blocks
+        BZ2CodecOptions options;
+        options.compression_level = 1;
+        RESULT_OK_AND_ASSIGN(auto serial, Codec::Create(CompressionType::BZ2, options));
+        options.decompression_threads = 4;
+        RESULT_OK_AND_ASSIGN(auto parallel, Codec::Create(CompressionType::BZ2, options));
+
+        for (int data_size: {0, 10, 1000000}) {
+            for (const auto &data: {MakeRandomData(data_size), MakeCompressibleData(data_size)}) {
+                std::vector<uint8_t> compressed(serial->MaxCompressedLen(data.size(), data.data()));
+                RESULT_OK_AND_ASSIGN(auto compressed_size, serial->Compress(data.size(), data.data(),
+                                                                            compressed.size(), compressed.data()));
+                compressed.resize(compressed_size);
+
+                // two concatenated streams, as pbzip2 writes them
+                std::vector<uint8_t> twice(compressed);
+                twice.insert(twice.end(), compressed.begin(), compressed.end());
+                std::vector<uint8_t> expected(data);
+                expected.insert(expected.end(), data.begin(), data.end());
+
+                std::vector<uint8_t> decompressed(expected.size());
+                RESULT_OK_AND_ASSIGN(auto decompressed_size, parallel->Decompress(twice.size(), twice.data(),
+                                                                                  decompressed.size(),
+                                                                                  decompressed.data()));
+                ASSERT_EQ(expected.size(), decompressed_size);
+                ASSERT_EQ(expected, decompressed);
+
+                CheckStreamingDecompressor(parallel.get(), data);
+            }
+        }
+
+        // output buffer one byte short
+        auto data = MakeCompressibleData(300000);
+        std::vector<uint8_t> compressed(serial->MaxCompressedLen(data.size(), data.data()));
+        RESULT_OK_AND_ASSIGN(auto compressed_size, serial->Compress(data.size(), data.data(),
+                                                                    compressed.size(), compressed.data()));
+        std::vector<uint8_t> decompressed(data.size() - 1);
+        ASSERT_FALSE(parallel->Decompress(compressed_size, compressed.data(),
+                                          decompressed.size(), decompressed.data()).ok());
+    }
+
+    TEST(TestCodecBZ2, ParallelDecompressFalseEndOfStreamMagic) {
+        // The symbol bitmap of a block is stored as is: with the byte ranges
+        // 3,5,6,7,9,10,11,14 in use, bytes 0x31,0x35,0x37,0x3a-0x3c of range 3 and
+        // 0x51,0x53,0x58,0x5b of range 5, it reads 0x1772 0x4538 0x5090, the end
+        // of stream magic, in the middle of every block.
+        const uint8_t alphabet[] = {0x31, 0x35, 0x37, 0x3a, 0x3b, 0x3c, 0x51, 0x53,
+                                    0x58, 0x5b, 0x60, 0x70, 0x90, 0xa0, 0xb0, 0xe0};
+        std::vector<uint8_t> data(300000);
+        for (uint64_t i = 0; i < data.size(); ++i) {
+            // no run of 4, which would add run lengths to the symbols
+            data[i] = alphabet[(i * 7 + i / 16 * 5 + i * i % 13) % 16];
+        }
+        BZ2CodecOptions options;
+        options.compression_level = 1;
+        RESULT_OK_AND_ASSIGN(auto serial, Codec::Create(CompressionType::BZ2, options));
+        options.decompression_threads = 4;
+        RESULT_OK_AND_ASSIGN(auto parallel, Codec::Create(CompressionType::BZ2, options));
+        std::vector<uint8_t> compressed(serial->MaxCompressedLen(data.size(), data.data()));
+        RESULT_OK_AND_ASSIGN(auto compressed_size, serial->Compress(data.size(), data.data(),
+                                                                    compressed.size(), compressed.data()));
+        compressed.resize(compressed_size);
+
+        int end_magics = 0;
+        uint64_t reg = 0;
+        for (uint64_t bit = 0; bit < compressed.size() * 8; ++bit) {
+            reg = (reg << 1) | ((compressed[bit / 8] >> (7 - bit % 8)) & 1);
+            end_magics += bit >= 47 && (reg & ((uint64_t{1} << 48) - 1)) == 0x177245385090ULL;
+        }
+        ASSERT_GT(end_magics, 1);
+
+        std::vector<uint8_t> decompressed(data.size());
+        RESULT_OK_AND_ASSIGN(auto decompressed_size, parallel->Decompress(compressed.size(), compressed.data(),
+                                                                          decompressed.size(),
+                                                                          decompressed.data()));
+        ASSERT_EQ(data.size(), decompressed_size);
+        ASSERT_EQ(data, decompressed);
+        CheckStreamingDecompressor(parallel.get(), data);
+    }
+#endif
+
+#ifdef ENABLE_LZO
+    TEST(TestCodecLZO, HadoopBlockFraming) {
+        RESULT_OK_AND_ASSIGN(auto codec, Codec::Create(CompressionType::LZO));
+        // 600000 bytes span three 256KB Hadoop blocks
+        auto data = MakeCompressibleData(600000);
+        std::vector<uint8_t> compressed(codec->MaxCompressedLen(data.size(), data.data()));
+        RESULT_OK_AND_ASSIGN(auto compressed_size, codec->Compress(data.size(), data.data(),
+                                                                   compressed.size(), compressed.data()));
+        compressed.resize(compressed_size);
+        // big-endian block decompressed size, then the first chunk compressed size
+        ASSERT_EQ(std::vector<uint8_t>({0x00, 0x04, 0x00, 0x00}),
+                  std::vector<uint8_t>(compressed.begin(), compressed.begin() + 4));
+
+        std::vector<uint8_t> decompressed(data.size());
+        RESULT_OK_AND_ASSIGN(auto decompressed_size, codec->Decompress(compressed.size(), compressed.data(),
+                                                                       decompressed.size(), decompressed.data()));
+        ASSERT_EQ(data.size(), decompressed_size);
+        ASSERT_EQ(data, decompressed);
+    }
+
+    TEST(TestCodecLZO, LzopStreamFormat) {
+        RESULT_OK_AND_ASSIGN(auto codec, Codec::Create(CompressionType::LZO));
+        RESULT_OK_AND_ASSIGN(auto compressor, codec->MakeCompressor());
+        auto data = MakeCompressibleData(300000);
+        auto compressed = StreamingCompressAll(compressor.get(), data);
+
+        const std::vector<uint8_t> magic = {0x89, 'L', 'Z', 'O', 0x00, 0x0d, 0x0a, 0x1a, 0x0a};
+        ASSERT_EQ(magic, std::vector<uint8_t>(compressed.begin(), compressed.begin() + magic.size()));
+        // end of stream marker
+        ASSERT_EQ(std::vector<uint8_t>(4, 0), std::vector<uint8_t>(compressed.end() - 4, compressed.end()));
+
+        RESULT_OK_AND_ASSIGN(auto decompressor, codec->MakeDecompressor());
+        RESULT_OK_AND_ASSIGN(auto decompressed, StreamingDecompressAll(decompressor.get(), compressed));
+        ASSERT_EQ(data, decompressed);
+
+        // A flipped bit in the block data must be caught by the adler32 checksums
+        compressed[compressed.size() - 8] ^= 0x01;
+        ASSERT_TRUE(decompressor->Reset().ok());
+        ASSERT_FALSE(StreamingDecompressAll(decompressor.get(), compressed).ok());
+    }
+#endif
+
 #ifdef ENABLE_LZ4
     TEST(TestCodecLZ4Hadoop, Compatibility) {
       // LZ4 Hadoop codec should be able to read back LZ4 raw blocks
@@ -774,4 +1271,239 @@ namespace alkaid {
     }
 #endif
 
+    TEST(TestFilter, Roundtrip) {
+        for (int32_t type_size: {1, 2, 3, 4, 8, 16}) {
+            for (int64_t length: {0, 5, 100, 1023, 4096 + 7}) {
+                auto data = MakeRandomData(static_cast<int>(length));
+                const int64_t count = length / type_size;
+                for (auto filter: {FilterType::BYTE_SHUFFLE, FilterType::BIT_SHUFFLE, FilterType::DELTA,
+                                   FilterType::XOR}) {
+                    std::vector<uint8_t> filtered(length), reverted(length);
+                    auto status = ApplyFilter(filter, type_size, data.data(), length, filtered.data());
+                    if ((filter == FilterType::DELTA || filter == FilterType::XOR) &&
+                        (type_size == 3 || type_size == 16)) {
+                        ASSERT_FALSE(status.ok());
+                        continue;
+                    }
+                    ASSERT_TRUE(status.ok());
+                    if (filter == FilterType::BYTE_SHUFFLE) {
+                        for (int64_t i = 0; i < count * type_size; ++i) {
+                            ASSERT_EQ(data[i], filtered[(i % type_size) * count + i / type_size]);
+                        }
+                    } else if (filter == FilterType::BIT_SHUFFLE) {
+                        // bit b of byte j of element i goes to bit i of plane 8 * j + b
+                        const int64_t bit_count = count & ~int64_t{7};
+                        for (int64_t i = 0; i < bit_count; ++i) {
+                            for (int32_t j = 0; j < type_size; ++j) {
+                                for (int b = 0; b < 8; ++b) {
+                                    int64_t bit = (8 * j + b) * bit_count + i;
+                                    ASSERT_EQ((data[i * type_size + j] >> b) & 1,
+                                              (filtered[bit / 8] >> (bit % 8)) & 1);
+                                }
+                            }
+                        }
+                    }
+                    ASSERT_TRUE(RevertFilter(filter, type_size, filtered.data(), length, reverted.data()).ok());
+                    ASSERT_EQ(data, reverted);
+                }
+            }
+        }
+    }
+
+    TEST(TestFilter, FilteredCodec) {
+        if (!Codec::IsAvailable(CompressionType::ZSTD)) {
+            GTEST_SKIP() << "Test requires ZSTD compression";
+        }
+        // timestamps with jitter, followed by a partial element
+        std::default_random_engine engine(42);
+        std::uniform_int_distribution<int64_t> jitter(0, 1000);
+        std::vector<uint8_t> data;
+        int64_t ts = 1717000000000000;
+        for (int i = 0; i < 20000; ++i) {
+            ts += 1000000 + jitter(engine);
+            data.insert(data.end(), reinterpret_cast<uint8_t *>(&ts), reinterpret_cast<uint8_t *>(&ts) + 8);
+        }
+        data.push_back(42);
+
+        auto compress = [&](Codec *codec) -> std::vector<uint8_t> {
+            std::vector<uint8_t> compressed(codec->MaxCompressedLen(data.size(), data.data()));
+            auto compressed_len = *codec->Compress(data.size(), data.data(), compressed.size(), compressed.data());
+            compressed.resize(compressed_len);
+            return compressed;
+        };
+        RESULT_OK_AND_ASSIGN(auto plain, Codec::Create(CompressionType::ZSTD));
+        auto plain_size = compress(plain.get()).size();
+
+        for (const auto &filters: std::vector<std::vector<FilterType>>{
+                {FilterType::BYTE_SHUFFLE},
+                {FilterType::DELTA, FilterType::BYTE_SHUFFLE},
+                {FilterType::DELTA, FilterType::BIT_SHUFFLE},
+                {FilterType::XOR, FilterType::DELTA, FilterType::BYTE_SHUFFLE}}) {
+            RESULT_OK_AND_ASSIGN(auto codec, MakeFilteredCodec(*Codec::Create(CompressionType::ZSTD), filters, 8));
+            auto compressed = compress(codec.get());
+            ASSERT_LT(compressed.size(), plain_size);
+
+            std::vector<uint8_t> decompressed(data.size());
+            RESULT_OK_AND_ASSIGN(auto decompressed_len, codec->Decompress(compressed.size(), compressed.data(),
+                                                                          decompressed.size(), decompressed.data()));
+            ASSERT_EQ(static_cast<int64_t>(data.size()), decompressed_len);
+            ASSERT_EQ(data, decompressed);
+            RESULT_OK_AND_ASSIGN(decompressed, codec->Decompress(compressed.size(), compressed.data()));
+            ASSERT_EQ(data, decompressed);
+        }
+
+        ASSERT_FALSE(MakeFilteredCodec(*Codec::Create(CompressionType::ZSTD), {FilterType::DELTA}, 3).ok());
+        RESULT_OK_AND_ASSIGN(auto unfiltered, MakeFilteredCodec(*Codec::Create(CompressionType::ZSTD), {}, 8));
+        ASSERT_FALSE(unfiltered->MakeCompressor().ok());
+    }
+
+    TEST(TestIntegerCodec, Roundtrip) {
+        std::default_random_engine engine(7);
+        for (int value_size: {4, 8}) {
+            IntegerCodecOptions options;
+            options.value_size = value_size;
+            // mixed widths, negative values, sorted ids and a constant run
+            std::vector<int64_t> values;
+            for (int bits: {0, 1, 7, 13, 31, 33, 63}) {
+                std::uniform_int_distribution<int64_t> dist(-(int64_t{1} << (bits / 2)), int64_t{1} << bits);
+                for (int i = 0; i < 300; ++i) {
+                    values.push_back(dist(engine));
+                }
+            }
+            for (int i = 0; i < 1000; ++i) {
+                values.push_back(1000000 + 3 * i);
+            }
+            values.insert(values.end(), 200, std::numeric_limits<int64_t>::min());
+            values.insert(values.end(), 200, std::numeric_limits<int64_t>::max());
+            std::vector<uint8_t> data;
+            for (auto v: values) {
+                data.insert(data.end(), reinterpret_cast<uint8_t *>(&v), reinterpret_cast<uint8_t *>(&v) + value_size);
+            }
+
+            for (auto type: {CompressionType::FRAME_OF_REFERENCE, CompressionType::DELTA_ZIGZAG,
+                             CompressionType::STREAM_VBYTE}) {
+                ASSERT_TRUE(Codec::IsAvailable(type));
+                RESULT_OK_AND_ASSIGN(auto codec, Codec::Create(type, options));
+                for (int64_t length: {int64_t{0}, int64_t{3}, int64_t{value_size * 129 + 2},
+                                      static_cast<int64_t>(data.size())}) {
+                    std::vector<uint8_t> compressed(codec->MaxCompressedLen(length, data.data()));
+                    RESULT_OK_AND_ASSIGN(auto compressed_len, codec->Compress(length, data.data(),
+                                                                              compressed.size(),
+                                                                              compressed.data()));
+                    ASSERT_EQ(codec->DecompressedLength(compressed_len, compressed.data()), length);
+                    std::vector<uint8_t> decompressed(length);
+                    RESULT_OK_AND_ASSIGN(auto decompressed_len,
+                                         codec->Decompress(compressed_len, compressed.data(),
+                                                           decompressed.size(), decompressed.data()));
+                    ASSERT_EQ(decompressed_len, length);
+                    ASSERT_TRUE(std::equal(decompressed.begin(), decompressed.end(), data.begin()));
+                    // truncated input is rejected
+                    if (compressed_len > 10) {
+                        ASSERT_FALSE(codec->Decompress(compressed_len - 1, compressed.data(),
+                                                       decompressed.size(), decompressed.data()).ok());
+                    }
+                }
+                ASSERT_FALSE(codec->MakeCompressor().ok());
+            }
+        }
+
+        IntegerCodecOptions bad_options;
+        bad_options.value_size = 2;
+        ASSERT_FALSE(Codec::Create(CompressionType::STREAM_VBYTE, bad_options).ok());
+        ASSERT_EQ(*Codec::GetCompressionType("delta_zigzag"), CompressionType::DELTA_ZIGZAG);
+    }
+
+    TEST(TestIntegerCodec, SortedValuesCompress) {
+        std::vector<uint32_t> ids;
+        for (uint32_t i = 0; i < 100000; ++i) {
+            ids.push_back(5000000 + 7 * i + (i % 3));
+        }
+        const auto *data = reinterpret_cast<const uint8_t *>(ids.data());
+        const int64_t length = ids.size() * sizeof(uint32_t);
+        for (auto type: {CompressionType::FRAME_OF_REFERENCE, CompressionType::DELTA_ZIGZAG,
+                         CompressionType::STREAM_VBYTE}) {
+            RESULT_OK_AND_ASSIGN(auto codec, Codec::Create(type));
+            std::vector<uint8_t> compressed(codec->MaxCompressedLen(length, data));
+            RESULT_OK_AND_ASSIGN(auto compressed_len, codec->Compress(length, data, compressed.size(),
+                                                                      compressed.data()));
+            ASSERT_LT(compressed_len, length);
+            if (type == CompressionType::DELTA_ZIGZAG) {
+                // deltas of 7 to 9 zigzag into 4 bits
+                ASSERT_LT(compressed_len, length / 6);
+            }
+        }
+    }
+
+    TEST(TestCodecMetrics, CountsCodecCalls) {
+        if (!Codec::IsAvailable(CompressionType::ZSTD)) {
+            GTEST_SKIP() << "Test requires ZSTD compression";
+        }
+        auto find = [](CompressionType type, int level) -> std::optional<CodecMetricsSnapshot> {
+            for (const auto &snapshot: CodecMetrics::snapshot()) {
+                if (snapshot.compression == type && snapshot.compression_level == level) {
+                    return snapshot;
+                }
+            }
+            return std::nullopt;
+        };
+        std::vector<uint8_t> data = MakeCompressibleData(100000);
+
+        // codecs created while disabled are not counted
+        RESULT_OK_AND_ASSIGN(auto plain, Codec::Create(CompressionType::ZSTD, 5));
+        std::vector<uint8_t> compressed(plain->MaxCompressedLen(data.size(), data.data()));
+        ASSERT_TRUE(plain->Compress(data.size(), data.data(), compressed.size(), compressed.data()).ok());
+        ASSERT_FALSE(find(CompressionType::ZSTD, 5).has_value());
+
+        CodecMetrics::set_enabled(true);
+        RESULT_OK_AND_ASSIGN(auto codec, Codec::Create(CompressionType::ZSTD, 5));
+        CodecMetrics::set_enabled(false);
+        ASSERT_EQ(codec->compression_type(), CompressionType::ZSTD);
+        ASSERT_EQ(codec->compression_level(), 5);
+        RESULT_OK_AND_ASSIGN(auto compressed_len, codec->Compress(data.size(), data.data(), compressed.size(),
+                                                                  compressed.data()));
+        RESULT_OK_AND_ASSIGN(auto decompressed, codec->Decompress(compressed_len, compressed.data()));
+        ASSERT_EQ(decompressed, data);
+        turbo::Cord streamed;
+        ASSERT_TRUE(codec->Compress(turbo::Cord(std::string_view(reinterpret_cast<const char *>(data.data()),
+                                                                 data.size())), &streamed).ok());
+
+        auto snapshot = find(CompressionType::ZSTD, 5);
+        ASSERT_TRUE(snapshot.has_value());
+        ASSERT_GE(snapshot->compress.calls, 2);
+        ASSERT_EQ(snapshot->compress.bytes_in, 2 * data.size());
+        ASSERT_GT(snapshot->compression_ratio(), 1.0);
+        ASSERT_EQ(snapshot->decompress.calls, 1);
+        ASSERT_EQ(snapshot->decompress.bytes_in, static_cast<uint64_t>(compressed_len));
+        ASSERT_EQ(snapshot->decompress.bytes_out, data.size());
+        uint64_t histogram_calls = 0;
+        for (auto count: snapshot->compress.latency_histogram) {
+            histogram_calls += count;
+        }
+        ASSERT_EQ(histogram_calls, snapshot->compress.calls);
+
+        CodecMetrics::reset();
+        ASSERT_EQ(find(CompressionType::ZSTD, 5)->compress.calls, 0);
+    }
+
+    TEST(TestChecksum, KnownValues) {
+        ASSERT_EQ(crc32c::value("123456789", 9), 0xe3069283u);
+        ASSERT_EQ(xxh3::hash64("", 0), 0x2d06800538d394c2ull);
+        ASSERT_EQ(xxh3::hash64("123456789", 9), 0x72dcb18b67a17dffull);
+
+        std::vector<uint8_t> data(100000);
+        for (size_t i = 0; i < data.size(); ++i) {
+            data[i] = static_cast<uint8_t>(i * 31 + 7);
+        }
+        // long enough for the interleaved crc32c streams, and xxh3 past 240 bytes
+        ASSERT_EQ(crc32c::value(data.data(), data.size()), 0xf3cb210bu);
+        ASSERT_EQ(xxh3::hash64(data.data(), 200), 0x12fdb864685f344dull);
+        ASSERT_EQ(xxh3::hash64(data.data(), 1000), 0x989765d0ea7a5ecdull);
+        // extend() over pieces equals the crc of the whole
+        uint32_t crc = 0;
+        for (size_t pos = 0; pos < data.size(); pos += 777) {
+            crc = crc32c::extend(crc, data.data() + pos, std::min<size_t>(777, data.size() - pos));
+        }
+        ASSERT_EQ(crc, 0xf3cb210bu);
+    }
+
 }  // namespace alkaid
@@ -19,9 +19,28 @@
 // Created by jeff on 24-6-10.
 //
 
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+#include <sys/stat.h>
+
 #include <gtest/gtest.h>
 
 #include <alkaid/files/filesystem.h>
+#include <alkaid/files/local/random_read_file.h>
+#include <alkaid/files/local/random_read_mmap_file.h>
+#include <alkaid/files/bgzf_file.h>
+#include <alkaid/files/cachingfs.h>
+#include <alkaid/files/checksum_file.h>
+#include <alkaid/files/compressed_file.h>
+#include <alkaid/files/external_sort.h>
+#include <alkaid/files/memfs.h>
+#include <alkaid/files/rate_limiter.h>
+#include <alkaid/files/record_log.h>
+#include <alkaid/files/rolling_file.h>
+#include <alkaid/files/spill_buffer.h>
 
 TEST(FileSystemTest, SequentialReadMMapFile) {
     auto fs = alkaid::Filesystem::localfs();
@@ -52,4 +71,846 @@ TEST(FileSystemTest, SequentialReadMMapFile) {
     EXPECT_TRUE(read_size.ok());
     EXPECT_EQ(read_size.value(), 1024);
     EXPECT_EQ(memcmp(buff, read_buff, 1024), 0);
-}
\ No newline at end of file
+}
+
+TEST(FileSystemTest, BgzfFile) {
+    auto fs = alkaid::Filesystem::localfs();
+    std::string data;
+    for (int i = 0; i < 100000; ++i) {
+        data += "chr1\t" + std::to_string(i * 7919 % 1000003) + "\tA\tG\n";
+    }
+
+    alkaid::BgzfWriteOptions write_options;
+    write_options.threads = 4;
+    write_options.file_options = alkaid::lfs::kDefaultTruncateWriteOption;
+    alkaid::BgzfFileWriter writer(fs->create_sequential_write_file().value(),
+                                  fs->create_sequential_write_file().value());
+    auto status = writer.open("test.bgz", write_options, {});
+    ASSERT_TRUE(status.ok()) << status.message();
+    std::vector<std::pair<size_t, uint64_t>> marks;
+    for (size_t pos = 0; pos < data.size(); pos += 100000) {
+        auto voffset = writer.virtual_tell();
+        ASSERT_TRUE(voffset.ok());
+        marks.emplace_back(pos, voffset.value());
+        ASSERT_TRUE(writer.append(data.data() + pos, std::min<size_t>(100000, data.size() - pos)).ok());
+    }
+    ASSERT_TRUE(writer.close().ok());
+
+    // sequential, blocks inflated ahead on a pool
+    alkaid::BgzfReadOptions read_options;
+    read_options.threads = 4;
+    alkaid::BgzfFileReader reader(fs->create_sequential_read_file().value());
+    ASSERT_TRUE(reader.open("test.bgz", read_options, {}).ok());
+    std::string content(data.size() + 1, '\0');
+    auto read_size = reader.read(content.data(), content.size());
+    ASSERT_TRUE(read_size.ok());
+    ASSERT_EQ(read_size.value(), data.size());
+    content.resize(read_size.value());
+    EXPECT_EQ(content, data);
+
+    // random access through virtual offsets and through the .gzi index
+    alkaid::BgzfRandomReadFile random(fs->create_random_read_mmap_file().value(),
+                                      fs->create_random_read_mmap_file().value());
+    ASSERT_TRUE(random.open("test.bgz", std::any(), {}).ok());
+    ASSERT_TRUE(random.has_index());
+    EXPECT_EQ(random.size().value(), data.size());
+    for (auto &[pos, voffset]: marks) {
+        std::string chunk;
+        ASSERT_TRUE(random.read_at(static_cast<off_t>(voffset), &chunk, 1000).ok());
+        EXPECT_EQ(chunk, data.substr(pos, 1000));
+    }
+    char buff[100];
+    auto rs = random.read_uncompressed_at(data.size() - 50, buff, sizeof(buff));
+    ASSERT_TRUE(rs.ok());
+    ASSERT_EQ(rs.value(), 50);
+    EXPECT_EQ(std::string(buff, 50), data.substr(data.size() - 50));
+}
+
+TEST(FileSystemTest, CompressedFileWriter) {
+    if (!alkaid::Codec::IsAvailable(alkaid::CompressionType::ZSTD)) {
+        GTEST_SKIP() << "Test requires ZSTD compression";
+    }
+    auto fs = alkaid::Filesystem::localfs();
+    std::string data;
+    for (int i = 0; i < 100000; ++i) {
+        data += "row " + std::to_string(i * 7919 % 1000003) + "\n";
+    }
+
+    alkaid::CompressedWriteOptions write_options;
+    write_options.compression = alkaid::CompressionType::ZSTD;
+    write_options.block_size = 64 * 1024;
+    write_options.threads = 4;
+    write_options.file_options = alkaid::lfs::kDefaultTruncateWriteOption;
+    alkaid::CompressedFileWriter writer(fs->create_sequential_write_file().value());
+    ASSERT_TRUE(writer.open("test.zst", write_options, {}).ok());
+    for (size_t pos = 0; pos < data.size(); pos += 10000) {
+        ASSERT_TRUE(writer.append(data.data() + pos, std::min<size_t>(10000, data.size() - pos)).ok());
+    }
+    EXPECT_EQ(writer.size().value(), data.size());
+    ASSERT_TRUE(writer.close().ok());
+
+    // the blocks are zstd frames back to back, which decompress as one stream
+    auto read_file = fs->create_sequential_read_file().value();
+    ASSERT_TRUE(read_file->open("test.zst").ok());
+    std::string compressed;
+    ASSERT_TRUE(read_file->read(&compressed, alkaid::kInfiniteFileSize).ok());
+    EXPECT_EQ(compressed.size(), writer.compressed_size());
+    auto codec = alkaid::Codec::Create(alkaid::CompressionType::ZSTD).value();
+    auto decompressor = codec->MakeDecompressor().value();
+    turbo::Cord content;
+    ASSERT_TRUE(decompressor->Decompress(turbo::Cord(compressed), &content).ok());
+    EXPECT_EQ(std::string(content), data);
+}
+
+TEST(FileSystemTest, ChecksumFile) {
+    auto fs = alkaid::Filesystem::localfs();
+    std::string data;
+    for (int i = 0; i < 50000; ++i) {
+        data += std::to_string(i * 7919 % 1000003) + ",";
+    }
+
+    for (auto type: {alkaid::ChecksumType::CRC32C, alkaid::ChecksumType::XXH3}) {
+        for (bool sidecar: {false, true}) {
+            alkaid::ChecksumOptions options;
+            options.type = type;
+            options.block_size = 4096;
+            auto write_options = options;
+            write_options.file_options = alkaid::lfs::kDefaultTruncateWriteOption;
+            alkaid::ChecksumFileWriter writer(fs->create_sequential_write_file().value(),
+                                              sidecar ? fs->create_sequential_write_file().value() : nullptr);
+            ASSERT_TRUE(writer.open("test.sum", write_options, {}).ok());
+            for (size_t pos = 0; pos < data.size(); pos += 10000) {
+                ASSERT_TRUE(writer.append(data.data() + pos, std::min<size_t>(10000, data.size() - pos)).ok());
+            }
+            ASSERT_TRUE(writer.close().ok());
+
+            alkaid::ChecksumFileReader reader(fs->create_sequential_read_file().value(),
+                                              sidecar ? fs->create_sequential_read_file().value() : nullptr);
+            ASSERT_TRUE(reader.open("test.sum", options, {}).ok());
+            EXPECT_EQ(reader.size().value(), data.size());
+            std::string content;
+            ASSERT_TRUE(reader.read(&content, alkaid::kInfiniteFileSize).ok());
+            EXPECT_EQ(content, data);
+
+            alkaid::ChecksumRandomReadFile random(fs->create_random_read_mmap_file().value(),
+                                                  sidecar ? fs->create_random_read_mmap_file().value() : nullptr);
+            ASSERT_TRUE(random.open("test.sum", options, {}).ok());
+            std::string chunk;
+            ASSERT_TRUE(random.read_at(5000, &chunk, 10000).ok());
+            EXPECT_EQ(chunk, data.substr(5000, 10000));
+            ASSERT_TRUE(random.close().ok());
+
+            // a flipped byte in the second block fails the reads covering it
+            std::string raw;
+            ASSERT_TRUE(fs->read_file("test.sum", &raw).ok());
+            raw[5000] ^= 0x20;
+            ASSERT_TRUE(fs->write_file("test.sum", raw).ok());
+            ASSERT_TRUE(random.open("test.sum", options, {}).ok());
+            chunk.clear();
+            ASSERT_TRUE(random.read_at(0, &chunk, 100).ok());
+            auto rs = random.read_at(4096, &chunk, 100);
+            ASSERT_FALSE(rs.ok());
+            EXPECT_EQ(rs.status().code(), turbo::StatusCode::kDataLoss);
+        }
+    }
+}
+
+TEST(FileSystemTest, RecordLog) {
+    auto fs = alkaid::Filesystem::localfs();
+    std::vector<std::string> records;
+    for (int i = 0; i < 200; ++i) {
+        // every tenth record spans several blocks
+        records.push_back(std::string(i % 10 == 0 ? 70000 + i : i, static_cast<char>('a' + i % 26)));
+    }
+
+    auto file = fs->create_sequential_write_file().value();
+    ASSERT_TRUE(file->open("test.log", alkaid::lfs::kDefaultTruncateWriteOption, {}).ok());
+    alkaid::RecordLogWriter writer(file);
+    for (size_t i = 0; i < records.size(); i += 4) {
+        std::vector<std::string_view> batch(records.begin() + i, records.begin() + i + 4);
+        ASSERT_TRUE(writer.add_records(batch).ok());
+    }
+    ASSERT_TRUE(file->close().ok());
+
+    std::string raw;
+    ASSERT_TRUE(fs->read_file("test.log", &raw).ok());
+    EXPECT_EQ(raw.size(), writer.size());
+
+    auto read_all = [&](size_t *dropped) {
+        alkaid::RecordLogReaderOptions options;
+        options.corruption_reporter = [dropped](size_t bytes, const turbo::Status &) { *dropped += bytes; };
+        auto reader_file = fs->create_sequential_read_file().value();
+        EXPECT_TRUE(reader_file->open("test.log", {}, {}).ok());
+        alkaid::RecordLogReader reader(reader_file, options);
+        std::vector<std::string> result;
+        std::string record;
+        while (reader.read_record(&record).value()) {
+            result.push_back(record);
+        }
+        return result;
+    };
+
+    size_t dropped = 0;
+    EXPECT_EQ(read_all(&dropped), records);
+    EXPECT_EQ(dropped, 0);
+
+    // a torn tail is dropped silently
+    ASSERT_TRUE(fs->write_file("test.log", raw.substr(0, raw.size() - 10)).ok());
+    auto result = read_all(&dropped);
+    EXPECT_EQ(result.size(), records.size() - 1);
+    EXPECT_EQ(dropped, 0);
+
+    // a corrupted block costs only the records in it
+    raw[alkaid::record_log::kBlockSize + 100] ^= 0x20;
+    ASSERT_TRUE(fs->write_file("test.log", raw).ok());
+    result = read_all(&dropped);
+    EXPECT_GT(dropped, 0);
+    EXPECT_LT(result.size(), records.size());
+    EXPECT_EQ(result.back(), records.back());
+}
+
+TEST(FileSystemTest, CompressedRecordLog) {
+    if (!alkaid::Codec::IsAvailable(alkaid::CompressionType::ZSTD)) {
+        GTEST_SKIP() << "Test requires ZSTD compression";
+    }
+    auto fs = alkaid::Filesystem::localfs();
+    std::vector<std::string> records;
+    for (int i = 0; i < 100; ++i) {
+        records.push_back(std::string(i % 10 == 0 ? 70000 + i : i, static_cast<char>('a' + i % 26)));
+    }
+
+    auto read_all = [&]() {
+        auto reader_file = fs->create_sequential_read_file().value();
+        EXPECT_TRUE(reader_file->open("compressed.log", {}, {}).ok());
+        alkaid::RecordLogReader reader(reader_file);
+        std::vector<std::string> result;
+        std::string record;
+        while (true) {
+            auto more = reader.read_record(&record);
+            EXPECT_TRUE(more.ok());
+            if (!more.ok() || !more.value()) {
+                break;
+            }
+            result.push_back(record);
+        }
+        return result;
+    };
+
+    alkaid::RecordLogWriterOptions options;
+    options.compression = alkaid::CompressionType::ZSTD;
+    auto file = fs->create_sequential_write_file().value();
+    ASSERT_TRUE(file->open("compressed.log", alkaid::lfs::kDefaultTruncateWriteOption, {}).ok());
+    alkaid::RecordLogWriter writer(file, options);
+    for (size_t i = 0; i < 50; ++i) {
+        ASSERT_TRUE(writer.add_record(records[i]).ok());
+    }
+    ASSERT_TRUE(file->close().ok());
+    // the repetitive records compress well
+    EXPECT_LT(writer.size(), 50 * 7000);
+    EXPECT_EQ(read_all(), std::vector<std::string>(records.begin(), records.begin() + 50));
+
+    // an uncompressed session appended to the compressed log
+    file = fs->create_sequential_write_file().value();
+    ASSERT_TRUE(file->open("compressed.log", alkaid::lfs::kDefaultAppendWriteOption, {}).ok());
+    alkaid::RecordLogWriter appender(file, alkaid::RecordLogWriterOptions(), writer.size());
+    for (size_t i = 50; i < records.size(); ++i) {
+        ASSERT_TRUE(appender.add_record(records[i]).ok());
+    }
+    ASSERT_TRUE(file->close().ok());
+    EXPECT_EQ(read_all(), records);
+    ASSERT_TRUE(fs->remove("compressed.log").ok());
+}
+
+TEST(FileSystemTest, RollingFileWriter) {
+    if (!alkaid::Codec::IsAvailable(alkaid::CompressionType::ZSTD)) {
+        GTEST_SKIP() << "Test requires ZSTD compression";
+    }
+    auto fs = alkaid::Filesystem::localfs();
+    ASSERT_TRUE(fs->remove_all_if_exists("rolling").ok());
+    ASSERT_TRUE(fs->create_directories("rolling").ok());
+
+    alkaid::RollingWriteOptions options;
+    options.max_segment_size = 10000;
+    options.max_segments = 3;
+    options.compression = alkaid::CompressedWriteOptions();
+    options.file_options = alkaid::lfs::kDefaultTruncateWriteOption;
+    std::string line(1000, 'x');
+    for (int round = 0; round < 2; ++round) {
+        alkaid::RollingFileWriter writer;
+        ASSERT_TRUE(writer.open("rolling/events.log", options, {}).ok());
+        for (int i = 0; i < 50; ++i) {
+            ASSERT_TRUE(writer.append(line).ok());
+        }
+        EXPECT_EQ(writer.size().value(), 50000);
+        ASSERT_TRUE(writer.close().ok());
+    }
+
+    // the numbering goes on across opens, and only the newest segments are kept
+    std::vector<std::string> files;
+    ASSERT_TRUE(fs->list_files("rolling", files, false).ok());
+    std::sort(files.begin(), files.end());
+    EXPECT_EQ(files, std::vector<std::string>({"events.log.000008.zstd", "events.log.000009.zstd",
+                                               "events.log.000010.zstd"}));
+    std::string compressed;
+    ASSERT_TRUE(fs->read_file("rolling/events.log.000010.zstd", &compressed).ok());
+    auto codec = alkaid::Codec::Create(alkaid::CompressionType::ZSTD).value();
+    std::string segment(10000, '\0');
+    auto n = codec->Decompress(compressed.size(), reinterpret_cast<const uint8_t *>(compressed.data()),
+                               segment.size(), reinterpret_cast<uint8_t *>(segment.data()));
+    ASSERT_TRUE(n.ok());
+    EXPECT_EQ(segment, std::string(10000, 'x'));
+    ASSERT_TRUE(fs->remove_all("rolling").ok());
+}
+
+TEST(FileSystemTest, ExternalSort) {
+    auto fs = alkaid::Filesystem::localfs();
+    std::vector<std::string> lines;
+    std::string data = "key,value\n";
+    for (int i = 0; i < 20000; ++i) {
+        lines.push_back(std::to_string(i * 7919 % 10007) + "," + std::to_string(i));
+        data += lines.back() + "\n";
+    }
+    ASSERT_TRUE(fs->write_file("sort_input.csv", data).ok());
+    // ordered on the key only, equal keys keep the input order
+    auto less = [](std::string_view a, std::string_view b) {
+        return std::stoi(std::string(a.substr(0, a.find(',')))) < std::stoi(std::string(b.substr(0, b.find(','))));
+    };
+    std::stable_sort(lines.begin(), lines.end(), less);
+    std::string expected = "key,value\n";
+    for (auto &line: lines) {
+        expected += line + "\n";
+    }
+
+    for (bool compress: {false, true}) {
+        alkaid::ExternalSortOptions options;
+        options.format = alkaid::RecordFormat::CSV;
+        options.has_header = true;
+        options.less = less;
+        options.memory_budget = 64 * 1024;
+        options.max_merge_fan_in = 4;
+        options.compress_runs = compress;
+        options.threads = 2;
+        options.temp_prefix = "sort-";
+        alkaid::ExternalSorter sorter(options);
+
+        auto input = fs->create_sequential_read_file().value();
+        ASSERT_TRUE(input->open("sort_input.csv", {}, {}).ok());
+        auto output = fs->create_sequential_write_file().value();
+        ASSERT_TRUE(output->open("sort_output.csv", alkaid::lfs::kDefaultTruncateWriteOption, {}).ok());
+        ASSERT_TRUE(sorter.sort(input.get(), output.get()).ok());
+        ASSERT_TRUE(output->close().ok());
+
+        EXPECT_EQ(sorter.stats().records, lines.size());
+        EXPECT_GT(sorter.stats().runs, 4);
+        EXPECT_GT(sorter.stats().merge_passes, 1);
+        std::string sorted;
+        ASSERT_TRUE(fs->read_file("sort_output.csv", &sorted).ok());
+        EXPECT_EQ(sorted, expected);
+    }
+}
+
+TEST(FileSystemTest, SpillBuffer) {
+    std::string data;
+    for (int i = 0; i < 50000; ++i) {
+        data += std::to_string(i * 7919 % 1000003) + ",";
+    }
+
+    for (auto compression: {alkaid::CompressionType::UNCOMPRESSED, alkaid::CompressionType::LZ4}) {
+        if (!alkaid::Codec::IsAvailable(compression)) {
+            continue;
+        }
+        alkaid::SpillBufferOptions options;
+        options.memory_budget = 10000;
+        options.block_size = 4096;
+        options.compression = compression;
+        alkaid::SpillBuffer buffer;
+        ASSERT_TRUE(buffer.open("spill-", options, {}).ok());
+        for (size_t pos = 0; pos < data.size(); pos += 3000) {
+            ASSERT_TRUE(buffer.append(data.data() + pos, std::min<size_t>(3000, data.size() - pos)).ok());
+        }
+        EXPECT_EQ(buffer.size().value(), data.size());
+        EXPECT_LT(buffer.memory_size(), options.memory_budget + options.block_size);
+        EXPECT_GT(buffer.spilled_size(), 0);
+
+        auto reader = buffer.new_reader().value();
+        std::string content;
+        ASSERT_TRUE(reader->read(&content, data.size()).ok());
+        EXPECT_EQ(content, data);
+
+        auto random = buffer.new_random_reader().value();
+        std::string chunk;
+        ASSERT_TRUE(random->read_at(5000, &chunk, 10000).ok());
+        EXPECT_EQ(chunk, data.substr(5000, 10000));
+        chunk.clear();
+        ASSERT_TRUE(random->read_at(data.size() - 100, &chunk, 100).ok());
+        EXPECT_EQ(chunk, data.substr(data.size() - 100));
+
+        auto spill_path = buffer.path();
+        ASSERT_TRUE(buffer.close().ok());
+        EXPECT_FALSE(alkaid::Filesystem::localfs()->exists(spill_path).value());
+    }
+}
+
+TEST(FileSystemTest, TempFile) {
+    auto fs = alkaid::Filesystem::localfs();
+    for (bool anonymous : {true, false}) {
+        alkaid::lfs::TempFileOption option;
+        option.anonymous = anonymous;
+        option.small_and_hot = anonymous;
+        auto file = fs->create_temp_file().value();
+        ASSERT_TRUE(file->open("temp-", option, {}).ok());
+        ASSERT_TRUE(file->append("hello temp file").ok());
+        ASSERT_TRUE(file->flush().ok());
+        std::string content;
+        ASSERT_TRUE(fs->read_file(file->path(), &content).ok());
+        EXPECT_EQ(content, "hello temp file");
+        auto path = file->path();
+        ASSERT_TRUE(file->close().ok());
+        EXPECT_FALSE(fs->exists(path).value());
+    }
+
+    std::string kept = "temp_file_kept.txt";
+    ASSERT_TRUE(fs->remove_if_exists(kept).ok());
+    auto file = fs->create_temp_file().value();
+    ASSERT_TRUE(file->open("temp-", {}, {}).ok());
+    ASSERT_TRUE(file->append("kept").ok());
+    ASSERT_TRUE(file->keep(kept).ok());
+    ASSERT_TRUE(file->close().ok());
+    std::string content;
+    ASSERT_TRUE(fs->read_file(kept, &content).ok());
+    EXPECT_EQ(content, "kept");
+    ASSERT_TRUE(fs->remove(kept).ok());
+}
+
+TEST(FileSystemTest, MemoryFilesystem) {
+    alkaid::MemoryFilesystemOptions options;
+    options.capacity = 1 << 20;
+    alkaid::MemoryFilesystem fs(options);
+    ASSERT_TRUE(fs.create_directories("/data/a").ok());
+    ASSERT_TRUE(fs.write_file("/data/a/x.txt", "hello").ok());
+    ASSERT_TRUE(fs.append_file("/data/a/x.txt", " world").ok());
+    ASSERT_TRUE(fs.write_file("/data/y.txt", "y").ok());
+    EXPECT_FALSE(fs.write_file("/missing/z.txt", "z").ok());
+    EXPECT_EQ(fs.file_size("/data/a/x.txt").value(), 11);
+
+    std::vector<std::string> files;
+    ASSERT_TRUE(fs.list_files("/data", files, false).ok());
+    EXPECT_EQ(files, std::vector<std::string>{"y.txt"});
+    std::vector<std::string> dirs;
+    ASSERT_TRUE(fs.list_directories("/data", dirs).ok());
+    EXPECT_EQ(dirs, std::vector<std::string>{"/data/a"});
+
+    // a large file, read into a Cord while it is overwritten
+    std::string data(300000, '\0');
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i] = static_cast<char>('a' + i % 23);
+    }
+    auto writer = fs.create_random_write_file().value();
+    ASSERT_TRUE(writer->open("/data/big", alkaid::lfs::kDefaultTruncateWriteOption, {}).ok());
+    ASSERT_TRUE(writer->write_at(0, data).ok());
+    auto reader = fs.create_random_read_file().value();
+    ASSERT_TRUE(reader->open("/data/big").ok());
+    turbo::Cord cord;
+    ASSERT_EQ(reader->read_at(1000, cord, 200000).value(), 200000);
+    ASSERT_TRUE(writer->write_at(1000, std::string(200000, '#')).ok());
+    EXPECT_EQ(std::string(cord), data.substr(1000, 200000));
+    std::string content;
+    ASSERT_TRUE(reader->read_at(999, &content, 2).ok());
+    EXPECT_EQ(content, std::string(1, data[999]) + "#");
+    ASSERT_TRUE(writer->close().ok());
+
+    // copies share the blocks until written
+    ASSERT_TRUE(fs.copy_file("/data/big", "/data/big.copy").ok());
+    ASSERT_TRUE(fs.file_resize("/data/big", 10).ok());
+    EXPECT_EQ(fs.file_size("/data/big.copy").value(), data.size());
+    EXPECT_FALSE(fs.write_file("/data/huge", std::string(1 << 20, 'h')).ok());
+
+    ASSERT_TRUE(fs.rename("/data/a", "/moved").ok());
+    EXPECT_TRUE(fs.exists("/moved/x.txt").value());
+    EXPECT_FALSE(fs.exists("/data/a").value());
+    content.clear();
+    ASSERT_TRUE(fs.read_file("/moved/x.txt", &content).ok());
+    EXPECT_EQ(content, "hello world");
+    ASSERT_TRUE(fs.copy_directories("/data", "/backup").ok());
+    EXPECT_TRUE(fs.exists("/backup/y.txt").value());
+
+    // temp files are removed on close, the open readers keep theirs
+    auto temp = fs.create_temp_file().value();
+    ASSERT_TRUE(temp->open("/tmp/spill-").ok());
+    ASSERT_TRUE(temp->append("spilled").ok());
+    auto temp_reader = fs.create_sequential_read_file().value();
+    ASSERT_TRUE(temp_reader->open(temp->path()).ok());
+    auto temp_path = temp->path();
+    ASSERT_TRUE(temp->close().ok());
+    EXPECT_FALSE(fs.exists(temp_path).value());
+    content.clear();
+    ASSERT_TRUE(temp_reader->read(&content, 100).ok());
+    EXPECT_EQ(content, "spilled");
+
+    ASSERT_TRUE(fs.remove_all("/data").ok());
+    ASSERT_TRUE(fs.remove_all("/backup").ok());
+    ASSERT_TRUE(fs.remove_all("/moved").ok());
+    reader.reset();
+    temp_reader.reset();
+    EXPECT_EQ(fs.used_size(), 0);
+}
+
+TEST(FileSystemTest, MemoryFilesystemSiblings) {
+    // "/d.bak" and "/d-old" sort between "/d" and "/d/x"
+    alkaid::MemoryFilesystem fs;
+    ASSERT_TRUE(fs.create_directories("/d/sub").ok());
+    ASSERT_TRUE(fs.write_file("/d/x", "x").ok());
+    ASSERT_TRUE(fs.write_file("/d/sub/y", "y").ok());
+    ASSERT_TRUE(fs.write_file("/d.bak", "bak").ok());
+    ASSERT_TRUE(fs.create_directory("/d-old").ok());
+    EXPECT_FALSE(fs.remove("/d").ok());
+    EXPECT_TRUE(fs.exists("/d/x").value());
+
+    ASSERT_TRUE(fs.create_directory("/e").ok());
+    ASSERT_TRUE(fs.write_file("/e/z", "z").ok());
+    EXPECT_FALSE(fs.rename("/d", "/e").ok());
+    ASSERT_TRUE(fs.remove_all("/e").ok());
+    ASSERT_TRUE(fs.rename("/d", "/e").ok());
+    EXPECT_FALSE(fs.exists("/d").value());
+    EXPECT_FALSE(fs.exists("/d/x").value());
+    std::string content;
+    ASSERT_TRUE(fs.read_file("/e/sub/y", &content).ok());
+    EXPECT_EQ(content, "y");
+
+    ASSERT_TRUE(fs.remove_all("/e").ok());
+    EXPECT_FALSE(fs.exists("/e/x").value());
+    EXPECT_FALSE(fs.exists("/e/sub/y").value());
+    EXPECT_TRUE(fs.exists("/d.bak").value());
+    EXPECT_TRUE(fs.exists("/d-old").value());
+    std::vector<std::string> files;
+    ASSERT_TRUE(fs.list_files("/", files, false).ok());
+    EXPECT_EQ(files, std::vector<std::string>{"d.bak"});
+
+    // the mmap factories read the same files
+    auto reader = fs.create_sequential_read_mmap_file().value();
+    ASSERT_TRUE(reader->open("/d.bak").ok());
+    content.clear();
+    ASSERT_TRUE(reader->read(&content, 3).ok());
+    EXPECT_EQ(content, "bak");
+    auto random = fs.create_random_read_mmap_file().value();
+    ASSERT_TRUE(random->open("/d.bak").ok());
+    content.clear();
+    ASSERT_TRUE(random->read_at(1, &content, 2).ok());
+    EXPECT_EQ(content, "ak");
+}
+
+TEST(FileSystemTest, CachingFilesystem) {
+    alkaid::MemoryFilesystem base;
+    ASSERT_TRUE(base.create_directories("/data").ok());
+    ASSERT_TRUE(base.write_file("/data/small", "small file").ok());
+    std::string data(300000, '\0');
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i] = static_cast<char>('a' + i % 19);
+    }
+    ASSERT_TRUE(base.write_file("/data/big", data).ok());
+
+    alkaid::CachingFilesystemOptions options;
+    options.memory_capacity = 200000;
+    options.small_file_size = 1024;
+    options.block_size = 64 * 1024;
+    options.disk_directory = "caching_fs_tier";
+    alkaid::CachingFilesystem fs(&base, options);
+
+    std::string content;
+    ASSERT_TRUE(fs.read_file("/data/small", &content).ok());
+    content.clear();
+    ASSERT_TRUE(fs.read_file("/data/small", &content).ok());
+    EXPECT_EQ(content, "small file");
+    EXPECT_EQ(fs.stats().misses, 1);
+    EXPECT_EQ(fs.stats().memory_hits, 1);
+
+    // the big file does not fit in memory, the blocks dropped from it are on disk
+    for (int pass = 0; pass < 2; ++pass) {
+        auto reader = fs.create_random_read_file().value();
+        ASSERT_TRUE(reader->open("/data/big").ok());
+        for (size_t offset = 0; offset < data.size(); offset += 50000) {
+            content.clear();
+            ASSERT_TRUE(reader->read_at(offset, &content, 50000).ok());
+            EXPECT_EQ(content, data.substr(offset, 50000));
+        }
+    }
+    EXPECT_EQ(fs.stats().misses, 6);
+    EXPECT_GT(fs.stats().disk_hits, 0);
+    EXPECT_LE(fs.stats().memory_size, options.memory_capacity);
+
+    // changed behind the cache
+    ASSERT_TRUE(base.write_file("/data/small", "changed small file").ok());
+    content.clear();
+    ASSERT_TRUE(fs.read_file("/data/small", &content).ok());
+    EXPECT_EQ(content, "changed small file");
+
+    options.disk_directory.clear();
+    options.write_policy = alkaid::CacheWritePolicy::WRITE_BACK;
+    alkaid::CachingFilesystem back(&base, options);
+    ASSERT_TRUE(back.write_file("/data/new", "written back").ok());
+    ASSERT_TRUE(back.append_file("/data/small", "!").ok());
+    EXPECT_FALSE(base.exists("/data/new").value());
+    content.clear();
+    ASSERT_TRUE(back.read_file("/data/new", &content).ok());
+    EXPECT_EQ(content, "written back");
+    EXPECT_GT(back.stats().dirty_size, 0);
+    ASSERT_TRUE(back.sync().ok());
+    EXPECT_EQ(back.stats().dirty_size, 0);
+    content.clear();
+    ASSERT_TRUE(base.read_file("/data/small", &content).ok());
+    EXPECT_EQ(content, "changed small file!");
+    EXPECT_TRUE(base.exists("/data/new").value());
+}
+
+TEST(FileSystemTest, RateLimiter) {
+    alkaid::RateLimiterOptions options;
+    options.write_bytes_per_second = 1024 * 1024;
+    options.refill_period_us = 10 * 1000;
+    auto limiter = std::make_shared<alkaid::RateLimiter>(options);
+    EXPECT_EQ(limiter->burst_bytes(alkaid::FileMode::WRITE), 10485);
+
+    alkaid::LocalFilesystemOptions fs_options;
+    fs_options.rate_limiter = limiter;
+    fs_options.io_priority = alkaid::IOPriority::LOW;
+    alkaid::LocalFilesystem fs(fs_options);
+    std::string data(256 * 1024, 'r');
+    auto start = std::chrono::steady_clock::now();
+    ASSERT_TRUE(fs.write_file("rate_limited.txt", data).ok());
+    ASSERT_TRUE(fs.remove_if_exists("rate_limited_copy.txt").ok());
+    ASSERT_TRUE(fs.copy_file("rate_limited.txt", "rate_limited_copy.txt").ok());
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    EXPECT_GE(elapsed, std::chrono::milliseconds(400));
+    EXPECT_EQ(limiter->total_bytes(alkaid::FileMode::WRITE), 2 * data.size());
+
+    // reads have no limit
+    std::string content;
+    ASSERT_TRUE(fs.read_file("rate_limited_copy.txt", &content).ok());
+    EXPECT_EQ(content, data);
+    EXPECT_GE(limiter->total_bytes(alkaid::FileMode::READ), 2 * data.size());
+    ASSERT_TRUE(fs.remove("rate_limited.txt").ok());
+    ASSERT_TRUE(fs.remove("rate_limited_copy.txt").ok());
+
+    // a request waiting for more than the burst left after lowering the rate
+    limiter->request(alkaid::FileMode::WRITE, limiter->burst_bytes(alkaid::FileMode::WRITE), alkaid::IOPriority::HIGH);
+    const auto written = limiter->total_bytes(alkaid::FileMode::WRITE);
+    std::thread waiter([&limiter]() {
+        limiter->request(alkaid::FileMode::WRITE, 1000, alkaid::IOPriority::HIGH);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    limiter->set_bytes_per_second(alkaid::FileMode::WRITE, 10 * 1024);
+    EXPECT_EQ(limiter->burst_bytes(alkaid::FileMode::WRITE), 102);
+    waiter.join();
+    // the bytes left after the granted burst were charged at the new rate, and counted once
+    EXPECT_EQ(limiter->total_bytes(alkaid::FileMode::WRITE), written + 1000);
+}
+
+TEST(FileSystemTest, SparseFile) {
+    alkaid::LocalFilesystem fs;
+    const size_t kSize = 8 * 1024 * 1024;
+    const off_t kSecond = 4 * 1024 * 1024;
+    ASSERT_TRUE(fs.remove_if_exists("sparse.img").ok());
+    ASSERT_TRUE(fs.remove_if_exists("sparse_copy.img").ok());
+    {
+        auto file = fs.create_random_write_file().value();
+        ASSERT_TRUE(file->open("sparse.img", alkaid::lfs::kDefaultTruncateWriteOption, alkaid::FileEventListener{}).ok());
+        ASSERT_TRUE(file->write_at(0, std::string(4096, 'a').data(), 4096).ok());
+        ASSERT_TRUE(file->write_at(kSecond, std::string(4096, 'b').data(), 4096).ok());
+        ASSERT_TRUE(file->truncate(kSize).ok());
+        ASSERT_TRUE(file->close().ok());
+    }
+    auto extents = fs.data_extents("sparse.img");
+    ASSERT_TRUE(extents.ok());
+    ASSERT_FALSE(extents.value().empty());
+    size_t data_size = 0;
+    for (auto &extent: extents.value()) {
+        data_size += extent.length;
+    }
+    // filesystems without holes report all of it as data
+    EXPECT_TRUE(data_size == kSize || extents.value().size() == 2);
+    EXPECT_EQ(extents.value().front().offset, 0);
+
+    std::string expected(kSize, '\0');
+    std::memset(expected.data(), 'a', 4096);
+    std::memset(expected.data() + kSecond, 'b', 4096);
+    std::string content;
+    ASSERT_TRUE(fs.read_file("sparse.img", &content).ok());
+    EXPECT_EQ(content, expected);
+
+    ASSERT_TRUE(fs.copy_file("sparse.img", "sparse_copy.img").ok());
+    content.clear();
+    ASSERT_TRUE(fs.read_file("sparse_copy.img", &content).ok());
+    EXPECT_EQ(content, expected);
+    auto copy_extents = fs.data_extents("sparse_copy.img");
+    ASSERT_TRUE(copy_extents.ok());
+    EXPECT_EQ(copy_extents.value().size(), extents.value().size());
+
+    // read in pieces across the holes
+    auto reader = fs.create_sequential_read_file().value();
+    ASSERT_TRUE(reader->open("sparse_copy.img").ok());
+    ASSERT_TRUE(reader->advance(1024).ok());
+    std::string piece;
+    content.assign(1024, 'a');
+    while (true) {
+        piece.clear();
+        auto n = reader->read(&piece, 1000 * 1000);
+        ASSERT_TRUE(n.ok());
+        if (n.value() == 0) {
+            break;
+        }
+        content += piece;
+    }
+    EXPECT_EQ(content, expected);
+    ASSERT_TRUE(fs.remove("sparse.img").ok());
+    ASSERT_TRUE(fs.remove("sparse_copy.img").ok());
+}
+
+TEST(FileSystemTest, CopyKeepsPermissions) {
+    alkaid::LocalFilesystemOptions options;
+    // copies through the files of the filesystem instead of filesystem::copy
+    options.rate_limiter = std::make_shared<alkaid::RateLimiter>(alkaid::RateLimiterOptions());
+    alkaid::LocalFilesystem fs(options);
+    const auto kExecutable = alkaid::filesystem::perms::owner_all | alkaid::filesystem::perms::group_read |
+                             alkaid::filesystem::perms::group_exec;
+    const auto kPrivate = alkaid::filesystem::perms::owner_all;
+    ASSERT_TRUE(fs.remove_all_if_exists("copy_perms").ok());
+    ASSERT_TRUE(fs.remove_all_if_exists("copy_perms_copy").ok());
+    ASSERT_TRUE(fs.create_directories("copy_perms/private").ok());
+    ASSERT_TRUE(fs.write_file("copy_perms/run.sh", "#!/bin/sh\n").ok());
+    alkaid::filesystem::permissions("copy_perms/run.sh", kExecutable);
+    alkaid::filesystem::permissions("copy_perms/private", kPrivate);
+
+    ASSERT_TRUE(fs.copy_file("copy_perms/run.sh", "copy_perms/run_copy.sh").ok());
+    EXPECT_EQ(alkaid::filesystem::status("copy_perms/run_copy.sh").permissions(), kExecutable);
+
+    // a fifo would block the copy
+    ASSERT_EQ(::mkfifo("copy_perms/private/pipe", 0600), 0);
+    auto status = fs.copy_file("copy_perms/private/pipe", "copy_perms/pipe_copy");
+    EXPECT_EQ(status.code(), turbo::StatusCode::kUnimplemented);
+    EXPECT_FALSE(fs.exists("copy_perms/pipe_copy").value());
+    EXPECT_FALSE(fs.copy_directory("copy_perms", "copy_perms_copy", alkaid::CopyOptions::Recursive).ok());
+    ASSERT_TRUE(fs.remove("copy_perms/private/pipe").ok());
+    ASSERT_TRUE(fs.remove_all_if_exists("copy_perms_copy").ok());
+
+    ASSERT_TRUE(fs.copy_directory("copy_perms", "copy_perms_copy", alkaid::CopyOptions::Recursive).ok());
+    EXPECT_EQ(alkaid::filesystem::status("copy_perms_copy/run.sh").permissions(), kExecutable);
+    EXPECT_EQ(alkaid::filesystem::status("copy_perms_copy/private").permissions(), kPrivate);
+    ASSERT_TRUE(fs.remove_all_if_exists("copy_perms").ok());
+    ASSERT_TRUE(fs.remove_all_if_exists("copy_perms_copy").ok());
+}
+
+TEST(FileSystemTest, RandomReadAsync) {
+    alkaid::LocalFilesystemOptions options;
+    options.io_pool = std::make_shared<alkaid::ThreadPool>(2);
+    alkaid::LocalFilesystem fs(options);
+    std::string data;
+    for (int i = 0; i < 100000; ++i) {
+        data += std::to_string(i);
+    }
+    ASSERT_TRUE(fs.write_file("random_read_async.txt", data).ok());
+    auto file = fs.create_random_read_file().value();
+    ASSERT_TRUE(file->open("random_read_async.txt").ok());
+    std::string buffer(4096, '\0');
+    for (off_t offset: {off_t(0), off_t(100000), off_t(data.size() - 1000)}) {
+        auto future = file->read_at_async(offset, buffer.data(), buffer.size());
+        auto n = future.get();
+        ASSERT_TRUE(n.ok());
+        auto expected = data.substr(offset, buffer.size());
+        ASSERT_EQ(n.value(), expected.size());
+        EXPECT_EQ(buffer.substr(0, n.value()), expected);
+    }
+    auto *local = dynamic_cast<alkaid::lfs::RandomReadFile *>(file.get());
+    ASSERT_NE(local, nullptr);
+    EXPECT_EQ(local->nowait_reads() + local->offloaded_reads(), 3);
+    if (local->nowait_supported()) {
+        // just written, so in the page cache
+        EXPECT_GT(local->nowait_reads(), 0);
+    }
+
+    // close waits for the reads on the pool
+    ASSERT_TRUE(local->evict(0, data.size()).ok());
+    auto future = file->read_at_async(0, buffer.data(), buffer.size());
+    ASSERT_TRUE(file->close().ok());
+    auto n = future.get();
+    ASSERT_TRUE(n.ok());
+    EXPECT_EQ(buffer.substr(0, n.value()), data.substr(0, buffer.size()));
+    ASSERT_TRUE(fs.remove("random_read_async.txt").ok());
+}
+
+TEST(FileSystemTest, RateLimitedReadAsync) {
+    alkaid::RateLimiterOptions limiter_options;
+    limiter_options.read_bytes_per_second = 64 * 1024 * 1024;
+    auto limiter = std::make_shared<alkaid::RateLimiter>(limiter_options);
+    alkaid::LocalFilesystemOptions options;
+    options.io_pool = std::make_shared<alkaid::ThreadPool>(2);
+    options.rate_limiter = limiter;
+    alkaid::LocalFilesystem fs(options);
+    std::string data(64 * 1024, 'l');
+    ASSERT_TRUE(fs.write_file("rate_limited_async.txt", data).ok());
+    auto file = fs.create_random_read_file().value();
+    ASSERT_NE(dynamic_cast<alkaid::RateLimitedRandomReadFile *>(file.get()), nullptr);
+    ASSERT_TRUE(file->open("rate_limited_async.txt").ok());
+    const auto read_bytes = limiter->total_bytes(alkaid::FileMode::READ);
+    std::string buffer(4096, '\0');
+    auto n = file->read_at_async(1000, buffer.data(), buffer.size()).get();
+    ASSERT_TRUE(n.ok());
+    ASSERT_EQ(n.value(), buffer.size());
+    EXPECT_EQ(buffer, data.substr(1000, buffer.size()));
+    EXPECT_EQ(limiter->total_bytes(alkaid::FileMode::READ), read_bytes + buffer.size());
+    ASSERT_TRUE(file->close().ok());
+    ASSERT_TRUE(fs.remove("rate_limited_async.txt").ok());
+}
+
+TEST(FileSystemTest, PageCacheResidency) {
+    alkaid::LocalFilesystem fs;
+    const size_t kSize = 1024 * 1024;
+    ASSERT_TRUE(fs.write_file("residency.txt", std::string(kSize, 'r')).ok());
+    auto file = fs.create_random_read_file().value();
+    ASSERT_TRUE(file->open("residency.txt").ok());
+    auto *local = dynamic_cast<alkaid::lfs::RandomReadFile *>(file.get());
+    ASSERT_NE(local, nullptr);
+    // just written, so in the page cache
+    auto extents = local->resident_extents(0, kSize);
+    ASSERT_TRUE(extents.ok());
+    ASSERT_EQ(extents.value().size(), 1);
+    EXPECT_EQ(extents.value()[0].offset, 0);
+    EXPECT_EQ(extents.value()[0].length, kSize);
+    extents = local->resident_extents(100, 1000);
+    ASSERT_TRUE(extents.ok());
+    ASSERT_EQ(extents.value().size(), 1);
+    EXPECT_EQ(extents.value()[0].offset, 100);
+    EXPECT_EQ(extents.value()[0].length, 1000);
+    ASSERT_TRUE(local->prefetch(0, kSize).ok());
+
+    auto mapped = fs.create_random_read_mmap_file().value();
+    ASSERT_TRUE(mapped->open("residency.txt").ok());
+    auto *mmap_file = dynamic_cast<alkaid::lfs::RandomReadMMapFile *>(mapped.get());
+    ASSERT_NE(mmap_file, nullptr);
+    ASSERT_TRUE(mmap_file->prefetch(0, kSize).ok());
+    extents = mmap_file->resident_extents(0, kSize * 2);
+    ASSERT_TRUE(extents.ok());
+    ASSERT_FALSE(extents.value().empty());
+    EXPECT_LE(extents.value().back().offset + extents.value().back().length, kSize);
+    // dirty pages may stay, only check that eviction is accepted
+    EXPECT_TRUE(mmap_file->evict(0, kSize).ok());
+    EXPECT_TRUE(local->evict(0, kSize).ok());
+    ASSERT_TRUE(mapped->close().ok());
+    ASSERT_TRUE(file->close().ok());
+
+    // by path, when the files handed out are wrapped by a rate limiter
+    alkaid::LocalFilesystemOptions options;
+    options.rate_limiter = std::make_shared<alkaid::RateLimiter>(alkaid::RateLimiterOptions());
+    alkaid::LocalFilesystem limited_fs(options);
+    ASSERT_EQ(dynamic_cast<alkaid::lfs::RandomReadFile *>(limited_fs.create_random_read_file().value().get()), nullptr);
+    ASSERT_TRUE(limited_fs.prefetch("residency.txt", 0, kSize).ok());
+    // read, so resident whatever the prefetch did yet
+    std::string content;
+    ASSERT_TRUE(limited_fs.read_file("residency.txt", &content).ok());
+    extents = limited_fs.resident_extents("residency.txt", 100, 1000);
+    ASSERT_TRUE(extents.ok());
+    ASSERT_EQ(extents.value().size(), 1);
+    EXPECT_EQ(extents.value()[0].offset, 100);
+    EXPECT_EQ(extents.value()[0].length, 1000);
+    EXPECT_TRUE(limited_fs.evict("residency.txt", 0, kSize).ok());
+    EXPECT_FALSE(limited_fs.resident_extents("no_such_file.txt", 0, kSize).ok());
+    ASSERT_TRUE(fs.remove("residency.txt").ok());
+}